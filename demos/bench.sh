@@ -0,0 +1,27 @@
+#!/bin/sh
+# Batería de regresión: levanta el miniserver con 1 worker y con uno por núcleo y mide cada
+# escenario con loadgen. Los argumentos extra se pasan a loadgen (por ejemplo -P 5000 -M 20000).
+# Requiere ./loadgen y docs/miniserver compilados. Termina con error si falla algún escenario.
+set -u
+cd "$(dirname "$0")"
+status=0
+
+run() {
+    label=$1
+    shift
+    output=$(./loadgen "$@") || status=1
+    echo "$output" | grep -e '^RESULT' -e '^REGRESIÓN' | while read -r line; do echo "$label  $line"; done
+}
+
+for workers in 1 auto; do
+    docs/miniserver -w "$workers" >/dev/null &
+    server=$!
+    sleep 1
+    run "w=$workers mezcla 5000/s  " -r 5000 -c 1000 -d 10 "$@"
+    run "w=$workers mezcla sin ritmo" -r 0 -c 500 -d 10 "$@"
+    run "w=$workers MESSAGE sin ritmo" -r 0 -c 500 -d 10 -m message=1 "$@"
+    run "w=$workers INVITE+BYE 2000/s" -r 2000 -c 1000 -d 10 -m invite=1,bye=1 "$@"
+    kill "$server"
+    wait "$server" 2>/dev/null
+done
+exit $status
@@ -7,11 +7,13 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h> // Necesario para strcpy
+#include "sip_metrics.h"
 
 #define SIP_IDENTITY "sip:caller@127.0.0.1"
 #define SIP_CONTACT_STR "sip:caller@127.0.0.1"
 #define SIP_DEST     "sip:callee@127.0.0.1"
 #define SIP_PROXY    "sip:proxy@127.0.0.1"
+#define METRICS_SOCKET "/tmp/demo3.metrics" // nc -U /tmp/demo3.metrics
 
 // Callback que maneja los eventos SIP
 static void sip_invite_callback(nua_event_t event, int status,
@@ -19,6 +21,7 @@ static void sip_invite_callback(nua_event_t event, int status,
 	void *context, nua_handle_t *nh,
 	void *param, const struct sip_s *sip, tagi_t *tags) {
 su_root_t *root = (su_root_t *)context;
+sip_metrics_event(event, status, nh);
 printf("Callback received event: %d, status: %d, phrase: %s\n", event, status, phrase);
 
 if (event == nua_i_invite) {
@@ -41,6 +44,7 @@ su_root_break(root);
 int main(void) {
     su_root_t *root;
     nua_t *nua;
+    nua_handle_t *nh;
 
     // Inicializa la librería
     su_init();
@@ -60,10 +64,16 @@ int main(void) {
         return EXIT_FAILURE;
     }
     fprintf(stdout, "NUA creado\n");
+    if (sip_metrics_init(METRICS_SOCKET) < 0) {
+        fprintf(stderr, "No se pudo abrir el socket de métricas %s\n", METRICS_SOCKET);
+    }
 
-    // Envía un INVITE al destino (SIP_DEST)
+    // Envía un INVITE al destino (SIP_DEST) por su propio handle, que es el que
+    // llega al callback con cada respuesta y por el que se mide la latencia
     // Se registra la identidad del caller y su contacto
-    nua_invite((nua_handle_t *)nua,
+    nh = nua_handle(nua, NULL, TAG_END());
+    sip_metrics_request(nh, SIP_METRICS_INVITE);
+    nua_invite(nh,
                NUTAG_ALLOW(SIP_IDENTITY),
                SIPTAG_CONTACT_STR(SIP_CONTACT_STR),
                SIPTAG_TO_STR("sip:callee@127.0.0.1:5060"),
@@ -77,6 +87,8 @@ int main(void) {
 
     // Limpieza
     // Liberamos
+    sip_metrics_shutdown(stdout);
+    if (nh) nua_handle_destroy(nh);
     nua_destroy(nua);
     su_root_destroy(root);
     su_deinit();
@@ -7,11 +7,13 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h> // Necesario para strcpy
+#include "sip_metrics.h"
 
 #define SIP_IDENTITY "sip:caller@127.0.0.1"
 #define SIP_CONTACT_STR "sip:caller@127.0.0.1"
 #define SIP_DEST     "sip:callee@127.0.0.1"
 #define SIP_PROXY    "sip:proxy@127.0.0.1"
+#define METRICS_SOCKET "/tmp/demo4.metrics" // nc -U /tmp/demo4.metrics
 
 #ifndef SIP_200_OK
 #define SIP_200_OK 200
@@ -25,6 +27,7 @@ static void	sip_invite_callback(nua_event_t event, int status,
 		void *param, const struct sip_s *sip, tagi_t *tags)
 {
 	su_root_t *root = (su_root_t *)context;
+	sip_metrics_event(event, status, nh);
 	printf("Callback received event: %d, status: %d, phrase: %s\n", event, status, phrase);
 
 	if (event == nua_i_invite) // Evento de INVITE entrante
@@ -97,10 +100,14 @@ int	main(void)
 		return (EXIT_FAILURE);
 	}
 	printf("nua_create() completado.\n");
+	if (sip_metrics_init(METRICS_SOCKET) < 0)
+		fprintf(stderr, "No se pudo abrir el socket de métricas %s\n", METRICS_SOCKET);
 	printf("Intentando enviar el INVITE...\n");
 
-    // Llamada a INVITE
-	nua_invite((nua_handle_t *)nua,
+    // Llamada a INVITE, con su propio handle para medir la latencia de sus respuestas
+	inv_handle = nua_handle(nua, NULL, TAG_END());
+	sip_metrics_request(inv_handle, SIP_METRICS_INVITE);
+	nua_invite(inv_handle,
 			   NUTAG_ALLOW(SIP_IDENTITY),
 			   SIPTAG_CONTACT_STR(SIP_CONTACT_STR),
 			   SIPTAG_TO_STR("sip:callee@127.0.0.1:5060"),
@@ -112,6 +119,9 @@ int	main(void)
 	printf("su_root_run() completado (esto podría no alcanzarse hasta recibir una respuesta).\n");
 
     // Limpieza
+	sip_metrics_shutdown(stdout);
+	if (inv_handle)
+		nua_handle_destroy(inv_handle);
 	nua_destroy(nua);
 	su_root_destroy(root);
 	su_deinit();
@@ -120,8 +130,9 @@ int	main(void)
 }
 
 /* PARA COMPILAR:
-gcc -o demo4 demo4.c $(pkg-config --cflags --libs sofia-sip-ua)
+gcc -o demo4 demo4.c $(pkg-config --cflags --libs sofia-sip-ua) -lpthread
 ./demo4 
+nc -U /tmp/demo4.metrics   # métricas mientras corre
 */
 
 /* RESPUESTA:
@@ -1,3 +1,8 @@
+// El contexto de la aplicación es la magia del su_root, y cada canal de órdenes el argumento de su fuente su_wait
+#define SU_ROOT_MAGIC_T struct app_context_s
+#define SU_WAKEUP_ARG_T struct command_channel_s
+#define SU_TIMER_ARG_T struct command_channel_s
+
 #include <sofia-sip/nta.h>
 #include <sofia-sip/url.h>
 #include <sofia-sip/su.h>
@@ -11,11 +16,18 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h> // Necesario para strcpy
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "sip_metrics.h"
+#include "sip_log.h"
 
 #define SIP_IDENTITY "sip:caller@127.0.0.1"
 #define SIP_CONTACT_STR "sip:caller@127.0.0.1"
 #define SIP_DEST     "sip:127.0.0.1:5060"
 #define SIP_PROXY    "sip:proxy@127.0.0.1"
+#define METRICS_SOCKET "/tmp/demo5.metrics" // nc -U /tmp/demo5.metrics
 
 #ifndef SIP_200_OK
 #define SIP_200_OK 200
@@ -24,9 +36,30 @@
 // Definición para el Content-Type de los mensajes
 #define MESSAGE_CONTENT_TYPE "text/plain"
 
+#define MAX_CHANNELS 16            // stdin, el socket de órdenes y sus conexiones
+#define COMMAND_BUFFER 65536       // bytes leídos de un canal por cada despertar
+#define COMMAND_FILE_TICK 1        // ms entre lecturas de un stdin redirigido desde un fichero
+
+// Canal de órdenes: stdin, el socket Unix que escucha o una conexión aceptada en él
+typedef struct command_channel_s {
+    struct app_context_s *app;
+    int fd;
+    su_wait_t wait[1];
+    su_timer_t *timer;             // fichero regular: no se puede esperar con su_wait, se lee por temporizador
+    int listener;                  // acepta conexiones en vez de leer órdenes
+    int interactive;               // stdin en una terminal: se muestra el prompt
+    size_t len;                    // bytes de una línea incompleta al principio de buf
+    char buf[COMMAND_BUFFER];
+} command_channel_t;
+
 // Definición de la estructura para el contexto de la aplicación
-typedef struct {
+typedef struct app_context_s {
     su_home_t home[1];
+    su_root_t *root;
+    nua_t *nua;
+    command_channel_t *channels[MAX_CHANNELS];
+    int open_channels;
+    const char *command_socket;    // ruta del socket de órdenes, o NULL
 } app_context_t;
 
 // Función para enviar un mensaje SIP MESSAGE
@@ -35,24 +68,30 @@ void send_sip_message(nua_t *nua, su_root_t *root, const char *to_uri, const cha
     if (app_ctx) {
         url_t *url = url_make(app_ctx->home, (const char *)to_uri);
         if (url) {
-            printf("Enviando mensaje a: %s con contenido: %s\n", to_uri, message);
+            sip_log_text(SIP_LOG_INFO, SIP_LOG_NO_EVENT, 0, NULL, "enviando MESSAGE a", to_uri);
             sip_to_t *sip_to = sip_to_create(app_ctx->home, url);
-            if (sip_to) {
-                nua_message((nua_handle_t *)nua,
+            // Un handle por mensaje: su respuesta llega con él y así se mide su latencia
+            nua_handle_t *nh = sip_to ? nua_handle(nua, NULL, TAG_END()) : NULL;
+            if (nh) {
+                sip_metrics_request(nh, SIP_METRICS_MESSAGE);
+                nua_message(nh,
                             SIPTAG_TO(sip_to),
                             SIPTAG_CONTENT_TYPE_STR(MESSAGE_CONTENT_TYPE),
                             SIPTAG_PAYLOAD_STR(message),
                             TAG_END());
                 su_free(app_ctx->home, sip_to); // Liberamos la estructura sip_to_t
+            } else if (sip_to) {
+                sip_log_text(SIP_LOG_ERROR, SIP_LOG_NO_EVENT, 0, NULL, "no se pudo crear el handle para", to_uri);
+                su_free(app_ctx->home, sip_to);
             } else {
-                printf("Error al crear la dirección SIP (To) desde la URL.\n");
+                sip_log_text(SIP_LOG_ERROR, SIP_LOG_NO_EVENT, 0, NULL, "dirección SIP (To) inválida", to_uri);
             }
             su_free(app_ctx->home, url); // Liberamos la estructura url_t
         } else {
-            printf("Error al crear la URL para: %s\n", to_uri);
+            sip_log_text(SIP_LOG_ERROR, SIP_LOG_NO_EVENT, 0, NULL, "URL inválida", to_uri);
         }
     } else {
-        printf("Error al obtener el contexto de la aplicación.\n");
+        sip_log_event(SIP_LOG_ERROR, SIP_LOG_NO_EVENT, 0, NULL, "sin contexto de la aplicación");
     }
 }
 
@@ -64,33 +103,35 @@ static void sip_invite_callback(nua_event_t event, int status,
        void *param, const struct sip_s *sip, tagi_t *tags)
 {
     su_root_t *root = (su_root_t *)context;
-    printf("Callback received event: %d, status: %d, phrase: %s\n", event, status, phrase);
+    sip_metrics_event(event, status, nh);
+    // Nada de printf en el bucle: cada línea es un registro binario que escribe el hilo de log
+    sip_log_text(SIP_LOG_DEBUG, event, status, nh, "callback", phrase);
 
     if (event == nua_i_invite) // Evento de INVITE entrante
-       printf("INVITE recibido, request-response\n");
+       sip_log_event(SIP_LOG_INFO, event, status, nh, "INVITE recibido, request-response");
 
     else if (event == nua_r_invite)
     {
-        printf("Respuesta agente al INVITE: %d %s\n", status, phrase);
+        sip_log_text(SIP_LOG_INFO, event, status, nh, "respuesta al INVITE:", phrase);
        if (status == 180)
        {
-          printf("Ringing...\n");
+          sip_log_event(SIP_LOG_DEBUG, event, status, nh, "Ringing...");
        }
        else if (status == 200)
        {
             // El INVITE esta ok, info ok
-          printf("200 OK recibido. Enviando ACK...\n");
+          sip_log_event(SIP_LOG_INFO, event, status, nh, "200 OK recibido. Enviando ACK...");
           nua_ack(nh, TAG_END()); // Send ACK for 200 OK
        }
     }
     else if (event == nua_i_ack)
     {
         // Ya te conozco
-       printf("ACK recibido\n");
+       sip_log_event(SIP_LOG_INFO, event, status, nh, "ACK recibido");
     }
     else if (event == nua_i_bye) // Evento de BYE entrante
     {
-       printf("BYE recibido, terminando la llamada.\n");
+       sip_log_event(SIP_LOG_INFO, event, status, nh, "BYE recibido, terminando la llamada.");
         // Enviar respuesta 200 OK para el BYE
         nua_respond(nh, SIP_200_OK, "OK", TAG_END());
         // Potentially initiate shutdown after BYE is handled
@@ -110,40 +151,195 @@ static void sip_invite_callback(nua_event_t event, int status,
                 SIPTAG_PAYLOAD_STR_REF(payload),
                 TAG_END());
 
-        printf("\n--- Mensaje SIP MESSAGE Recibido ---\n");
-        printf("De: %s\n", from);
-        printf("Content-Type: %s\n", content_type);
+        // El registro copia los primeros SIP_LOG_TEXT-1 bytes de cada texto
+        sip_log_text(SIP_LOG_INFO, event, status, nh, "MESSAGE recibido de", from);
+        sip_log_text(SIP_LOG_DEBUG, event, status, nh, "Content-Type:", content_type);
         if (payload) {
-            printf("Contenido:\n%s\n", payload);
+            sip_log_text(SIP_LOG_INFO, event, status, nh, "contenido:", payload);
         } else {
-            printf("Contenido vacío.\n");
+            sip_log_event(SIP_LOG_INFO, event, status, nh, "contenido vacío");
         }
-        printf("--------------------------------------\n");
     } else if (event == nua_r_message) {
-        printf("Respuesta al mensaje SIP MESSAGE: %d %s\n", status, phrase);
+        sip_log_text(SIP_LOG_INFO, event, status, nh, "respuesta al MESSAGE:", phrase);
+        if (status >= 200) nua_handle_destroy(nh); // el handle de send_sip_message ya no hace falta
         // nua_shutdown(nua); // Considerar si esto es apropiado aquí
     }
     else
     {
-       printf("Evento SIP: %d, %s\n", event, phrase);
+       sip_log_text(SIP_LOG_WARN, event, status, nh, "evento SIP no manejado:", phrase);
        // nua_shutdown(nua); // Considerar si esto es apropiado aquí
        sleep(1);
        su_root_break(root);
     }
 }
 
-int main(void) {
-    app_context_t app_ctx;
-    su_root_t  *root;
-    nua_t     *nua;
-    char command[256];
+static int command_readable(app_context_t *app, su_wait_t *wait, command_channel_t *ch);
+static int read_commands(app_context_t *app, command_channel_t *ch);
+
+static void command_file_tick(app_context_t *app, su_timer_t *timer, command_channel_t *ch)
+{
+    // Temporizador de un solo disparo que se rearma mientras el fichero tenga órdenes
+    (void)timer;
+    if (read_commands(app, ch) == 0) su_timer_set(ch->timer, command_file_tick, ch);
+}
+
+static command_channel_t *open_channel(app_context_t *app, int fd, int listener)
+{
+    /*
+    Registra 'fd' como fuente su_wait del mismo su_root que atiende a nua: las órdenes
+    se leen y despachan dentro del bucle, entre evento y evento SIP, sin hilos ni bloqueos.
+    Un stdin redirigido desde un fichero siempre está listo y epoll no lo admite:
+    se lee un bloque cada COMMAND_FILE_TICK ms con un su_timer del mismo su_root.
+    */
+    command_channel_t *ch = NULL;
+    struct stat st;
+    int slot;
+    for (slot = 0; slot < MAX_CHANNELS && app->channels[slot]; ++slot);
+    if (slot < MAX_CHANNELS) ch = calloc(1, sizeof(*ch));
+    if (!ch) return NULL;
+    ch->app = app;
+    ch->fd = fd;
+    ch->listener = listener;
+    ch->interactive = fd == STDIN_FILENO && isatty(fd);
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        ch->timer = su_timer_create(su_root_task(app->root), COMMAND_FILE_TICK);
+        if (!ch->timer || su_timer_set(ch->timer, command_file_tick, ch) < 0) {
+            su_timer_destroy(ch->timer);
+            free(ch);
+            return NULL;
+        }
+    } else if (su_wait_create(ch->wait, fd, SU_WAIT_IN) < 0 ||
+               su_root_register(app->root, ch->wait, command_readable, ch, 0) < 0) {
+        free(ch);
+        return NULL;
+    }
+    app->channels[slot] = ch;
+    app->open_channels++;
+    return ch;
+}
+
+static void release_channel(app_context_t *app, command_channel_t *ch)
+{
+    if (ch->timer) {
+        su_timer_destroy(ch->timer);
+    } else {
+        su_root_unregister(app->root, ch->wait, command_readable, ch);
+        su_wait_destroy(ch->wait);
+    }
+    if (ch->fd != STDIN_FILENO) close(ch->fd);
+    free(ch);
+}
+
+static void close_channel(app_context_t *app, command_channel_t *ch)
+{
+    // Sin canales de órdenes abiertos (EOF en stdin y sin socket) el programa termina, como con 'salir'
+    for (int i = 0; i < MAX_CHANNELS; ++i) {
+        if (app->channels[i] == ch) app->channels[i] = NULL;
+    }
+    release_channel(app, ch);
+    if (--app->open_channels == 0) su_root_break(app->root);
+}
+
+static void dispatch_command(app_context_t *app, char *command)
+{
+    // Una línea, ya sin el salto: se atiende en el acto, en el hilo del bucle
     char to_uri[100];
     char message[156];
 
+    if (strcmp(command, "salir") == 0) {
+        su_root_break(app->root);
+    }
+    else if (strncmp(command, "enviar ", 7) == 0) {
+        if (sscanf(command + 7, "%99s %155[^\n]", to_uri, message) == 2) {
+            send_sip_message(app->nua, app->root, to_uri, message);
+        } else {
+            sip_log_text(SIP_LOG_WARN, SIP_LOG_NO_EVENT, 0, NULL, "formato incorrecto, usa 'enviar <uri> <mensaje>':", command);
+        }
+    }
+    else if (command[0]) {
+        sip_log_text(SIP_LOG_WARN, SIP_LOG_NO_EVENT, 0, NULL, "orden desconocida:", command);
+    }
+}
+
+static int read_commands(app_context_t *app, command_channel_t *ch)
+{
+    /*
+    Una sola lectura de hasta COMMAND_BUFFER bytes (no bloquea: el su_root ya sabe que hay
+    algo) y se despachan todas las líneas completas. Lo que quede de una línea a medias espera
+    a la siguiente lectura; si quedan datos, el su_root vuelve a llamar después de atender
+    los eventos SIP pendientes. Retorna -1 si el canal se cerró (EOF o error).
+    */
+    if (ch->len == sizeof(ch->buf)) ch->len = 0; // línea más larga que el búfer: se descarta lo leído de ella
+    ssize_t n = read(ch->fd, ch->buf + ch->len, sizeof(ch->buf) - ch->len);
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) return 0;
+    if (n <= 0) {
+        close_channel(app, ch);
+        return -1;
+    }
+    char *line = ch->buf, *end = ch->buf + ch->len + n, *eol;
+    while ((eol = memchr(line, '\n', end - line))) {
+        *eol = '\0';
+        if (eol > line && eol[-1] == '\r') eol[-1] = '\0';
+        dispatch_command(app, line);
+        line = eol + 1;
+    }
+    ch->len = end - line;
+    memmove(ch->buf, line, ch->len);
+    if (ch->interactive) {
+        printf("> ");
+        fflush(stdout);
+    }
+    return 0;
+}
+
+static int command_readable(app_context_t *app, su_wait_t *wait, command_channel_t *ch)
+{
+    // El canal tiene datos; en el socket de escucha, cada conexión nueva se convierte en otro canal
+    (void)wait;
+    if (ch->listener) {
+        int fd = accept(ch->fd, NULL, NULL);
+        if (fd >= 0 && !open_channel(app, fd, 0)) {
+            sip_log_event(SIP_LOG_WARN, SIP_LOG_NO_EVENT, 0, NULL, "demasiados clientes de órdenes");
+            close(fd);
+        }
+        return 0;
+    }
+    read_commands(app, ch);
+    return 0;
+}
+
+static int open_command_socket(app_context_t *app, const char *path)
+{
+    // Socket Unix de órdenes: un cliente con script envía líneas 'enviar <uri> <mensaje>' sin pasar por la terminal
+    struct sockaddr_un addr = {0};
+    int fd;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 16) < 0 || !open_channel(app, fd, 1)) {
+        close(fd);
+        return -1;
+    }
+    app->command_socket = path;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    app_context_t app_ctx = {0};
+    su_root_t  *root;
+    nua_t     *nua;
+
     printf("Iniciando el programa...\n");
     su_init();
     su_home_init(app_ctx.home); // Inicializa la memory home
     printf("su_init() completado.\n");
+    fflush(stdout); // a partir de aquí el hilo de log escribe en el mismo descriptor
+    if (sip_log_init(STDOUT_FILENO, SIP_LOG_INFO) < 0) {
+        fprintf(stderr, "No se pudo arrancar el hilo de log\n");
+    }
     root = su_root_create(&app_ctx); // Pasa la estructura de contexto a su_root_create
     if (!root) {
        fprintf(stderr, "No se pudo crear el su_root\n");
@@ -160,12 +356,18 @@ int main(void) {
        su_root_destroy(root);
        return (EXIT_FAILURE);
     }
+    app_ctx.root = root;
+    app_ctx.nua = nua;
     printf("nua_create() completado.\n");
+    if (sip_metrics_init(METRICS_SOCKET) < 0) {
+        fprintf(stderr, "No se pudo abrir el socket de métricas %s\n", METRICS_SOCKET);
+    }
     printf("Intentando enviar el INVITE...\n");
 
     // Llamada a INVITE
     nua_handle_t *invite_handle = nua_handle(nua, NULL, TAG_END()); // Obtain a handle for the INVITE
     if (invite_handle) {
+        sip_metrics_request(invite_handle, SIP_METRICS_INVITE);
         nua_invite(invite_handle,
                  NUTAG_ALLOW(SIP_IDENTITY),
                  SIPTAG_CONTACT_STR(SIP_CONTACT_STR),
@@ -178,35 +380,35 @@ int main(void) {
     }
 
 
+    // Órdenes por stdin y, con -s <ruta>, también por un socket Unix
+    if (!open_channel(&app_ctx, STDIN_FILENO, 0)) {
+        fprintf(stderr, "No se pudo registrar stdin en el su_root\n");
+    }
+    if (argc > 2 && strcmp(argv[1], "-s") == 0 && open_command_socket(&app_ctx, argv[2]) < 0) {
+        fprintf(stderr, "No se pudo abrir el socket de órdenes %s\n", argv[2]);
+    }
+
     printf("\n--- Cliente SIP (con Mensajería) ---\n");
     printf("Ingresa 'enviar <uri> <mensaje>' para enviar un mensaje.\n");
     printf("Ingresa 'salir' para salir.\n");
-    printf("El programa también intentará enviar un INVITE.\n\n");
-
-    while (1) {
-        printf("> ");
-        if (fgets(command, sizeof(command), stdin) == NULL) {
-            break; // Error o EOF
-        }
-        command[strcspn(command, "\n")] = 0; // Eliminar el newline
-
-        if (strcmp(command, "salir") == 0) {
-            break;
-        }
-        else if (strncmp(command, "enviar ", 7) == 0) {
-            if (sscanf(command + 7, "%99s %[^\n]", to_uri, message) == 2) {
-                send_sip_message(nua, root, to_uri, message);
-            } else {
-                printf("Error: Formato incorrecto. Usa 'enviar <uri> <mensaje>'.\n");
-            }
-        }
+    if (app_ctx.command_socket) {
+        printf("También se aceptan órdenes por el socket %s.\n", app_ctx.command_socket);
     }
+    printf("El programa también intentará enviar un INVITE.\n\n");
+    if (isatty(STDIN_FILENO)) printf("> ");
+    fflush(stdout);
 
-    // Ejecuta el loop de eventos SIP (bloqueante)
+    // Ejecuta el loop de eventos SIP (bloqueante): atiende a la vez a nua y a las órdenes
     su_root_run(root);
     printf("su_root_run() completado.\n");
 
     // Limpieza
+    for (int i = 0; i < MAX_CHANNELS; ++i) {
+        if (app_ctx.channels[i]) release_channel(&app_ctx, app_ctx.channels[i]);
+    }
+    if (app_ctx.command_socket) unlink(app_ctx.command_socket);
+    sip_log_shutdown(); // escribe lo que quede en los anillos
+    sip_metrics_shutdown(stdout);
     if (inv_handle) {
         nua_handle_destroy(inv_handle); // Destroy the INVITE handle
     }
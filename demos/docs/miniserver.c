@@ -1,18 +1,50 @@
+#define _GNU_SOURCE // recvmmsg, memmem
+// Los workers se pasan a sí mismos como magia de su su_root y de su socket,
+// y los datagramas reenviados entre workers viajan como argumento de un su_msg
+#define SU_ROOT_MAGIC_T struct worker_s
+#define SU_WAKEUP_ARG_T struct worker_s
+#define SU_MSG_ARG_T struct forwarded_s
+
 #include <sofia-sip/nta.h>
 #include <sofia-sip/su.h>
 #include <sofia-sip/su_tag.h>
+#include <sofia-sip/su_wait.h>
 #include <sofia-sip/nua.h>
 #include <sofia-sip/sip.h>
 #include <sofia-sip/nua_tag.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "../sip_metrics.h"
+#include "../sip_log.h"
+
+#define SIP_PORT 5060
+#define MAX_WORKERS 64
+#define RECV_BATCH 32              // datagramas leídos por cada recvmmsg
+#define SIP_MAX_DATAGRAM 8192
+#define SIP_MAX_RESPONSE 4096
+#define SIP_MAX_VIAS 8
+#define TXN_BUCKETS 65536          // potencia de dos
+#define SIP_T1 500                 // ms, RFC 3261
+#define SIP_T2 4000
+#define TXN_LINGER_MS (64 * SIP_T1) // una transacción recuerda su respuesta este tiempo (Timer J/H)
+#define METRICS_SOCKET "/tmp/miniserver.metrics" // nc -U /tmp/miniserver.metrics
 
 static void server_message_callback(nua_event_t event, int status,
                                   const char *phrase, nua_t *nua, void *context, nua_handle_t *nh,
                                   void *param, const struct sip_s *sip, tagi_t *tags)
 {
-    printf("server_message_callback fue llamada con evento: %d\n", event);
+    sip_metrics_event(event, status, nh);
+    sip_log_text(SIP_LOG_DEBUG, event, status, nh, "server_message_callback", phrase);
     const char *from = NULL;
     const char *content_type = NULL;
     const char *payload = NULL;
@@ -28,28 +60,26 @@ static void server_message_callback(nua_event_t event, int status,
         // payload = (const char *)sip_get_body(sip);
         // payload_length = sip_get_body_length(sip);
 
-        printf("\n--- Mensaje SIP MESSAGE Recibido ---\n");
-        printf("De: %s\n", from);
-        printf("Content-Type: %s\n", content_type);
+        // El registro copia los primeros SIP_LOG_TEXT-1 bytes de cada texto
+        sip_log_text(SIP_LOG_INFO, event, status, nh, "MESSAGE recibido de", from);
+        sip_log_text(SIP_LOG_DEBUG, event, status, nh, "Content-Type:", content_type);
         if (payload) {
-            printf("Contenido:\n%s\n", payload);
+            sip_log_text(SIP_LOG_INFO, event, status, nh, "contenido:", payload);
         } else {
-            printf("Contenido vacío.\n");
+            sip_log_event(SIP_LOG_INFO, event, status, nh, "contenido vacío");
         }
-        printf("--------------------------------------\n");
         nua_respond(nh, 200, "OK", TAG_END());
         nua_destroy(nua);
     } else if (event == nua_r_message) {
-        printf("Respuesta al mensaje SIP: %d %s\n", status, phrase);
+        sip_log_text(SIP_LOG_INFO, event, status, nh, "respuesta al mensaje SIP:", phrase);
     }
 }
 
-int main(void)
+static int run_single(void)
 {
     su_root_t *root;
     nua_t *nua;
 
-    su_init();
     root = su_root_create(NULL);
     if (root == NULL) {
         fprintf(stderr, "Can't create root object\n");
@@ -69,12 +99,556 @@ int main(void)
     }
 
     printf("Sofia-SIP miniserver started at sip:127.0.0.1:5060\n");
+    fflush(stdout); // el hilo de log escribe en el mismo descriptor
+    if (sip_metrics_init(METRICS_SOCKET) < 0) {
+        fprintf(stderr, "No se pudo abrir el socket de métricas %s\n", METRICS_SOCKET);
+    }
 
     su_root_run(root);
 
     nua_destroy(nua);
     su_root_destroy(root);
-    su_deinit();
 
     return EXIT_SUCCESS;
+}
+
+/*
+Modo multihilo: un worker por núcleo, cada uno con su propio su_root en su propio hilo
+y su propio socket UDP en el puerto 5060 (SO_REUSEPORT). El kernel reparte los datagramas
+entre los sockets por origen, pero el estado de una transacción (la respuesta que se
+reenvía ante una retransmisión, el 200 OK del INVITE que se repite hasta el ACK) vive en
+un solo worker: cada datagrama se asigna por el hash de su Call-ID, y si lo leyó otro
+worker se le pasa al dueño con un su_msg, que lo entrega en el bucle del dueño.
+Así las retransmisiones y el ACK de un diálogo siempre llegan al mismo worker, y los
+workers no comparten nada más que la tabla de su_root para reenviarse datagramas.
+
+nua/nta abren y enlazan su propio socket y no tienen forma de recibir un datagrama leído
+por otro hilo, así que los workers responden con una capa de transacciones mínima propia
+(sin estado de llamada más allá de lo descrito): MESSAGE, BYE, REGISTER, OPTIONS y CANCEL
+reciben 200 OK, INVITE recibe 180 Ringing y 200 OK, y el resto 501 Not Implemented.
+*/
+
+// Datagrama leído por un worker que pertenece a otro
+typedef struct forwarded_s {
+    struct sockaddr_storage from;
+    socklen_t fromlen;
+    size_t len;
+    char data[];
+} forwarded_t;
+
+// Transacción servidor: la respuesta final se guarda para contestar igual a las retransmisiones
+typedef struct txn_s {
+    struct txn_s *next;
+    uint64_t hash;
+    char *key;                   // Call-ID, número y método del CSeq
+    size_t key_len;
+    char *response;
+    size_t response_len;
+    struct sockaddr_storage peer;
+    socklen_t peerlen;
+    uint64_t expires;            // ms de CLOCK_MONOTONIC en que se olvida
+    uint64_t retransmit_at;      // 2xx de un INVITE sin ACK: próxima retransmisión (0 = ninguna)
+    unsigned interval;           // intervalo actual de retransmisión, de T1 a T2
+} txn_t;
+
+typedef struct worker_s {
+    int index;
+    pthread_t thread;
+    su_root_t *root;
+    su_socket_t sock;
+    su_wait_t wait[1];
+    su_timer_t *timer;           // retransmisiones de 2xx y purga de transacciones, cada T1
+    txn_t **txns;                // TXN_BUCKETS cadenas
+    unsigned long received, forwarded, handled, retransmissions, dropped;
+} worker_t;
+
+// Cabeceras de una petición, apuntando al datagrama (líneas completas sin el CRLF)
+typedef struct {
+    const char *method;
+    size_t method_len;
+    const char *via[SIP_MAX_VIAS];
+    size_t via_len[SIP_MAX_VIAS];
+    int vias;
+    const char *from, *to, *call_id, *cseq;
+    size_t from_len, to_len, call_id_len, cseq_len;
+    const char *call_id_value;
+    size_t call_id_value_len;
+    unsigned long cseq_num;
+    const char *cseq_method;
+    size_t cseq_method_len;
+} sip_request_t;
+
+static worker_t workers[MAX_WORKERS];
+static int num_workers;
+static pthread_barrier_t workers_ready;
+
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint64_t hash_bytes(const char *data, size_t len)
+{
+    // FNV-1a de 64 bits
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static const char *next_line(const char *p, const char *end, size_t *len)
+{
+    // Longitud de la línea que empieza en p (sin CRLF o LF) y comienzo de la siguiente
+    const char *eol = memchr(p, '\n', end - p);
+    if (!eol) {
+        *len = end - p;
+        return end;
+    }
+    *len = (eol > p && eol[-1] == '\r') ? (size_t)(eol - 1 - p) : (size_t)(eol - p);
+    return eol + 1;
+}
+
+static const char *header_value(const char *line, size_t len, const char *name, const char *compact, size_t *value_len)
+{
+    // Si la línea es la cabecera 'name' (o su forma compacta), retorna su valor sin espacios iniciales
+    const char *colon = memchr(line, ':', len);
+    if (!colon) return NULL;
+    size_t name_len = colon - line;
+    while (name_len > 0 && (line[name_len - 1] == ' ' || line[name_len - 1] == '\t')) name_len--;
+    int match = (name_len == strlen(name) && strncasecmp(line, name, name_len) == 0) ||
+                (compact && name_len == 1 && (line[0] | 0x20) == compact[0]);
+    if (!match) return NULL;
+    const char *value = colon + 1;
+    while (value < line + len && (*value == ' ' || *value == '\t')) value++;
+    *value_len = line + len - value;
+    return value;
+}
+
+static int find_call_id(const char *data, size_t len, const char **value, size_t *value_len)
+{
+    /*
+    Busca el Call-ID sin parsear el resto del mensaje: es lo único que hace falta
+    para decidir qué worker atiende el datagrama. Retorna -1 si no lo tiene.
+    */
+    const char *p = data, *end = data + len;
+    size_t line_len;
+    p = next_line(p, end, &line_len); // línea de petición o de estado
+    while (p < end) {
+        const char *line = p;
+        p = next_line(p, end, &line_len);
+        if (line_len == 0) break; // fin de las cabeceras
+        *value = header_value(line, line_len, "Call-ID", "i", value_len);
+        if (*value) return 0;
+    }
+    return -1;
+}
+
+static int parse_request(const char *data, size_t len, sip_request_t *req)
+{
+    /* Extrae las cabeceras que hacen falta para responder. Retorna -1 si no es una petición válida. */
+    const char *p = data, *end = data + len;
+    size_t line_len, value_len;
+    memset(req, 0, sizeof(*req));
+
+    const char *line = p;
+    p = next_line(p, end, &line_len);
+    const char *space = memchr(line, ' ', line_len);
+    if (!space || line_len < 8 || memcmp(line + line_len - 8, " SIP/2.0", 8) != 0) return -1;
+    req->method = line;
+    req->method_len = space - line;
+
+    while (p < end) {
+        line = p;
+        p = next_line(p, end, &line_len);
+        if (line_len == 0) break;
+        const char *value;
+        if (header_value(line, line_len, "Via", "v", &value_len)) {
+            if (req->vias == SIP_MAX_VIAS) return -1;
+            req->via[req->vias] = line;
+            req->via_len[req->vias++] = line_len;
+        } else if (header_value(line, line_len, "From", "f", &value_len)) {
+            req->from = line;
+            req->from_len = line_len;
+        } else if (header_value(line, line_len, "To", "t", &value_len)) {
+            req->to = line;
+            req->to_len = line_len;
+        } else if ((value = header_value(line, line_len, "Call-ID", "i", &value_len))) {
+            req->call_id = line;
+            req->call_id_len = line_len;
+            req->call_id_value = value;
+            req->call_id_value_len = value_len;
+        } else if ((value = header_value(line, line_len, "CSeq", NULL, &value_len))) {
+            char *num_end;
+            req->cseq = line;
+            req->cseq_len = line_len;
+            req->cseq_num = strtoul(value, &num_end, 10);
+            while (num_end < value + value_len && *num_end == ' ') num_end++;
+            req->cseq_method = num_end;
+            req->cseq_method_len = value + value_len - num_end;
+        }
+    }
+    if (!req->vias || !req->from || !req->to || !req->call_id || !req->cseq || !req->cseq_method_len) return -1;
+    return 0;
+}
+
+static int method_is(const sip_request_t *req, const char *method)
+{
+    return req->method_len == strlen(method) && memcmp(req->method, method, req->method_len) == 0;
+}
+
+static nua_event_t request_event(const sip_request_t *req)
+{
+    // El evento nua_i_* que habría despachado nua para esta petición, para contarla igual que el callback
+    if (method_is(req, "INVITE")) return nua_i_invite;
+    if (method_is(req, "ACK")) return nua_i_ack;
+    if (method_is(req, "MESSAGE")) return nua_i_message;
+    if (method_is(req, "BYE")) return nua_i_bye;
+    if (method_is(req, "REGISTER")) return nua_i_register;
+    if (method_is(req, "OPTIONS")) return nua_i_options;
+    if (method_is(req, "CANCEL")) return nua_i_cancel;
+    return nua_i_method;
+}
+
+static size_t build_response(char *buf, const sip_request_t *req, int status, const char *phrase,
+                             const struct sockaddr_in *peer)
+{
+    /*
+    Construye la respuesta copiando Via, From, To, Call-ID y CSeq de la petición.
+    Al To se le añade una etiqueta derivada del Call-ID (estable entre retransmisiones),
+    y a la primera Via, si pide rport (RFC 3581), la dirección y el puerto de origen.
+    */
+    size_t len = 0;
+    len += snprintf(buf + len, SIP_MAX_RESPONSE - len, "SIP/2.0 %d %s\r\n", status, phrase);
+    for (int i = 0; i < req->vias && len < SIP_MAX_RESPONSE; ++i) {
+        const char *via = req->via[i];
+        size_t via_len = req->via_len[i];
+        const char *rport = i == 0 ? memmem(via, via_len, ";rport", 6) : NULL;
+        if (rport && (rport + 6 == via + via_len || rport[6] != '=')) {
+            char ip[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, &peer->sin_addr, ip, sizeof(ip));
+            len += snprintf(buf + len, SIP_MAX_RESPONSE - len, "%.*s;rport=%u;received=%s%.*s\r\n",
+                            (int)(rport - via), via, ntohs(peer->sin_port), ip,
+                            (int)(via + via_len - rport - 6), rport + 6);
+        } else {
+            len += snprintf(buf + len, SIP_MAX_RESPONSE - len, "%.*s\r\n", (int)via_len, via);
+        }
+    }
+    if (len < SIP_MAX_RESPONSE) {
+        int tagged = memmem(req->to, req->to_len, ";tag=", 5) != NULL;
+        uint32_t tag = (uint32_t)hash_bytes(req->call_id_value, req->call_id_value_len);
+        len += snprintf(buf + len, SIP_MAX_RESPONSE - len, "%.*s\r\n", (int)req->from_len, req->from);
+        if (tagged) {
+            len += snprintf(buf + len, SIP_MAX_RESPONSE - len, "%.*s\r\n", (int)req->to_len, req->to);
+        } else {
+            len += snprintf(buf + len, SIP_MAX_RESPONSE - len, "%.*s;tag=%08x\r\n", (int)req->to_len, req->to, tag);
+        }
+    }
+    if (len < SIP_MAX_RESPONSE) {
+        len += snprintf(buf + len, SIP_MAX_RESPONSE - len, "%.*s\r\n%.*s\r\n",
+                        (int)req->call_id_len, req->call_id, (int)req->cseq_len, req->cseq);
+    }
+    if (len < SIP_MAX_RESPONSE && method_is(req, "INVITE") && status >= 200 && status < 300) {
+        len += snprintf(buf + len, SIP_MAX_RESPONSE - len, "Contact: <sip:127.0.0.1:%d>\r\n", SIP_PORT);
+    }
+    if (len < SIP_MAX_RESPONSE) {
+        len += snprintf(buf + len, SIP_MAX_RESPONSE - len, "Server: miniserver\r\nContent-Length: 0\r\n\r\n");
+    }
+    return len < SIP_MAX_RESPONSE ? len : 0;
+}
+
+static txn_t *txn_find(worker_t *w, uint64_t hash, const char *key, size_t key_len)
+{
+    for (txn_t *t = w->txns[hash & (TXN_BUCKETS - 1)]; t; t = t->next) {
+        if (t->hash == hash && t->key_len == key_len && memcmp(t->key, key, key_len) == 0) return t;
+    }
+    return NULL;
+}
+
+static void txn_free(txn_t *t)
+{
+    free(t->key);
+    free(t->response);
+    free(t);
+}
+
+static void send_to(worker_t *w, const char *data, size_t len, const struct sockaddr *peer, socklen_t peerlen)
+{
+    if (sendto(w->sock, data, len, MSG_DONTWAIT, peer, peerlen) < 0) w->dropped++;
+}
+
+static void handle_datagram(worker_t *w, const char *data, size_t len, const struct sockaddr *from, socklen_t fromlen)
+{
+    /*
+    Atiende una petición en el worker dueño de su Call-ID. Una retransmisión recibe la
+    respuesta guardada; un ACK detiene las retransmisiones del 2xx de su INVITE.
+    Las respuestas (que llegan si el servidor también envía peticiones) se descartan.
+    */
+    sip_request_t req;
+    char key[512], response[SIP_MAX_RESPONSE];
+    if (from->sa_family != AF_INET || parse_request(data, len, &req) < 0) {
+        w->dropped++;
+        return;
+    }
+    w->handled++;
+    int ack = method_is(&req, "ACK");
+    int key_len = snprintf(key, sizeof(key), "%.*s %lu %.*s", (int)req.call_id_value_len, req.call_id_value,
+                           req.cseq_num, ack ? 6 : (int)req.cseq_method_len, ack ? "INVITE" : req.cseq_method);
+    if (key_len <= 0 || (size_t)key_len >= sizeof(key)) {
+        w->dropped++;
+        return;
+    }
+    uint64_t hash = hash_bytes(key, key_len);
+    txn_t *txn = txn_find(w, hash, key, key_len);
+    if (ack) {
+        if (txn) txn->retransmit_at = 0;
+        sip_metrics_event(nua_i_ack, 0, NULL);
+        return;
+    }
+    if (txn) {
+        w->retransmissions++;
+        send_to(w, txn->response, txn->response_len, from, fromlen);
+        return;
+    }
+
+    const struct sockaddr_in *peer = (const struct sockaddr_in *)from;
+    int invite = method_is(&req, "INVITE");
+    int status = 200;
+    const char *phrase = "OK";
+    if (!invite && !method_is(&req, "MESSAGE") && !method_is(&req, "BYE") && !method_is(&req, "REGISTER") &&
+        !method_is(&req, "OPTIONS") && !method_is(&req, "CANCEL")) {
+        status = 501;
+        phrase = "Not Implemented";
+    }
+    if (invite) {
+        size_t n = build_response(response, &req, 180, "Ringing", peer);
+        if (n) send_to(w, response, n, from, fromlen);
+    }
+    size_t n = build_response(response, &req, status, phrase, peer);
+    if (!n) {
+        w->dropped++;
+        return;
+    }
+    send_to(w, response, n, from, fromlen);
+    nua_event_t event = request_event(&req);
+    sip_metrics_event(event, status, NULL);
+    sip_log_event(SIP_LOG_DEBUG, event, status, NULL, "petición atendida"); // filtrado salvo con SIP_LOG_LEVEL=debug
+
+    txn = calloc(1, sizeof(*txn));
+    if (txn) {
+        txn->key = malloc(key_len);
+        txn->response = malloc(n);
+    }
+    if (!txn || !txn->key || !txn->response) {
+        if (txn) txn_free(txn);
+        return; // sin memoria, una retransmisión se volverá a atender como nueva
+    }
+    txn->hash = hash;
+    memcpy(txn->key, key, key_len);
+    txn->key_len = key_len;
+    memcpy(txn->response, response, n);
+    txn->response_len = n;
+    memcpy(&txn->peer, from, fromlen);
+    txn->peerlen = fromlen;
+    uint64_t now = now_ms();
+    txn->expires = now + TXN_LINGER_MS;
+    if (invite && status == 200) {
+        txn->interval = SIP_T1;
+        txn->retransmit_at = now + SIP_T1;
+    }
+    txn_t **bucket = &w->txns[hash & (TXN_BUCKETS - 1)];
+    txn->next = *bucket;
+    *bucket = txn;
+}
+
+static void worker_timer(worker_t *w, su_timer_t *timer, su_timer_arg_t *arg)
+{
+    // Cada T1: retransmite los 2xx de INVITE sin ACK (con intervalo doble hasta T2) y olvida las transacciones viejas
+    (void)timer;
+    (void)arg;
+    uint64_t now = now_ms();
+    for (size_t b = 0; b < TXN_BUCKETS; ++b) {
+        txn_t **link = &w->txns[b];
+        while (*link) {
+            txn_t *t = *link;
+            if (t->expires <= now) {
+                *link = t->next;
+                txn_free(t);
+                continue;
+            }
+            if (t->retransmit_at && t->retransmit_at <= now) {
+                send_to(w, t->response, t->response_len, (struct sockaddr *)&t->peer, t->peerlen);
+                t->interval = t->interval * 2 < SIP_T2 ? t->interval * 2 : SIP_T2;
+                t->retransmit_at = now + t->interval;
+            }
+            link = &t->next;
+        }
+    }
+}
+
+static void worker_forwarded(worker_t *w, su_msg_r msg, forwarded_t *fwd)
+{
+    // Se ejecuta en el bucle del dueño: el datagrama lo leyó otro worker
+    (void)msg;
+    handle_datagram(w, fwd->data, fwd->len, (struct sockaddr *)&fwd->from, fwd->fromlen);
+}
+
+static void route_datagram(worker_t *w, const char *data, size_t len, const struct sockaddr *from, socklen_t fromlen)
+{
+    /*
+    Decide el worker por el hash del Call-ID. Si es este, atiende el datagrama en el sitio;
+    si no, lo copia en un su_msg para el su_root del dueño. Sin Call-ID no hay transacción
+    que proteger: lo atiende quien lo leyó.
+    */
+    const char *call_id;
+    size_t call_id_len;
+    worker_t *owner = w;
+    if (find_call_id(data, len, &call_id, &call_id_len) == 0) {
+        owner = &workers[hash_bytes(call_id, call_id_len) % num_workers];
+    }
+    if (owner == w) {
+        handle_datagram(w, data, len, from, fromlen);
+        return;
+    }
+    su_msg_r msg = SU_MSG_R_INIT;
+    if (su_msg_create(msg, su_root_task(owner->root), su_root_task(w->root), worker_forwarded,
+                      sizeof(forwarded_t) + len) < 0) {
+        w->dropped++;
+        return;
+    }
+    forwarded_t *fwd = su_msg_data(msg);
+    memcpy(&fwd->from, from, fromlen);
+    fwd->fromlen = fromlen;
+    fwd->len = len;
+    memcpy(fwd->data, data, len);
+    if (su_msg_send(msg) < 0) w->dropped++;
+    else w->forwarded++;
+}
+
+static int worker_readable(worker_t *w, su_wait_t *wait, su_wakeup_arg_t *arg)
+{
+    /*
+    El socket tiene datagramas: se leen por lotes de RECV_BATCH con recvmmsg hasta vaciarlo,
+    así una ráfaga cuesta una llamada al sistema por lote y una vuelta del bucle.
+    */
+    static __thread char (*buffers)[SIP_MAX_DATAGRAM];
+    struct mmsghdr msgs[RECV_BATCH];
+    struct iovec iov[RECV_BATCH];
+    struct sockaddr_storage from[RECV_BATCH];
+    (void)wait;
+    (void)arg;
+    if (!buffers && !(buffers = malloc(RECV_BATCH * sizeof(*buffers)))) return 0;
+
+    for (;;) {
+        for (int i = 0; i < RECV_BATCH; ++i) {
+            iov[i].iov_base = buffers[i];
+            iov[i].iov_len = SIP_MAX_DATAGRAM - 1;
+            memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &from[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+        }
+        int n = recvmmsg(w->sock, msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) break; // EAGAIN: vacío
+        for (int i = 0; i < n; ++i) {
+            w->received++;
+            route_datagram(w, buffers[i], msgs[i].msg_len, (struct sockaddr *)&from[i], msgs[i].msg_hdr.msg_namelen);
+        }
+        if (n < RECV_BATCH) break;
+    }
+    return 0;
+}
+
+static su_socket_t open_reuseport_socket(void)
+{
+    // Todos los workers enlazan 127.0.0.1:5060; el kernel reparte los datagramas entre ellos
+    su_socket_t sock = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) return -1;
+    int one = 1;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(SIP_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) < 0 ||
+        bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind 5060");
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void *worker_main(void *arg)
+{
+    /*
+    Cada worker crea su su_root en su propio hilo (un su_root pertenece al hilo que lo crea),
+    registra su socket como fuente su_wait y espera a los demás antes de atender:
+    el reparto por Call-ID necesita el su_root de todos.
+    */
+    worker_t *w = arg;
+    int ok = 1;
+    w->root = su_root_create(w);
+    w->txns = calloc(TXN_BUCKETS, sizeof(txn_t *));
+    w->sock = w->root && w->txns ? open_reuseport_socket() : -1;
+    if (w->sock < 0 || su_wait_create(w->wait, w->sock, SU_WAIT_IN) < 0 ||
+        su_root_register(w->root, w->wait, worker_readable, w, 0) < 0) {
+        fprintf(stderr, "Worker %d: no se pudo preparar su socket\n", w->index);
+        ok = 0;
+    }
+    w->timer = ok ? su_timer_create(su_root_task(w->root), SIP_T1) : NULL;
+    if (w->timer) su_timer_run(w->timer, worker_timer, NULL);
+    pthread_barrier_wait(&workers_ready);
+    if (!ok) exit(EXIT_FAILURE);
+
+    su_root_run(w->root);
+    return NULL;
+}
+
+static int run_workers(int n)
+{
+    // El hilo principal hace de worker 0
+    num_workers = n;
+    pthread_barrier_init(&workers_ready, NULL, n);
+    for (int i = 1; i < n; ++i) {
+        workers[i].index = i;
+        if (pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]) != 0) {
+            perror("pthread_create worker");
+            return EXIT_FAILURE;
+        }
+    }
+    printf("Sofia-SIP miniserver started at sip:127.0.0.1:%d with %d workers\n", SIP_PORT, n);
+    fflush(stdout); // el hilo de log escribe en el mismo descriptor
+    if (sip_metrics_init(METRICS_SOCKET) < 0) {
+        fprintf(stderr, "No se pudo abrir el socket de métricas %s\n", METRICS_SOCKET);
+    }
+    worker_main(&workers[0]);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
+    int ret;
+
+    su_init();
+    if (sip_log_init(STDOUT_FILENO, SIP_LOG_INFO) < 0) {
+        fprintf(stderr, "No se pudo arrancar el hilo de log\n");
+    }
+    if (argc > 2 && strcmp(argv[1], "-w") == 0) {
+        int n = strcmp(argv[2], "auto") == 0 ? (int)sysconf(_SC_NPROCESSORS_ONLN) : atoi(argv[2]);
+        if (n < 1 || n > MAX_WORKERS) {
+            fprintf(stderr, "Número de workers inválido (1-%d)\n", MAX_WORKERS);
+            return EXIT_FAILURE;
+        }
+        ret = run_workers(n);
+    } else {
+        ret = run_single();
+    }
+    sip_log_shutdown();
+    su_deinit();
+
+    return ret;
 }
\ No newline at end of file
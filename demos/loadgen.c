@@ -0,0 +1,948 @@
+#define _GNU_SOURCE // recvmmsg, sendmmsg, memmem
+// El generador es la magia del su_root y cada socket es el argumento de su fuente su_wait
+#define SU_ROOT_MAGIC_T struct loadgen_s
+#define SU_WAKEUP_ARG_T struct lg_socket_s
+
+#include <sofia-sip/su.h>
+#include <sofia-sip/su_wait.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/*
+Generador de carga SIP por loopback a partir de demo3/demo4 (un INVITE) y demo5 (MESSAGE).
+En vez de una petición por nua_invite/nua_message, envía transacciones UDP crudas a un ritmo
+configurable (peticiones por segundo), con un máximo de transacciones en curso y una mezcla
+de REGISTER, INVITE, MESSAGE y BYE. Las peticiones salen de plantillas precalculadas a partir
+de docs/invite.sip: por cada método y socket se construye el texto una sola vez y al enviar
+solo se copian y se rellenan en su sitio los campos de ancho fijo (branch, tag y Call-ID).
+
+nua no sirve para medir capacidad: cada petición crea un handle, pasa por nta y por el parser
+completo, y el cliente se satura antes que el servidor. Aquí la transacción cliente es mínima
+(retransmisiones de RFC 3261 sobre UDP y fin por respuesta final o por timeout), y la latencia
+de cada transacción, desde el primer envío hasta la respuesta final, va a un histograma por método.
+*/
+
+#define SIP_T1 500                 // ms, RFC 3261
+#define SIP_T2 4000
+#define MAX_SOCKETS 64
+#define SEND_BATCH 64              // peticiones por sendmmsg
+#define RECV_BATCH 64              // respuestas por recvmmsg
+#define SIP_MAX_REQUEST 1024
+#define SIP_MAX_DATAGRAM 8192
+#define SIP_MAX_TAG 64
+#define DIALOG_RING 65536          // llamadas establecidas a la espera de su BYE (potencia de dos)
+#define TICK_MS 1                  // periodo del temporizador de ritmo
+#define SCAN_MS 10                 // cada cuánto se revisan retransmisiones y timeouts
+
+// Ancho en hexadecimal de los campos que se rellenan en las plantillas
+#define BRANCH_DIGITS 16
+#define TAG_DIGITS 8
+#define CALL_ID_DIGITS 16
+
+enum { M_REGISTER, M_INVITE, M_MESSAGE, M_BYE, M_ACK, METHOD_COUNT };
+static const char *const method_names[METHOD_COUNT] = { "REGISTER", "INVITE", "MESSAGE", "BYE", "ACK" };
+#define MIX_METHODS M_ACK          // el ACK no forma parte de la mezcla: sigue a cada 2xx de INVITE
+
+// Histograma log-lineal al estilo HDR: 2^HIST_SUB_BITS sub-cubetas por potencia de dos (error < 1%)
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS (40 * HIST_SUB) // hasta 2^39 µs
+
+typedef struct {
+    unsigned long counts[HIST_BUCKETS];
+    unsigned long total;
+    uint64_t max;
+} histogram_t;
+
+// Plantilla de una petición para un método y un socket, con los campos a rellenar en posiciones fijas
+typedef struct {
+    char text[SIP_MAX_REQUEST];
+    size_t len;
+    size_t branch_off, tag_off, call_id_off;
+    size_t to_tag_off;           // dónde se inserta la etiqueta remota del To (BYE y ACK), 0 = ninguna
+} sip_template_t;
+
+typedef struct lg_socket_s {
+    struct loadgen_s *lg;
+    su_socket_t fd;
+    su_wait_t wait[1];
+    unsigned short port;
+    sip_template_t templates[METHOD_COUNT];
+    struct mmsghdr batch[SEND_BATCH];
+    struct iovec iov[SEND_BATCH];
+    char (*buffers)[SIP_MAX_REQUEST];
+    int pending;                 // peticiones renderizadas en el lote sin enviar
+} lg_socket_t;
+
+// Llamada establecida (INVITE con 2xx y ACK) que puede cerrar un BYE
+typedef struct {
+    uint64_t call_id;
+    uint32_t tag;
+    uint8_t to_tag_len;
+    char to_tag[SIP_MAX_TAG];
+} dialog_t;
+
+// Transacción cliente en curso; el branch es el índice de la ranura y su generación
+typedef struct {
+    uint32_t gen;
+    uint8_t method;
+    uint8_t active;
+    uint8_t provisional;         // INVITE con 1xx: deja de retransmitirse (Timer A)
+    lg_socket_t *sock;
+    dialog_t dialog;             // Call-ID, tag local y, para BYE, la etiqueta remota
+    uint64_t sent_ns, retransmit_ns, deadline_ns;
+    unsigned interval_ms;
+} txn_t;
+
+typedef struct {
+    unsigned long started, completed, retransmissions, timeouts, classes[7];
+    histogram_t latency;
+} method_stats_t;
+
+typedef struct {
+    const char *template_path;
+    struct sockaddr_in server;
+    unsigned rate;               // peticiones por segundo, 0 = sin límite (siempre 'concurrency' en curso)
+    unsigned concurrency;
+    unsigned duration;           // segundos
+    unsigned long total;         // transacciones, 0 = sin límite
+    unsigned sockets;
+    unsigned timeout_ms;
+    unsigned weights[MIX_METHODS];
+    uint64_t max_p99_us;         // umbrales de regresión, 0 = sin umbral
+    double min_tps;
+} config_t;
+
+typedef struct loadgen_s {
+    config_t cfg;
+    su_root_t *root;
+    su_timer_t *timer;
+    lg_socket_t *socks;
+    txn_t *txns;
+    uint32_t *free_slots;
+    unsigned free_count;
+    unsigned char *mix;          // tabla barajada con los métodos según los pesos
+    unsigned mix_len, mix_pos, next_sock;
+    dialog_t *dialogs;
+    unsigned dialog_head, dialog_count;
+    uint64_t run_id, calls, acks, rng;
+    uint64_t start_ns, last_done_ns, last_scan_ns, last_report_ns;
+    unsigned long issued;        // oportunidades de envío según el ritmo
+    unsigned long started, completed_at_report, throttled, send_errors, stray;
+    int stopping;
+    method_stats_t stats[METHOD_COUNT];
+} loadgen_t;
+
+static volatile sig_atomic_t interrupted;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t xorshift(uint64_t *state)
+{
+    uint64_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+static void put_hex(char *p, uint64_t value, int digits)
+{
+    static const char hex[] = "0123456789abcdef";
+    for (int i = digits - 1; i >= 0; --i) {
+        p[i] = hex[value & 15];
+        value >>= 4;
+    }
+}
+
+static int get_hex(const char *p, const char *end, int digits, uint64_t *value)
+{
+    uint64_t v = 0;
+    if (end - p < digits) return -1;
+    for (int i = 0; i < digits; ++i) {
+        int c = p[i];
+        if (c >= '0' && c <= '9') v = v << 4 | (c - '0');
+        else if (c >= 'a' && c <= 'f') v = v << 4 | (c - 'a' + 10);
+        else return -1;
+    }
+    *value = v;
+    return 0;
+}
+
+static unsigned hist_index(uint64_t v)
+{
+    if (v < HIST_SUB) return (unsigned)v;
+    int shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS;
+    unsigned index = ((unsigned)(shift + 1) << HIST_SUB_BITS) + (unsigned)((v >> shift) - HIST_SUB);
+    return index < HIST_BUCKETS ? index : HIST_BUCKETS - 1;
+}
+
+static uint64_t hist_value(unsigned index)
+{
+    // Punto medio de la cubeta: el error es a lo sumo media sub-cubeta
+    unsigned bucket = index >> HIST_SUB_BITS;
+    if (bucket == 0) return index;
+    uint64_t low = (uint64_t)((index & (HIST_SUB - 1)) + HIST_SUB) << (bucket - 1);
+    return low + ((1ULL << (bucket - 1)) >> 1);
+}
+
+static void hist_record(histogram_t *h, uint64_t v)
+{
+    h->counts[hist_index(v)]++;
+    h->total++;
+    if (v > h->max) h->max = v;
+}
+
+static void hist_merge(histogram_t *into, const histogram_t *from)
+{
+    for (unsigned i = 0; i < HIST_BUCKETS; ++i) into->counts[i] += from->counts[i];
+    into->total += from->total;
+    if (from->max > into->max) into->max = from->max;
+}
+
+static uint64_t hist_percentile(const histogram_t *h, double p)
+{
+    if (!h->total) return 0;
+    unsigned long rank = (unsigned long)(p / 100.0 * h->total + 0.5);
+    unsigned long seen = 0;
+    if (rank < 1) rank = 1;
+    for (unsigned i = 0; i < HIST_BUCKETS; ++i) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            uint64_t v = hist_value(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+static const char *next_line(const char *p, const char *end, size_t *len)
+{
+    // Longitud de la línea que empieza en p (sin CRLF o LF) y comienzo de la siguiente
+    const char *eol = memchr(p, '\n', end - p);
+    if (!eol) {
+        *len = end - p;
+        return end;
+    }
+    *len = (eol > p && eol[-1] == '\r') ? (size_t)(eol - 1 - p) : (size_t)(eol - p);
+    return eol + 1;
+}
+
+static const char *header_value(const char *line, size_t len, const char *name, const char *compact, size_t *value_len)
+{
+    // Si la línea es la cabecera 'name' (o su forma compacta), retorna su valor sin espacios iniciales
+    const char *colon = memchr(line, ':', len);
+    if (!colon) return NULL;
+    size_t name_len = colon - line;
+    while (name_len > 0 && (line[name_len - 1] == ' ' || line[name_len - 1] == '\t')) name_len--;
+    int match = (name_len == strlen(name) && strncasecmp(line, name, name_len) == 0) ||
+                (compact && name_len == 1 && (line[0] | 0x20) == compact[0]);
+    if (!match) return NULL;
+    const char *value = colon + 1;
+    while (value < line + len && (*value == ' ' || *value == '\t')) value++;
+    *value_len = line + len - value;
+    return value;
+}
+
+static int append(sip_template_t *t, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static int append(sip_template_t *t, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(t->text + t->len, sizeof(t->text) - t->len, fmt, ap);
+    va_end(ap);
+    if (n < 0 || (size_t)n >= sizeof(t->text) - t->len) return -1;
+    t->len += n;
+    return 0;
+}
+
+static int append_field(sip_template_t *t, size_t *offset, int digits)
+{
+    if (t->len + digits >= sizeof(t->text)) return -1;
+    *offset = t->len;
+    memset(t->text + t->len, '0', digits);
+    t->len += digits;
+    return 0;
+}
+
+static int build_template(sip_template_t *t, const char *base, size_t base_len, int method, unsigned short port)
+{
+    /*
+    Convierte el INVITE de ejemplo (docs/invite.sip) en la plantilla de 'method':
+    - La línea de petición y el CSeq llevan el método; REGISTER va al dominio (sip:127.0.0.1).
+    - Via lleva el puerto local del socket, rport y un branch z9hG4bK de BRANCH_DIGITS cifras.
+    - From lleva un tag de TAG_DIGITS cifras y Call-ID, CALL_ID_DIGITS cifras @127.0.0.1.
+    - BYE y ACK van dentro del diálogo: el To recibe la etiqueta del 2xx al renderizar,
+      y BYE usa CSeq 2.
+    - MESSAGE lleva un cuerpo de texto y REGISTER un Expires. Content-Length se recalcula.
+    Los "..." de la plantilla son los huecos que se rellenan aquí.
+    */
+    const char *p = base, *end = base + base_len;
+    const char *name = method_names[method];
+    const char *body = method == M_MESSAGE ? "loadgen" : "";
+    size_t line_len, value_len;
+    memset(t, 0, sizeof(*t));
+
+    const char *line = p;
+    p = next_line(p, end, &line_len);
+    const char *uri = memchr(line, ' ', line_len);
+    if (!uri || line_len < 8 || memcmp(line + line_len - 8, " SIP/2.0", 8) != 0) return -1;
+    uri++;
+    size_t uri_len = line + line_len - 8 - uri;
+    if (method == M_REGISTER) {
+        // El registro va al dominio de la URI: sip:callee@127.0.0.1 -> sip:127.0.0.1
+        const char *at = memchr(uri, '@', uri_len);
+        if (append(t, "REGISTER sip:%.*s SIP/2.0\r\n", at ? (int)(uri + uri_len - at - 1) : (int)uri_len - 4,
+                   at ? at + 1 : uri + 4) < 0) return -1;
+    } else if (append(t, "%s %.*s SIP/2.0\r\n", name, (int)uri_len, uri) < 0) {
+        return -1;
+    }
+
+    while (p < end) {
+        line = p;
+        p = next_line(p, end, &line_len);
+        if (line_len == 0) break;
+        const char *value;
+        int rc = 0;
+        if (header_value(line, line_len, "Via", "v", &value_len)) {
+            rc = append(t, "Via: SIP/2.0/UDP 127.0.0.1:%u;rport;branch=z9hG4bK", port);
+            if (!rc) rc = append_field(t, &t->branch_off, BRANCH_DIGITS);
+            if (!rc) rc = append(t, "\r\n");
+        } else if ((value = header_value(line, line_len, "From", "f", &value_len))) {
+            const char *tag = memmem(value, value_len, ";tag=", 5);
+            rc = append(t, "From: %.*s;tag=", tag ? (int)(tag - value) : (int)value_len, value);
+            if (!rc) rc = append_field(t, &t->tag_off, TAG_DIGITS);
+            if (!rc) rc = append(t, "\r\n");
+        } else if ((value = header_value(line, line_len, "To", "t", &value_len))) {
+            if (method == M_REGISTER) {
+                // En un REGISTER el To es la dirección que se registra, la del From
+                const char *from_line = memmem(base, base_len, "\nFrom:", 6);
+                const char *from = from_line ? from_line + 6 : NULL;
+                size_t from_len = 0;
+                if (from) {
+                    while (*from == ' ') from++;
+                    from_len = strcspn(from, ";\r\n");
+                }
+                rc = from ? append(t, "To: %.*s\r\n", (int)from_len, from) : append(t, "To: %.*s\r\n", (int)value_len, value);
+            } else {
+                rc = append(t, "To: %.*s", (int)value_len, value);
+                if (!rc && (method == M_BYE || method == M_ACK)) {
+                    rc = append(t, ";tag=");
+                    t->to_tag_off = t->len;
+                }
+                if (!rc) rc = append(t, "\r\n");
+            }
+        } else if (header_value(line, line_len, "Call-ID", "i", &value_len)) {
+            rc = append(t, "Call-ID: ");
+            if (!rc) rc = append_field(t, &t->call_id_off, CALL_ID_DIGITS);
+            if (!rc) rc = append(t, "@127.0.0.1\r\n");
+        } else if (header_value(line, line_len, "CSeq", NULL, &value_len)) {
+            rc = append(t, "CSeq: %d %s\r\n", method == M_BYE ? 2 : 1, name);
+        } else if (header_value(line, line_len, "Content-Length", "l", &value_len)) {
+            continue;
+        } else if ((value = header_value(line, line_len, "User-Agent", NULL, &value_len))) {
+            const char *dots = memmem(value, value_len, "...", 3);
+            rc = append(t, "User-Agent: %.*s%s\r\n", dots ? (int)(dots - value) : (int)value_len, value,
+                        dots ? "loadgen" : "");
+        } else if ((header_value(line, line_len, "Contact", "m", &value_len) ||
+                    header_value(line, line_len, "Allow", NULL, &value_len)) &&
+                   method != M_INVITE && method != M_REGISTER) {
+            continue; // solo INVITE y REGISTER anuncian contacto y capacidades
+        } else {
+            rc = append(t, "%.*s\r\n", (int)line_len, line);
+        }
+        if (rc < 0) return -1;
+    }
+    if (method == M_REGISTER && append(t, "Expires: 3600\r\n") < 0) return -1;
+    if (method == M_MESSAGE && append(t, "Content-Type: text/plain\r\n") < 0) return -1;
+    if (append(t, "Content-Length: %zu\r\n\r\n%s", strlen(body), body) < 0) return -1;
+    if (!t->branch_off || !t->tag_off || !t->call_id_off) return -1;
+    return 0;
+}
+
+static size_t render(const sip_template_t *t, char *buf, uint64_t branch, const dialog_t *d)
+{
+    /*
+    Copia la plantilla y escribe en su sitio branch, tag y Call-ID. Si la plantilla
+    va dentro de un diálogo, inserta además la etiqueta remota en el To.
+    */
+    size_t tag_len = t->to_tag_off ? d->to_tag_len : 0;
+    size_t split = t->to_tag_off ? t->to_tag_off : t->len;
+    if (t->len + tag_len > SIP_MAX_REQUEST) return 0;
+    memcpy(buf, t->text, split);
+    if (tag_len) memcpy(buf + split, d->to_tag, tag_len);
+    memcpy(buf + split + tag_len, t->text + split, t->len - split);
+    put_hex(buf + t->branch_off + (t->branch_off >= split ? tag_len : 0), branch, BRANCH_DIGITS);
+    put_hex(buf + t->tag_off + (t->tag_off >= split ? tag_len : 0), d->tag, TAG_DIGITS);
+    put_hex(buf + t->call_id_off + (t->call_id_off >= split ? tag_len : 0), d->call_id, CALL_ID_DIGITS);
+    return t->len + tag_len;
+}
+
+static void flush_socket(loadgen_t *lg, lg_socket_t *s)
+{
+    // Un sendmmsg por lote; lo que el socket no acepte se reenviará con las retransmisiones
+    int off = 0;
+    while (off < s->pending) {
+        int n = sendmmsg(s->fd, s->batch + off, s->pending - off, MSG_DONTWAIT);
+        if (n <= 0) {
+            lg->send_errors += s->pending - off;
+            break;
+        }
+        off += n;
+    }
+    s->pending = 0;
+}
+
+static void send_now(loadgen_t *lg, lg_socket_t *s, const char *data, size_t len)
+{
+    if (send(s->fd, data, len, MSG_DONTWAIT) < 0) lg->send_errors++;
+}
+
+static void finish_txn(loadgen_t *lg, uint32_t slot)
+{
+    lg->txns[slot].active = 0;
+    lg->free_slots[lg->free_count++] = slot;
+}
+
+static void start_txn(loadgen_t *lg)
+{
+    /*
+    Toma una ranura libre y el siguiente método de la mezcla, y renderiza la petición
+    en el lote de un socket (por turnos). BYE cierra la llamada establecida más antigua;
+    si no hay ninguna se envía un INVITE en su lugar.
+    */
+    uint32_t slot = lg->free_slots[--lg->free_count];
+    txn_t *t = &lg->txns[slot];
+    int method = lg->mix[lg->mix_pos];
+    if (++lg->mix_pos == lg->mix_len) lg->mix_pos = 0;
+    lg_socket_t *s = &lg->socks[lg->next_sock];
+    if (++lg->next_sock == lg->cfg.sockets) lg->next_sock = 0;
+
+    if (method == M_BYE && lg->dialog_count) {
+        t->dialog = lg->dialogs[(lg->dialog_head - lg->dialog_count) & (DIALOG_RING - 1)];
+        lg->dialog_count--;
+    } else {
+        if (method == M_BYE) method = M_INVITE;
+        t->dialog.call_id = lg->run_id | (++lg->calls & 0xffffffffffULL);
+        t->dialog.tag = (uint32_t)xorshift(&lg->rng);
+        t->dialog.to_tag_len = 0;
+    }
+    t->gen++;
+    t->method = method;
+    t->active = 1;
+    t->provisional = 0;
+    t->sock = s;
+    t->sent_ns = now_ns();
+    t->interval_ms = SIP_T1;
+    t->retransmit_ns = t->sent_ns + SIP_T1 * 1000000ULL;
+    t->deadline_ns = t->sent_ns + lg->cfg.timeout_ms * 1000000ULL;
+
+    char *buf = s->buffers[s->pending];
+    size_t len = render(&s->templates[method], buf, (uint64_t)slot << 32 | t->gen, &t->dialog);
+    if (!len) {
+        lg->send_errors++;
+        finish_txn(lg, slot);
+        return;
+    }
+    s->iov[s->pending].iov_base = buf;
+    s->iov[s->pending].iov_len = len;
+    if (++s->pending == SEND_BATCH) flush_socket(lg, s);
+    lg->stats[method].started++;
+    lg->started++;
+}
+
+static void fill(loadgen_t *lg, uint64_t now)
+{
+    /*
+    Inicia las transacciones que tocan. Con ritmo, las que corresponden al tiempo transcurrido
+    (las que no caben por la concurrencia se pierden y se cuentan: no se acumulan en ráfagas
+    que falsearían la latencia). Sin ritmo, tantas como ranuras libres.
+    */
+    if (lg->stopping) return;
+    unsigned long want;
+    if (lg->cfg.rate) {
+        unsigned long due = (unsigned long)((now - lg->start_ns) * lg->cfg.rate / 1000000000ULL);
+        if (due <= lg->issued) return;
+        want = due - lg->issued;
+        lg->issued = due;
+        if (want > lg->free_count) {
+            lg->throttled += want - lg->free_count;
+            want = lg->free_count;
+        }
+    } else {
+        want = lg->free_count;
+    }
+    if (lg->cfg.total && lg->started + want > lg->cfg.total) want = lg->cfg.total - lg->started;
+    while (want--) start_txn(lg);
+    for (unsigned i = 0; i < lg->cfg.sockets; ++i) {
+        if (lg->socks[i].pending) flush_socket(lg, &lg->socks[i]);
+    }
+}
+
+static void send_ack(loadgen_t *lg, lg_socket_t *s, const dialog_t *d)
+{
+    // ACK de un 2xx: transacción propia sin respuesta, con un branch que no corresponde a ninguna ranura
+    char buf[SIP_MAX_REQUEST];
+    size_t len = render(&s->templates[M_ACK], buf, 1ULL << 63 | ++lg->acks, d);
+    if (len) send_now(lg, s, buf, len);
+}
+
+static void handle_response(loadgen_t *lg, lg_socket_t *s, const char *data, size_t len, uint64_t now)
+{
+    /*
+    Asocia la respuesta a su transacción por el branch de la Via (ranura y generación).
+    Una respuesta final cierra la transacción y registra su latencia; el 2xx de un INVITE
+    se confirma con un ACK y deja la llamada lista para un BYE. Lo que no encaja
+    (respuestas repetidas, transacciones ya vencidas) se cuenta como suelto.
+    */
+    const char *end = data + len;
+    if (len < 12 || memcmp(data, "SIP/2.0 ", 8) != 0) {
+        lg->stray++;
+        return;
+    }
+    int status = atoi(data + 8);
+    const char *branch = memmem(data, len, ";branch=z9hG4bK", 15);
+    uint64_t id;
+    if (status < 100 || status > 699 || !branch || get_hex(branch + 15, end, BRANCH_DIGITS, &id) < 0) {
+        lg->stray++;
+        return;
+    }
+    uint32_t slot = (uint32_t)(id >> 32);
+    txn_t *t = slot < lg->cfg.concurrency ? &lg->txns[slot] : NULL;
+    if (!t || !t->active || t->gen != (uint32_t)id) {
+        lg->stray++;
+        return;
+    }
+    method_stats_t *st = &lg->stats[t->method];
+    if (status < 200) {
+        if (!t->provisional) st->classes[1]++;
+        t->provisional = 1;
+        return;
+    }
+    st->classes[status / 100]++;
+    st->completed++;
+    hist_record(&st->latency, (now - t->sent_ns) / 1000);
+    lg->last_done_ns = now;
+
+    if (t->method == M_INVITE && status < 300) {
+        // La etiqueta del To del 2xx identifica el diálogo
+        const char *p = data;
+        size_t line_len, value_len;
+        p = next_line(p, end, &line_len);
+        while (p < end) {
+            const char *line = p;
+            p = next_line(p, end, &line_len);
+            if (line_len == 0) break;
+            const char *value = header_value(line, line_len, "To", "t", &value_len);
+            const char *tag = value ? memmem(value, value_len, ";tag=", 5) : NULL;
+            if (!tag) continue;
+            tag += 5;
+            size_t tag_len = strcspn(tag, ";\r\n");
+            if (tag_len > SIP_MAX_TAG) tag_len = SIP_MAX_TAG;
+            memcpy(t->dialog.to_tag, tag, tag_len);
+            t->dialog.to_tag_len = (uint8_t)tag_len;
+            break;
+        }
+        send_ack(lg, s, &t->dialog);
+        lg->dialogs[lg->dialog_head++ & (DIALOG_RING - 1)] = t->dialog;
+        if (lg->dialog_count < DIALOG_RING) lg->dialog_count++;
+    }
+    finish_txn(lg, slot);
+}
+
+static int socket_readable(loadgen_t *lg, su_wait_t *wait, lg_socket_t *s)
+{
+    // Respuestas por lotes de RECV_BATCH, con una sola lectura del reloj por lote
+    static char buffers[RECV_BATCH][SIP_MAX_DATAGRAM];
+    struct mmsghdr msgs[RECV_BATCH];
+    struct iovec iov[RECV_BATCH];
+    (void)wait;
+
+    for (;;) {
+        memset(msgs, 0, sizeof(msgs));
+        for (int i = 0; i < RECV_BATCH; ++i) {
+            iov[i].iov_base = buffers[i];
+            iov[i].iov_len = SIP_MAX_DATAGRAM;
+            msgs[i].msg_hdr.msg_iov = &iov[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        int n = recvmmsg(s->fd, msgs, RECV_BATCH, MSG_DONTWAIT, NULL);
+        if (n <= 0) break;
+        uint64_t now = now_ns();
+        for (int i = 0; i < n; ++i) handle_response(lg, s, buffers[i], msgs[i].msg_len, now);
+        if (n < RECV_BATCH) break;
+    }
+    if (!lg->cfg.rate) fill(lg, now_ns());
+    return 0;
+}
+
+static void scan_txns(loadgen_t *lg, uint64_t now)
+{
+    /*
+    Retransmisiones de RFC 3261 sobre UDP: INVITE cada T1, 2T1, 4T1... hasta su primer 1xx
+    (Timer A), el resto con el intervalo doblado hasta T2 (Timer E). Al vencer el timeout
+    (Timer B/F) la transacción se da por perdida.
+    */
+    char buf[SIP_MAX_REQUEST];
+    for (uint32_t slot = 0; slot < lg->cfg.concurrency; ++slot) {
+        txn_t *t = &lg->txns[slot];
+        if (!t->active) continue;
+        if (now >= t->deadline_ns) {
+            lg->stats[t->method].timeouts++;
+            finish_txn(lg, slot);
+            continue;
+        }
+        if (now < t->retransmit_ns || (t->method == M_INVITE && t->provisional)) continue;
+        size_t len = render(&t->sock->templates[t->method], buf, (uint64_t)slot << 32 | t->gen, &t->dialog);
+        send_now(lg, t->sock, buf, len);
+        lg->stats[t->method].retransmissions++;
+        t->interval_ms *= 2;
+        if (t->method != M_INVITE && t->interval_ms > SIP_T2) t->interval_ms = SIP_T2;
+        t->retransmit_ns = now + t->interval_ms * 1000000ULL;
+    }
+}
+
+static void tick(loadgen_t *lg, su_timer_t *timer, su_timer_arg_t *arg)
+{
+    /*
+    Cada TICK_MS: inicia las transacciones que tocan, revisa retransmisiones cada SCAN_MS,
+    imprime el progreso cada segundo y, tras la duración o el total pedidos (o Ctrl+C),
+    espera a que terminen las transacciones en curso antes de parar el bucle.
+    */
+    (void)timer;
+    (void)arg;
+    uint64_t now = now_ns();
+    if (!lg->stopping && (interrupted || (lg->cfg.duration && now - lg->start_ns >= lg->cfg.duration * 1000000000ULL) ||
+                          (lg->cfg.total && lg->started >= lg->cfg.total))) {
+        lg->stopping = 1;
+    }
+    fill(lg, now);
+    if (now - lg->last_scan_ns >= SCAN_MS * 1000000ULL) {
+        scan_txns(lg, now);
+        lg->last_scan_ns = now;
+    }
+    if (now - lg->last_report_ns >= 1000000000ULL) {
+        unsigned long completed = 0;
+        for (int m = 0; m < METHOD_COUNT; ++m) completed += lg->stats[m].completed;
+        printf("t=%5.1fs iniciadas=%lu completadas=%lu (%lu/s) en curso=%u\n",
+               (now - lg->start_ns) / 1e9, lg->started, completed,
+               (unsigned long)((completed - lg->completed_at_report) * 1e9 / (now - lg->last_report_ns)),
+               lg->cfg.concurrency - lg->free_count);
+        fflush(stdout);
+        lg->completed_at_report = completed;
+        lg->last_report_ns = now;
+    }
+    if (lg->stopping && (lg->free_count == lg->cfg.concurrency || interrupted > 1)) su_root_break(lg->root);
+}
+
+static int report(loadgen_t *lg)
+{
+    /*
+    Tabla por método y una línea RESULT fácil de comparar entre ejecuciones.
+    La tasa es de transacciones completadas hasta la última respuesta final: las esperas
+    del drenaje por transacciones que acaban en timeout no la rebajan.
+    Retorna 1 si no se cumple algún umbral de regresión (-P, -M).
+    */
+    histogram_t *all = calloc(1, sizeof(*all));
+    if (!all) return 1;
+    double seconds = lg->last_done_ns > lg->start_ns ? (lg->last_done_ns - lg->start_ns) / 1e9 : 1;
+    unsigned long started = 0, completed = 0, retransmissions = 0, timeouts = 0, ok = 0, failed = 0;
+
+    printf("\n%-9s %10s %11s %9s %9s %9s %9s %9s %9s %9s\n", "método", "iniciadas", "completadas",
+           "reenvíos", "timeouts", "2xx", "otras", "p50(us)", "p99(us)", "p999(us)");
+    for (int m = 0; m < MIX_METHODS; ++m) {
+        method_stats_t *st = &lg->stats[m];
+        if (!st->started) continue;
+        unsigned long other = st->completed - st->classes[2];
+        printf("%-9s %10lu %11lu %9lu %9lu %9lu %9lu %9llu %9llu %9llu\n", method_names[m], st->started,
+               st->completed, st->retransmissions, st->timeouts, st->classes[2], other,
+               (unsigned long long)hist_percentile(&st->latency, 50),
+               (unsigned long long)hist_percentile(&st->latency, 99),
+               (unsigned long long)hist_percentile(&st->latency, 99.9));
+        hist_merge(all, &st->latency);
+        started += st->started;
+        completed += st->completed;
+        retransmissions += st->retransmissions;
+        timeouts += st->timeouts;
+        ok += st->classes[2];
+        failed += other;
+    }
+    uint64_t p50 = hist_percentile(all, 50), p99 = hist_percentile(all, 99), p999 = hist_percentile(all, 99.9);
+    printf("%-9s %10lu %11lu %9lu %9lu %9lu %9lu %9llu %9llu %9llu\n", "total", started, completed,
+           retransmissions, timeouts, ok, failed,
+           (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999);
+    printf("\nACK enviados: %llu, sin concurrencia libre: %lu, errores de envío: %lu, respuestas sueltas: %lu\n",
+           (unsigned long long)lg->acks, lg->throttled, lg->send_errors, lg->stray);
+
+    double tps = completed / seconds;
+    printf("RESULT tps=%.0f p50_us=%llu p99_us=%llu p999_us=%llu max_us=%llu completed=%lu timeouts=%lu failed=%lu\n",
+           tps, (unsigned long long)p50, (unsigned long long)p99, (unsigned long long)p999,
+           (unsigned long long)all->max, completed, timeouts, failed);
+    int ret = 0;
+    if (lg->cfg.max_p99_us && p99 > lg->cfg.max_p99_us) {
+        printf("REGRESIÓN: p99 %llu us > %llu us\n", (unsigned long long)p99, (unsigned long long)lg->cfg.max_p99_us);
+        ret = 1;
+    }
+    if (lg->cfg.min_tps > 0 && tps < lg->cfg.min_tps) {
+        printf("REGRESIÓN: %.0f transacciones/s < %.0f\n", tps, lg->cfg.min_tps);
+        ret = 1;
+    }
+    free(all);
+    return ret;
+}
+
+static int parse_mix(config_t *cfg, const char *spec)
+{
+    // "invite=40,message=40,register=10,bye=10": pesos relativos, los métodos omitidos pesan 0
+    char copy[256];
+    if (strlen(spec) >= sizeof(copy)) return -1;
+    strcpy(copy, spec);
+    memset(cfg->weights, 0, sizeof(cfg->weights));
+    for (char *save, *item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(item, '=');
+        int m;
+        if (!eq) return -1;
+        *eq = '\0';
+        for (m = 0; m < MIX_METHODS && strcasecmp(item, method_names[m]) != 0; ++m);
+        if (m == MIX_METHODS) return -1;
+        cfg->weights[m] = (unsigned)atoi(eq + 1);
+    }
+    unsigned sum = 0;
+    for (int m = 0; m < MIX_METHODS; ++m) sum += cfg->weights[m];
+    return sum > 0 && sum <= 10000 ? 0 : -1;
+}
+
+static int parse_server(config_t *cfg, const char *spec)
+{
+    // "ip[:puerto]"
+    char host[64];
+    const char *colon = strrchr(spec, ':');
+    size_t host_len = colon ? (size_t)(colon - spec) : strlen(spec);
+    if (host_len >= sizeof(host)) return -1;
+    memcpy(host, spec, host_len);
+    host[host_len] = '\0';
+    cfg->server.sin_family = AF_INET;
+    cfg->server.sin_port = htons(colon ? atoi(colon + 1) : 5060);
+    return inet_pton(AF_INET, host, &cfg->server.sin_addr) == 1 ? 0 : -1;
+}
+
+static char *read_file(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    char *data = malloc(SIP_MAX_REQUEST + 1);
+    *len = data ? fread(data, 1, SIP_MAX_REQUEST, f) : 0;
+    fclose(f);
+    if (data && (*len == 0 || *len == SIP_MAX_REQUEST)) {
+        free(data);
+        return NULL;
+    }
+    if (data) data[*len] = '\0';
+    return data;
+}
+
+static int open_socket(loadgen_t *lg, lg_socket_t *s, const char *base, size_t base_len)
+{
+    /*
+    Socket UDP conectado al servidor: send y recv sin dirección, y el kernel solo entrega
+    respuestas del servidor. Con varios sockets los paquetes llegan desde varios puertos,
+    y un servidor con SO_REUSEPORT los reparte entre sus workers.
+    */
+    struct sockaddr_in local = {0};
+    socklen_t local_len = sizeof(local);
+    int bufsize = 4 << 20;
+    s->lg = lg;
+    s->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (s->fd < 0) return -1;
+    setsockopt(s->fd, SOL_SOCKET, SO_RCVBUF, &bufsize, sizeof(bufsize));
+    setsockopt(s->fd, SOL_SOCKET, SO_SNDBUF, &bufsize, sizeof(bufsize));
+    if (connect(s->fd, (struct sockaddr *)&lg->cfg.server, sizeof(lg->cfg.server)) < 0 ||
+        getsockname(s->fd, (struct sockaddr *)&local, &local_len) < 0) return -1;
+    s->port = ntohs(local.sin_port);
+    for (int m = 0; m < METHOD_COUNT; ++m) {
+        if (build_template(&s->templates[m], base, base_len, m, s->port) < 0) {
+            fprintf(stderr, "Plantilla inválida para %s\n", method_names[m]);
+            return -1;
+        }
+    }
+    s->buffers = malloc(SEND_BATCH * sizeof(*s->buffers));
+    if (!s->buffers) return -1;
+    for (int i = 0; i < SEND_BATCH; ++i) {
+        s->batch[i].msg_hdr.msg_iov = &s->iov[i];
+        s->batch[i].msg_hdr.msg_iovlen = 1;
+    }
+    if (su_wait_create(s->wait, s->fd, SU_WAIT_IN) < 0 ||
+        su_root_register(lg->root, s->wait, socket_readable, s, 0) < 0) return -1;
+    return 0;
+}
+
+static int setup(loadgen_t *lg)
+{
+    /*
+    Prepara ranuras, tabla de mezcla, sockets y plantillas antes de empezar a medir.
+    La tabla de mezcla tiene una entrada por unidad de peso y se baraja una vez:
+    elegir el método de cada transacción es solo avanzar un índice.
+    */
+    config_t *cfg = &lg->cfg;
+    size_t base_len;
+    char *base = read_file(cfg->template_path, &base_len);
+    if (!base) {
+        fprintf(stderr, "No se pudo leer la plantilla %s\n", cfg->template_path);
+        return -1;
+    }
+    lg->rng = (now_ns() ^ ((uint64_t)getpid() << 32)) | 1;
+    lg->run_id = (xorshift(&lg->rng) & 0xffffff) << 40; // Call-ID únicos entre ejecuciones
+    lg->txns = calloc(cfg->concurrency, sizeof(txn_t));
+    lg->free_slots = malloc(cfg->concurrency * sizeof(uint32_t));
+    lg->dialogs = malloc(DIALOG_RING * sizeof(dialog_t));
+    lg->socks = calloc(cfg->sockets, sizeof(lg_socket_t));
+    for (int m = 0; m < MIX_METHODS; ++m) lg->mix_len += cfg->weights[m];
+    lg->mix = malloc(lg->mix_len);
+    if (!lg->txns || !lg->free_slots || !lg->dialogs || !lg->socks || !lg->mix) {
+        free(base);
+        return -1;
+    }
+    for (unsigned i = 0; i < cfg->concurrency; ++i) lg->free_slots[i] = cfg->concurrency - 1 - i;
+    lg->free_count = cfg->concurrency;
+    unsigned pos = 0;
+    for (int m = 0; m < MIX_METHODS; ++m) {
+        for (unsigned w = 0; w < cfg->weights[m]; ++w) lg->mix[pos++] = (unsigned char)m;
+    }
+    for (unsigned i = lg->mix_len - 1; i > 0; --i) {
+        unsigned j = xorshift(&lg->rng) % (i + 1);
+        unsigned char tmp = lg->mix[i];
+        lg->mix[i] = lg->mix[j];
+        lg->mix[j] = tmp;
+    }
+    for (unsigned i = 0; i < cfg->sockets; ++i) {
+        if (open_socket(lg, &lg->socks[i], base, base_len) < 0) {
+            perror("socket");
+            free(base);
+            return -1;
+        }
+    }
+    free(base);
+    lg->timer = su_timer_create(su_root_task(lg->root), TICK_MS);
+    return lg->timer ? 0 : -1;
+}
+
+static void on_sigint(int sig)
+{
+    (void)sig;
+    interrupted++; // el segundo Ctrl+C no espera a las transacciones en curso
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+            "Uso: %s [opciones]\n"
+            "  -s ip[:puerto]  servidor (127.0.0.1:5060)\n"
+            "  -r n            peticiones por segundo, 0 = sin límite (1000)\n"
+            "  -c n            transacciones en curso como máximo (1000)\n"
+            "  -d s            duración en segundos (10)\n"
+            "  -n n            número de transacciones (sin límite)\n"
+            "  -m mezcla       pesos por método (invite=40,message=40,register=10,bye=10)\n"
+            "  -p n            sockets de origen (4)\n"
+            "  -T ms           timeout de transacción (%d)\n"
+            "  -f fichero      plantilla base (docs/invite.sip)\n"
+            "  -P us           falla si el p99 supera este valor\n"
+            "  -M n            falla si se completan menos transacciones por segundo\n",
+            prog, 64 * SIP_T1);
+}
+
+int main(int argc, char *argv[])
+{
+    static loadgen_t lg;
+    config_t *cfg = &lg.cfg;
+    int opt, ret;
+
+    cfg->template_path = "docs/invite.sip";
+    cfg->rate = 1000;
+    cfg->concurrency = 1000;
+    cfg->sockets = 4;
+    cfg->timeout_ms = 64 * SIP_T1;
+    parse_mix(cfg, "invite=40,message=40,register=10,bye=10");
+    parse_server(cfg, "127.0.0.1:5060");
+
+    while ((opt = getopt(argc, argv, "s:r:c:d:n:m:p:T:f:P:M:h")) != -1) {
+        switch (opt) {
+        case 's':
+            if (parse_server(cfg, optarg) < 0) {
+                fprintf(stderr, "Servidor inválido: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'r': cfg->rate = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'c': cfg->concurrency = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'd': cfg->duration = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'n': cfg->total = strtoul(optarg, NULL, 10); break;
+        case 'm':
+            if (parse_mix(cfg, optarg) < 0) {
+                fprintf(stderr, "Mezcla inválida: %s\n", optarg);
+                return EXIT_FAILURE;
+            }
+            break;
+        case 'p': cfg->sockets = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'T': cfg->timeout_ms = (unsigned)strtoul(optarg, NULL, 10); break;
+        case 'f': cfg->template_path = optarg; break;
+        case 'P': cfg->max_p99_us = strtoull(optarg, NULL, 10); break;
+        case 'M': cfg->min_tps = atof(optarg); break;
+        default:
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (cfg->concurrency < 1 || cfg->concurrency > (1u << 24) || cfg->sockets < 1 || cfg->sockets > MAX_SOCKETS ||
+        cfg->timeout_ms < 1) {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    if (!cfg->duration && !cfg->total) cfg->duration = 10; // con -n y sin -d: hasta completarlas
+
+    su_init();
+    lg.root = su_root_create(&lg);
+    if (!lg.root || setup(&lg) < 0) {
+        fprintf(stderr, "No se pudo preparar el generador\n");
+        return EXIT_FAILURE;
+    }
+    signal(SIGINT, on_sigint);
+
+    printf("loadgen -> %s:%u ritmo=%u/s concurrencia=%u sockets=%u mezcla=", inet_ntoa(cfg->server.sin_addr),
+           ntohs(cfg->server.sin_port), cfg->rate, cfg->concurrency, cfg->sockets);
+    for (int m = 0; m < MIX_METHODS; ++m) printf("%s%s=%u", m ? "," : "", method_names[m], cfg->weights[m]);
+    printf("\n");
+
+    lg.start_ns = lg.last_scan_ns = lg.last_report_ns = now_ns();
+    su_timer_run(lg.timer, tick, NULL);
+    fill(&lg, lg.start_ns);
+    su_root_run(lg.root);
+
+    ret = report(&lg);
+
+    su_timer_destroy(lg.timer);
+    for (unsigned i = 0; i < cfg->sockets; ++i) {
+        su_root_unregister(lg.root, lg.socks[i].wait, socket_readable, &lg.socks[i]);
+        close(lg.socks[i].fd);
+        free(lg.socks[i].buffers);
+    }
+    su_root_destroy(lg.root);
+    su_deinit();
+
+    return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,220 @@
+#ifndef SIP_LOG_H
+#define SIP_LOG_H
+
+/*
+Log asíncrono para los callbacks de nua: el hilo del su_root nunca escribe en la terminal.
+- Cada hilo que registra tiene su propio anillo sin locks (un productor, un consumidor)
+  de registros binarios de 64 bytes: instante, evento, status, handle, un texto fijo
+  (literal) y hasta SIP_LOG_TEXT-1 bytes copiados de un texto variable (frase, remitente...).
+- Registrar cuesta leer el reloj, copiar el registro y publicar el índice: sin llamadas al
+  sistema ni formateo. El nivel se filtra antes de tocar el anillo, y si el anillo está lleno
+  el registro se descarta y se cuenta; el bucle nunca espera al disco o a la terminal.
+- Un hilo formateador vacía todos los anillos por lotes, da formato a los registros y los
+  escribe con una sola llamada write() por lote. Informa de los descartados.
+- Dentro de un hilo el orden es exacto; entre hilos los lotes pueden intercalarse.
+*/
+
+#include <sofia-sip/nua.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SIP_LOG_RING 4096            // registros por hilo (potencia de dos)
+#define SIP_LOG_TEXT 32
+#define SIP_LOG_BATCH (64 * 1024)    // bytes formateados por write()
+#define SIP_LOG_IDLE_US 1000         // espera del formateador cuando no hay nada que escribir
+#define SIP_LOG_NO_EVENT 0xffff
+
+enum { SIP_LOG_ERROR, SIP_LOG_WARN, SIP_LOG_INFO, SIP_LOG_DEBUG };
+static const char *const sip_log_level_names[] = { "ERROR", "WARN", "INFO", "DEBUG" };
+
+typedef struct {
+    uint64_t ts_ns;              // CLOCK_REALTIME
+    const void *handle;
+    const char *what;            // literal: no se copia
+    int32_t status;
+    uint16_t event;              // nua_event_t o SIP_LOG_NO_EVENT
+    uint8_t level;
+    uint8_t text_len;
+    char text[SIP_LOG_TEXT];
+} sip_log_record_t;
+
+typedef struct sip_log_ring_s {
+    struct sip_log_ring_s *next;
+    _Atomic unsigned long dropped;         // solo lo escribe el productor
+    _Alignas(64) _Atomic uint64_t head;    // siguiente registro a escribir (productor)
+    uint64_t tail_cache;                   // última cola vista por el productor
+    _Alignas(64) _Atomic uint64_t tail;    // siguiente registro a formatear (consumidor)
+    sip_log_record_t records[SIP_LOG_RING];
+} sip_log_ring_t;
+
+static _Atomic(sip_log_ring_t *) sip_log_rings;
+static __thread sip_log_ring_t *sip_log_self;
+static _Atomic int sip_log_level = -1;     // -1 hasta sip_log_init: no se registra nada
+static _Atomic int sip_log_stop;
+static int sip_log_fd = -1;
+static pthread_t sip_log_thread;
+
+static inline sip_log_ring_t *sip_log_ring(void)
+{
+    // El anillo del hilo actual; el primero se enlaza a la lista con un CAS
+    sip_log_ring_t *r = sip_log_self;
+    if (r) return r;
+    if (posix_memalign((void **)&r, 64, sizeof(*r)) != 0) return NULL;
+    memset(r, 0, sizeof(*r));
+    r->next = atomic_load_explicit(&sip_log_rings, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&sip_log_rings, &r->next, r,
+                                                  memory_order_release, memory_order_relaxed));
+    return sip_log_self = r;
+}
+
+static inline void sip_log_text(int level, int event, int status, const void *nh, const char *what, const char *text)
+{
+    /*
+    Registra un evento. 'what' debe ser un literal (se guarda el puntero); 'text' se copia
+    truncado a SIP_LOG_TEXT-1 bytes y puede ser NULL.
+    */
+    if (level > atomic_load_explicit(&sip_log_level, memory_order_relaxed)) return;
+    sip_log_ring_t *r = sip_log_ring();
+    if (!r) return;
+    uint64_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    if (head - r->tail_cache >= SIP_LOG_RING) {
+        r->tail_cache = atomic_load_explicit(&r->tail, memory_order_acquire);
+        if (head - r->tail_cache >= SIP_LOG_RING) {
+            atomic_store_explicit(&r->dropped, atomic_load_explicit(&r->dropped, memory_order_relaxed) + 1,
+                                  memory_order_relaxed);
+            return;
+        }
+    }
+    sip_log_record_t *rec = &r->records[head & (SIP_LOG_RING - 1)];
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    rec->ts_ns = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    rec->handle = nh;
+    rec->what = what;
+    rec->status = status;
+    rec->event = (uint16_t)event;
+    rec->level = (uint8_t)level;
+    size_t len = text ? strnlen(text, SIP_LOG_TEXT - 1) : 0;
+    memcpy(rec->text, text ? text : "", len);
+    rec->text_len = (uint8_t)len;
+    atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+static inline void sip_log_event(int level, int event, int status, const void *nh, const char *what)
+{
+    sip_log_text(level, event, status, nh, what, NULL);
+}
+
+static inline size_t sip_log_format(char *buf, size_t size, const sip_log_record_t *rec)
+{
+    // "hh:mm:ss.uuuuuu NIVEL evento status nh=... qué texto"; la hora local se calcula una vez por segundo
+    static time_t last_sec = -1;
+    static char clock_text[16];
+    time_t sec = (time_t)(rec->ts_ns / 1000000000ULL);
+    if (sec != last_sec) {
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        strftime(clock_text, sizeof(clock_text), "%H:%M:%S", &tm);
+        last_sec = sec;
+    }
+    int n = snprintf(buf, size, "%s.%06u %-5s %s %d nh=%p %s%s%.*s\n", clock_text,
+                     (unsigned)(rec->ts_ns % 1000000000ULL / 1000), sip_log_level_names[rec->level],
+                     rec->event == SIP_LOG_NO_EVENT ? "-" : nua_event_name((nua_event_t)rec->event),
+                     rec->status, rec->handle, rec->what ? rec->what : "", rec->text_len ? " " : "",
+                     (int)rec->text_len, rec->text);
+    return n < 0 ? 0 : (size_t)n < size ? (size_t)n : size - 1;
+}
+
+static inline void sip_log_write(const char *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(sip_log_fd, buf, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return; // sin salida no hay a quién avisar
+        buf += n;
+        len -= n;
+    }
+}
+
+static inline void *sip_log_formatter(void *arg)
+{
+    /*
+    Recorre los anillos, formatea lo publicado en un búfer y lo escribe de una vez;
+    la cola de cada anillo se libera después de formatear sus registros. Cuando crecen
+    los descartados escribe un aviso. Al pedir la parada vacía todo antes de salir.
+    */
+    static char buf[SIP_LOG_BATCH];
+    unsigned long reported = 0;
+    (void)arg;
+    for (;;) {
+        int stopping = atomic_load_explicit(&sip_log_stop, memory_order_acquire);
+        size_t len = 0, formatted = 0;
+        unsigned long dropped = 0;
+        for (sip_log_ring_t *r = atomic_load_explicit(&sip_log_rings, memory_order_acquire); r; r = r->next) {
+            uint64_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+            uint64_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+            while (tail != head) {
+                if (SIP_LOG_BATCH - len < 256) {
+                    sip_log_write(buf, len);
+                    len = 0;
+                }
+                len += sip_log_format(buf + len, SIP_LOG_BATCH - len, &r->records[tail & (SIP_LOG_RING - 1)]);
+                tail++;
+                formatted++;
+            }
+            atomic_store_explicit(&r->tail, tail, memory_order_release);
+            dropped += atomic_load_explicit(&r->dropped, memory_order_relaxed);
+        }
+        if (dropped != reported) {
+            if (SIP_LOG_BATCH - len < 256) {
+                sip_log_write(buf, len);
+                len = 0;
+            }
+            len += snprintf(buf + len, SIP_LOG_BATCH - len, "sip_log: %lu registros descartados (anillo lleno)\n",
+                            dropped - reported);
+            reported = dropped;
+        }
+        if (len) sip_log_write(buf, len);
+        if (!formatted) {
+            if (stopping) break;
+            struct timespec idle = { 0, SIP_LOG_IDLE_US * 1000 };
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+static inline int sip_log_init(int fd, int level)
+{
+    /*
+    Arranca el formateador hacia 'fd' con el nivel máximo 'level';
+    $SIP_LOG_LEVEL (error, warn, info, debug) lo sustituye. Retorna -1 si no pudo arrancar.
+    */
+    const char *env = getenv("SIP_LOG_LEVEL");
+    for (int l = SIP_LOG_ERROR; env && l <= SIP_LOG_DEBUG; ++l) {
+        if (strcasecmp(env, sip_log_level_names[l]) == 0) level = l;
+    }
+    sip_log_fd = fd;
+    atomic_store(&sip_log_stop, 0);
+    if (pthread_create(&sip_log_thread, NULL, sip_log_formatter, NULL) != 0) return -1;
+    atomic_store(&sip_log_level, level);
+    return 0;
+}
+
+static inline void sip_log_shutdown(void)
+{
+    // Deja de aceptar registros, espera a que el formateador escriba los pendientes y lo detiene
+    if (atomic_exchange(&sip_log_level, -1) < 0) return;
+    atomic_store_explicit(&sip_log_stop, 1, memory_order_release);
+    pthread_join(sip_log_thread, NULL);
+}
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef SIP_METRICS_H
+#define SIP_METRICS_H
+
+/*
+Métricas de los callbacks de nua, sin locks y por hilo:
+- Cada hilo que despacha eventos (el de su su_root) escribe solo en su propio bloque,
+  creado en su primer evento y enlazado a una lista global que solo crece.
+- Los contadores tienen un único escritor: se incrementan con load y store relajados,
+  sin instrucciones atómicas de lectura-modificación ni barreras; un lector de otro hilo
+  ve cada contador entero, quizá con algún evento de retraso.
+- Histogramas log-lineales al estilo HDR (en µs) para INVITE→180, INVITE→200 y MESSAGE→2xx:
+  la petición se anota con sip_metrics_request() al enviarla, y la respuesta en el callback
+  se asocia por su handle.
+- Un hilo aparte atiende un socket Unix: cada conexión recibe un volcado de texto con la
+  suma de todos los hilos, sin detener ningún bucle (nc -U /tmp/demo5.metrics).
+*/
+
+#include <sofia-sip/nua.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define SIP_METRICS_EVENTS 128                  // cubre todos los nua_event_t
+#define SIP_METRICS_SUB_BITS 6                  // 64 sub-cubetas por potencia de dos: error < 1.6%
+#define SIP_METRICS_SUB (1u << SIP_METRICS_SUB_BITS)
+#define SIP_METRICS_BUCKETS (36 * SIP_METRICS_SUB) // hasta 2^35 µs
+#define SIP_METRICS_PENDING 1024                // peticiones en curso por hilo (potencia de dos)
+#define SIP_METRICS_DUMP_MAX 8192
+
+enum { SIP_METRICS_INVITE_180, SIP_METRICS_INVITE_200, SIP_METRICS_MESSAGE_2XX, SIP_METRICS_HISTS };
+enum { SIP_METRICS_INVITE = 1, SIP_METRICS_MESSAGE };   // tipos de petición que se miden
+
+typedef _Atomic unsigned long sip_metrics_counter_t;
+
+typedef struct {
+    sip_metrics_counter_t counts[SIP_METRICS_BUCKETS];
+    _Atomic uint64_t max;
+} sip_metrics_hist_t;
+
+// Petición enviada a la espera de respuesta; la tabla es del hilo dueño y no se comparte
+typedef struct {
+    const void *nh;
+    uint64_t start_ns;
+    uint8_t kind;
+    uint8_t ringing;             // ya se midió el 180 de este INVITE
+} sip_metrics_pending_t;
+
+typedef struct sip_metrics_s {
+    struct sip_metrics_s *next;
+    sip_metrics_counter_t events[SIP_METRICS_EVENTS];
+    sip_metrics_counter_t classes[7];   // por status / 100
+    sip_metrics_counter_t untracked;    // respuestas sin petición anotada o con la tabla llena
+    sip_metrics_hist_t hist[SIP_METRICS_HISTS];
+    sip_metrics_pending_t pending[SIP_METRICS_PENDING];
+} sip_metrics_t;
+
+static const char *const sip_metrics_hist_names[SIP_METRICS_HISTS] = { "invite_180", "invite_200", "message_2xx" };
+
+static _Atomic(sip_metrics_t *) sip_metrics_threads;
+static __thread sip_metrics_t *sip_metrics_self;
+static int sip_metrics_listener = -1;
+static char sip_metrics_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static inline void sip_metrics_inc(sip_metrics_counter_t *c)
+{
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+static inline uint64_t sip_metrics_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline sip_metrics_t *sip_metrics_thread(void)
+{
+    // El bloque del hilo actual; el primero se enlaza a la lista con un CAS
+    sip_metrics_t *m = sip_metrics_self;
+    if (m) return m;
+    m = calloc(1, sizeof(*m));
+    if (!m) return NULL;
+    m->next = atomic_load_explicit(&sip_metrics_threads, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(&sip_metrics_threads, &m->next, m,
+                                                  memory_order_release, memory_order_relaxed));
+    return sip_metrics_self = m;
+}
+
+static inline unsigned sip_metrics_bucket(uint64_t v)
+{
+    if (v < SIP_METRICS_SUB) return (unsigned)v;
+    int shift = 63 - __builtin_clzll(v) - SIP_METRICS_SUB_BITS;
+    unsigned index = ((unsigned)(shift + 1) << SIP_METRICS_SUB_BITS) + (unsigned)((v >> shift) - SIP_METRICS_SUB);
+    return index < SIP_METRICS_BUCKETS ? index : SIP_METRICS_BUCKETS - 1;
+}
+
+static inline uint64_t sip_metrics_bucket_value(unsigned index)
+{
+    // Punto medio de la cubeta
+    unsigned range = index >> SIP_METRICS_SUB_BITS;
+    if (range == 0) return index;
+    uint64_t low = (uint64_t)((index & (SIP_METRICS_SUB - 1)) + SIP_METRICS_SUB) << (range - 1);
+    return low + ((1ULL << (range - 1)) >> 1);
+}
+
+static inline void sip_metrics_record(sip_metrics_hist_t *h, uint64_t us)
+{
+    sip_metrics_inc(&h->counts[sip_metrics_bucket(us)]);
+    if (us > atomic_load_explicit(&h->max, memory_order_relaxed)) {
+        atomic_store_explicit(&h->max, us, memory_order_relaxed);
+    }
+}
+
+static inline size_t sip_metrics_slot(const void *nh, int kind)
+{
+    uint64_t h = ((uint64_t)(uintptr_t)nh ^ (uint64_t)kind) * 0x9e3779b97f4a7c15ULL;
+    return (size_t)(h >> 32) & (SIP_METRICS_PENDING - 1);
+}
+
+static inline sip_metrics_pending_t *sip_metrics_find(sip_metrics_t *m, const void *nh, int kind)
+{
+    for (size_t i = sip_metrics_slot(nh, kind), n = 0; n < SIP_METRICS_PENDING; i = (i + 1) & (SIP_METRICS_PENDING - 1), ++n) {
+        sip_metrics_pending_t *p = &m->pending[i];
+        if (!p->kind) return NULL;
+        if (p->nh == nh && p->kind == kind) return p;
+    }
+    return NULL;
+}
+
+static inline void sip_metrics_forget(sip_metrics_t *m, sip_metrics_pending_t *p)
+{
+    /*
+    Borra una entrada de la tabla de sondeo lineal desplazando hacia atrás las que
+    le siguen en su racha, así las búsquedas no necesitan marcas de borrado.
+    */
+    size_t hole = p - m->pending;
+    size_t i = hole;
+    for (size_t n = 1; n < SIP_METRICS_PENDING; ++n) { // con la tabla llena no hay hueco que la corte
+        i = (i + 1) & (SIP_METRICS_PENDING - 1);
+        sip_metrics_pending_t *q = &m->pending[i];
+        if (!q->kind) break;
+        size_t home = sip_metrics_slot(q->nh, q->kind);
+        // q puede ocupar el hueco si su posición ideal no está entre el hueco y ella
+        if (((i - home) & (SIP_METRICS_PENDING - 1)) >= ((i - hole) & (SIP_METRICS_PENDING - 1))) {
+            m->pending[hole] = *q;
+            hole = i;
+        }
+    }
+    m->pending[hole].kind = 0;
+}
+
+static inline void sip_metrics_request(nua_handle_t *nh, int kind)
+{
+    /* Anota el envío de un INVITE o MESSAGE por el handle 'nh'; llamarla justo antes de nua_invite/nua_message. */
+    sip_metrics_t *m = sip_metrics_thread();
+    if (!m || !nh) return;
+    sip_metrics_pending_t *p = sip_metrics_find(m, nh, kind);
+    if (!p) {
+        size_t i = sip_metrics_slot(nh, kind), n = 0;
+        while (m->pending[i].kind && n++ < SIP_METRICS_PENDING) i = (i + 1) & (SIP_METRICS_PENDING - 1);
+        if (m->pending[i].kind) {
+            sip_metrics_inc(&m->untracked); // tabla llena: esta petición no se mide
+            return;
+        }
+        p = &m->pending[i];
+        p->nh = nh;
+        p->kind = (uint8_t)kind;
+    }
+    p->start_ns = sip_metrics_now_ns();
+    p->ringing = 0;
+}
+
+static inline void sip_metrics_event(nua_event_t event, int status, nua_handle_t *nh)
+{
+    /*
+    Primera línea de cada callback de nua: cuenta el evento y la clase de su status,
+    y si es la respuesta a un INVITE o MESSAGE anotado, registra su latencia.
+    Un INVITE mide su primer 180 y su 2xx; cualquier respuesta final cierra la petición.
+    */
+    sip_metrics_t *m = sip_metrics_thread();
+    if (!m) return;
+    if ((unsigned)event < SIP_METRICS_EVENTS) sip_metrics_inc(&m->events[event]);
+    if (status >= 100 && status < 700) sip_metrics_inc(&m->classes[status / 100]);
+
+    int kind = event == nua_r_invite ? SIP_METRICS_INVITE : event == nua_r_message ? SIP_METRICS_MESSAGE : 0;
+    if (!kind || status < 100 || !nh) return;
+    sip_metrics_pending_t *p = sip_metrics_find(m, nh, kind);
+    if (!p) {
+        if (status >= 200) sip_metrics_inc(&m->untracked);
+        return;
+    }
+    uint64_t us = (sip_metrics_now_ns() - p->start_ns) / 1000;
+    if (status < 200) {
+        if (status == 180 && !p->ringing) {
+            sip_metrics_record(&m->hist[SIP_METRICS_INVITE_180], us);
+            p->ringing = 1;
+        }
+        return;
+    }
+    if (status < 300) {
+        sip_metrics_record(&m->hist[kind == SIP_METRICS_INVITE ? SIP_METRICS_INVITE_200 : SIP_METRICS_MESSAGE_2XX], us);
+    }
+    sip_metrics_forget(m, p);
+}
+
+static inline uint64_t sip_metrics_percentile(const unsigned long *counts, unsigned long total, uint64_t max, double pct)
+{
+    unsigned long rank = (unsigned long)(pct / 100.0 * total + 0.5), seen = 0;
+    if (rank < 1) rank = 1;
+    for (unsigned i = 0; i < SIP_METRICS_BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            uint64_t v = sip_metrics_bucket_value(i);
+            return v < max ? v : max;
+        }
+    }
+    return max;
+}
+
+static inline size_t sip_metrics_snapshot(char *buf, size_t size)
+{
+    /*
+    Suma los bloques de todos los hilos con lecturas relajadas y escribe un volcado de texto:
+    eventos distintos de cero por nombre, clases de status y, por histograma,
+    número de muestras y percentiles en µs. Retorna la longitud escrita.
+    */
+    static __thread unsigned long counts[SIP_METRICS_BUCKETS];
+    unsigned long events[SIP_METRICS_EVENTS] = {0}, classes[7] = {0}, untracked = 0;
+    unsigned threads = 0;
+    size_t len = 0;
+#define SIP_METRICS_PRINT(...) \
+    do { if (len < size) len += snprintf(buf + len, size - len, __VA_ARGS__); } while (0)
+
+    sip_metrics_t *head = atomic_load_explicit(&sip_metrics_threads, memory_order_acquire);
+    for (sip_metrics_t *m = head; m; m = m->next) {
+        threads++;
+        for (int e = 0; e < SIP_METRICS_EVENTS; ++e) events[e] += atomic_load_explicit(&m->events[e], memory_order_relaxed);
+        for (int c = 0; c < 7; ++c) classes[c] += atomic_load_explicit(&m->classes[c], memory_order_relaxed);
+        untracked += atomic_load_explicit(&m->untracked, memory_order_relaxed);
+    }
+    SIP_METRICS_PRINT("threads %u\n", threads);
+    for (int e = 0; e < SIP_METRICS_EVENTS; ++e) {
+        if (events[e]) SIP_METRICS_PRINT("event %s %lu\n", nua_event_name((nua_event_t)e), events[e]);
+    }
+    for (int c = 1; c < 7; ++c) SIP_METRICS_PRINT("status %dxx %lu\n", c, classes[c]);
+    for (int h = 0; h < SIP_METRICS_HISTS; ++h) {
+        unsigned long total = 0;
+        uint64_t max = 0;
+        memset(counts, 0, sizeof(counts));
+        for (sip_metrics_t *m = head; m; m = m->next) {
+            for (unsigned i = 0; i < SIP_METRICS_BUCKETS; ++i) {
+                unsigned long n = atomic_load_explicit(&m->hist[h].counts[i], memory_order_relaxed);
+                counts[i] += n;
+                total += n;
+            }
+            uint64_t hmax = atomic_load_explicit(&m->hist[h].max, memory_order_relaxed);
+            if (hmax > max) max = hmax;
+        }
+        SIP_METRICS_PRINT("latency %s count=%lu p50_us=%llu p99_us=%llu p999_us=%llu max_us=%llu\n",
+                          sip_metrics_hist_names[h], total,
+                          (unsigned long long)(total ? sip_metrics_percentile(counts, total, max, 50) : 0),
+                          (unsigned long long)(total ? sip_metrics_percentile(counts, total, max, 99) : 0),
+                          (unsigned long long)(total ? sip_metrics_percentile(counts, total, max, 99.9) : 0),
+                          (unsigned long long)max);
+    }
+    SIP_METRICS_PRINT("untracked %lu\n", untracked);
+#undef SIP_METRICS_PRINT
+    return len < size ? len : size - 1;
+}
+
+static inline void *sip_metrics_admin(void *arg)
+{
+    // Hilo del socket de administración: un volcado por conexión
+    static char buf[SIP_METRICS_DUMP_MAX];
+    int listener = (int)(intptr_t)arg;
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break; // socket cerrado por sip_metrics_shutdown
+        }
+        size_t len = sip_metrics_snapshot(buf, sizeof(buf)), off = 0;
+        while (off < len) {
+            ssize_t n = send(fd, buf + off, len - off, MSG_NOSIGNAL);
+            if (n <= 0) break;
+            off += n;
+        }
+        close(fd);
+    }
+    return NULL;
+}
+
+static inline int sip_metrics_init(const char *path)
+{
+    /*
+    Abre el socket de administración en 'path' (o en $SIP_METRICS_SOCKET) y arranca su hilo.
+    Sin socket las métricas se siguen contando; retorna -1 para avisar.
+    */
+    const char *env = getenv("SIP_METRICS_SOCKET");
+    struct sockaddr_un addr = {0};
+    pthread_t thread;
+    if (env && *env) path = env;
+    if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    strcpy(sip_metrics_path, path);
+
+    sip_metrics_listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sip_metrics_listener < 0) return -1;
+    unlink(path);
+    if (bind(sip_metrics_listener, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(sip_metrics_listener, 16) < 0 ||
+        pthread_create(&thread, NULL, sip_metrics_admin, (void *)(intptr_t)sip_metrics_listener) != 0) {
+        close(sip_metrics_listener);
+        sip_metrics_listener = -1;
+        return -1;
+    }
+    pthread_detach(thread);
+    return 0;
+}
+
+static inline void sip_metrics_shutdown(FILE *out)
+{
+    // Cierra el socket de administración y, si se pide, deja un último volcado en 'out'
+    if (sip_metrics_listener >= 0) {
+        shutdown(sip_metrics_listener, SHUT_RDWR); // despierta el accept del hilo de administración
+        close(sip_metrics_listener);
+        sip_metrics_listener = -1;
+        unlink(sip_metrics_path);
+    }
+    if (out) {
+        char buf[SIP_METRICS_DUMP_MAX];
+        sip_metrics_snapshot(buf, sizeof(buf));
+        fputs(buf, out);
+    }
+}
+
+#endif
@@ -1,72 +1,568 @@
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-#define MAX_CACHE_SIZE 10
+#define CACHE_SHARDS 16                // Número de shards, potencia de dos
+#define CACHE_SHARD_INITIAL_CAPACITY 8 // Slots iniciales por shard, potencia de dos
+#define CACHE_KEY_SIZE 50
+#define CACHE_VALUE_SIZE 100
+#define CACHE_LINE_SIZE 64
+#define CACHE_STATS_SLOTS 64           // contadores por hilo, sumados en cache_stats
+#define CACHE_SWEEP_BATCH 256          // slots revisados por cada toma del write lock en el barrido
+
+#define BENCH_KEYS 100000
+#define BENCH_MAX_THREADS 32
+#define BENCH_SECONDS 1
+
+#define DEMO_TTL_MS 1500        // las entradas del ejemplo caducan a los 1,5 s
+#define DEMO_SWEEP_INTERVAL_MS 500
+
+typedef enum {
+    CACHE_READ_RWLOCK,  // los lectores toman el read lock del shard
+    CACHE_READ_SEQLOCK  // los lectores no toman locks ni escriben memoria compartida
+} cache_read_mode_t;
 
 typedef struct {
-    char key[50];
-    char value[100];
+    uint64_t hash;       // 0 indica slot libre
+    int64_t expires_at;  // ms en CLOCK_MONOTONIC; 0 = sin caducidad
+    uint8_t referenced;  // bit de referencia del algoritmo CLOCK
+    char key[CACHE_KEY_SIZE];
+    char value[CACHE_VALUE_SIZE];
 } cache_entry_t;
 
+typedef struct cache_table {
+    size_t capacity;            // potencia de dos
+    struct cache_table *retired; // tablas antiguas pendientes de liberar
+    cache_entry_t slots[];
+} cache_table_t;
+
+typedef struct {
+    pthread_rwlock_t rwlock;        // serializa a los escritores; en modo rwlock, también a los lectores
+    atomic_uint seq;                // impar mientras un escritor modifica el shard
+    _Atomic(cache_table_t *) table; // tabla de direccionamiento abierto (sondeo lineal)
+    atomic_size_t count;
+    size_t max_capacity;            // límite de slots según el presupuesto de memoria; 0 = sin límite
+    size_t hand;                    // manecilla del CLOCK, solo la mueven los escritores
+} __attribute__((aligned(CACHE_LINE_SIZE))) cache_shard_t;
+
+typedef struct {
+    atomic_ulong hits;
+    atomic_ulong misses;
+    atomic_ulong evictions;
+    atomic_ulong expirations;
+} __attribute__((aligned(CACHE_LINE_SIZE))) cache_stats_slot_t;
+
+typedef struct {
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;   // entradas vivas expulsadas por el CLOCK
+    unsigned long expirations; // entradas eliminadas por TTL (barrido o expulsión)
+    size_t entries;
+    size_t bytes;              // memoria de las tablas vivas
+} cache_stats_t;
+
 typedef struct {
-    cache_entry_t cache[MAX_CACHE_SIZE]; // array de 10 posiciones, max 10 nodes
-    int count;
-    pthread_rwlock_t rwlock;
+    cache_shard_t shards[CACHE_SHARDS]; // cada shard en su propia línea de caché
+    cache_read_mode_t read_mode;
+    cache_stats_slot_t stats[CACHE_STATS_SLOTS];
+
+    pthread_t sweeper;
+    int sweeper_running;
+    int sweeper_interval_ms;
+    pthread_mutex_t sweeper_mutex;
+    pthread_cond_t sweeper_cond;
 } shared_cache_t;
 
-void cache_init(shared_cache_t *cache);
-char *cache_lookup(shared_cache_t *cache, const char *key);
-int cache_add(shared_cache_t *cache, const char *key, const char *value);
+int cache_init(shared_cache_t *cache, cache_read_mode_t read_mode, size_t max_bytes);
+int cache_lookup(shared_cache_t *cache, const char *key, char *value, size_t value_size);
+int cache_add(shared_cache_t *cache, const char *key, const char *value, int ttl_ms);
+int cache_start_sweeper(shared_cache_t *cache, int interval_ms);
+void cache_stats(shared_cache_t *cache, cache_stats_t *out);
+void cache_destroy(shared_cache_t *cache);
 
-void cache_init(shared_cache_t *cache) {
-    /* Inicializa la estructura de la caché compartida y el read-write lock. */
-    cache->count = 0;
-    pthread_rwlock_init(&cache->rwlock, NULL);
+static uint64_t cache_hash(const char *key) {
+    /* Hash FNV-1a de 64 bits. Nunca retorna 0, que se reserva para los slots libres. */
+    uint64_t h = 1469598103934665603ULL;
+    while (*key) {
+        h ^= (unsigned char)*key++;
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
 }
 
-char *cache_lookup(shared_cache_t *cache, const char *key) {
-    /* Busca una entrada en la caché de forma segura para múltiples lectores.
-    - Adquiere el lock de lectura para la caché.
-    - Itera a través de las entradas de la caché.
-    - Si encuentra la clave, libera el lock y retorna el valor.
-    - Si no se encuentra, libera el lock y retorna NULL.
+static cache_shard_t *cache_shard_for(shared_cache_t *cache, uint64_t hash) {
+    /* Los bits altos eligen el shard; los bajos, el slot dentro del shard. */
+    return &cache->shards[hash >> (64 - __builtin_ctz(CACHE_SHARDS))];
+}
+
+static int64_t cache_now_ms(void) {
+    /* Reloj monótono de baja resolución: basta para TTLs en ms y es más barato en cada lookup. */
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int entry_expired(int64_t expires_at, int64_t *now) {
+    /* Consulta el reloj solo si la entrada tiene TTL. */
+    if (expires_at == 0) return 0;
+    if (*now == 0) *now = cache_now_ms();
+    return expires_at <= *now;
+}
+
+static cache_stats_slot_t *cache_stats_slot(shared_cache_t *cache) {
+    /*
+    Cada hilo escribe sus contadores en su propio slot (una línea de caché),
+    así contar aciertos no hace rebotar ninguna línea entre núcleos.
+    */
+    static atomic_int next_slot;
+    static _Thread_local int slot = -1;
+    if (slot < 0) slot = atomic_fetch_add(&next_slot, 1) % CACHE_STATS_SLOTS;
+    return &cache->stats[slot];
+}
+
+static void stat_inc(atomic_ulong *counter) {
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static cache_table_t *table_alloc(size_t capacity) {
+    cache_table_t *t = calloc(1, sizeof(cache_table_t) + capacity * sizeof(cache_entry_t));
+    if (t) t->capacity = capacity;
+    return t;
+}
+
+static cache_entry_t *table_find(cache_table_t *t, uint64_t hash, const char *key) {
+    /* Sondeo lineal desde el slot inicial hasta encontrar la clave o un slot libre.
+       Debe llamarse con el lock del shard adquirido. */
+    size_t mask = t->capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        cache_entry_t *e = &t->slots[i];
+        if (e->hash == 0) return NULL;
+        if (e->hash == hash && strcmp(e->key, key) == 0) return e;
+    }
+}
+
+static void table_remove(cache_table_t *t, size_t i) {
+    /*
+    Borrado sin tombstones (backward-shift): las entradas siguientes del mismo racimo
+    cuyo slot inicial no está en (i, j] se desplazan hacia atrás para cerrar el hueco.
+    Debe llamarse dentro de una sección de escritura del shard.
+    */
+    size_t mask = t->capacity - 1;
+    for (size_t j = (i + 1) & mask; t->slots[j].hash != 0; j = (j + 1) & mask) {
+        size_t home = t->slots[j].hash & mask;
+        int in_range = i < j ? (home > i && home <= j) : (home > i || home <= j);
+        if (!in_range) {
+            t->slots[i] = t->slots[j];
+            i = j;
+        }
+    }
+    __atomic_store_n(&t->slots[i].hash, 0, __ATOMIC_RELEASE);
+}
+
+static void shard_write_begin(cache_shard_t *shard) {
+    /* Marca el shard como "en escritura" (seq impar) antes de tocar la tabla. */
+    atomic_store_explicit(&shard->seq, atomic_load_explicit(&shard->seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void shard_write_end(cache_shard_t *shard) {
+    atomic_store_explicit(&shard->seq, atomic_load_explicit(&shard->seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+}
+
+static int shard_grow(cache_shard_t *shard) {
+    /*
+    Duplica la capacidad del shard y reinserta todas las entradas.
+    Se llama con el write lock del shard adquirido; el resto de shards sigue atendiendo.
+
+    La tabla nueva se publica con un único store atómico. La antigua no se libera:
+    un lector sin lock podría estar recorriéndola. Se encadena en 'retired' y se libera
+    en cache_destroy; como la capacidad se duplica, lo retenido nunca supera el tamaño de la tabla viva.
+    */
+    cache_table_t *old = atomic_load_explicit(&shard->table, memory_order_relaxed);
+    cache_table_t *t = table_alloc(old->capacity * 2);
+    if (!t) return -1;
+    size_t mask = t->capacity - 1;
+    for (size_t i = 0; i < old->capacity; ++i) {
+        cache_entry_t *e = &old->slots[i];
+        if (e->hash == 0) continue;
+        size_t j = e->hash & mask;
+        while (t->slots[j].hash != 0) j = (j + 1) & mask;
+        t->slots[j] = *e;
+    }
+    t->retired = old;
+    atomic_store_explicit(&shard->table, t, memory_order_release);
+    shard->hand = 0;
+    return 0;
+}
+
+static int shard_evict(shared_cache_t *cache, cache_shard_t *shard) {
+    /*
+    Libera un slot con el algoritmo CLOCK (LRU aproximado).
+
+    - La manecilla avanza por la tabla; una entrada caducada se elimina sin más.
+    - Si la entrada tiene el bit de referencia, se le quita y se sigue (segunda oportunidad).
+    - La primera entrada sin referencia es la víctima.
+    - Dos vueltas completas bastan: en la primera se limpian todos los bits.
+    - Los lectores en modo seqlock vuelven a marcar entradas mientras la manecilla avanza,
+      así que las dos vueltas pueden acabar sin víctima: entonces retorna -1 y 'count' no cambia.
+    Se llama dentro de la sección de escritura del shard; los lectores nunca mueven la manecilla.
+    Retorna 0 si liberó un slot.
     */
-    int i = -1;
-    pthread_rwlock_rdlock(&cache->rwlock);
-    while (i++ < cache->count) {
-        if (strcmp(cache->cache[i].key, key) == 0) {
-            pthread_rwlock_unlock(&cache->rwlock);
-            return cache->cache[i].value;
+    cache_table_t *t = atomic_load_explicit(&shard->table, memory_order_relaxed);
+    size_t mask = t->capacity - 1;
+    int64_t now = 0;
+    for (size_t n = 0; n <= 2 * t->capacity; ++n) {
+        cache_entry_t *e = &t->slots[shard->hand];
+        if (e->hash != 0) {
+            if (entry_expired(e->expires_at, &now)) {
+                table_remove(t, shard->hand);
+                atomic_fetch_sub_explicit(&shard->count, 1, memory_order_relaxed);
+                stat_inc(&cache_stats_slot(cache)->expirations);
+                return 0;
+            }
+            if (!__atomic_load_n(&e->referenced, __ATOMIC_RELAXED)) {
+                table_remove(t, shard->hand);
+                atomic_fetch_sub_explicit(&shard->count, 1, memory_order_relaxed);
+                stat_inc(&cache_stats_slot(cache)->evictions);
+                return 0;
+            }
+            __atomic_store_n(&e->referenced, 0, __ATOMIC_RELAXED);
         }
-        pthread_rwlock_unlock(&cache->rwlock);
-        return(NULL);
+        shard->hand = (shard->hand + 1) & mask;
     }
+    return -1;
+}
+
+int cache_init(shared_cache_t *cache, cache_read_mode_t read_mode, size_t max_bytes) {
+    /*
+    Inicializa la caché compartida.
+
+    - Cada shard recibe su propia tabla hash y su propio read-write lock,
+      de modo que lectores y escritores de claves distintas no compiten por la misma línea de caché.
+    - read_mode elige cómo leen los lectores (ver cache_lookup).
+    - max_bytes es el presupuesto de memoria de las tablas, repartido entre los shards
+      (0 = sin límite). Al alcanzarlo, cache_add expulsa entradas en lugar de crecer.
+    - Retorna 0 en éxito, -1 si falla la reserva de memoria.
+    */
+    size_t max_capacity = 0;
+    if (max_bytes) {
+        max_capacity = CACHE_SHARD_INITIAL_CAPACITY;
+        while (max_capacity * 2 * sizeof(cache_entry_t) <= max_bytes / CACHE_SHARDS) max_capacity *= 2;
+    }
+
+    memset(cache->stats, 0, sizeof(cache->stats));
+    cache->read_mode = read_mode;
+    cache->sweeper_running = 0;
+    for (int i = 0; i < CACHE_SHARDS; ++i) {
+        cache_shard_t *shard = &cache->shards[i];
+        cache_table_t *t = table_alloc(CACHE_SHARD_INITIAL_CAPACITY);
+        if (!t) {
+            while (--i >= 0) {
+                free(atomic_load(&cache->shards[i].table));
+                pthread_rwlock_destroy(&cache->shards[i].rwlock);
+            }
+            return -1;
+        }
+        atomic_init(&shard->table, t);
+        atomic_init(&shard->seq, 0);
+        atomic_init(&shard->count, 0);
+        shard->max_capacity = max_capacity;
+        shard->hand = 0;
+        pthread_rwlock_init(&shard->rwlock, NULL);
+    }
+    return 0;
 }
 
-int cache_add(shared_cache_t *cache, const char *key, const char *value) {
-    pthread_rwlock_wrlock(&cache->rwlock);
-    if (cache->count < MAX_CACHE_SIZE) {
-        strcpy(cache->cache[cache->count].key, key);
-        strcpy(cache->cache[cache->count].value, value);
-        cache->count++;
-        pthread_rwlock_unlock(&cache->rwlock);
+static int cache_lookup_seqlock(cache_shard_t *shard, uint64_t hash, const char *key,
+                                char *value, size_t value_size) {
+    /*
+    Lectura optimista: copia la entrada a la pila y valida que 'seq' no cambió.
+    No adquiere locks ni escribe memoria compartida, así que la línea de caché del shard
+    permanece en estado compartido en todos los núcleos lectores.
+    Si un escritor intervino (seq impar o distinto), se reintenta.
+    La única escritura posible es el bit de referencia del CLOCK, y solo si estaba a 0.
+    Retorna 0 si se encontró, -1 si no existe y -2 si existe pero ha caducado.
+    */
+    char k[CACHE_KEY_SIZE];
+    char v[CACHE_VALUE_SIZE];
+    cache_entry_t *e = NULL;
+    int64_t expires_at = 0;
+    int64_t now = 0;
+    for (;;) {
+        unsigned s1 = atomic_load_explicit(&shard->seq, memory_order_acquire);
+        if (s1 & 1) continue;
+
+        cache_table_t *t = atomic_load_explicit(&shard->table, memory_order_acquire);
+        size_t mask = t->capacity - 1;
+        int found = 0;
+        // Limitado a 'capacity' pasos: con lecturas inconsistentes no se garantiza un slot libre
+        for (size_t n = 0, i = hash & mask; n < t->capacity; ++n, i = (i + 1) & mask) {
+            uint64_t h = __atomic_load_n(&t->slots[i].hash, __ATOMIC_RELAXED);
+            if (h == 0) break;
+            if (h != hash) continue;
+            memcpy(k, t->slots[i].key, sizeof(k));
+            if (strncmp(k, key, sizeof(k)) != 0) continue;
+            memcpy(v, t->slots[i].value, sizeof(v));
+            expires_at = __atomic_load_n(&t->slots[i].expires_at, __ATOMIC_RELAXED);
+            e = &t->slots[i];
+            found = 1;
+            break;
+        }
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shard->seq, memory_order_relaxed) != s1) continue;
+
+        if (!found) return -1;
+        if (entry_expired(expires_at, &now)) return -2;
+        if (!__atomic_load_n(&e->referenced, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&e->referenced, 1, __ATOMIC_RELAXED);
+        }
+        v[sizeof(v) - 1] = '\0';
+        snprintf(value, value_size, "%s", v);
         return 0;
+    }
+}
+
+int cache_lookup(shared_cache_t *cache, const char *key, char *value, size_t value_size) {
+    /* Busca una entrada en la caché de forma segura para múltiples lectores.
+    - Calcula el hash de la clave y localiza su shard.
+    - Modo CACHE_READ_SEQLOCK: lectura optimista sin locks (cache_lookup_seqlock).
+    - Modo CACHE_READ_RWLOCK: adquiere el lock de lectura solo de ese shard.
+    - Si encuentra la clave, copia el valor en el buffer del llamante,
+      así el lector nunca conserva un puntero a memoria que un escritor puede modificar.
+    - Una entrada caducada cuenta como fallo; la eliminan el barrido o el CLOCK,
+      nunca el lector (caducidad perezosa).
+    - Marca el bit de referencia del CLOCK solo si no estaba marcado.
+    - Retorna 0 si se encontró la clave, -1 si no.
+    */
+    uint64_t hash = cache_hash(key);
+    cache_shard_t *shard = cache_shard_for(cache, hash);
+    int found;
+
+    if (cache->read_mode == CACHE_READ_SEQLOCK) {
+        found = cache_lookup_seqlock(shard, hash, key, value, value_size);
+    } else {
+        int64_t now = 0;
+        found = -1;
+        pthread_rwlock_rdlock(&shard->rwlock);
+        cache_entry_t *e = table_find(atomic_load_explicit(&shard->table, memory_order_relaxed), hash, key);
+        if (e && entry_expired(e->expires_at, &now)) {
+            found = -2;
+        } else if (e) {
+            if (!__atomic_load_n(&e->referenced, __ATOMIC_RELAXED)) {
+                __atomic_store_n(&e->referenced, 1, __ATOMIC_RELAXED);
+            }
+            snprintf(value, value_size, "%s", e->value);
+            found = 0;
+        }
+        pthread_rwlock_unlock(&shard->rwlock);
+    }
+
+    cache_stats_slot_t *stats = cache_stats_slot(cache);
+    stat_inc(found == 0 ? &stats->hits : &stats->misses);
+    return found == 0 ? 0 : -1;
+}
+
+int cache_add(shared_cache_t *cache, const char *key, const char *value, int ttl_ms) {
+    /*
+    Inserta o actualiza una entrada. Es, junto con el barrido, el único escritor de la caché.
+
+    - Rechaza claves o valores que no caben en la entrada.
+    - Adquiere el write lock del shard y abre la sección de escritura del seqlock.
+    - Si la clave existe, actualiza el valor y renueva su TTL.
+    - Si el factor de carga superaría 3/4, duplica la tabla del shard antes de insertar;
+      si el presupuesto de memoria no permite crecer, expulsa una entrada con el CLOCK.
+    - El hash se publica al final, cuando clave y valor ya están escritos.
+    - ttl_ms <= 0 significa que la entrada no caduca.
+    - Retorna 0 en éxito, -1 si la entrada es demasiado grande, falla la memoria o
+      el shard está lleno y el CLOCK no encontró víctima.
+    */
+    if (strlen(key) >= CACHE_KEY_SIZE || strlen(value) >= CACHE_VALUE_SIZE) return -1;
+
+    uint64_t hash = cache_hash(key);
+    cache_shard_t *shard = cache_shard_for(cache, hash);
+    int64_t expires_at = ttl_ms > 0 ? cache_now_ms() + ttl_ms : 0;
+    int ret = 0;
+
+    pthread_rwlock_wrlock(&shard->rwlock);
+    shard_write_begin(shard);
+    cache_table_t *t = atomic_load_explicit(&shard->table, memory_order_relaxed);
+    cache_entry_t *e = table_find(t, hash, key);
+    size_t count = atomic_load_explicit(&shard->count, memory_order_relaxed);
+    if (e) {
+        strcpy(e->value, value);
+        e->expires_at = expires_at;
     } else {
-        pthread_rwlock_unlock(&cache->rwlock);
+        if ((count + 1) * 4 > t->capacity * 3) {
+            if (shard->max_capacity && t->capacity >= shard->max_capacity) {
+                if (shard_evict(cache, shard) != 0) ret = -1; // sin víctima: no se llena la tabla
+            } else if (shard_grow(shard) != 0) {
+                ret = -1;
+            }
+        }
+        if (ret == 0) {
+            t = atomic_load_explicit(&shard->table, memory_order_relaxed);
+            size_t mask = t->capacity - 1;
+            size_t i = hash & mask;
+            while (t->slots[i].hash != 0) i = (i + 1) & mask;
+            e = &t->slots[i];
+            strcpy(e->key, key);
+            strcpy(e->value, value);
+            e->expires_at = expires_at;
+            e->referenced = 1;
+            __atomic_store_n(&e->hash, hash, __ATOMIC_RELEASE);
+            atomic_fetch_add_explicit(&shard->count, 1, memory_order_relaxed);
+        }
+    }
+    shard_write_end(shard);
+    pthread_rwlock_unlock(&shard->rwlock);
+    return ret;
+}
+
+static void shard_sweep(shared_cache_t *cache, cache_shard_t *shard) {
+    /*
+    Elimina las entradas caducadas de un shard.
+    Recorre la tabla en tramos de CACHE_SWEEP_BATCH slots y suelta el write lock entre tramos,
+    así ni los lectores en modo rwlock ni los que reintentan en modo seqlock esperan
+    más que un tramo. Si la tabla crece entre tramos, el barrido sigue sobre la nueva.
+    */
+    int64_t now = cache_now_ms();
+    for (size_t pos = 0;;) {
+        pthread_rwlock_wrlock(&shard->rwlock);
+        cache_table_t *t = atomic_load_explicit(&shard->table, memory_order_relaxed);
+        if (pos >= t->capacity) {
+            pthread_rwlock_unlock(&shard->rwlock);
+            return;
+        }
+        shard_write_begin(shard);
+        size_t end = pos + CACHE_SWEEP_BATCH < t->capacity ? pos + CACHE_SWEEP_BATCH : t->capacity;
+        while (pos < end) {
+            cache_entry_t *e = &t->slots[pos];
+            if (e->hash != 0 && entry_expired(e->expires_at, &now)) {
+                table_remove(t, pos); // la entrada desplazada a 'pos' se revisa en la siguiente vuelta
+                atomic_fetch_sub_explicit(&shard->count, 1, memory_order_relaxed);
+                stat_inc(&cache_stats_slot(cache)->expirations);
+            } else {
+                pos++;
+            }
+        }
+        shard_write_end(shard);
+        pthread_rwlock_unlock(&shard->rwlock);
+    }
+}
+
+static void *cache_sweeper(void *arg) {
+    /*
+    Hilo de barrido: cada sweeper_interval_ms recorre todos los shards eliminando caducadas.
+    Espera sobre una condición para que cache_destroy pueda despertarlo y detenerlo al instante.
+    */
+    shared_cache_t *cache = (shared_cache_t *)arg;
+    pthread_mutex_lock(&cache->sweeper_mutex);
+    while (cache->sweeper_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += cache->sweeper_interval_ms / 1000;
+        deadline.tv_nsec += (long)(cache->sweeper_interval_ms % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        pthread_cond_timedwait(&cache->sweeper_cond, &cache->sweeper_mutex, &deadline);
+        if (!cache->sweeper_running) break;
+
+        pthread_mutex_unlock(&cache->sweeper_mutex);
+        for (int i = 0; i < CACHE_SHARDS; ++i) {
+            shard_sweep(cache, &cache->shards[i]);
+        }
+        pthread_mutex_lock(&cache->sweeper_mutex);
+    }
+    pthread_mutex_unlock(&cache->sweeper_mutex);
+    return NULL;
+}
+
+int cache_start_sweeper(shared_cache_t *cache, int interval_ms) {
+    /*
+    Arranca el hilo de barrido de entradas caducadas.
+    Retorna 0 en éxito, -1 si ya estaba arrancado o no se pudo crear el hilo.
+    */
+    if (cache->sweeper_running || interval_ms <= 0) return -1;
+    pthread_mutex_init(&cache->sweeper_mutex, NULL);
+    pthread_cond_init(&cache->sweeper_cond, NULL);
+    cache->sweeper_interval_ms = interval_ms;
+    cache->sweeper_running = 1;
+    if (pthread_create(&cache->sweeper, NULL, cache_sweeper, cache) != 0) {
+        perror("Error al crear el hilo de barrido");
+        cache->sweeper_running = 0;
+        pthread_mutex_destroy(&cache->sweeper_mutex);
+        pthread_cond_destroy(&cache->sweeper_cond);
         return -1;
     }
+    return 0;
+}
+
+void cache_stats(shared_cache_t *cache, cache_stats_t *out) {
+    /*
+    Suma los contadores de todos los hilos. Los valores son aproximados
+    mientras haya hilos trabajando, suficiente para dimensionar la caché.
+    */
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < CACHE_STATS_SLOTS; ++i) {
+        cache_stats_slot_t *s = &cache->stats[i];
+        out->hits += atomic_load_explicit(&s->hits, memory_order_relaxed);
+        out->misses += atomic_load_explicit(&s->misses, memory_order_relaxed);
+        out->evictions += atomic_load_explicit(&s->evictions, memory_order_relaxed);
+        out->expirations += atomic_load_explicit(&s->expirations, memory_order_relaxed);
+    }
+    for (int i = 0; i < CACHE_SHARDS; ++i) {
+        cache_shard_t *shard = &cache->shards[i];
+        out->entries += atomic_load_explicit(&shard->count, memory_order_relaxed);
+        out->bytes += atomic_load_explicit(&shard->table, memory_order_acquire)->capacity * sizeof(cache_entry_t);
+    }
+}
+
+void cache_destroy(shared_cache_t *cache) {
+    /*
+    Detiene el hilo de barrido si está arrancado, libera las tablas (vivas y retiradas)
+    y destruye los locks de todos los shards.
+    */
+    if (cache->sweeper_running) {
+        pthread_mutex_lock(&cache->sweeper_mutex);
+        cache->sweeper_running = 0;
+        pthread_cond_signal(&cache->sweeper_cond);
+        pthread_mutex_unlock(&cache->sweeper_mutex);
+        pthread_join(cache->sweeper, NULL);
+        pthread_mutex_destroy(&cache->sweeper_mutex);
+        pthread_cond_destroy(&cache->sweeper_cond);
+    }
+    for (int i = 0; i < CACHE_SHARDS; ++i) {
+        cache_table_t *t = atomic_load(&cache->shards[i].table);
+        while (t) {
+            cache_table_t *next = t->retired;
+            free(t);
+            t = next;
+        }
+        pthread_rwlock_destroy(&cache->shards[i].rwlock);
+    }
 }
 
 void *reader_thread(void *arg) {
     shared_cache_t *cache = (shared_cache_t *)arg;
     for (int i = 0; i < 5; ++i) {
-        char key[50];
+        char key[CACHE_KEY_SIZE];
+        char value[CACHE_VALUE_SIZE];
         sprintf(key, "key_%d", rand() % 5);
-        char *value = cache_lookup(cache, key);
-        if (value) {
+        if (cache_lookup(cache, key, value, sizeof(value)) == 0) {
             printf("Lector %lu: Encontrado key '%s' con valor '%s'\n", pthread_self(), key, value);
         } else {
             printf("Lector %lu: No se encontró key '%s'\n", pthread_self(), key);
@@ -79,23 +575,115 @@ void *reader_thread(void *arg) {
 void *writer_thread(void *arg) {
     shared_cache_t *cache = (shared_cache_t *)arg;
     for (int i = 0; i < 3; ++i) {
-        char key[50];
-        char value[100];
+        char key[CACHE_KEY_SIZE];
+        char value[CACHE_VALUE_SIZE];
         sprintf(key, "key_%d", i);
         sprintf(value, "value_%d_%lu", i, pthread_self());
-        if (cache_add(cache, key, value) == 0) {
+        if (cache_add(cache, key, value, DEMO_TTL_MS) == 0) {
             printf("Escritor %lu: Añadido key '%s' con valor '%s'\n", pthread_self(), key, value);
         } else {
-            printf("Escritor %lu: No se pudo añadir key '%s' (caché llena)\n", pthread_self(), key);
+            printf("Escritor %lu: No se pudo añadir key '%s'\n", pthread_self(), key);
         }
         usleep(rand() % 750000); // Espera aleatoria
     }
     pthread_exit(NULL);
 }
 
-int main() {
+// Benchmark: lookups/segundo frente a número de hilos lectores, con un escritor de fondo
+typedef struct {
+    shared_cache_t *cache;
+    atomic_int *stop;
+    unsigned seed;
+    unsigned long lookups;
+} bench_arg_t;
+
+static char bench_keys[BENCH_KEYS][CACHE_KEY_SIZE];
+
+void *bench_reader(void *arg) {
+    bench_arg_t *b = (bench_arg_t *)arg;
+    char value[CACHE_VALUE_SIZE];
+    unsigned x = b->seed;
+    unsigned long n = 0;
+    while (!atomic_load_explicit(b->stop, memory_order_relaxed)) {
+        x ^= x << 13; x ^= x >> 17; x ^= x << 5; // xorshift32, sin estado compartido
+        cache_lookup(b->cache, bench_keys[x % BENCH_KEYS], value, sizeof(value));
+        n++;
+    }
+    b->lookups = n; // escrito una sola vez, en la línea de caché propia del hilo
+    return NULL;
+}
+
+void *bench_writer(void *arg) {
+    bench_arg_t *b = (bench_arg_t *)arg;
+    char value[CACHE_VALUE_SIZE];
+    unsigned long i = 0;
+    while (!atomic_load_explicit(b->stop, memory_order_relaxed)) {
+        sprintf(value, "updated_%lu", i);
+        cache_add(b->cache, bench_keys[i++ % BENCH_KEYS], value, 0);
+        usleep(100); // carga mayoritariamente de lectura
+    }
+    return NULL;
+}
+
+static double bench_run(cache_read_mode_t mode, int num_readers) {
+    shared_cache_t cache;
+    atomic_int stop = 0;
+    pthread_t readers[BENCH_MAX_THREADS], writer;
+    bench_arg_t args[BENCH_MAX_THREADS] __attribute__((aligned(CACHE_LINE_SIZE)));
+    bench_arg_t wargs = {.cache = &cache, .stop = &stop};
+
+    if (cache_init(&cache, mode, 0) != 0) return 0;
+    for (int i = 0; i < BENCH_KEYS; ++i) {
+        cache_add(&cache, bench_keys[i], "sip:user@10.0.0.1:5060", 0);
+    }
+
+    pthread_create(&writer, NULL, bench_writer, &wargs);
+    for (int i = 0; i < num_readers; ++i) {
+        args[i] = (bench_arg_t){.cache = &cache, .stop = &stop, .seed = 2463534242u + i};
+        pthread_create(&readers[i], NULL, bench_reader, &args[i]);
+    }
+    sleep(BENCH_SECONDS);
+    atomic_store(&stop, 1);
+
+    unsigned long total = 0;
+    for (int i = 0; i < num_readers; ++i) {
+        pthread_join(readers[i], NULL);
+        total += args[i].lookups;
+    }
+    pthread_join(writer, NULL);
+    cache_destroy(&cache);
+    return (double)total / BENCH_SECONDS;
+}
+
+static void bench(void) {
+    /*
+    Compara el modo rwlock con el modo seqlock duplicando el número de lectores
+    hasta BENCH_MAX_THREADS. Cada medida usa una caché nueva de BENCH_KEYS claves.
+    */
+    for (int i = 0; i < BENCH_KEYS; ++i) {
+        sprintf(bench_keys[i], "sip:user%d@mcx.local", i);
+    }
+    printf("%8s %16s %16s\n", "hilos", "rwlock (ops/s)", "seqlock (ops/s)");
+    for (int n = 1; n <= BENCH_MAX_THREADS; n *= 2) {
+        double rw = bench_run(CACHE_READ_RWLOCK, n);
+        double seq = bench_run(CACHE_READ_SEQLOCK, n);
+        printf("%8d %16.0f %16.0f\n", n, rw, seq);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+
     shared_cache_t cache;
-    cache_init(&cache);
+    cache_read_mode_t mode = (argc > 1 && strcmp(argv[1], "seqlock") == 0) ? CACHE_READ_SEQLOCK : CACHE_READ_RWLOCK;
+    if (cache_init(&cache, mode, 64 * 1024) != 0) { // presupuesto de 64 KiB
+        perror("Error al inicializar la caché");
+        return 1;
+    }
+    cache_start_sweeper(&cache, DEMO_SWEEP_INTERVAL_MS);
     srand(time(NULL));
 
     pthread_t readers[3], writers[2];
@@ -114,17 +702,59 @@ int main() {
         pthread_join(writers[i], NULL);
     }
 
-    pthread_rwlock_destroy(&cache.rwlock);
+    cache_stats_t stats;
+    cache_stats(&cache, &stats);
+    printf("Estadísticas: %lu aciertos, %lu fallos, %lu expulsiones, %lu caducadas, %zu entradas, %zu bytes\n",
+           stats.hits, stats.misses, stats.evictions, stats.expirations, stats.entries, stats.bytes);
+
+    cache_destroy(&cache);
     printf("Programa principal terminado.\n");
     return 0;
 }
 
 /*
-Compila: gcc pthreads1.c -o rwlock_cache -lpthread
-Ejecuta: ./rwlock_cache
+Compila: gcc -O2 pthreads1.c -o rwlock_cache -lpthread
+Ejecuta: ./rwlock_cache            (lectores con rwlock)
+         ./rwlock_cache seqlock    (lectores sin lock)
+         ./rwlock_cache bench      (lookups/s frente a número de hilos, ambos modos)
 Explicación:
 Este bloque demuestra el uso de read-write locks para proteger una caché compartida.
 Múltiples hilos lectores pueden acceder a la caché simultáneamente,
 pero cuando un hilo escritor quiere modificar la caché,
 necesita obtener un lock exclusivo, bloqueando a todos los demás hilos (lectores y escritores).
+
+    -Shards: la caché se divide en CACHE_SHARDS tablas independientes,
+    cada una con su propio read-write lock y alineada a una línea de caché.
+    Los bits altos del hash eligen el shard, así que claves distintas
+    casi nunca compiten por el mismo lock.
+
+    -Tabla hash: cada shard es una tabla de direccionamiento abierto con sondeo lineal.
+    La búsqueda es O(1) en promedio, y la tabla se duplica cuando supera
+    un factor de carga de 3/4, sin límite fijo de entradas.
+
+    -Buffers del llamante: cache_lookup copia el valor en un buffer
+    proporcionado por el lector mientras mantiene el lock,
+    en lugar de devolver un puntero a la tabla que podría cambiar después.
+
+    -Modo seqlock: incluso sin contención, pthread_rwlock_rdlock hace una operación
+    atómica de escritura sobre el lock, y la línea de caché rebota entre núcleos.
+    En CACHE_READ_SEQLOCK los lectores solo leen: toman el contador 'seq' del shard,
+    copian la entrada y comprueban que 'seq' no cambió; si cambió, reintentan.
+    cache_add sigue siendo el único escritor y deja 'seq' impar mientras modifica.
+    Las tablas reemplazadas al crecer se conservan hasta cache_destroy,
+    porque un lector sin lock puede seguir recorriéndolas.
+
+    -Presupuesto de memoria y CLOCK: cache_init recibe un límite en bytes.
+    Cuando un shard no puede crecer más, cache_add expulsa una entrada
+    con el algoritmo CLOCK: cada shard tiene su propia manecilla,
+    y los lectores solo marcan el bit de referencia (si no estaba ya marcado),
+    sin tomar el write lock ni mover la manecilla.
+
+    -TTL: cada entrada tiene su propia caducidad (ttl_ms en cache_add).
+    El lector trata una entrada caducada como un fallo (caducidad perezosa),
+    y un hilo de barrido (cache_start_sweeper) la elimina en tramos cortos
+    para no bloquear a los lectores. El borrado usa backward-shift, sin tombstones.
+
+    -Estadísticas: aciertos, fallos, expulsiones y caducadas se cuentan por hilo
+    y cache_stats los suma, junto con el número de entradas y los bytes de las tablas.
  */
\ No newline at end of file
@@ -1,274 +1,1689 @@
-#include <pthread.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <string.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <fcntl.h>
-#include <sys/select.h>
-#include <errno.h>
-
-#define PORT 8080
-#define MAX_CLIENTS 10
-#define THREAD_POOL_SIZE 4
-#define MAX_TASKS 20
-#define BUFFER_SIZE 1024
-
-// (Incluir aquí las definiciones de task_t y thread_pool_t del Bloque 9, simplificadas si es necesario)
-typedef struct {
-    void (*function)(void *);
-    void *argument;
-    int priority;
-} task_t;
-
-typedef struct {
-    task_t **tasks[1];
-    int head[1];
-    int tail[1];
-    int count[1];
-    int capacity;
-    pthread_mutex_t queue_mutex;
-    pthread_cond_t queue_not_empty[1];
-    pthread_cond_t queue_not_full[1];
-    pthread_t threads[THREAD_POOL_SIZE];
-    int shutdown;
-} thread_pool_t;
-
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks);
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument); // Simplificado sin prioridad
-void thread_pool_destroy(thread_pool_t *pool);
-void *worker(void *pool);
-
-// Estructura para pasar información del cliente a la tarea del thread pool
-typedef struct {
-    int client_fd;
-} client_info_t;
-
-void handle_client(void *arg);
-
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks) {
-    pool->capacity = max_tasks;
-    for (int i = 0; i < 1; ++i) {
-        pool->head[i] = pool->tail[i] = pool->count[i] = 0;
-        pool->tasks[i] = malloc(sizeof(task_t) * pool->capacity);
-        if (!pool->tasks[i]) perror("malloc tasks failed");
-        pthread_cond_init(&pool->queue_not_empty[i], NULL);
-        pthread_cond_init(&pool->queue_not_full[i], NULL);
-    }
-    pthread_mutex_init(&pool->queue_mutex, NULL);
-    pool->shutdown = 0;
-    for (int i = 0; i < num_threads; ++i) {
-        pthread_create(&pool->threads[i], NULL, worker, pool);
-    }
-}
-
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument) {
-    pthread_mutex_lock(&pool->queue_mutex);
-    while (pool->count[0] == pool->capacity && !pool->shutdown) {
-        pthread_cond_wait(&pool->queue_not_full[0], &pool->queue_mutex);
-    }
-    if (pool->shutdown) {
-        pthread_mutex_unlock(&pool->queue_mutex);
-        return;
-    }
-    pool->tasks[0][pool->tail[0]].function = function;
-    pool->tasks[0][pool->tail[0]].argument = argument;
-    pool->tail[0] = (pool->tail[0] + 1) % pool->capacity;
-    pool->count[0]++;
-    pthread_cond_signal(&pool->queue_not_empty[0]);
-    pthread_mutex_unlock(&pool->queue_mutex);
-}
-
-void *worker(void *pool) {
-    thread_pool_t *p = (thread_pool_t *)pool;
-    while (1) {
-        pthread_mutex_lock(&p->queue_mutex);
-        while (p->count[0] == 0 && !p->shutdown) {
-            pthread_cond_wait(&p->queue_not_empty[0], &p->queue_mutex);
-        }
-        if (p->shutdown) {
-            pthread_mutex_unlock(&p->queue_mutex);
-            pthread_exit(NULL);
-        }
-        task_t task = p->tasks[0][p->head[0]];
-        p->head[0] = (p->head[0] + 1) % p->capacity;
-        p->count[0]--;
-        pthread_cond_signal(&p->queue_not_full[0]);
-        pthread_mutex_unlock(&p->queue_mutex);
-        task.function(task.argument);
-    }
-    return NULL;
-}
-
-void thread_pool_destroy(thread_pool_t *pool) {
-    pthread_mutex_lock(&pool->queue_mutex);
-    pool->shutdown = 1;
-    pthread_cond_broadcast(&pool->queue_not_empty[0]);
-    pthread_mutex_unlock(&pool->queue_mutex);
-    for (int i = 0; i < THREAD_POOL_SIZE; ++i) {
-        pthread_join(pool->threads[i], NULL);
-    }
-    for (int i = 0; i < 1; ++i) {
-        free(pool->tasks[i]);
-        pthread_cond_destroy(&pool->queue_not_empty[i]);
-        pthread_cond_destroy(&pool->queue_not_full[i]);
-    }
-    pthread_mutex_destroy(&pool->queue_mutex);
-}
-
-void handle_client(void *arg) {
-    /*
-    Función que se ejecuta en un hilo del pool para manejar la comunicación con un cliente.
-
-    - Recibe un puntero a una estructura client_info_t que contiene el descriptor del socket del cliente.
-    - Lee datos del socket del cliente (no bloqueante).
-    - Procesa los datos recibidos.
-    - Envía una respuesta al cliente (no bloqueante).
-    - Cierra la conexión con el cliente.
-    */
-}
-
-int main() {
-    int server_fd, new_socket, max_fd;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-    fd_set readfds;
-    thread_pool_t pool;
-
-    // Inicializar el thread pool
-    thread_pool_init(&pool, THREAD_POOL_SIZE, MAX_TASKS);
-
-    // Crear socket del servidor
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
-        perror("socket failed");
-        exit(EXIT_FAILURE);
-    }
-
-    // Configurar socket no bloqueante
-    int flags = fcntl(server_fd, F_GETFL, 0);
-    if (fcntl(server_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
-        perror("fcntl nonblock failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
-    }
-
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
-
-    // Bind del socket
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
-        perror("bind failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
-    }
-
-    // Escuchar por conexiones
-    if (listen(server_fd, MAX_CLIENTS) < 0) {
-        perror("listen failed");
-        close(server_fd);
-        exit(EXIT_FAILURE);
-    }
-
-    printf("Servidor escuchando en el puerto %d...\n", PORT);
-
-    while (1) {
-        FD_ZERO(&readfds);
-        FD_SET(server_fd, &readfds);
-        max_fd = server_fd;
-
-        // No estamos gestionando activamente los sockets de los clientes en el bucle principal
-        // ya que el I/O se delega al thread pool.
-
-        // Usar select para esperar por actividad en el socket del servidor (nuevas conexiones)
-        int activity = select(max_fd + 1, &readfds, NULL, NULL, NULL);
-
-        if ((activity < 0) && (errno != EINTR)) {
-            perror("select error");
-            continue;
-        }
-
-        if (FD_ISSET(server_fd, &readfds)) {
-            if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) {
-                perror("accept failed");
-                continue;
-            }
-
-            printf("Nueva conexión aceptada, socket fd es %d, IP es: %s, puerto: %d\n", new_socket, inet_ntoa(address.sin_addr), ntohs(address.sin_port));
-
-            // Configurar el socket del cliente como no bloqueante (opcional, depende de la estrategia)
-            flags = fcntl(new_socket, F_GETFL, 0);
-            if (fcntl(new_socket, F_SETFL, flags | O_NONBLOCK) < 0) {
-                perror("fcntl nonblock client failed");
-                close(new_socket);
-                continue;
-            }
-
-            // Crear una tarea para manejar al cliente y enviarla al thread pool
-            client_info_t *client_info = malloc(sizeof(client_info_t));
-            if (!client_info) {
-                perror("malloc client_info failed");
-                close(new_socket);
-                continue;
-            }
-            client_info->client_fd = new_socket;
-            thread_pool_submit(&pool, handle_client, client_info);
-        }
-    }
-
-    // En un servidor real, aquí habría lógica para una terminación más controlada
-    close(server_fd);
-    thread_pool_destroy(&pool);
-    return 0;
-}
-
-/*
-Compila: gcc pthreads10.c -o nonblocking_io_pool -lpthread
-Ejecuta: ./nonblocking_io_pool
-Explicación:
-    -Socket No Bloqueante:
-        El socket del servidor se configura como no bloqueante
-        usando fcntl(server_fd, F_SETFL, flags | O_NONBLOCK).
-        Esto significa que las llamadas a accept() retornarán inmediatamente,
-        incluso si no hay conexiones pendientes
-        (en cuyo caso retornarán con un error EAGAIN o EWOULDBLOCK).
-
-    -select para Multiplexación de I/O:
-        La función select() se utiliza para esperar
-        a que haya actividad en el socket del servidor
-        (es decir, una nueva conexión entrante).
-        select() permite al servidor esperar en múltiples descriptores de archivo a la vez,
-        aunque en este ejemplo solo estamos esperando en el socket del servidor en el bucle principal.
-
-    -Thread Pool para Manejo de Clientes:
-        Cuando se acepta una nueva conexión, no se crea un nuevo hilo directamente para manejarla.
-        En lugar de eso, se crea1 una estructura client_info_t
-        que contiene el descriptor del socket del cliente,
-        y esta estructura se pasa como argumento a la función handle_client.
-        Esta función handle_client se envía como una tarea al thread pool.
-
-    -handle_client en el Thread Pool:
-        La función handle_client se ejecuta en uno de los hilos trabajadores del pool.
-        Esta función es responsable de leer y escribir datos en el socket del cliente.
-        En este ejemplo simplificado, se usa recv() y send(),
-        que en sockets no bloqueantes también deberían manejarse de forma no bloqueante
-        en un entorno real más complejo (posiblemente usando select o poll dentro del hilo trabajador
-        si es necesario manejar múltiples operaciones de I/O para un solo cliente).
-
-    -Beneficios:
-        Este enfoque permite que un número limitado de hilos en el thread pool
-        maneje potencialmente muchas conexiones de clientes.
-        El bucle principal del servidor no se bloquea esperando a que los clientes envíen datos;
-        simplemente acepta nuevas conexiones y las delega al pool de hilos.
-
-Nota Importante:
-Este es un ejemplo simplificado.
-Un servidor real con I/O no bloqueante y un thread pool requeriría
-un manejo mucho más sofisticado de los estados de conexión,
-la lectura y escritura parcial de datos,
-y posiblemente el uso de mecanismos de notificación de eventos más avanzados
-(como epoll en Linux para un mayor rendimiento con un gran número de conexiones).
-Sin embargo, este bloque sienta las bases para entender cómo integrar la I/O no bloqueante
-con un thread pool usando select para la aceptación de conexiones.
+#define _GNU_SOURCE // accept4, pthread_setaffinity_np
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h> // Para inet_ntoa y ntohs
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <errno.h>
+
+#define PORT 8080
+#define LISTEN_BACKLOG SOMAXCONN
+#define MAX_EVENTS 256   // eventos que devuelve cada epoll_wait
+#define MAX_REACTORS 64  // bucles de eventos en modo reuseport
+#define URING_ENTRIES 256      // entradas de la cola de envío de cada anillo io_uring
+#define URING_BUFFERS 512      // buffers de recepción provistos al kernel por anillo, potencia de dos
+#define URING_BUFFER_GROUP 0
+#define THREAD_POOL_SIZE 4
+#define MAX_TASKS 20
+#define BUFFER_SIZE 1024
+#define MAX_FRAME_SIZE (1 << 20) // mensaje más largo aceptado, con o sin prefijo de longitud
+#define FRAME_HEADER_MAX 24      // "$<longitud>\n" del mensaje con prefijo
+#define OUTPUT_IOVECS 16         // fragmentos de salida por cada sendmsg
+#define OUTPUT_HIGH_WATER (256 * 1024) // io_uring: salida pendiente a partir de la cual se deja de leer
+#define WORKER_BATCH 8
+#define CACHE_LINE_SIZE 64
+#define SLAB_SIZE (64 * 1024)   // bloque del que se reparten los objetos de una clase
+#define SLAB_MIN_OBJECT 64      // clase más pequeña; cada clase dobla la anterior
+#define SLAB_CLASSES 8          // de 64 B a 8 KiB; lo mayor va a malloc
+#define SLAB_REMOTE_BATCH 32    // liberaciones de objetos de otro hilo entregadas de una vez
+
+// (Incluir aquí las definiciones de task_t y thread_pool_t del Bloque 9, simplificadas si es necesario)
+typedef struct {
+    void (*function)(void *);
+    void *argument;
+    int priority;
+} task_t;
+
+// Cola MPMC acotada con operaciones por lotes (copia del Bloque 6)
+typedef struct {
+    atomic_size_t seq;
+    task_t task;
+} mpmc_cell_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t dequeue_pos;
+    _Alignas(CACHE_LINE_SIZE) mpmc_cell_t *cells;
+    size_t mask;
+} mpmc_queue_t;
+
+typedef struct {
+    mpmc_queue_t tasks;
+    atomic_int idle_workers;
+    atomic_int waiting_submitters;
+    pthread_mutex_t queue_mutex; // solo para dormir/despertar
+    pthread_cond_t queue_not_empty;
+    pthread_cond_t queue_not_full;
+    pthread_t threads[THREAD_POOL_SIZE];
+    atomic_int shutdown;
+} thread_pool_t;
+
+void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks);
+void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument); // Simplificado sin prioridad
+void thread_pool_destroy(thread_pool_t *pool);
+void *worker(void *pool);
+
+// Bucle de eventos. En el modo por defecto hay uno solo y reparte las conexiones al pool;
+// en modo reuseport hay uno por núcleo, cada uno con su listener SO_REUSEPORT,
+// y atiende él mismo las conexiones que aceptó (pool == NULL).
+typedef struct {
+    int epoll_fd;
+    int listen_fd;
+    int cpu;              // CPU a la que se fija el hilo, -1 sin afinidad
+    thread_pool_t *pool;
+    struct uring *ring;   // backend io_uring; NULL con epoll
+    pthread_t thread;
+} reactor_t;
+
+// Asignador por clases de tamaño (slabs) con una caché por hilo, para conexiones y salida
+typedef struct slab {
+    struct slab_cache *owner; // hilo dueño: solo él toca la lista de libres
+    struct slab *next;        // lista de slabs con hueco de su clase
+    struct slab *prev;
+    void *free;               // objetos libres, enlazados por su primera palabra
+    unsigned used;
+    unsigned capacity;
+    int cls;
+    int listed;               // está en la lista de slabs con hueco
+} slab_t;
+
+typedef struct {
+    atomic_size_t slabs;      // slabs de la clase creados por este hilo
+    atomic_size_t objects;    // asignados menos liberados por este hilo (solo la suma es significativa)
+    atomic_size_t bytes;      // bytes pedidos, con la misma convención
+} slab_class_counters_t;
+
+typedef struct slab_cache {
+    slab_t *partial[SLAB_CLASSES];
+    _Alignas(CACHE_LINE_SIZE) void *_Atomic remote; // objetos liberados por otros hilos, pendientes
+    _Alignas(CACHE_LINE_SIZE) slab_class_counters_t stats[SLAB_CLASSES];
+    struct slab_cache *batch_owner; // liberaciones remotas de este hilo aún no entregadas
+    void *batch_head;
+    void *batch_tail;
+    int batch_count;
+    struct slab_cache *next_cache;  // registro global, para las estadísticas
+} slab_cache_t;
+
+typedef struct {
+    size_t object_size;
+    size_t slabs;
+    size_t objects;
+    size_t bytes;             // bytes pedidos por los objetos vivos
+} slab_stats_t;
+
+void *slab_alloc(size_t size);
+void slab_free(void *ptr, size_t size);
+void slab_stats(slab_stats_t stats[SLAB_CLASSES]);
+
+// Fragmento de la cola de salida. Las respuestas se copian al último fragmento
+// y la cola se envía con un solo sendmsg de hasta OUTPUT_IOVECS fragmentos.
+typedef struct output_chunk {
+    struct output_chunk *next;
+    size_t off;  // bytes ya enviados
+    size_t len;  // bytes escritos
+    size_t cap;
+    char data[];
+} output_chunk_t;
+
+typedef struct {
+    output_chunk_t *head;
+    output_chunk_t *tail;
+    size_t len;  // bytes pendientes en toda la cola
+} output_queue_t;
+
+// Estado de una conexión. Una conexión ociosa solo ocupa esta estructura:
+// el buffer de lectura está en la pila del trabajador, 'in' solo existe mientras
+// hay un mensaje a medio recibir y la cola de salida mientras hay bytes que el socket no aceptó.
+typedef struct connection {
+    int client_fd;
+    reactor_t *reactor; // reactor en el que está registrada, para rearmarla
+    char *in;           // mensaje incompleto, crece hasta MAX_FRAME_SIZE
+    size_t in_len;
+    size_t in_cap;
+    output_queue_t out; // respuestas pendientes de enviar
+    // Solo en el backend io_uring: operaciones en vuelo que aún referencian la conexión
+    int recv_armed;     // recv multishot activo
+    output_queue_t sending;  // fragmentos del send en vuelo (la salida nueva va a 'out')
+    struct uring_send *send; // msghdr del send en vuelo, reservado junto a la conexión
+    int close_linked;   // el send en vuelo lleva enlazado el close
+    int closing;        // el cliente cerró o hubo un error: cerrar al terminar el send
+    int recv_paused;    // contrapresión: recv cancelado hasta que baje la salida
+    char *held;         // lo que entregó el recv mientras se cancelaba, aún sin procesar
+    size_t held_len;
+    size_t held_off;
+    unsigned deferred;  // operaciones (1 << URING_OP_*) que esperan un SQE libre
+    struct connection *next_deferred;
+} connection_t;
+
+void handle_client(void *arg);
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static void mpmc_wait_seq(mpmc_cell_t *cell, size_t expected) {
+    for (int spins = 0; atomic_load_explicit(&cell->seq, memory_order_acquire) != expected; ++spins) {
+        if (spins < 64) cpu_relax();
+        else sched_yield();
+    }
+}
+
+static int mpmc_queue_init(mpmc_queue_t *q, size_t capacity) {
+    size_t cap = 2;
+    while (cap < capacity) cap *= 2;
+    q->cells = malloc(sizeof(mpmc_cell_t) * cap);
+    if (!q->cells) return -1;
+    for (size_t i = 0; i < cap; ++i) atomic_init(&q->cells[i].seq, i);
+    q->mask = cap - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    return 0;
+}
+
+static size_t mpmc_enqueue_bulk(mpmc_queue_t *q, const task_t *tasks, size_t n) {
+    size_t cap = q->mask + 1;
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    size_t k;
+    for (;;) {
+        size_t used = pos - atomic_load_explicit(&q->dequeue_pos, memory_order_acquire);
+        if (used > cap) {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+            continue;
+        }
+        if (used == cap) return 0;
+        k = n < cap - used ? n : cap - used;
+        if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + k,
+                                                  memory_order_relaxed, memory_order_relaxed)) break;
+    }
+    for (size_t i = 0; i < k; ++i) {
+        mpmc_cell_t *cell = &q->cells[(pos + i) & q->mask];
+        mpmc_wait_seq(cell, pos + i);
+        cell->task = tasks[i];
+        atomic_store_explicit(&cell->seq, pos + i + 1, memory_order_release);
+    }
+    return k;
+}
+
+static size_t mpmc_dequeue_bulk(mpmc_queue_t *q, task_t *tasks, size_t n) {
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    size_t k;
+    for (;;) {
+        size_t avail = atomic_load_explicit(&q->enqueue_pos, memory_order_acquire) - pos;
+        if (avail == 0) return 0;
+        if (avail > q->mask + 1) {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+            continue;
+        }
+        k = n < avail ? n : avail;
+        if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + k,
+                                                  memory_order_relaxed, memory_order_relaxed)) break;
+    }
+    for (size_t i = 0; i < k; ++i) {
+        mpmc_cell_t *cell = &q->cells[(pos + i) & q->mask];
+        mpmc_wait_seq(cell, pos + i + 1);
+        tasks[i] = cell->task;
+        atomic_store_explicit(&cell->seq, pos + i + q->mask + 1, memory_order_release);
+    }
+    return k;
+}
+
+static size_t mpmc_size(mpmc_queue_t *q) {
+    size_t tail = atomic_load_explicit(&q->enqueue_pos, memory_order_acquire);
+    size_t head = atomic_load_explicit(&q->dequeue_pos, memory_order_acquire);
+    return tail > head ? tail - head : 0;
+}
+
+void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks) {
+    if (mpmc_queue_init(&pool->tasks, max_tasks) != 0) perror("malloc tasks failed");
+    atomic_init(&pool->idle_workers, 0);
+    atomic_init(&pool->waiting_submitters, 0);
+    atomic_init(&pool->shutdown, 0);
+    pthread_mutex_init(&pool->queue_mutex, NULL);
+    pthread_cond_init(&pool->queue_not_empty, NULL);
+    pthread_cond_init(&pool->queue_not_full, NULL);
+    for (int i = 0; i < num_threads; ++i) {
+        pthread_create(&pool->threads[i], NULL, worker, pool);
+    }
+}
+
+void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument) {
+    // Sin lock por tarea: solo se toma el mutex si hay que despertar o esperar
+    task_t task = {function, argument, 0};
+    while (mpmc_enqueue_bulk(&pool->tasks, &task, 1) == 0) {
+        pthread_mutex_lock(&pool->queue_mutex);
+        atomic_fetch_add_explicit(&pool->waiting_submitters, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (mpmc_size(&pool->tasks) > pool->tasks.mask && !atomic_load(&pool->shutdown)) {
+            pthread_cond_wait(&pool->queue_not_full, &pool->queue_mutex);
+        }
+        atomic_fetch_sub_explicit(&pool->waiting_submitters, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&pool->queue_mutex);
+        if (atomic_load(&pool->shutdown)) return;
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pool->idle_workers, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&pool->queue_mutex);
+        pthread_cond_signal(&pool->queue_not_empty);
+        pthread_mutex_unlock(&pool->queue_mutex);
+    }
+}
+
+void *worker(void *pool) {
+    thread_pool_t *p = (thread_pool_t *)pool;
+    task_t batch[WORKER_BATCH];
+    while (1) {
+        size_t want = mpmc_size(&p->tasks) / THREAD_POOL_SIZE;
+        if (want < 1) want = 1;
+        if (want > WORKER_BATCH) want = WORKER_BATCH;
+        size_t k = mpmc_dequeue_bulk(&p->tasks, batch, want);
+        if (k == 0) {
+            pthread_mutex_lock(&p->queue_mutex);
+            atomic_fetch_add_explicit(&p->idle_workers, 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            while (mpmc_size(&p->tasks) == 0 && !atomic_load(&p->shutdown)) {
+                pthread_cond_wait(&p->queue_not_empty, &p->queue_mutex);
+            }
+            atomic_fetch_sub_explicit(&p->idle_workers, 1, memory_order_relaxed);
+            pthread_mutex_unlock(&p->queue_mutex);
+            if (atomic_load(&p->shutdown)) pthread_exit(NULL);
+            continue;
+        }
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&p->waiting_submitters, memory_order_relaxed) > 0) {
+            pthread_mutex_lock(&p->queue_mutex);
+            pthread_cond_broadcast(&p->queue_not_full);
+            pthread_mutex_unlock(&p->queue_mutex);
+        }
+        for (size_t i = 0; i < k; ++i) {
+            batch[i].function(batch[i].argument);
+        }
+    }
+    return NULL;
+}
+
+void thread_pool_destroy(thread_pool_t *pool) {
+    pthread_mutex_lock(&pool->queue_mutex);
+    atomic_store(&pool->shutdown, 1);
+    pthread_cond_broadcast(&pool->queue_not_empty);
+    pthread_cond_broadcast(&pool->queue_not_full);
+    pthread_mutex_unlock(&pool->queue_mutex);
+    for (int i = 0; i < THREAD_POOL_SIZE; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->tasks.cells);
+    pthread_cond_destroy(&pool->queue_not_empty);
+    pthread_cond_destroy(&pool->queue_not_full);
+    pthread_mutex_destroy(&pool->queue_mutex);
+}
+
+// Implementación del asignador por clases de tamaño
+static pthread_mutex_t slab_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static slab_cache_t *slab_registry = NULL;
+static _Thread_local slab_cache_t *slab_local = NULL;
+
+static int slab_class(size_t size) {
+    /* Clase i = objetos de SLAB_MIN_OBJECT << i bytes; -1 si no cabe en ninguna. */
+    if (size <= SLAB_MIN_OBJECT) return 0;
+    int cls = 64 - __builtin_clzl(size - 1) - __builtin_ctz(SLAB_MIN_OBJECT);
+    return cls < SLAB_CLASSES ? cls : -1;
+}
+
+static slab_cache_t *slab_cache_get(void) {
+    /* Caché del hilo, creada en su primera asignación o liberación y registrada para slab_stats. */
+    if (slab_local) return slab_local;
+    slab_cache_t *cache = aligned_alloc(CACHE_LINE_SIZE, sizeof(slab_cache_t));
+    if (!cache) return NULL;
+    memset(cache, 0, sizeof(*cache));
+    atomic_init(&cache->remote, NULL);
+    pthread_mutex_lock(&slab_registry_mutex);
+    cache->next_cache = slab_registry;
+    slab_registry = cache;
+    pthread_mutex_unlock(&slab_registry_mutex);
+    slab_local = cache;
+    return cache;
+}
+
+static void slab_counter_add(atomic_size_t *counter, size_t delta) {
+    // Un solo escritor por contador: load + store relajados, sin instrucción atómica con lock
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+static void slab_list_add(slab_cache_t *cache, slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = cache->partial[slab->cls];
+    if (slab->next) slab->next->prev = slab;
+    cache->partial[slab->cls] = slab;
+    slab->listed = 1;
+}
+
+static void slab_list_remove(slab_cache_t *cache, slab_t *slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else cache->partial[slab->cls] = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->listed = 0;
+}
+
+static slab_t *slab_create(slab_cache_t *cache, int cls) {
+    /* Reserva un slab alineado a SLAB_SIZE (así un objeto encuentra su slab enmascarando la dirección). */
+    slab_t *slab = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+    if (!slab) return NULL;
+    size_t object_size = (size_t)SLAB_MIN_OBJECT << cls;
+    size_t header = (sizeof(slab_t) + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+    slab->owner = cache;
+    slab->cls = cls;
+    slab->used = 0;
+    slab->capacity = (SLAB_SIZE - header) / object_size;
+    slab->free = NULL;
+    for (unsigned i = slab->capacity; i-- > 0;) {
+        void **object = (void **)((char *)slab + header + i * object_size);
+        *object = slab->free;
+        slab->free = object;
+    }
+    slab_counter_add(&cache->stats[cls].slabs, 1);
+    slab_list_add(cache, slab);
+    return slab;
+}
+
+static void slab_free_local(slab_cache_t *cache, slab_t *slab, void *ptr) {
+    /*
+    Devuelve un objeto a un slab propio. Un slab vacío se libera si la clase tiene otro con hueco,
+    para no guardar memoria que ya no se usa tras un pico de conexiones o de valores.
+    */
+    *(void **)ptr = slab->free;
+    slab->free = ptr;
+    slab->used--;
+    if (!slab->listed) slab_list_add(cache, slab);
+    if (slab->used == 0 && (slab->prev || slab->next)) {
+        slab_list_remove(cache, slab);
+        slab_counter_add(&cache->stats[slab->cls].slabs, (size_t)-1);
+        free(slab);
+    }
+}
+
+static void slab_drain_remote(slab_cache_t *cache) {
+    /* Recoge con un solo intercambio atómico todos los objetos que otros hilos liberaron. */
+    void *object = atomic_exchange_explicit(&cache->remote, NULL, memory_order_acquire);
+    while (object) {
+        void *next = *(void **)object;
+        slab_free_local(cache, (slab_t *)((uintptr_t)object & ~(uintptr_t)(SLAB_SIZE - 1)), object);
+        object = next;
+    }
+}
+
+static void slab_push_remote(slab_cache_t *owner, void *first, void *last) {
+    /* Entrega una cadena de objetos a su dueño con un solo CAS, sea cual sea su longitud. */
+    void *head = atomic_load_explicit(&owner->remote, memory_order_relaxed);
+    do {
+        *(void **)last = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote, &head, first,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+static void slab_flush_remote(slab_cache_t *cache) {
+    if (!cache->batch_owner) return;
+    slab_push_remote(cache->batch_owner, cache->batch_head, cache->batch_tail);
+    cache->batch_owner = NULL;
+    cache->batch_head = cache->batch_tail = NULL;
+    cache->batch_count = 0;
+}
+
+static size_t slab_usable_size(size_t size) {
+    /* Bytes realmente disponibles al pedir size: el tamaño de su clase, o size si va a malloc. */
+    int cls = slab_class(size);
+    return cls < 0 ? size : (size_t)SLAB_MIN_OBJECT << cls;
+}
+
+void *slab_alloc(size_t size) {
+    /*
+    Asigna size bytes de la caché del hilo.
+
+    - Tamaños de más de SLAB_MIN_OBJECT << (SLAB_CLASSES - 1) bytes van a malloc.
+    - Toma un objeto del primer slab con hueco de la clase, sin locks ni atómicas.
+    - Si no hay, recoge antes las liberaciones remotas; si sigue sin haber, crea un slab.
+    */
+    int cls = slab_class(size);
+    if (cls < 0) return malloc(size);
+    slab_cache_t *cache = slab_cache_get();
+    if (!cache) return NULL;
+
+    slab_t *slab = cache->partial[cls];
+    if (!slab) {
+        slab_drain_remote(cache);
+        slab = cache->partial[cls];
+    }
+    if (!slab && !(slab = slab_create(cache, cls))) return NULL;
+
+    void *object = slab->free;
+    slab->free = *(void **)object;
+    if (++slab->used == slab->capacity) slab_list_remove(cache, slab);
+    slab_counter_add(&cache->stats[cls].objects, 1);
+    slab_counter_add(&cache->stats[cls].bytes, size);
+    return object;
+}
+
+void slab_free(void *ptr, size_t size) {
+    /*
+    Libera un objeto de slab_alloc; size debe ser el mismo que se pidió.
+
+    - Si el slab es del hilo, el objeto vuelve a su lista de libres directamente.
+    - Si es de otro hilo, se acumula en un lote (enlazado por los propios objetos)
+      que se entrega al dueño de una vez al llenarse o al cambiar de dueño:
+      una operación atómica cada SLAB_REMOTE_BATCH liberaciones en lugar de una por objeto,
+      y nunca un lock compartido como los de las arenas de malloc.
+    */
+    if (!ptr) return;
+    int cls = slab_class(size);
+    if (cls < 0) {
+        free(ptr);
+        return;
+    }
+    slab_t *slab = (slab_t *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+    slab_cache_t *cache = slab_cache_get();
+    if (!cache) { // sin caché propia (sin memoria): se devuelve suelto, sin lote ni contadores
+        slab_push_remote(slab->owner, ptr, ptr);
+        return;
+    }
+    slab_counter_add(&cache->stats[cls].objects, (size_t)-1);
+    slab_counter_add(&cache->stats[cls].bytes, (size_t)0 - size);
+
+    if (slab->owner == cache) {
+        slab_free_local(cache, slab, ptr);
+        return;
+    }
+    if (cache->batch_owner != slab->owner) {
+        slab_flush_remote(cache);
+        cache->batch_owner = slab->owner;
+        cache->batch_tail = ptr;
+        *(void **)ptr = NULL;
+    } else {
+        *(void **)ptr = cache->batch_head;
+    }
+    cache->batch_head = ptr;
+    if (++cache->batch_count == SLAB_REMOTE_BATCH) slab_flush_remote(cache);
+}
+
+void slab_stats(slab_stats_t stats[SLAB_CLASSES]) {
+    /* Suma los contadores de todas las cachés: slabs, objetos vivos y bytes pedidos por clase. */
+    for (int i = 0; i < SLAB_CLASSES; ++i) {
+        stats[i].object_size = (size_t)SLAB_MIN_OBJECT << i;
+        stats[i].slabs = stats[i].objects = stats[i].bytes = 0;
+    }
+    pthread_mutex_lock(&slab_registry_mutex);
+    for (slab_cache_t *cache = slab_registry; cache; cache = cache->next_cache) {
+        for (int i = 0; i < SLAB_CLASSES; ++i) {
+            stats[i].slabs += atomic_load_explicit(&cache->stats[i].slabs, memory_order_relaxed);
+            stats[i].objects += atomic_load_explicit(&cache->stats[i].objects, memory_order_relaxed);
+            stats[i].bytes += atomic_load_explicit(&cache->stats[i].bytes, memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&slab_registry_mutex);
+}
+
+static char *output_reserve(output_queue_t *q, size_t len) {
+    /* Retorna hueco para len bytes al final de la cola, añadiendo un fragmento si no cabe. */
+    output_chunk_t *tail = q->tail;
+    if (!tail || tail->cap - tail->len < len) {
+        // Los fragmentos llenan su clase del asignador: BUFFER_SIZE bytes con la cabecera
+        size_t size = sizeof(output_chunk_t) + len > BUFFER_SIZE ? sizeof(output_chunk_t) + len : BUFFER_SIZE;
+        size = slab_usable_size(size);
+        size_t cap = size - sizeof(output_chunk_t);
+        output_chunk_t *c = slab_alloc(size);
+        if (!c) return NULL;
+        c->next = NULL;
+        c->off = 0;
+        c->len = 0;
+        c->cap = cap;
+        if (tail) tail->next = c;
+        else q->head = c;
+        q->tail = tail = c;
+    }
+    return tail->data + tail->len;
+}
+
+static int output_append(output_queue_t *q, const char *data, size_t len) {
+    /* Copia len bytes al final de la cola. Retorna -1 si falla la reserva. */
+    char *dst = output_reserve(q, len);
+    if (!dst) return -1;
+    memcpy(dst, data, len);
+    q->tail->len += len;
+    q->len += len;
+    return 0;
+}
+
+static int output_iov(const output_queue_t *q, struct iovec *iov, int max) {
+    /* Describe hasta max fragmentos pendientes de la cola para sendmsg. Retorna cuántos. */
+    int n = 0;
+    for (output_chunk_t *c = q->head; c && n < max; c = c->next) {
+        iov[n].iov_base = c->data + c->off;
+        iov[n].iov_len = c->len - c->off;
+        ++n;
+    }
+    return n;
+}
+
+static void output_consume(output_queue_t *q, size_t n) {
+    /* Descarta n bytes enviados del principio de la cola y libera los fragmentos agotados. */
+    q->len -= n;
+    while (n > 0) {
+        output_chunk_t *c = q->head;
+        size_t k = c->len - c->off;
+        if (k > n) {
+            c->off += n;
+            return;
+        }
+        n -= k;
+        q->head = c->next;
+        if (!q->head) q->tail = NULL;
+        slab_free(c, sizeof(output_chunk_t) + c->cap);
+    }
+}
+
+static void output_reset(output_queue_t *q) {
+    while (q->head) {
+        output_chunk_t *c = q->head;
+        q->head = c->next;
+        slab_free(c, sizeof(output_chunk_t) + c->cap);
+    }
+    q->tail = NULL;
+    q->len = 0;
+}
+
+static void close_connection(connection_t *conn) {
+    // close() también lo quita del epoll: el fd no está duplicado
+    printf("Cliente fd %d desconectado\n", conn->client_fd);
+    close(conn->client_fd);
+    output_reset(&conn->out);
+    free(conn->in);
+    slab_free(conn, sizeof(connection_t));
+}
+
+static int rearm_connection(connection_t *conn) {
+    /*
+    Vuelve a armar la conexión en el epoll (EPOLLONESHOT): esperando datos si no hay salida pendiente,
+    o esperando hueco en el socket si la hay. Con EPOLL_CTL_MOD el kernel revisa el estado actual,
+    así que no se pierde un evento que llegó mientras el trabajador procesaba.
+    En modo reuseport la conexión está registrada para siempre con EPOLLIN | EPOLLOUT
+    y no hace falta rearmarla.
+    */
+    if (!conn->reactor->pool) return 0;
+    struct epoll_event ev;
+    ev.events = (conn->out.len > 0 ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    return epoll_ctl(conn->reactor->epoll_fd, EPOLL_CTL_MOD, conn->client_fd, &ev);
+}
+
+static int flush_output(connection_t *conn) {
+    /*
+    Envía la salida pendiente hasta vaciarla o hasta EAGAIN. Retorna -1 si la conexión falló.
+    sendmsg es el writev de los sockets (admite MSG_NOSIGNAL): varios fragmentos
+    salen en una sola llamada, y un envío parcial deja la cola lista para retomarlo.
+    */
+    struct iovec iov[OUTPUT_IOVECS];
+    while (conn->out.len > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = output_iov(&conn->out, iov, OUTPUT_IOVECS);
+        ssize_t n = sendmsg(conn->client_fd, &msg, MSG_NOSIGNAL);
+        if (n > 0) {
+            output_consume(&conn->out, n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int next_frame(const char *buf, size_t len, size_t *start, size_t *frame_len, size_t *consumed) {
+    /*
+    Busca un mensaje completo al principio de buf. Hay dos formatos:
+    - Línea terminada en '\n' (el '\r' previo, si lo hay, no forma parte del mensaje).
+    - Mensaje con prefijo de longitud: "$<n>\n" seguido de n bytes cualesquiera y un '\n' final.
+    Retorna 1 y la posición del mensaje si está completo, 0 si faltan bytes
+    y -1 si el prefijo no es válido o el mensaje supera MAX_FRAME_SIZE.
+    */
+    if (len > 0 && buf[0] == '$') {
+        const char *nl = memchr(buf, '\n', len < FRAME_HEADER_MAX ? len : FRAME_HEADER_MAX);
+        if (!nl) return len < FRAME_HEADER_MAX ? 0 : -1;
+        size_t n = 0;
+        const char *p = buf + 1;
+        if (p == nl) return -1;
+        for (; p < nl; ++p) {
+            if (*p < '0' || *p > '9') return -1;
+            n = n * 10 + (*p - '0');
+            if (n > MAX_FRAME_SIZE) return -1;
+        }
+        size_t header = nl - buf + 1;
+        if (len < header + n + 1) return 0;
+        if (buf[header + n] != '\n') return -1;
+        *start = header;
+        *frame_len = n;
+        *consumed = header + n + 1;
+        return 1;
+    }
+    const char *nl = memchr(buf, '\n', len);
+    if (!nl) return len > MAX_FRAME_SIZE ? -1 : 0;
+    *start = 0;
+    *frame_len = nl - buf;
+    if (*frame_len > 0 && nl[-1] == '\r') --*frame_len;
+    *consumed = nl - buf + 1;
+    return 1;
+}
+
+static long process_frames(connection_t *conn, char *buf, size_t len) {
+    /*
+    Responde a cada mensaje completo de buf con su eco (con el mismo formato con el que llegó).
+    Retorna los bytes consumidos; el resto es un mensaje incompleto. Retorna -1 si hay
+    un mensaje inválido o no se pudo encolar la respuesta.
+    */
+    size_t used = 0;
+    while (used < len) {
+        size_t start, frame_len, consumed;
+        int r = next_frame(buf + used, len - used, &start, &frame_len, &consumed);
+        if (r == 0) break;
+        if (r < 0 || output_append(&conn->out, buf + used, consumed) < 0) return -1;
+        used += consumed;
+    }
+    return (long)used;
+}
+
+static int consume_input(connection_t *conn, char *data, size_t len) {
+    /*
+    Procesa los bytes recibidos. Si no hay un mensaje a medias, se procesan directamente
+    desde el buffer de recepción y solo el resto incompleto se copia a conn->in;
+    si lo hay, los bytes se añaden a conn->in, que crece según haga falta.
+    conn->in se libera en cuanto queda vacío. Retorna -1 si la conexión debe cerrarse.
+    */
+    char *buf = data;
+    size_t buf_len = len;
+    if (conn->in_len > 0) {
+        if (conn->in_len + len > conn->in_cap) {
+            size_t cap = conn->in_cap;
+            while (cap < conn->in_len + len) cap *= 2;
+            char *in = realloc(conn->in, cap);
+            if (!in) return -1;
+            conn->in = in;
+            conn->in_cap = cap;
+        }
+        memcpy(conn->in + conn->in_len, data, len);
+        conn->in_len += len;
+        buf = conn->in;
+        buf_len = conn->in_len;
+    }
+
+    long used = process_frames(conn, buf, buf_len);
+    if (used < 0) return -1;
+    size_t rest = buf_len - used;
+    if (rest == 0) {
+        free(conn->in);
+        conn->in = NULL;
+        conn->in_len = conn->in_cap = 0;
+    } else if (buf == conn->in) {
+        memmove(conn->in, conn->in + used, rest);
+        conn->in_len = rest;
+    } else {
+        size_t cap = rest > BUFFER_SIZE ? rest : BUFFER_SIZE;
+        conn->in = malloc(cap);
+        if (!conn->in) return -1;
+        memcpy(conn->in, buf + used, rest);
+        conn->in_len = rest;
+        conn->in_cap = cap;
+    }
+    return 0;
+}
+
+void handle_client(void *arg) {
+    /*
+    Función que se ejecuta en un hilo del pool cuando el reactor ve actividad en una conexión.
+
+    - Recibe un puntero al connection_t de la conexión. Por EPOLLONESHOT,
+      ningún otro trabajador la procesa a la vez. En modo reuseport se ejecuta
+      en el propio hilo del reactor que aceptó la conexión.
+    - Envía primero la salida pendiente; si el socket sigue lleno, no lee más
+      (contrapresión) y espera EPOLLOUT.
+    - Lee datos del socket hasta EAGAIN: con disparo por flanco, un evento
+      no se repite por los datos que queden sin leer.
+    - Separa los mensajes completos (líneas o mensajes con prefijo de longitud) y responde
+      a cada uno con su eco; un mensaje partido entre lecturas espera en la conexión al resto.
+      Las respuestas de todas las lecturas se envían juntas con sendmsg.
+    - Si el cliente cerró o hubo un error, cierra la conexión; si no, la rearma en el epoll.
+    */
+    connection_t *conn = (connection_t *)arg;
+    char buffer[BUFFER_SIZE];
+
+    if (conn->out.len > 0 && flush_output(conn) < 0) {
+        close_connection(conn);
+        return;
+    }
+    while (conn->out.len == 0) {
+        ssize_t n = recv(conn->client_fd, buffer, sizeof(buffer), 0);
+        if (n > 0) {
+            if (consume_input(conn, buffer, n) < 0) {
+                flush_output(conn); // lo ya respondido antes del mensaje inválido
+                close_connection(conn);
+                return;
+            }
+            if (flush_output(conn) < 0) {
+                close_connection(conn);
+                return;
+            }
+        } else if (n == 0) {
+            close_connection(conn);
+            return;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            perror("recv failed");
+            close_connection(conn);
+            return;
+        }
+    }
+    if (rearm_connection(conn) < 0) {
+        perror("epoll_ctl rearm failed");
+        close_connection(conn);
+    }
+}
+
+static void accept_connections(reactor_t *reactor) {
+    /*
+    Acepta todas las conexiones pendientes: el listener también es de disparo por flanco,
+    así que hay que vaciar la cola de accept hasta EAGAIN o no llegará otro evento.
+    Cada cliente nace no bloqueante (accept4) y se registra con su connection_t
+    en el epoll de este reactor, al que queda fijado.
+    */
+    while (1) {
+        struct sockaddr_in address;
+        socklen_t addrlen = sizeof(address);
+        int new_socket = accept4(reactor->listen_fd, (struct sockaddr *)&address, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (new_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept failed"); // p. ej. EMFILE
+            return;
+        }
+
+        printf("Nueva conexión aceptada, socket fd es %d, IP es: %s, puerto: %d\n", new_socket, inet_ntoa(address.sin_addr), ntohs(address.sin_port));
+
+        connection_t *conn = slab_alloc(sizeof(connection_t));
+        if (!conn) {
+            perror("slab_alloc connection failed");
+            close(new_socket);
+            continue;
+        }
+        memset(conn, 0, sizeof(connection_t));
+        conn->client_fd = new_socket;
+        conn->reactor = reactor;
+
+        struct epoll_event ev;
+        ev.events = reactor->pool ? EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT
+                                  : EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, new_socket, &ev) < 0) {
+            perror("epoll_ctl add client failed");
+            close(new_socket);
+            slab_free(conn, sizeof(connection_t));
+        }
+    }
+}
+
+static void raise_fd_limit(void) {
+    // Cada conexión es un descriptor: subir el límite blando al duro (100k conexiones ociosas)
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static int create_listener(int reuseport) {
+    /*
+    Crea el socket de escucha no bloqueante en PORT.
+    Con 'reuseport' activa SO_REUSEPORT: varios sockets pueden escuchar en el mismo puerto
+    y el kernel reparte las conexiones entrantes entre ellos.
+    Retorna el descriptor, o -1 en error.
+    */
+    int server_fd;
+    struct sockaddr_in address;
+
+    // Crear socket del servidor
+    if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror("socket failed");
+        return -1;
+    }
+
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reuseport && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt SO_REUSEPORT failed");
+        close(server_fd);
+        return -1;
+    }
+
+    // Configurar socket no bloqueante
+    int flags = fcntl(server_fd, F_GETFL, 0);
+    if (fcntl(server_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        perror("fcntl nonblock failed");
+        close(server_fd);
+        return -1;
+    }
+
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(PORT);
+
+    // Bind del socket
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(server_fd);
+        return -1;
+    }
+
+    // Escuchar por conexiones
+    if (listen(server_fd, LISTEN_BACKLOG) < 0) {
+        perror("listen failed");
+        close(server_fd);
+        return -1;
+    }
+    return server_fd;
+}
+
+static int reactor_init(reactor_t *reactor, int reuseport, int cpu, thread_pool_t *pool) {
+    /* Crea el listener y el epoll del reactor y registra el listener (data.ptr == NULL lo identifica). */
+    reactor->cpu = cpu;
+    reactor->pool = pool;
+    reactor->ring = NULL;
+    if ((reactor->listen_fd = create_listener(reuseport)) < 0) return -1;
+    if ((reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        perror("epoll_create1 failed");
+        close(reactor->listen_fd);
+        return -1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->listen_fd, &ev) < 0) {
+        perror("epoll_ctl add listener failed");
+        close(reactor->epoll_fd);
+        close(reactor->listen_fd);
+        return -1;
+    }
+    return 0;
+}
+
+void *reactor_loop(void *arg) {
+    /*
+    Bucle de eventos de un reactor.
+
+    - Si tiene CPU asignada, fija el hilo a ella: las conexiones, sus buffers y las estructuras
+      del kernel del socket se quedan en la caché de ese núcleo.
+    - Acepta las conexiones de su listener y espera actividad en ellas con epoll_wait.
+    - Con pool, cada conexión activa se envía como tarea (queda desarmada por EPOLLONESHOT
+      hasta que el trabajador la rearme); sin pool, la atiende el propio reactor:
+      no hay traspaso entre hilos.
+    */
+    reactor_t *reactor = (reactor_t *)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    if (reactor->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(reactor->cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) fprintf(stderr, "No se pudo fijar el reactor a la CPU %d: %s\n", reactor->cpu, strerror(rc));
+    }
+
+    while (1) {
+        int n = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno != EINTR) perror("epoll_wait error");
+            continue;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.ptr == NULL) {
+                accept_connections(reactor);
+            } else if (reactor->pool) {
+                thread_pool_submit(reactor->pool, handle_client, events[i].data.ptr);
+            } else {
+                handle_client(events[i].data.ptr);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Backend io_uring. Se usan directamente las llamadas al sistema y <linux/io_uring.h>,
+// sin liburing, para no añadir dependencias: el programa sigue compilando con gcc y -lpthread.
+typedef struct uring {
+    int ring_fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned sqe_tail;     // SQEs preparados, publicados al kernel en uring_enter
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    struct io_uring_buf_ring *buf_ring; // buffers de recepción provistos al kernel
+    char *buffers;
+    unsigned short buf_tail;
+    connection_t *deferred; // conexiones con operaciones sin SQE, reintentadas en cada vuelta
+    int accept_deferred;
+} uring_t;
+
+// msghdr e iovecs de un sendmsg en vuelo: el kernel los lee hasta que se completa.
+// Se reservan junto a las conexiones del backend io_uring; las de epoll no los necesitan.
+typedef struct uring_send {
+    struct msghdr msg;
+    struct iovec iov[OUTPUT_IOVECS];
+} uring_send_t;
+
+// user_data = puntero a la conexión | tipo de operación (connection_t está alineada a 8)
+enum { URING_OP_ACCEPT = 0, URING_OP_RECV = 1, URING_OP_SEND = 2, URING_OP_CLOSE = 3, URING_OP_CANCEL = 4, URING_OP_PROBE = 5 };
+#define URING_OP_MASK 7ULL
+
+static int uring_enter(uring_t *ring, unsigned min_complete) {
+    /*
+    Publica los SQEs preparados (release) y, si min_complete > 0, espera completaciones.
+    Se piden todos los que el kernel aún no consumió, también los de un intento fallido.
+    */
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    unsigned submit = ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    int ret = (int)syscall(__NR_io_uring_enter, ring->ring_fd, submit, min_complete,
+                           min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    return ret < 0 && errno != EINTR ? -1 : 0;
+}
+
+static int uring_reserve(uring_t *ring, unsigned n) {
+    /*
+    Asegura n SQEs libres; si la cola está llena, envía lo preparado para hacer sitio.
+    Retorna -1 si el kernel no acepta más envíos (p. ej. EBUSY con la cola de completaciones llena).
+    */
+    while (ring->sqe_tail + n - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) > ring->sq_entries) {
+        if (uring_enter(ring, 0) < 0) return -1;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    /* Siguiente SQE libre, o NULL si no lo hay: el llamante aplaza la operación con uring_defer. */
+    if (uring_reserve(ring, 1) < 0) return NULL;
+    unsigned idx = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    ring->sqe_tail++;
+    return sqe;
+}
+
+static void uring_provide_buffer(uring_t *ring, unsigned short bid) {
+    /* Devuelve un buffer de recepción al anillo de buffers provistos; se publica con uring_publish_buffers. */
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_BUFFERS - 1)];
+    buf->addr = (unsigned long)(ring->buffers + (size_t)bid * BUFFER_SIZE);
+    buf->len = BUFFER_SIZE;
+    buf->bid = bid;
+    ring->buf_tail++;
+}
+
+static void uring_publish_buffers(uring_t *ring) {
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_defer(uring_t *ring, connection_t *conn, int op) {
+    /* Anota una operación sin SQE; uring_retry_deferred la repite antes de la siguiente espera. */
+    if (!conn->deferred) {
+        conn->next_deferred = ring->deferred;
+        ring->deferred = conn;
+    }
+    conn->deferred |= 1u << op;
+}
+
+static int uring_hold_input(connection_t *conn, const char *data, size_t len) {
+    /* Guarda sin procesar lo que entrega el recv durante la pausa. Retorna -1 si falla la memoria. */
+    char *held = realloc(conn->held, conn->held_len + len);
+    if (!held) return -1;
+    memcpy(held + conn->held_len, data, len);
+    conn->held = held;
+    conn->held_len += len;
+    return 0;
+}
+
+static void uring_destroy(uring_t *ring) {
+    if (ring->buf_ring) munmap(ring->buf_ring, sizeof(struct io_uring_buf) * URING_BUFFERS);
+    free(ring->buffers);
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->ring_fd >= 0) close(ring->ring_fd);
+}
+
+static int uring_probe_recv_multishot(uring_t *ring) {
+    /*
+    io_uring_setup y los buffers provistos funcionan desde 5.19, pero el recv multishot es de 6.0:
+    en 5.19 cada recv terminaría con -EINVAL y se cerrarían todas las conexiones.
+    Se prueba con un socketpair: un byte seguido de EOF debe dar una completación con datos
+    e IORING_CQE_F_MORE (y después la final). Retorna 0 si el kernel lo soporta.
+    */
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) return -1;
+    int written = write(sv[1], "x", 1) == 1;
+    close(sv[1]);
+    struct io_uring_sqe *sqe = written ? uring_get_sqe(ring) : NULL;
+    int supported = 0;
+    if (sqe) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sv[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUFFER_GROUP;
+        sqe->user_data = URING_OP_PROBE;
+        for (int more = 1; more && uring_enter(ring, 1) == 0;) {
+            unsigned head = *ring->cq_head;
+            unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+                if (cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE)) supported = 1;
+                if (cqe->flags & IORING_CQE_F_BUFFER) uring_provide_buffer(ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                if (!(cqe->flags & IORING_CQE_F_MORE)) more = 0;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+        uring_publish_buffers(ring);
+    }
+    close(sv[0]);
+    return supported ? 0 : -1;
+}
+
+static int uring_init(uring_t *ring) {
+    /*
+    Crea el anillo y registra URING_BUFFERS buffers de recepción provistos (kernel >= 5.19),
+    y comprueba que el kernel admite el recv multishot (6.0).
+    Retorna -1 si el kernel no soporta io_uring o alguna de estas funciones
+    (o si está deshabilitado, p. ej. por seccomp): el llamante vuelve a epoll.
+    */
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES * 4; // holgura para ráfagas de completaciones multishot
+    ring->ring_fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->ring_fd < 0) return -1;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+        uring_destroy(ring);
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+    ring->cq_ring = ring->sq_ring;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+    char *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(sq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(sq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(sq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(sq + params.cq_off.cqes);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+
+    // Anillo de buffers provistos: el kernel elige un buffer libre al completar cada recv,
+    // así una conexión ociosa no tiene ningún buffer reservado
+    ring->buf_ring = mmap(NULL, sizeof(struct io_uring_buf) * URING_BUFFERS, PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    ring->buffers = malloc((size_t)URING_BUFFERS * BUFFER_SIZE);
+    if (ring->buf_ring == MAP_FAILED || !ring->buffers) {
+        if (ring->buf_ring == MAP_FAILED) ring->buf_ring = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)ring->buf_ring;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        uring_destroy(ring);
+        return -1;
+    }
+    ring->buf_tail = 0;
+    for (unsigned short bid = 0; bid < URING_BUFFERS; ++bid) uring_provide_buffer(ring, bid);
+    uring_publish_buffers(ring);
+    if (uring_probe_recv_multishot(ring) < 0) {
+        uring_destroy(ring);
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    return 0;
+}
+
+static void uring_arm_accept(uring_t *ring, int listen_fd) {
+    /*
+    Accept multishot: un solo SQE produce una completación por cada conexión aceptada.
+    Los clientes quedan bloqueantes a propósito: con O_NONBLOCK io_uring devolvería EAGAIN
+    en vez de esperar él mismo a que el socket esté listo.
+    */
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        ring->accept_deferred = 1;
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = URING_OP_ACCEPT;
+}
+
+static void uring_arm_recv(uring_t *ring, connection_t *conn) {
+    /*
+    Recv multishot con buffer elegido por el kernel del grupo URING_BUFFER_GROUP.
+    Un recv aplazado por falta de SQE ya cuenta como armado: nadie más cierra la conexión.
+    */
+    conn->recv_armed = 1;
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        uring_defer(ring, conn, URING_OP_RECV);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->client_fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = (unsigned long long)(uintptr_t)conn | URING_OP_RECV;
+}
+
+static void uring_cancel_recv(uring_t *ring, connection_t *conn) {
+    /* Cancela el recv multishot de la conexión; su completación final llega con -ECANCELED. */
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        uring_defer(ring, conn, URING_OP_CANCEL);
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (unsigned long long)(uintptr_t)conn | URING_OP_RECV;
+    sqe->user_data = URING_OP_CANCEL; // sin conexión: puede completarse después de liberarla
+}
+
+static void uring_close(uring_t *ring, connection_t *conn) {
+    /* Cierra el socket con IORING_OP_CLOSE; la conexión se libera al completarse. */
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        uring_defer(ring, conn, URING_OP_CLOSE);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = conn->client_fd;
+    sqe->user_data = (unsigned long long)(uintptr_t)conn | URING_OP_CLOSE;
+}
+
+static void uring_submit_send(uring_t *ring, connection_t *conn) {
+    /*
+    Envía lo que queda de 'sending' (hasta OUTPUT_IOVECS fragmentos) con un IORING_OP_SENDMSG.
+    Si la conexión se está cerrando y es el último envío, el send se enlaza con IOSQE_IO_LINK
+    a su IORING_OP_CLOSE: ambos van en el mismo io_uring_enter y el cierre solo se ejecuta
+    si el send se completó entero. Los dos SQEs se reservan juntos: sin sitio, se aplaza el par.
+    */
+    uring_send_t *send = conn->send;
+    memset(&send->msg, 0, sizeof(send->msg));
+    send->msg.msg_iov = send->iov;
+    send->msg.msg_iovlen = output_iov(&conn->sending, send->iov, OUTPUT_IOVECS);
+    size_t len = 0;
+    for (size_t i = 0; i < send->msg.msg_iovlen; ++i) len += send->iov[i].iov_len;
+    int link = conn->closing && !conn->recv_armed && conn->out.len == 0 && len == conn->sending.len;
+    if (uring_reserve(ring, link ? 2 : 1) < 0) {
+        uring_defer(ring, conn, URING_OP_SEND);
+        return;
+    }
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->client_fd;
+    sqe->addr = (unsigned long)&send->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = (unsigned long long)(uintptr_t)conn | URING_OP_SEND;
+    conn->close_linked = link;
+    if (conn->close_linked) {
+        sqe->flags = IOSQE_IO_LINK;
+        uring_close(ring, conn);
+    }
+}
+
+static void uring_flush(uring_t *ring, connection_t *conn) {
+    /*
+    Envía la salida acumulada de la conexión si no hay ya un send en vuelo (así las respuestas
+    salen en orden y un send nunca apunta a un fragmento al que se sigan añadiendo bytes):
+    la cola entera pasa al send y la salida nueva empieza una vacía.
+    Sin salida y con la conexión cerrándose, la cierra.
+    */
+    if (conn->sending.len > 0) return;
+    if (conn->out.len == 0) {
+        if (conn->closing && !conn->recv_armed) uring_close(ring, conn);
+        return;
+    }
+    conn->sending = conn->out;
+    memset(&conn->out, 0, sizeof(conn->out));
+    uring_submit_send(ring, conn);
+}
+
+static void uring_resume_recv(uring_t *ring, connection_t *conn) {
+    /*
+    Sale de la pausa por contrapresión cuando el recv cancelado ya terminó y la salida pendiente
+    bajó a la mitad de OUTPUT_HIGH_WATER. Lo retenido durante la cancelación se procesa
+    de BUFFER_SIZE en BUFFER_SIZE y se para si la salida vuelve a pasar del límite
+    (sigue el siguiente send completado); el recv solo se rearma sin nada retenido.
+    */
+    if (!conn->recv_paused || conn->recv_armed || conn->closing) return;
+    if (conn->out.len + conn->sending.len > OUTPUT_HIGH_WATER / 2) return;
+    while (conn->held_off < conn->held_len && conn->out.len + conn->sending.len <= OUTPUT_HIGH_WATER) {
+        size_t len = conn->held_len - conn->held_off;
+        if (len > BUFFER_SIZE) len = BUFFER_SIZE;
+        if (consume_input(conn, conn->held + conn->held_off, len) < 0) {
+            conn->closing = 1; // sin recv: cierra uring_flush
+            break;
+        }
+        conn->held_off += len;
+    }
+    if (conn->held_off == conn->held_len) {
+        free(conn->held);
+        conn->held = NULL;
+        conn->held_len = conn->held_off = 0;
+    }
+    uring_flush(ring, conn);
+    if (conn->closing || conn->held || conn->out.len + conn->sending.len > OUTPUT_HIGH_WATER) return;
+    conn->recv_paused = 0;
+    uring_arm_recv(ring, conn);
+}
+
+static void uring_retry_deferred(uring_t *ring, reactor_t *reactor) {
+    /*
+    Repite las operaciones que no encontraron SQE. Una conexión con operaciones aplazadas
+    no se libera: su close es una de ellas o aún no se ha pedido.
+    */
+    if (ring->accept_deferred) {
+        ring->accept_deferred = 0;
+        uring_arm_accept(ring, reactor->listen_fd);
+    }
+    connection_t *list = ring->deferred;
+    ring->deferred = NULL;
+    while (list) {
+        connection_t *conn = list;
+        list = conn->next_deferred;
+        unsigned ops = conn->deferred;
+        conn->deferred = 0;
+        // Si entretanto el recv terminó y se rearmó, el cancel aplazado ya no debe tocarlo
+        if ((ops & (1u << URING_OP_CANCEL)) && conn->recv_paused && conn->recv_armed) uring_cancel_recv(ring, conn);
+        if (ops & (1u << URING_OP_RECV)) uring_arm_recv(ring, conn);
+        if (ops & (1u << URING_OP_SEND)) uring_submit_send(ring, conn);
+        if (ops & (1u << URING_OP_CLOSE)) uring_close(ring, conn);
+    }
+}
+
+static void uring_handle_cqe(uring_t *ring, reactor_t *reactor, struct io_uring_cqe *cqe) {
+    /* Procesa una completación. Puede preparar nuevos SQEs, que salen en el siguiente io_uring_enter. */
+    int op = (int)(cqe->user_data & URING_OP_MASK);
+    connection_t *conn = (connection_t *)(uintptr_t)(cqe->user_data & ~URING_OP_MASK);
+
+    switch (op) {
+    case URING_OP_ACCEPT:
+        if (cqe->res >= 0) {
+            connection_t *c = slab_alloc(sizeof(connection_t) + sizeof(uring_send_t));
+            if (!c) {
+                perror("slab_alloc connection failed");
+                close(cqe->res);
+            } else {
+                memset(c, 0, sizeof(connection_t) + sizeof(uring_send_t));
+                printf("Nueva conexión aceptada, socket fd es %d\n", cqe->res);
+                c->client_fd = cqe->res;
+                c->reactor = reactor;
+                c->send = (uring_send_t *)(c + 1);
+                uring_arm_recv(ring, c);
+            }
+        } else if (cqe->res != -EAGAIN && cqe->res != -EINTR) {
+            fprintf(stderr, "accept failed: %s\n", strerror(-cqe->res));
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) uring_arm_accept(ring, reactor->listen_fd);
+        break;
+
+    case URING_OP_RECV:
+        if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+            unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            char *data = ring->buffers + (size_t)bid * BUFFER_SIZE;
+            // En pausa, lo que aún entregue el recv que se está cancelando espera sin procesar
+            if (!conn->closing && (conn->recv_paused ? uring_hold_input(conn, data, cqe->res)
+                                                     : consume_input(conn, data, cqe->res)) < 0) {
+                conn->closing = 1;
+                shutdown(conn->client_fd, SHUT_RD); // termina el recv multishot; lo ya encolado se envía
+            }
+            uring_provide_buffer(ring, bid);
+        }
+        if (!conn->closing && !conn->recv_paused && conn->out.len + conn->sending.len > OUTPUT_HIGH_WATER) {
+            // Contrapresión, como handle_client con epoll: no se leen más peticiones hasta que salga la salida
+            conn->recv_paused = 1;
+            if (cqe->flags & IORING_CQE_F_MORE) uring_cancel_recv(ring, conn);
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            conn->recv_armed = 0;
+            if (!conn->closing && (cqe->res > 0 || cqe->res == -ENOBUFS ||
+                                   (cqe->res == -ECANCELED && conn->recv_paused))) {
+                // Sin buffers libres o multishot cortado por el kernel: se rearma, salvo en pausa
+                if (!conn->recv_paused) uring_arm_recv(ring, conn);
+            } else {
+                if (cqe->res < 0 && cqe->res != -ECONNRESET) fprintf(stderr, "recv failed: %s\n", strerror(-cqe->res));
+                conn->closing = 1; // res == 0: el cliente cerró
+            }
+        }
+        uring_flush(ring, conn);
+        uring_resume_recv(ring, conn);
+        break;
+
+    case URING_OP_SEND:
+        if (cqe->res < 0) {
+            if (cqe->res != -EPIPE && cqe->res != -ECONNRESET) fprintf(stderr, "send failed: %s\n", strerror(-cqe->res));
+            // Si el send falló, el close enlazado se canceló: hay que volver a cerrar
+            output_reset(&conn->sending);
+            output_reset(&conn->out);
+            if (conn->recv_armed) {
+                if (!conn->closing) shutdown(conn->client_fd, SHUT_RDWR); // termina el recv multishot, que cerrará
+            } else {
+                uring_close(ring, conn); // cerrándose o en pausa: no hay recv que cierre
+            }
+            conn->closing = 1;
+            break;
+        }
+        output_consume(&conn->sending, cqe->res);
+        if (conn->sending.len > 0) { // envío parcial (el close enlazado se canceló) o más fragmentos
+            uring_submit_send(ring, conn);
+            break;
+        }
+        if (!conn->close_linked) {
+            uring_flush(ring, conn);
+            uring_resume_recv(ring, conn); // la salida bajó: si estaba en pausa, vuelve a leer
+        }
+        break;
+
+    case URING_OP_CLOSE:
+        if (cqe->res == -ECANCELED) break; // el send enlazado falló; lo cierra su completación
+        printf("Cliente fd %d desconectado\n", conn->client_fd);
+        output_reset(&conn->sending);
+        output_reset(&conn->out);
+        free(conn->in);
+        free(conn->held);
+        slab_free(conn, sizeof(connection_t) + sizeof(uring_send_t));
+        break;
+
+    case URING_OP_CANCEL: // el recv cancelado informa en su propia completación
+        break;
+    }
+}
+
+void *uring_loop(void *arg) {
+    /*
+    Bucle de eventos io_uring de un reactor (mismo listener SO_REUSEPORT y afinidad que reactor_loop).
+
+    - Un único accept multishot para todas las conexiones y un recv multishot por conexión:
+      no hay que volver a pedir la operación tras cada evento.
+    - Los recv usan buffers provistos: el kernel toma uno del anillo al llegar datos
+      y el bucle lo devuelve en cuanto copia los bytes.
+    - Cada vuelta procesa todas las completaciones disponibles y entrega todos los SQEs
+      resultantes (sends, rearmados, cierres) y la espera de la siguiente tanda
+      en una sola llamada a io_uring_enter.
+    - Una conexión con más de OUTPUT_HIGH_WATER bytes de salida pendientes deja de leer:
+      se cancela su recv multishot y se rearma cuando los sends vacían la cola.
+    - Las operaciones que no encontraron SQE se repiten antes de cada espera.
+    */
+    reactor_t *reactor = (reactor_t *)arg;
+    uring_t *ring = reactor->ring;
+
+    if (reactor->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(reactor->cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) fprintf(stderr, "No se pudo fijar el reactor a la CPU %d: %s\n", reactor->cpu, strerror(rc));
+    }
+
+    uring_arm_accept(ring, reactor->listen_fd);
+    while (1) {
+        uring_retry_deferred(ring, reactor);
+        // Con operaciones aún aplazadas no se espera: puede no haber nada en vuelo que despierte el bucle.
+        // EBUSY: la cola de completaciones está llena y el kernel no admite envíos hasta vaciarla
+        int wait = !ring->deferred && !ring->accept_deferred;
+        if (uring_enter(ring, wait) < 0 && errno != EBUSY && errno != EAGAIN) perror("io_uring_enter failed");
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            uring_handle_cqe(ring, reactor, &ring->cqes[head & *ring->cq_mask]);
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        uring_publish_buffers(ring);
+    }
+    return NULL;
+}
+
+static int parse_cpu_list(const char *arg, int *cpus, int max) {
+    /* Convierte "0,2,4" en {0, 2, 4}. Retorna el número de CPUs, o -1 si la lista no es válida. */
+    int n = 0;
+    const char *p = arg;
+    while (*p && n < max) {
+        char *end;
+        long cpu = strtol(p, &end, 10);
+        if (end == p || cpu < 0 || cpu >= CPU_SETSIZE) return -1;
+        cpus[n++] = (int)cpu;
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    thread_pool_t pool;
+
+    raise_fd_limit();
+
+    if (argc > 1 && (strcmp(argv[1], "reuseport") == 0 || strcmp(argv[1], "uring") == 0)) {
+        // Un reactor por núcleo: sin aceptador central ni cola compartida entre hilos
+        static reactor_t reactors[MAX_REACTORS];
+        static uring_t rings[MAX_REACTORS];
+        int use_uring = strcmp(argv[1], "uring") == 0;
+        int cpus[MAX_REACTORS];
+        int ncpu = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        int n;
+        int pin = argc > 2;
+        if (ncpu < 1) ncpu = 1;
+        if (argc > 2 && strcmp(argv[2], "auto") == 0) {
+            n = ncpu < MAX_REACTORS ? ncpu : MAX_REACTORS;
+            for (int i = 0; i < n; ++i) cpus[i] = i;
+        } else if (argc > 2) {
+            if ((n = parse_cpu_list(argv[2], cpus, MAX_REACTORS)) <= 0) {
+                fprintf(stderr, "Lista de CPUs no válida: %s\n", argv[2]);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            n = ncpu < MAX_REACTORS ? ncpu : MAX_REACTORS;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (reactor_init(&reactors[i], 1, pin ? cpus[i] : -1, NULL) < 0) exit(EXIT_FAILURE);
+            if (use_uring && uring_init(&rings[i]) < 0) {
+                // Kernel sin io_uring (o sin buffers provistos, < 5.19): se sigue con epoll
+                fprintf(stderr, "io_uring no disponible (%s), usando epoll\n", strerror(errno));
+                for (int k = 0; k < i; ++k) uring_destroy(&rings[k]);
+                use_uring = 0;
+            }
+        }
+        for (int i = 0; i < n && use_uring; ++i) reactors[i].ring = &rings[i];
+        void *(*loop)(void *) = use_uring ? uring_loop : reactor_loop;
+        printf("Servidor escuchando en el puerto %d con %d reactores SO_REUSEPORT (%s)%s...\n",
+               PORT, n, use_uring ? "io_uring" : "epoll", pin ? " fijados a CPU" : "");
+        for (int i = 1; i < n; ++i) {
+            if (pthread_create(&reactors[i].thread, NULL, loop, &reactors[i]) != 0) {
+                perror("pthread_create reactor failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        loop(&reactors[0]);
+        return 0;
+    }
+
+    // Modo por defecto: un reactor que reparte las conexiones activas al thread pool
+    reactor_t reactor;
+    thread_pool_init(&pool, THREAD_POOL_SIZE, MAX_TASKS);
+    if (reactor_init(&reactor, 0, -1, &pool) < 0) exit(EXIT_FAILURE);
+    printf("Servidor escuchando en el puerto %d...\n", PORT);
+    reactor_loop(&reactor);
+
+    // En un servidor real, aquí habría lógica para una terminación más controlada
+    close(reactor.epoll_fd);
+    close(reactor.listen_fd);
+    thread_pool_destroy(&pool);
+    return 0;
+}
+
+/*
+Compila: gcc pthreads10.c -o nonblocking_io_pool -lpthread
+Ejecuta: ./nonblocking_io_pool [reuseport | uring [auto | lista de CPUs, p. ej. 0,2,4]]
+Explicación:
+    -Socket No Bloqueante:
+        El socket del servidor se configura como no bloqueante
+        usando fcntl(server_fd, F_SETFL, flags | O_NONBLOCK).
+        Esto significa que las llamadas a accept() retornarán inmediatamente,
+        incluso si no hay conexiones pendientes
+        (en cuyo caso retornarán con un error EAGAIN o EWOULDBLOCK).
+        Los clientes se aceptan ya no bloqueantes con accept4(SOCK_NONBLOCK).
+
+    -Reactor epoll con disparo por flanco:
+        El bucle principal espera con epoll_wait sobre el listener y sobre todas las conexiones,
+        sin el límite de FD_SETSIZE de select() y sin reconstruir conjuntos de descriptores.
+        Con EPOLLET un evento solo se notifica cuando cambia el estado, así que el listener
+        se vacía con accept4 hasta EAGAIN y cada lectura de cliente llega hasta EAGAIN.
+        Las conexiones se registran con EPOLLONESHOT: tras un evento quedan desarmadas
+        hasta que el trabajador que las atiende las rearma, de modo que dos hilos nunca
+        procesan la misma conexión a la vez.
+
+    -Estado por Conexión:
+        Cada conexión tiene un connection_t (descriptor, reactor, mensaje a medio recibir
+        y cola de salida). Una conexión ociosa no ocupa más que esa estructura y su descriptor;
+        por eso el servidor sube RLIMIT_NOFILE y usa un backlog de SOMAXCONN
+        para poder mantener decenas de miles de clientes MCX conectados.
+
+    -Cola de Tareas sin Locks:
+        El thread pool usa la cola MPMC por lotes del Bloque 6:
+        encolar una conexión no toma ningún mutex ni hace pthread_cond_signal
+        salvo que haya trabajadores dormidos.
+
+    -Thread Pool para Manejo de Clientes:
+        Cuando una conexión tiene actividad, el reactor no la atiende directamente:
+        envía handle_client con su connection_t como tarea al thread pool.
+
+    -handle_client en el Thread Pool:
+        La función handle_client se ejecuta en uno de los hilos trabajadores del pool.
+        Lee hasta EAGAIN y responde con un eco. Si el socket no acepta toda la respuesta,
+        el resto queda en la salida pendiente, la conexión se rearma con EPOLLOUT
+        y no se lee más hasta vaciarla. Si el cliente cierra, se libera la conexión.
+
+    -Mensajes y conexiones persistentes:
+        La conexión sigue abierta entre peticiones, así que cada mensaje no paga
+        el establecimiento de una conexión TCP. Los mensajes se delimitan dentro del flujo:
+        una línea terminada en '\n', o "$<n>\n" seguido de n bytes y un '\n' para mensajes
+        binarios o con saltos de línea (hasta MAX_FRAME_SIZE). Los mensajes completos
+        se procesan directamente desde el buffer de recepción; solo el trozo de un mensaje
+        partido entre lecturas se copia a un buffer de la conexión, que crece según haga falta
+        y se libera al completarlo. Un mensaje inválido cierra la conexión.
+        Las respuestas se copian a una cola de fragmentos y se envían con sendmsg
+        (el writev de los sockets): varias respuestas salen en una llamada, y si el socket
+        solo acepta una parte, la cola recuerda hasta dónde se envió y se retoma con EPOLLOUT.
+
+    -Modo reuseport (un reactor por núcleo):
+        Con ./nonblocking_io_pool reuseport se lanza un bucle de eventos por CPU en línea,
+        cada uno con su propio socket de escucha con SO_REUSEPORT en el mismo puerto.
+        El kernel reparte las conexiones entrantes entre los listeners, y cada conexión
+        la atiende siempre el reactor que la aceptó: no hay aceptador central,
+        ni cola compartida, ni traspaso de la conexión a otro hilo.
+        Las conexiones se registran una sola vez con EPOLLIN | EPOLLOUT por flanco,
+        sin EPOLLONESHOT, así que tampoco hace falta rearmarlas tras cada evento.
+        La afinidad es configurable: sin más argumentos los hilos no se fijan,
+        con 'auto' el reactor i se fija a la CPU i, y con una lista ('0,2,4')
+        se lanza un reactor por CPU de la lista, fijado a ella.
+
+    -Backend io_uring (./nonblocking_io_pool uring):
+        Igual que el modo reuseport, pero cada reactor usa un anillo io_uring en lugar de epoll.
+        En vez de esperar a que un socket esté listo y luego hacer recv/send (una llamada
+        al sistema por operación), el reactor encola las operaciones y el kernel las completa:
+        un accept multishot sirve para todas las conexiones, cada conexión tiene un recv
+        multishot que usa buffers provistos (el kernel toma uno del anillo de buffers
+        al llegar datos, así las conexiones ociosas no tienen buffer reservado),
+        y el último send antes de cerrar va enlazado (IOSQE_IO_LINK) con el close.
+        Cada vuelta del bucle procesa todas las completaciones y entrega todos los SQEs
+        nuevos junto con la espera en una única llamada a io_uring_enter.
+        Se usan las llamadas al sistema directamente con <linux/io_uring.h>, sin liburing.
+        Requiere Linux 6.0 (recv multishot); si io_uring_setup o el registro de buffers fallan
+        (kernel antiguo, io_uring deshabilitado), el servidor arranca con epoll.
+
+    -Asignador por clases de tamaño (slab):
+        Las conexiones y los fragmentos de salida no se piden a malloc sino a slab_alloc.
+        Cada hilo tiene su caché con slabs de 64 KiB por clase de tamaño (64 B a 8 KiB):
+        asignar y liberar en el propio hilo es sacar o meter en una lista, sin locks
+        ni atómicas, y sin competir por las arenas de malloc cuando hay mucho movimiento
+        de conexiones. Los slabs están alineados a su tamaño, así que un objeto encuentra
+        su slab (y su hilo dueño) enmascarando la dirección. Un objeto liberado por otro hilo
+        (en modo pool, la conexión la crea el reactor y la cierra un trabajador) se acumula
+        en un lote y se entrega al dueño con un solo CAS cada SLAB_REMOTE_BATCH objetos;
+        el dueño recoge sus objetos con un intercambio atómico cuando se queda sin hueco.
+        slab_stats suma por clase los slabs, los objetos vivos y los bytes pedidos
+        (el Bloque 11 los muestra con el comando STATS).
+
+    -Beneficios:
+        Este enfoque permite que un número limitado de hilos en el thread pool
+        maneje potencialmente muchas conexiones de clientes.
+        El bucle principal del servidor no se bloquea esperando a que los clientes envíen datos;
+        simplemente acepta nuevas conexiones y las delega al pool de hilos.
+
+Nota Importante:
+Este es un ejemplo simplificado.
+El eco devuelve cada mensaje tal cual llegó; un servidor real interpretaría su contenido
+(el Bloque 11 ejecuta comandos con el mismo formato de mensajes).
+Sin embargo, este bloque sienta las bases para entender cómo integrar la I/O no bloqueante
+con un thread pool usando un reactor epoll.
  */
\ No newline at end of file
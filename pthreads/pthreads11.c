@@ -1,237 +1,3925 @@
-#include <pthread.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <fcntl.h>
-#include <sys/select.h>
-#include <errno.h>
-#include <unistd.h>
-#include <arpa/inet.h> // Para inet_ntoa y ntohs
-
-#define PORT 8080
-#define MAX_CLIENTS 10
-#define THREAD_POOL_SIZE 4
-#define MAX_TASKS 20
-#define BUFFER_SIZE 1024
-#define MAX_KEY_LENGTH 64
-#define MAX_VALUE_LENGTH 256
-
-// (Incluir aquí las definiciones de task_t y thread_pool_t del Bloque 10)
-typedef struct {
-    void (*function)(void *);
-    void *argument;
-} task_t;
-
-typedef struct {
-    task_t **tasks[1];
-    int head[1];
-    int tail[1];
-    int count[1];
-    int capacity;
-    pthread_mutex_t queue_mutex;
-    pthread_cond_t queue_not_empty[1];
-    pthread_cond_t queue_not_full[1];
-    pthread_t threads[THREAD_POOL_SIZE];
-    int shutdown;
-} thread_pool_t;
-
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks);
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument);
-void thread_pool_destroy(thread_pool_t *pool);
-void *worker(void *pool);
-
-// Estructura para el almacén clave-valor
-typedef struct {
-    char key[MAX_KEY_LENGTH];
-    char value[MAX_VALUE_LENGTH];
-} kv_entry_t;
-
-typedef struct {
-    kv_entry_t *store;
-    int capacity;
-    int size;
-    pthread_rwlock_t rwlock;
-} key_value_store_t;
-
-key_value_store_t *kv_store_create(int capacity);
-char *kv_store_get(key_value_store_t *store, const char *key);
-int kv_store_put(key_value_store_t *store, const char *key, const char *value);
-int kv_store_delete(key_value_store_t *store, const char *key);
-void kv_store_destroy(key_value_store_t *store);
-
-// Estructura para pasar información del cliente y el almacén a la tarea del thread pool
-typedef struct {
-    int client_fd;
-    key_value_store_t *store;
-} client_context_t;
-
-void handle_client(void *arg);
-
-// Implementaciones de thread pool (copia del Bloque 10)
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks) {
-/* ... */
-}
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument) {
-  /* ... */
-}
-void *worker(void *pool) {
-  /* ... */
-}
-void thread_pool_destroy(thread_pool_t *pool) {
-  /* ... */
-}
-
-// Implementaciones del almacén clave-valor
-key_value_store_t *kv_store_create(int capacity) {
-    /*
-    Crea e inicializa el almacén clave-valor concurrente.
-
-    - Asigna memoria para la estructura del almacén.
-    - Asigna memoria para el array de entradas clave-valor.
-    - Inicializa el read-write lock para controlar el acceso concurrente.
-    */
-}
-
-char *kv_store_get(key_value_store_t *store, const char *key) {
-    /*
-    Obtiene el valor asociado a una clave del almacén de forma concurrente para lectores.
-
-    - Adquiere el read lock.
-    - Itera a través del almacén para buscar la clave.
-    - Si se encuentra, libera el lock y retorna el valor.
-    - Si no se encuentra, libera el lock y retorna NULL.
-    */
-}
-
-int kv_store_put(key_value_store_t *store, const char *key, const char *value) {
-    /*
-    Inserta o actualiza un par clave-valor en el almacén con escritura exclusiva.
-
-    - Adquiere el write lock.
-    - Busca si la clave ya existe para actualizar el valor.
-    - Si no existe y hay espacio, añade una nueva entrada.
-    - Libera el lock y retorna 0 en éxito, -1 si no hay espacio.
-    */
-}
-
-int kv_store_delete(key_value_store_t *store, const char *key) {
-    /*
-    Elimina un par clave-valor del almacén con escritura exclusiva.
-
-    - Adquiere el write lock.
-    - Busca la clave y, si se encuentra, la elimina moviendo las entradas restantes.
-    - Libera el lock y retorna 0 en éxito, -1 si no se encuentra.
-    */
-}
-
-void handle_client(void *arg) {
-    /*
-    Maneja las peticiones de un cliente en un hilo del thread pool.
-
-    - Recibe el descriptor del socket del cliente y el almacén clave-valor.
-    - Lee comandos del cliente (GET, PUT, DELETE).
-    - Parsea el comando y la clave (y el valor para PUT).
-    - Realiza la operación correspondiente en el almacén clave-valor.
-    - Envía una respuesta al cliente.
-    - Cierra la conexión.
-    */
-}
-
-int main() {
-    int server_fd, new_socket, max_fd;
-    struct sockaddr_in address;
-    int addrlen = sizeof(address);
-    fd_set readfds;
-    thread_pool_t pool;
-    key_value_store_t *store;
-
-    // Inicializar el thread pool
-    thread_pool_init(&pool, THREAD_POOL_SIZE, MAX_TASKS);
-
-    // Crear el almacén clave-valor
-    store = kv_store_create(100); // Capacidad para 100 entradas
-    if (!store) {
-        perror("kv_store_create failed");
-        exit(EXIT_FAILURE);
-    }
-
-    // Crear socket del servidor (igual que en el Bloque 10)
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) { /* ... */ }
-    int flags = fcntl(server_fd, F_GETFL, 0);
-    if (fcntl(server_fd, F_SETFL, flags | O_NONBLOCK) < 0) { /* ... */ }
-    address.sin_family = AF_INET;
-    address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) { /* ... */ }
-    if (listen(server_fd, MAX_CLIENTS) < 0) { /* ... */ }
-    printf("Servidor escuchando en el puerto %d...\n", PORT);
-
-    while (1) {
-        FD_ZERO(&readfds);
-        FD_SET(server_fd, &readfds);
-        max_fd = server_fd;
-
-        int activity = select(max_fd + 1, &readfds, NULL, NULL, NULL);
-
-        if ((activity < 0) && (errno != EINTR)) { /* ... */ }
-
-        if (FD_ISSET(server_fd, &readfds)) {
-            if ((new_socket = accept(server_fd, (struct sockaddr *)&address, (socklen_t *)&addrlen)) < 0) { /* ... */ }
-            printf("Nueva conexión aceptada, socket fd es %d, IP es: %s, puerto: %d\n", new_socket, inet_ntoa(address.sin_addr), ntohs(address.sin_port));
-            flags = fcntl(new_socket, F_GETFL, 0);
-            if (fcntl(new_socket, F_SETFL, flags | O_NONBLOCK) < 0) { /* ... */ }
-
-            client_context_t *context = malloc(sizeof(client_context_t));
-            if (!context) { /* ... */ }
-            context->client_fd = new_socket;
-            context->store = store;
-            thread_pool_submit(&pool, handle_client, context);
-        }
-    }
-
-    close(server_fd);
-    thread_pool_destroy(&pool);
-    kv_store_destroy(store);
-    return 0;
-}
-
-Compila: gcc pthreads11.c -o concurrent_kv_store -lpthread
-Ejecuta: ./concurrent_kv_store
-Explicación:
-    -Almacén Clave-Valor Concurrente:
-        Se implementa una estructura key_value_store_t
-        que utiliza un array para almacenar las entradas clave-valor
-        y un pthread_rwlock_t para controlar el acceso concurrente.
-        Esto permite que múltiples lectores accedan al almacén simultáneamente,
-        pero requiere un lock exclusivo para las operaciones de escritura (PUT y DELETE).
-
-    -Operaciones del Almacén:
-        Se proporcionan funciones para crear, obtener, insertar/actualizar
-        y eliminar pares clave-valor de forma thread-safe.
-
-    -Integración con el Servidor No Bloqueante y el Thread Pool:
-        Al igual que en el Bloque 10,
-        se utiliza un servidor no bloqueante con select para aceptar conexiones.
-        Cada conexión aceptada se pasa como una tarea al thread pool.
-
-    -handle_client con Almacén:
-        La función handle_client ahora recibe un client_context_t
-        que contiene tanto el descriptor del socket del cliente como un puntero
-        al almacén clave-valor compartido.
-
-    -Protocolo Simple:
-        El cliente puede enviar comandos simples como GET <key>,
-        PUT <key> <value>, y DELETE <key>.
-        El servidor responde con OK, VALUE <value>, NOT_FOUND, o ERROR.
-
-Para probar este servidor:
-
-        Ejecuta el programa concurrent_kv_store.
-            Puedes usar la herramienta netcat (nc) desde otra terminal
-            para interactuar con el servidor.
-    Por ejemplo:
-        Para insertar un valor: echo "PUT mykey myvalue" | nc localhost 8080
-        Para obtener un valor: echo "GET mykey" | nc localhost 8080
-        Para eliminar una clave: echo "DELETE mykey" | nc localhost 8080
\ No newline at end of file
+#define _GNU_SOURCE // accept4, pthread_setaffinity_np
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <errno.h>
+#include <endian.h>
+#include <unistd.h>
+#include <arpa/inet.h> // Para inet_ntoa y ntohs
+
+#define PORT 8080
+#define LISTEN_BACKLOG SOMAXCONN
+#define MAX_EVENTS 256   // eventos que devuelve cada epoll_wait
+#define MAX_REACTORS 64  // bucles de eventos en modo reuseport
+#define URING_ENTRIES 256      // entradas de la cola de envío de cada anillo io_uring
+#define URING_BUFFERS 512      // buffers de recepción provistos al kernel por anillo, potencia de dos
+#define URING_BUFFER_GROUP 0
+#define THREAD_POOL_SIZE 4
+#define MAX_TASKS 20
+#define BUFFER_SIZE 1024
+#define MAX_FRAME_SIZE (1 << 20) // comando más largo aceptado, con o sin prefijo de longitud
+#define FRAME_HEADER_MAX 24      // "$<longitud>\n" del comando con prefijo
+#define BIN_MAGIC_REQUEST 0x80   // primer byte de una petición binaria; ningún comando de texto empieza así
+#define BIN_MAGIC_RESPONSE 0x81
+#define BIN_OP_GET 1
+#define BIN_OP_PUT 2
+#define BIN_OP_DELETE 3
+#define BIN_OP_EXPIRE 4          // valor: TTL en ms, uint64_t little-endian
+#define BIN_OP_TTL 5             // respuesta: ms restantes, int64_t little-endian (-1 = no caduca)
+#define BIN_STATUS_OK 0
+#define BIN_STATUS_NOT_FOUND 1
+#define BIN_STATUS_ERROR 2
+#define BIN_ZERO_COPY_MIN 256    // valores desde este tamaño se envían desde el almacén sin copiarlos
+#define OUTPUT_IOVECS 16         // fragmentos de salida por cada sendmsg
+#define OUTPUT_HIGH_WATER (256 * 1024) // io_uring: salida pendiente a partir de la cual se deja de leer
+#define WORKER_BATCH 8
+#define CACHE_LINE_SIZE 64
+#define SLAB_SIZE (64 * 1024)   // bloque del que se reparten los objetos de una clase
+#define SLAB_MIN_OBJECT 64      // clase más pequeña; cada clase dobla la anterior
+#define SLAB_CLASSES 8          // de 64 B a 8 KiB; lo mayor va a malloc
+#define SLAB_REMOTE_BATCH 32    // liberaciones de objetos de otro hilo entregadas de una vez
+#define KV_SHARDS 64          // particiones del índice, cada una con su lock (potencia de dos)
+#define KV_MIN_BUCKETS 8      // cubetas iniciales por partición (potencia de dos)
+#define KV_REHASH_STEP 4      // cubetas migradas por escritura durante un redimensionado
+#define KV_MAX_READERS 64     // hilos con lecturas sin lock; los demás usan el read lock
+#define KV_RECLAIM_BATCH 64   // memoria retirada por partición antes de intentar liberarla
+#define KV_DATA_DIR "."       // directorio del log y de la instantánea del almacén
+#define KV_COMPACT_BYTES (16 * 1024 * 1024) // tamaño del log que dispara una compactación
+#define KV_COMPACT_CHECK_MS 1000            // cada cuánto mira el compactador el tamaño del log
+#define KV_WAL_FILE "kv.wal"
+#define KV_WAL_OLD "kv.wal.old"               // log rotado cuyo contenido aún no está en la instantánea
+#define KV_SNAPSHOT_FILE "kv.snap"
+#define KV_SNAPSHOT_TMP "kv.snap.tmp"
+#define KV_SNAPSHOT_MAGIC "KVSNAP02"          // 02: registros con caducidad
+#define KV_WAL_HEADER 13                      // checksum, operación, longitud de clave y de valor
+#define KV_OP_PUT 1
+#define KV_OP_DELETE 2
+#define KV_OP_EXPIRE 3                        // valor: caducidad absoluta en ms de CLOCK_REALTIME (8 bytes)
+#define KV_WHEEL_BITS 6                       // cada nivel de la rueda de temporizadores: 64 ranuras
+#define KV_WHEEL_SLOTS (1 << KV_WHEEL_BITS)
+#define KV_WHEEL_LEVELS 5                     // tic de 1 ms: 64 ms, 4 s, 4,4 min, 4,7 h y 12 días por vuelta
+#define KV_EXPIRE_MAX_SLEEP_MS 1000           // el hilo de caducidad duerme como mucho esto sin temporizadores
+#define KV_PIN_DEAD 0x80000000u               // en 'pins': el almacén ya soltó el objeto; lo libera el último unpin
+
+// Definiciones de task_t y thread_pool_t del Bloque 10
+typedef struct {
+    void (*function)(void *);
+    void *argument;
+} task_t;
+
+// Cola MPMC acotada con operaciones por lotes (copia del Bloque 6)
+typedef struct {
+    atomic_size_t seq;
+    task_t task;
+} mpmc_cell_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t dequeue_pos;
+    _Alignas(CACHE_LINE_SIZE) mpmc_cell_t *cells;
+    size_t mask;
+} mpmc_queue_t;
+
+typedef struct {
+    mpmc_queue_t tasks;
+    atomic_int idle_workers;
+    atomic_int waiting_submitters;
+    pthread_mutex_t queue_mutex; // solo para dormir/despertar
+    pthread_cond_t queue_not_empty;
+    pthread_cond_t queue_not_full;
+    pthread_t threads[THREAD_POOL_SIZE];
+    atomic_int shutdown;
+} thread_pool_t;
+
+void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks);
+void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument);
+void thread_pool_destroy(thread_pool_t *pool);
+void *worker(void *pool);
+
+// Asignador por clases de tamaño (slabs) con una caché por hilo (copia del Bloque 10),
+// para conexiones, salida y entradas del almacén
+typedef struct slab {
+    struct slab_cache *owner; // hilo dueño: solo él toca la lista de libres
+    struct slab *next;        // lista de slabs con hueco de su clase
+    struct slab *prev;
+    void *free;               // objetos libres, enlazados por su primera palabra
+    unsigned used;
+    unsigned capacity;
+    int cls;
+    int listed;               // está en la lista de slabs con hueco
+} slab_t;
+
+typedef struct {
+    atomic_size_t slabs;      // slabs de la clase creados por este hilo
+    atomic_size_t objects;    // asignados menos liberados por este hilo (solo la suma es significativa)
+    atomic_size_t bytes;      // bytes pedidos, con la misma convención
+} slab_class_counters_t;
+
+typedef struct slab_cache {
+    slab_t *partial[SLAB_CLASSES];
+    _Alignas(CACHE_LINE_SIZE) void *_Atomic remote; // objetos liberados por otros hilos, pendientes
+    _Alignas(CACHE_LINE_SIZE) slab_class_counters_t stats[SLAB_CLASSES];
+    struct slab_cache *batch_owner; // liberaciones remotas de este hilo aún no entregadas
+    void *batch_head;
+    void *batch_tail;
+    int batch_count;
+    struct slab_cache *next_cache;  // registro global, para las estadísticas
+} slab_cache_t;
+
+typedef struct {
+    size_t object_size;
+    size_t slabs;
+    size_t objects;
+    size_t bytes;             // bytes pedidos por los objetos vivos
+} slab_stats_t;
+
+void *slab_alloc(size_t size);
+void slab_free(void *ptr, size_t size);
+void slab_stats(slab_stats_t stats[SLAB_CLASSES]);
+
+// Estructura para el almacén clave-valor: índice hash dividido en KV_SHARDS particiones,
+// cada una con su lock, su tabla de cubetas encadenadas y su propio redimensionado incremental
+typedef enum {
+    KV_READ_RWLOCK,  // kv_store_get toma el read lock de la partición
+    KV_READ_SEQLOCK  // kv_store_get no toma locks ni escribe memoria compartida
+} kv_read_mode_t;
+
+// Memoria quitada del índice que un lector sin lock aún puede estar recorriendo
+typedef struct kv_retired {
+    struct kv_retired *next;
+    unsigned long epoch;  // época global cuando se retiró
+    void *mem;            // bloque a liberar (contiene este kv_retired_t)
+    size_t size;          // tamaño pedido a slab_alloc, o 0 si vino de malloc
+    atomic_uint *pins;    // solo nodos: si hay envíos en curso, libera el último kv_store_unpin
+} kv_retired_t;
+
+// Temporizador de caducidad de una clave, enlazado en una ranura de la rueda de su partición
+typedef struct kv_timer {
+    struct kv_timer *next;
+    struct kv_timer **pprev;  // enlace que apunta a este, para quitarlo en O(1); NULL si no está en la rueda
+    uint64_t expires;         // ms de CLOCK_MONOTONIC, 0 = sin caducidad
+    uint32_t slot;            // nivel * KV_WHEEL_SLOTS + ranura
+} kv_timer_t;
+
+// Rueda de temporizadores jerárquica: el nivel l tiene ranuras de 64^l ms. Un temporizador va
+// al nivel más bajo que cubre su plazo; al dar la vuelta un nivel, la ranura siguiente
+// del nivel superior se reparte en los inferiores (cascada)
+typedef struct {
+    kv_timer_t *slots[KV_WHEEL_LEVELS][KV_WHEEL_SLOTS];
+    uint64_t occupied[KV_WHEEL_LEVELS]; // bit por ranura no vacía: el siguiente tic con trabajo sale con ctz
+    uint64_t now;             // último ms procesado
+    size_t count;
+    atomic_ullong next_due;   // próximo ms con trabajo (cota inferior), leído sin lock por el hilo de caducidad
+} kv_wheel_t;
+
+// Entrada del índice: clave y valor de longitud variable en un solo bloque
+typedef struct kv_node {
+    struct kv_node *next;
+    uint64_t hash;
+    uint32_t key_len;
+    uint32_t value_len;
+    uint32_t value_cap;   // hueco hasta el final de su clase del asignador; un valor más largo va a un nodo nuevo
+    uint32_t deleted;     // borrada en memoria pero presente en la instantánea: oculta su versión de disco
+    atomic_uint pins;     // envíos sin copia en curso (más KV_PIN_DEAD): mientras haya, el valor no cambia
+    kv_timer_t timer;     // caducidad (TTL); un PUT la quita
+    kv_retired_t retired;
+    char data[];          // clave seguida del valor
+} kv_node_t;
+
+typedef struct {
+    kv_retired_t retired;
+    size_t mask;          // número de cubetas - 1 (potencia de dos)
+    kv_node_t *buckets[];
+} kv_table_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) pthread_rwlock_t rwlock; // serializa a los escritores; en modo rwlock, también a los lectores
+    atomic_uint seq;          // impar mientras un escritor modifica la partición
+    kv_table_t *table[2];     // table[1] solo existe durante un redimensionado
+    size_t rehash_idx;        // siguiente cubeta de table[0] por migrar a table[1]
+    size_t count;
+    kv_retired_t *retired;    // pendientes de liberar (solo en modo KV_READ_SEQLOCK)
+    size_t retired_count;
+    kv_wheel_t wheel;         // caducidades de las claves de la partición, protegida por el write lock
+} kv_shard_t;
+
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong epoch; // época en la que lee el hilo, 0 si no está leyendo
+} kv_reader_t;
+
+// Instantánea en disco: un índice hash de direccionamiento abierto que se usa directamente
+// desde el mmap, sin cargarlo en memoria
+typedef struct {
+    char magic[8];            // KV_SNAPSHOT_MAGIC
+    uint64_t count;
+    uint64_t buckets;         // potencia de dos
+    uint64_t table_offset;    // tabla de buckets * uint64_t con el desplazamiento de cada registro (0 = libre)
+    uint64_t ttl_count;       // registros con caducidad: se cargan en memoria al abrir
+    uint64_t ttl_offset;      // tras la tabla, ttl_count * uint64_t con sus desplazamientos
+    uint64_t file_size;
+} kv_snapshot_header_t;
+
+typedef struct {
+    uint64_t hash;
+    uint32_t key_len;
+    uint32_t value_len;
+    uint64_t expires;         // caducidad en ms de CLOCK_REALTIME, 0 = sin caducidad
+    char data[];              // clave seguida del valor; el siguiente registro empieza alineado a 8
+} kv_snapshot_record_t;
+
+typedef struct {
+    const char *map;
+    size_t size;
+    const kv_snapshot_header_t *header;
+    const uint64_t *table;
+    atomic_uint pins;         // envíos sin copia desde el mmap (más KV_PIN_DEAD al sustituirla)
+} kv_snapshot_t;
+
+// Aviso de caducidad: la clave y el último valor, válidos solo durante la llamada
+typedef void (*kv_expire_fn)(void *arg, const char *key, size_t key_len, const char *value, size_t value_len);
+
+// Log de escritura anticipada (WAL) con commit en grupo
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t synced;
+    int fd;                   // -1 en un almacén solo en memoria
+    char *buf;                // registros añadidos que aún no se han escrito
+    size_t len;
+    size_t cap;
+    char *spare;              // buffer del último lote escrito, para reutilizarlo
+    size_t spare_cap;
+    unsigned long long appended; // LSN: bytes de registros añadidos desde que se abrió el almacén
+    atomic_ullong durable;    // LSN ya escrito y con fdatasync
+    size_t file_size;         // bytes del fichero actual, para decidir la compactación
+    int flushing;             // un hilo está escribiendo un lote (el líder del grupo)
+    int failed;               // error de E/S: no se puede garantizar la durabilidad
+} kv_wal_t;
+
+typedef struct {
+    kv_shard_t shards[KV_SHARDS];
+    kv_reader_t readers[KV_MAX_READERS];
+    atomic_int num_readers;
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong epoch; // época global para liberar la memoria retirada
+    kv_read_mode_t read_mode;
+    // Persistencia (solo con kv_store_open)
+    kv_snapshot_t *snapshot;  // NULL si no hay instantánea
+    kv_wal_t wal;
+    char *dir;
+    atomic_int compacting;    // mientras se construye una instantánea, los borrados dejan marca
+    pthread_t compactor;
+    int compactor_running;
+    int stop;
+    pthread_mutex_t compact_mutex;
+    pthread_cond_t compact_cond;
+    // Caducidad de claves (TTL)
+    kv_expire_fn on_expire;   // se llama, fuera de los locks, por cada clave caducada
+    void *on_expire_arg;
+    pthread_t expirer;
+    int expirer_running;
+    int expirer_stop;
+    pthread_mutex_t expiry_mutex;
+    pthread_cond_t expiry_cond;   // con CLOCK_MONOTONIC
+    atomic_ullong expiry_wake;    // ms en que despertará el hilo de caducidad
+} key_value_store_t;
+
+// Referencia a un valor del almacén (un nodo o la instantánea) que no se libera ni cambia
+// hasta kv_store_unpin: permite enviarlo al socket directamente desde la memoria del almacén
+typedef struct {
+    void (*release)(void *object);
+    void *object;
+} kv_pin_t;
+
+// Una clave de MGET, MPUT o MDEL
+typedef struct {
+    const char *key;
+    size_t key_len;
+    const char *value;    // MPUT: valor a escribir
+    size_t value_len;     // MPUT: su longitud; MGET: longitud del valor leído
+    size_t value_off;     // MGET: posición del valor en el buffer de valores
+    int found;            // MGET: la clave existe; MPUT/MDEL: la escritura se aplicó
+    uint64_t hash;        // lo calcula el almacén al agrupar el lote
+} kv_batch_item_t;
+
+key_value_store_t *kv_store_create(int capacity, kv_read_mode_t read_mode);
+key_value_store_t *kv_store_open(const char *dir, int capacity, kv_read_mode_t read_mode);
+int kv_store_get(key_value_store_t *store, const char *key, char *value, size_t value_size);
+int kv_store_put(key_value_store_t *store, const char *key, const char *value);
+int kv_store_delete(key_value_store_t *store, const char *key);
+int kv_store_put_lsn(key_value_store_t *store, const char *key, const char *value, unsigned long long *lsn);
+int kv_store_delete_lsn(key_value_store_t *store, const char *key, unsigned long long *lsn);
+int kv_store_mget(key_value_store_t *store, kv_batch_item_t *items, size_t n, char **values, size_t *values_cap);
+int kv_store_mput_lsn(key_value_store_t *store, kv_batch_item_t *items, size_t n, unsigned long long *lsn);
+int kv_store_mdelete_lsn(key_value_store_t *store, kv_batch_item_t *items, size_t n, unsigned long long *lsn);
+int kv_store_sync(key_value_store_t *store, unsigned long long lsn);
+int kv_store_update_lsn(key_value_store_t *store, int op, const char *key, size_t key_len,
+                        const char *value, size_t value_len, unsigned long long *lsn);
+int kv_store_pin(key_value_store_t *store, const char *key, size_t key_len, kv_pin_t *pin, const char **value, size_t *value_len);
+void kv_store_unpin(kv_pin_t pin);
+int kv_store_expire_lsn(key_value_store_t *store, const char *key, size_t key_len, uint64_t ttl_ms, unsigned long long *lsn);
+long long kv_store_ttl(key_value_store_t *store, const char *key, size_t key_len);
+void kv_store_set_expire_callback(key_value_store_t *store, kv_expire_fn fn, void *arg);
+void kv_store_destroy(key_value_store_t *store);
+
+// Bucle de eventos (copia del Bloque 10): uno que reparte al pool, o uno por núcleo (pool == NULL)
+typedef struct {
+    int epoll_fd;
+    int listen_fd;
+    int cpu;              // CPU a la que se fija el hilo, -1 sin afinidad
+    thread_pool_t *pool;
+    key_value_store_t *store;
+    struct uring *ring;   // backend io_uring; NULL con epoll
+    pthread_t thread;
+} reactor_t;
+
+// Cola de salida por fragmentos (copia del Bloque 10). Un fragmento puede apuntar a memoria
+// ajena (un valor fijado del almacén) en lugar de llevar los datos: se envía sin copiarlo
+typedef struct output_chunk {
+    struct output_chunk *next;
+    size_t off;  // bytes ya enviados
+    size_t len;  // bytes escritos
+    size_t cap;  // 0 en un fragmento por referencia
+    const char *ref;               // datos ajenos, o NULL si están en data[]
+    void (*release)(void *arg);    // se llama al terminar de enviar (o descartar) 'ref'
+    void *release_arg;
+    char data[];
+} output_chunk_t;
+
+typedef struct {
+    output_chunk_t *head;
+    output_chunk_t *tail;
+    size_t len;  // bytes pendientes en toda la cola
+} output_queue_t;
+
+// Protocolo binario: cabecera fija en little-endian, igual en peticiones y respuestas,
+// seguida de la clave (solo en peticiones) y el valor
+typedef struct {
+    uint8_t magic;        // BIN_MAGIC_REQUEST o BIN_MAGIC_RESPONSE
+    uint8_t opcode;       // BIN_OP_*; la respuesta repite el de la petición
+    uint16_t status;      // BIN_STATUS_* en la respuesta, 0 en la petición
+    uint32_t key_len;     // 0 en la respuesta
+    uint32_t value_len;
+    uint32_t request_id;  // opaco: la respuesta lo devuelve tal cual
+} bin_header_t;
+
+typedef enum {
+    PROTOCOL_UNKNOWN,     // aún no ha llegado ningún byte
+    PROTOCOL_TEXT,
+    PROTOCOL_BINARY
+} protocol_t;
+
+// Estado de una conexión: el almacén, el comando a medio recibir y las respuestas pendientes
+typedef struct client_context {
+    int client_fd;
+    protocol_t protocol;  // lo decide el primer byte recibido
+    key_value_store_t *store;
+    reactor_t *reactor;   // reactor en el que está registrada, para rearmarla
+    char *in;             // comando incompleto, crece hasta MAX_FRAME_SIZE
+    size_t in_len;
+    size_t in_cap;
+    output_queue_t out;   // respuestas pendientes de enviar
+    unsigned long long wal_lsn; // última escritura de la conexión; debe estar en disco antes de responderla
+    // Solo en el backend io_uring (ver Bloque 10)
+    int recv_armed;
+    output_queue_t sending;
+    struct uring_send *send;
+    int close_linked;
+    int closing;
+    int recv_paused;
+    char *held;
+    size_t held_len;
+    size_t held_off;
+    unsigned deferred;
+    struct client_context *next_deferred;
+} client_context_t;
+
+void handle_client(void *arg);
+
+// Implementaciones de thread pool (copia del Bloque 10)
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static void mpmc_wait_seq(mpmc_cell_t *cell, size_t expected) {
+    for (int spins = 0; atomic_load_explicit(&cell->seq, memory_order_acquire) != expected; ++spins) {
+        if (spins < 64) cpu_relax();
+        else sched_yield();
+    }
+}
+
+static int mpmc_queue_init(mpmc_queue_t *q, size_t capacity) {
+    size_t cap = 2;
+    while (cap < capacity) cap *= 2;
+    q->cells = malloc(sizeof(mpmc_cell_t) * cap);
+    if (!q->cells) return -1;
+    for (size_t i = 0; i < cap; ++i) atomic_init(&q->cells[i].seq, i);
+    q->mask = cap - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    return 0;
+}
+
+static size_t mpmc_enqueue_bulk(mpmc_queue_t *q, const task_t *tasks, size_t n) {
+    size_t cap = q->mask + 1;
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    size_t k;
+    for (;;) {
+        size_t used = pos - atomic_load_explicit(&q->dequeue_pos, memory_order_acquire);
+        if (used > cap) {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+            continue;
+        }
+        if (used == cap) return 0;
+        k = n < cap - used ? n : cap - used;
+        if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + k,
+                                                  memory_order_relaxed, memory_order_relaxed)) break;
+    }
+    for (size_t i = 0; i < k; ++i) {
+        mpmc_cell_t *cell = &q->cells[(pos + i) & q->mask];
+        mpmc_wait_seq(cell, pos + i);
+        cell->task = tasks[i];
+        atomic_store_explicit(&cell->seq, pos + i + 1, memory_order_release);
+    }
+    return k;
+}
+
+static size_t mpmc_dequeue_bulk(mpmc_queue_t *q, task_t *tasks, size_t n) {
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    size_t k;
+    for (;;) {
+        size_t avail = atomic_load_explicit(&q->enqueue_pos, memory_order_acquire) - pos;
+        if (avail == 0) return 0;
+        if (avail > q->mask + 1) {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+            continue;
+        }
+        k = n < avail ? n : avail;
+        if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + k,
+                                                  memory_order_relaxed, memory_order_relaxed)) break;
+    }
+    for (size_t i = 0; i < k; ++i) {
+        mpmc_cell_t *cell = &q->cells[(pos + i) & q->mask];
+        mpmc_wait_seq(cell, pos + i + 1);
+        tasks[i] = cell->task;
+        atomic_store_explicit(&cell->seq, pos + i + q->mask + 1, memory_order_release);
+    }
+    return k;
+}
+
+static size_t mpmc_size(mpmc_queue_t *q) {
+    size_t tail = atomic_load_explicit(&q->enqueue_pos, memory_order_acquire);
+    size_t head = atomic_load_explicit(&q->dequeue_pos, memory_order_acquire);
+    return tail > head ? tail - head : 0;
+}
+
+void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks) {
+    if (mpmc_queue_init(&pool->tasks, max_tasks) != 0) perror("malloc tasks failed");
+    atomic_init(&pool->idle_workers, 0);
+    atomic_init(&pool->waiting_submitters, 0);
+    atomic_init(&pool->shutdown, 0);
+    pthread_mutex_init(&pool->queue_mutex, NULL);
+    pthread_cond_init(&pool->queue_not_empty, NULL);
+    pthread_cond_init(&pool->queue_not_full, NULL);
+    for (int i = 0; i < num_threads; ++i) {
+        pthread_create(&pool->threads[i], NULL, worker, pool);
+    }
+}
+
+void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument) {
+    // Sin lock por tarea: solo se toma el mutex si hay que despertar o esperar
+    task_t task = {function, argument};
+    while (mpmc_enqueue_bulk(&pool->tasks, &task, 1) == 0) {
+        pthread_mutex_lock(&pool->queue_mutex);
+        atomic_fetch_add_explicit(&pool->waiting_submitters, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (mpmc_size(&pool->tasks) > pool->tasks.mask && !atomic_load(&pool->shutdown)) {
+            pthread_cond_wait(&pool->queue_not_full, &pool->queue_mutex);
+        }
+        atomic_fetch_sub_explicit(&pool->waiting_submitters, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&pool->queue_mutex);
+        if (atomic_load(&pool->shutdown)) return;
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pool->idle_workers, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&pool->queue_mutex);
+        pthread_cond_signal(&pool->queue_not_empty);
+        pthread_mutex_unlock(&pool->queue_mutex);
+    }
+}
+
+void *worker(void *pool) {
+    thread_pool_t *p = (thread_pool_t *)pool;
+    task_t batch[WORKER_BATCH];
+    while (1) {
+        size_t want = mpmc_size(&p->tasks) / THREAD_POOL_SIZE;
+        if (want < 1) want = 1;
+        if (want > WORKER_BATCH) want = WORKER_BATCH;
+        size_t k = mpmc_dequeue_bulk(&p->tasks, batch, want);
+        if (k == 0) {
+            pthread_mutex_lock(&p->queue_mutex);
+            atomic_fetch_add_explicit(&p->idle_workers, 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            while (mpmc_size(&p->tasks) == 0 && !atomic_load(&p->shutdown)) {
+                pthread_cond_wait(&p->queue_not_empty, &p->queue_mutex);
+            }
+            atomic_fetch_sub_explicit(&p->idle_workers, 1, memory_order_relaxed);
+            pthread_mutex_unlock(&p->queue_mutex);
+            if (atomic_load(&p->shutdown)) pthread_exit(NULL);
+            continue;
+        }
+        atomic_thread_fence(memory_order_seq_cst);
+        if (atomic_load_explicit(&p->waiting_submitters, memory_order_relaxed) > 0) {
+            pthread_mutex_lock(&p->queue_mutex);
+            pthread_cond_broadcast(&p->queue_not_full);
+            pthread_mutex_unlock(&p->queue_mutex);
+        }
+        for (size_t i = 0; i < k; ++i) {
+            batch[i].function(batch[i].argument);
+        }
+    }
+    return NULL;
+}
+
+void thread_pool_destroy(thread_pool_t *pool) {
+    pthread_mutex_lock(&pool->queue_mutex);
+    atomic_store(&pool->shutdown, 1);
+    pthread_cond_broadcast(&pool->queue_not_empty);
+    pthread_cond_broadcast(&pool->queue_not_full);
+    pthread_mutex_unlock(&pool->queue_mutex);
+    for (int i = 0; i < THREAD_POOL_SIZE; ++i) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->tasks.cells);
+    pthread_cond_destroy(&pool->queue_not_empty);
+    pthread_cond_destroy(&pool->queue_not_full);
+    pthread_mutex_destroy(&pool->queue_mutex);
+}
+
+// Implementación del asignador por clases de tamaño (copia del Bloque 10)
+static pthread_mutex_t slab_registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static slab_cache_t *slab_registry = NULL;
+static _Thread_local slab_cache_t *slab_local = NULL;
+
+static int slab_class(size_t size) {
+    /* Clase i = objetos de SLAB_MIN_OBJECT << i bytes; -1 si no cabe en ninguna. */
+    if (size <= SLAB_MIN_OBJECT) return 0;
+    int cls = 64 - __builtin_clzl(size - 1) - __builtin_ctz(SLAB_MIN_OBJECT);
+    return cls < SLAB_CLASSES ? cls : -1;
+}
+
+static slab_cache_t *slab_cache_get(void) {
+    /* Caché del hilo, creada en su primera asignación o liberación y registrada para slab_stats. */
+    if (slab_local) return slab_local;
+    slab_cache_t *cache = aligned_alloc(CACHE_LINE_SIZE, sizeof(slab_cache_t));
+    if (!cache) return NULL;
+    memset(cache, 0, sizeof(*cache));
+    atomic_init(&cache->remote, NULL);
+    pthread_mutex_lock(&slab_registry_mutex);
+    cache->next_cache = slab_registry;
+    slab_registry = cache;
+    pthread_mutex_unlock(&slab_registry_mutex);
+    slab_local = cache;
+    return cache;
+}
+
+static void slab_counter_add(atomic_size_t *counter, size_t delta) {
+    // Un solo escritor por contador: load + store relajados, sin instrucción atómica con lock
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+static void slab_list_add(slab_cache_t *cache, slab_t *slab) {
+    slab->prev = NULL;
+    slab->next = cache->partial[slab->cls];
+    if (slab->next) slab->next->prev = slab;
+    cache->partial[slab->cls] = slab;
+    slab->listed = 1;
+}
+
+static void slab_list_remove(slab_cache_t *cache, slab_t *slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else cache->partial[slab->cls] = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+    slab->listed = 0;
+}
+
+static slab_t *slab_create(slab_cache_t *cache, int cls) {
+    /* Reserva un slab alineado a SLAB_SIZE (así un objeto encuentra su slab enmascarando la dirección). */
+    slab_t *slab = aligned_alloc(SLAB_SIZE, SLAB_SIZE);
+    if (!slab) return NULL;
+    size_t object_size = (size_t)SLAB_MIN_OBJECT << cls;
+    size_t header = (sizeof(slab_t) + CACHE_LINE_SIZE - 1) & ~(size_t)(CACHE_LINE_SIZE - 1);
+    slab->owner = cache;
+    slab->cls = cls;
+    slab->used = 0;
+    slab->capacity = (SLAB_SIZE - header) / object_size;
+    slab->free = NULL;
+    for (unsigned i = slab->capacity; i-- > 0;) {
+        void **object = (void **)((char *)slab + header + i * object_size);
+        *object = slab->free;
+        slab->free = object;
+    }
+    slab_counter_add(&cache->stats[cls].slabs, 1);
+    slab_list_add(cache, slab);
+    return slab;
+}
+
+static void slab_free_local(slab_cache_t *cache, slab_t *slab, void *ptr) {
+    /*
+    Devuelve un objeto a un slab propio. Un slab vacío se libera si la clase tiene otro con hueco,
+    para no guardar memoria que ya no se usa tras un pico de conexiones o de valores.
+    */
+    *(void **)ptr = slab->free;
+    slab->free = ptr;
+    slab->used--;
+    if (!slab->listed) slab_list_add(cache, slab);
+    if (slab->used == 0 && (slab->prev || slab->next)) {
+        slab_list_remove(cache, slab);
+        slab_counter_add(&cache->stats[slab->cls].slabs, (size_t)-1);
+        free(slab);
+    }
+}
+
+static void slab_drain_remote(slab_cache_t *cache) {
+    /* Recoge con un solo intercambio atómico todos los objetos que otros hilos liberaron. */
+    void *object = atomic_exchange_explicit(&cache->remote, NULL, memory_order_acquire);
+    while (object) {
+        void *next = *(void **)object;
+        slab_free_local(cache, (slab_t *)((uintptr_t)object & ~(uintptr_t)(SLAB_SIZE - 1)), object);
+        object = next;
+    }
+}
+
+static void slab_push_remote(slab_cache_t *owner, void *first, void *last) {
+    /* Entrega una cadena de objetos a su dueño con un solo CAS, sea cual sea su longitud. */
+    void *head = atomic_load_explicit(&owner->remote, memory_order_relaxed);
+    do {
+        *(void **)last = head;
+    } while (!atomic_compare_exchange_weak_explicit(&owner->remote, &head, first,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+static void slab_flush_remote(slab_cache_t *cache) {
+    if (!cache->batch_owner) return;
+    slab_push_remote(cache->batch_owner, cache->batch_head, cache->batch_tail);
+    cache->batch_owner = NULL;
+    cache->batch_head = cache->batch_tail = NULL;
+    cache->batch_count = 0;
+}
+
+static size_t slab_usable_size(size_t size) {
+    /* Bytes realmente disponibles al pedir size: el tamaño de su clase, o size si va a malloc. */
+    int cls = slab_class(size);
+    return cls < 0 ? size : (size_t)SLAB_MIN_OBJECT << cls;
+}
+
+void *slab_alloc(size_t size) {
+    /*
+    Asigna size bytes de la caché del hilo.
+
+    - Tamaños de más de SLAB_MIN_OBJECT << (SLAB_CLASSES - 1) bytes van a malloc.
+    - Toma un objeto del primer slab con hueco de la clase, sin locks ni atómicas.
+    - Si no hay, recoge antes las liberaciones remotas; si sigue sin haber, crea un slab.
+    */
+    int cls = slab_class(size);
+    if (cls < 0) return malloc(size);
+    slab_cache_t *cache = slab_cache_get();
+    if (!cache) return NULL;
+
+    slab_t *slab = cache->partial[cls];
+    if (!slab) {
+        slab_drain_remote(cache);
+        slab = cache->partial[cls];
+    }
+    if (!slab && !(slab = slab_create(cache, cls))) return NULL;
+
+    void *object = slab->free;
+    slab->free = *(void **)object;
+    if (++slab->used == slab->capacity) slab_list_remove(cache, slab);
+    slab_counter_add(&cache->stats[cls].objects, 1);
+    slab_counter_add(&cache->stats[cls].bytes, size);
+    return object;
+}
+
+void slab_free(void *ptr, size_t size) {
+    /*
+    Libera un objeto de slab_alloc; size debe ser el mismo que se pidió.
+
+    - Si el slab es del hilo, el objeto vuelve a su lista de libres directamente.
+    - Si es de otro hilo, se acumula en un lote (enlazado por los propios objetos)
+      que se entrega al dueño de una vez al llenarse o al cambiar de dueño:
+      una operación atómica cada SLAB_REMOTE_BATCH liberaciones en lugar de una por objeto,
+      y nunca un lock compartido como los de las arenas de malloc.
+    */
+    if (!ptr) return;
+    int cls = slab_class(size);
+    if (cls < 0) {
+        free(ptr);
+        return;
+    }
+    slab_t *slab = (slab_t *)((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+    slab_cache_t *cache = slab_cache_get();
+    if (!cache) { // sin caché propia (sin memoria): se devuelve suelto, sin lote ni contadores
+        slab_push_remote(slab->owner, ptr, ptr);
+        return;
+    }
+    slab_counter_add(&cache->stats[cls].objects, (size_t)-1);
+    slab_counter_add(&cache->stats[cls].bytes, (size_t)0 - size);
+
+    if (slab->owner == cache) {
+        slab_free_local(cache, slab, ptr);
+        return;
+    }
+    if (cache->batch_owner != slab->owner) {
+        slab_flush_remote(cache);
+        cache->batch_owner = slab->owner;
+        cache->batch_tail = ptr;
+        *(void **)ptr = NULL;
+    } else {
+        *(void **)ptr = cache->batch_head;
+    }
+    cache->batch_head = ptr;
+    if (++cache->batch_count == SLAB_REMOTE_BATCH) slab_flush_remote(cache);
+}
+
+void slab_stats(slab_stats_t stats[SLAB_CLASSES]) {
+    /* Suma los contadores de todas las cachés: slabs, objetos vivos y bytes pedidos por clase. */
+    for (int i = 0; i < SLAB_CLASSES; ++i) {
+        stats[i].object_size = (size_t)SLAB_MIN_OBJECT << i;
+        stats[i].slabs = stats[i].objects = stats[i].bytes = 0;
+    }
+    pthread_mutex_lock(&slab_registry_mutex);
+    for (slab_cache_t *cache = slab_registry; cache; cache = cache->next_cache) {
+        for (int i = 0; i < SLAB_CLASSES; ++i) {
+            stats[i].slabs += atomic_load_explicit(&cache->stats[i].slabs, memory_order_relaxed);
+            stats[i].objects += atomic_load_explicit(&cache->stats[i].objects, memory_order_relaxed);
+            stats[i].bytes += atomic_load_explicit(&cache->stats[i].bytes, memory_order_relaxed);
+        }
+    }
+    pthread_mutex_unlock(&slab_registry_mutex);
+}
+
+// Implementaciones del almacén clave-valor
+static uint64_t kv_hash(const char *key, size_t len) {
+    /* FNV-1a con el mezclado final de MurmurHash3: los bits altos eligen la partición y los bajos la cubeta. */
+    uint64_t h = 1469598103934665603ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)key[i];
+        h *= 1099511628211ULL;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static kv_shard_t *kv_shard(key_value_store_t *store, uint64_t hash) {
+    return &store->shards[hash >> (64 - __builtin_ctz(KV_SHARDS))];
+}
+
+static size_t kv_node_size(const kv_node_t *node) {
+    return sizeof(kv_node_t) + node->key_len + node->value_cap;
+}
+
+static void kv_release(void *mem, size_t size) {
+    if (size) slab_free(mem, size);
+    else free(mem);
+}
+
+static kv_table_t *kv_table_create(size_t buckets) {
+    kv_table_t *table = calloc(1, sizeof(kv_table_t) + buckets * sizeof(kv_node_t *));
+    if (!table) return NULL;
+    table->mask = buckets - 1;
+    return table;
+}
+
+static uint64_t kv_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int64_t kv_wall_offset_ms(void) {
+    // Diferencia entre CLOCK_REALTIME y CLOCK_MONOTONIC: en disco las caducidades son absolutas de reloj de pared
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000 - (int64_t)kv_now_ms();
+}
+
+static uint64_t kv_mono_from_wall(uint64_t wall) {
+    int64_t mono = (int64_t)wall - kv_wall_offset_ms();
+    return mono > 0 ? (uint64_t)mono : 1; // caducó antes del arranque: vence en el primer tic
+}
+
+static int kv_expired(const kv_node_t *node) {
+    /* Caducidad perezosa: una clave vencida no se ve aunque el hilo de caducidad aún no la haya quitado. */
+    uint64_t expires = __atomic_load_n(&node->timer.expires, __ATOMIC_RELAXED); // un escritor puede estar cambiándola
+    return expires != 0 && expires <= kv_now_ms();
+}
+
+static void kv_wheel_link(kv_wheel_t *w, kv_timer_t *t, uint64_t min_due) {
+    /*
+    Enlaza un temporizador en el nivel más bajo que cubre su plazo: O(1).
+    Uno más lejano que la última vuelta se deja en la última ranura alcanzable
+    y se vuelve a colocar en cada cascada.
+    */
+    uint64_t due = t->expires > min_due ? t->expires : min_due;
+    uint64_t delta = due - w->now;
+    if (delta >= 1ULL << (KV_WHEEL_BITS * KV_WHEEL_LEVELS)) {
+        delta = (1ULL << (KV_WHEEL_BITS * KV_WHEEL_LEVELS)) - 1;
+        due = w->now + delta;
+    }
+    int level = 0;
+    while (level < KV_WHEEL_LEVELS - 1 && delta >= 1ULL << (KV_WHEEL_BITS * (level + 1))) level++;
+    unsigned slot = (due >> (KV_WHEEL_BITS * level)) & (KV_WHEEL_SLOTS - 1);
+    kv_timer_t **head = &w->slots[level][slot];
+    t->next = *head;
+    if (t->next) t->next->pprev = &t->next;
+    t->pprev = head;
+    *head = t;
+    t->slot = level * KV_WHEEL_SLOTS + slot;
+    w->occupied[level] |= 1ULL << slot;
+}
+
+static void kv_wheel_cancel(kv_wheel_t *w, kv_timer_t *t) {
+    /* Quita un temporizador de la rueda en O(1) gracias a pprev. No hace nada si no está. */
+    if (!t->pprev) return;
+    if (t->next) t->next->pprev = t->pprev;
+    *t->pprev = t->next;
+    unsigned level = t->slot / KV_WHEEL_SLOTS, slot = t->slot % KV_WHEEL_SLOTS;
+    if (!w->slots[level][slot]) w->occupied[level] &= ~(1ULL << slot);
+    t->pprev = NULL;
+    w->count--;
+}
+
+static uint64_t kv_wheel_next(const kv_wheel_t *w) {
+    /*
+    Próximo ms con trabajo: el vencimiento de la primera ranura no vacía del nivel 0,
+    o la cascada de la primera ranura no vacía de un nivel superior. Con el mapa de bits
+    de cada nivel son unas pocas instrucciones, así que los tics vacíos se saltan.
+    */
+    uint64_t next = UINT64_MAX;
+    for (int level = 0; level < KV_WHEEL_LEVELS; ++level) {
+        uint64_t bits = w->occupied[level];
+        if (!bits) continue;
+        int shift = KV_WHEEL_BITS * level;
+        uint64_t base = (w->now >> shift) + 1; // primer bloque de este nivel que aún no ha empezado
+        unsigned rot = base & (KV_WHEEL_SLOTS - 1);
+        uint64_t rotated = rot ? (bits >> rot) | (bits << (64 - rot)) : bits;
+        uint64_t tick = (base + __builtin_ctzll(rotated)) << shift;
+        if (tick < next) next = tick;
+    }
+    return next;
+}
+
+static kv_timer_t *kv_wheel_advance(kv_wheel_t *w, uint64_t now) {
+    /*
+    Avanza la rueda hasta 'now' procesando solo los tics con trabajo: en cada uno, primero
+    las cascadas de los niveles que dan la vuelta y después la ranura del nivel 0.
+    Retorna los temporizadores vencidos, ya fuera de la rueda, encadenados por 'next'.
+    */
+    kv_timer_t *expired = NULL;
+    while (w->now < now) {
+        uint64_t tick = w->count ? kv_wheel_next(w) : UINT64_MAX;
+        if (tick > now) {
+            w->now = now;
+            break;
+        }
+        w->now = tick;
+        for (int level = 1; level < KV_WHEEL_LEVELS; ++level) {
+            int shift = KV_WHEEL_BITS * level;
+            if (tick & ((1ULL << shift) - 1)) break;
+            unsigned slot = (tick >> shift) & (KV_WHEEL_SLOTS - 1);
+            kv_timer_t *list = w->slots[level][slot];
+            w->slots[level][slot] = NULL;
+            w->occupied[level] &= ~(1ULL << slot);
+            while (list) {
+                kv_timer_t *next = list->next;
+                kv_wheel_link(w, list, tick);
+                list = next;
+            }
+        }
+        unsigned slot = tick & (KV_WHEEL_SLOTS - 1);
+        kv_timer_t *list = w->slots[0][slot];
+        w->slots[0][slot] = NULL;
+        w->occupied[0] &= ~(1ULL << slot);
+        while (list) {
+            kv_timer_t *next = list->next;
+            list->pprev = NULL;
+            list->next = expired;
+            expired = list;
+            w->count--;
+            list = next;
+        }
+    }
+    atomic_store(&w->next_due, w->count ? kv_wheel_next(w) : UINT64_MAX);
+    return expired;
+}
+
+static void kv_wheel_add(key_value_store_t *store, kv_wheel_t *w, kv_timer_t *t) {
+    /*
+    Programa la caducidad t->expires (con el write lock de la partición). Si vence antes
+    de lo que el hilo de caducidad piensa dormir, lo despierta.
+    */
+    if (w->count == 0) { // rueda vacía: se pone en hora para que los plazos se midan desde ahora
+        uint64_t now = kv_now_ms();
+        if (now > w->now + 1) w->now = now - 1;
+    }
+    kv_wheel_link(w, t, w->now + 1);
+    w->count++;
+    uint64_t due = kv_wheel_next(w);
+    atomic_store(&w->next_due, due);
+    if (due < atomic_load(&store->expiry_wake)) {
+        pthread_mutex_lock(&store->expiry_mutex);
+        pthread_cond_signal(&store->expiry_cond);
+        pthread_mutex_unlock(&store->expiry_mutex);
+    }
+}
+
+static void *kv_expirer(void *arg);
+
+key_value_store_t *kv_store_create(int capacity, kv_read_mode_t read_mode) {
+    /*
+    Crea e inicializa el almacén clave-valor concurrente.
+
+    - 'capacity' es solo una estimación: cada partición empieza con cubetas
+      para su parte y el índice crece después sin límite.
+    - Inicializa el read-write lock y el contador de secuencia de cada partición,
+      y la época global usada por los lectores en modo KV_READ_SEQLOCK.
+    - Arranca el hilo de caducidad, que duerme hasta el próximo vencimiento.
+    */
+    key_value_store_t *store = aligned_alloc(CACHE_LINE_SIZE, sizeof(key_value_store_t));
+    if (!store) return NULL;
+    memset(store, 0, sizeof(*store));
+
+    size_t buckets = KV_MIN_BUCKETS;
+    while (buckets * KV_SHARDS < (size_t)capacity) buckets *= 2;
+    for (int i = 0; i < KV_SHARDS; ++i) {
+        kv_shard_t *shard = &store->shards[i];
+        shard->table[0] = kv_table_create(buckets);
+        if (!shard->table[0]) {
+            while (i-- > 0) free(store->shards[i].table[0]);
+            free(store);
+            return NULL;
+        }
+        pthread_rwlock_init(&shard->rwlock, NULL);
+        atomic_init(&shard->seq, 0);
+        shard->wheel.now = kv_now_ms();
+        atomic_init(&shard->wheel.next_due, UINT64_MAX);
+    }
+    for (int i = 0; i < KV_MAX_READERS; ++i) atomic_init(&store->readers[i].epoch, 0);
+    atomic_init(&store->num_readers, 0);
+    atomic_init(&store->epoch, 1);
+    store->read_mode = read_mode;
+    store->wal.fd = -1;
+    atomic_init(&store->wal.durable, 0);
+    atomic_init(&store->compacting, 0);
+    pthread_mutex_init(&store->wal.mutex, NULL);
+    pthread_cond_init(&store->wal.synced, NULL);
+    pthread_mutex_init(&store->compact_mutex, NULL);
+    pthread_cond_init(&store->compact_cond, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_mutex_init(&store->expiry_mutex, NULL);
+    pthread_cond_init(&store->expiry_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    atomic_init(&store->expiry_wake, 0);
+    if (pthread_create(&store->expirer, NULL, kv_expirer, store) == 0) store->expirer_running = 1;
+    return store;
+}
+
+static void kv_free_retired(kv_retired_t *retired) {
+    // Un nodo con envíos sin copia en curso se marca y lo libera el último kv_store_unpin
+    if (retired->pins && atomic_fetch_or(retired->pins, KV_PIN_DEAD) != 0) return;
+    kv_release(retired->mem, retired->size);
+}
+
+static void kv_retire(key_value_store_t *store, kv_shard_t *shard, kv_retired_t *retired, void *mem, size_t size,
+                      atomic_uint *pins) {
+    /*
+    Libera un nodo o una tabla ya desenlazados del índice. En modo KV_READ_SEQLOCK
+    un lector sin lock puede estar recorriéndolo: se apunta con la época actual
+    y kv_reclaim lo libera cuando ningún lector pueda verlo.
+    */
+    retired->mem = mem;
+    retired->size = size;
+    retired->pins = pins;
+    if (store->read_mode == KV_READ_RWLOCK) {
+        kv_free_retired(retired);
+        return;
+    }
+    retired->epoch = atomic_load(&store->epoch);
+    retired->next = shard->retired;
+    shard->retired = retired;
+    shard->retired_count++;
+}
+
+static unsigned long kv_try_advance(key_value_store_t *store) {
+    /* Avanza la época global si todos los lectores activos leen ya en la actual. Retorna la época vigente. */
+    unsigned long epoch = atomic_load(&store->epoch);
+    int readers = atomic_load(&store->num_readers);
+    if (readers > KV_MAX_READERS) readers = KV_MAX_READERS;
+    int quiescent = 1;
+    for (int i = 0; i < readers && quiescent; ++i) {
+        unsigned long e = atomic_load(&store->readers[i].epoch);
+        quiescent = e == 0 || e == epoch;
+    }
+    if (quiescent && atomic_compare_exchange_strong(&store->epoch, &epoch, epoch + 1)) epoch++;
+    return epoch;
+}
+
+static void kv_reclaim(key_value_store_t *store, kv_shard_t *shard) {
+    /*
+    Liberación por épocas. La época global solo avanza si todos los lectores activos
+    ya leen en la época actual; lo retirado en la época e se desenlazó antes de que
+    empezara cualquier lectura de la época e + 1, así que es seguro liberarlo
+    cuando la época global llega a e + 2.
+    */
+    unsigned long epoch = kv_try_advance(store);
+
+    kv_retired_t **link = &shard->retired;
+    while (*link) {
+        kv_retired_t *retired = *link;
+        if (retired->epoch + 2 <= epoch) {
+            *link = retired->next;
+            shard->retired_count--;
+            kv_free_retired(retired);
+        } else {
+            link = &retired->next;
+        }
+    }
+}
+
+static void kv_write_begin(kv_shard_t *shard) {
+    /* Adquiere el write lock y deja 'seq' impar para invalidar las lecturas optimistas en curso. */
+    pthread_rwlock_wrlock(&shard->rwlock);
+    atomic_store_explicit(&shard->seq, atomic_load_explicit(&shard->seq, memory_order_relaxed) + 1,
+                          memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+static void kv_write_end(key_value_store_t *store, kv_shard_t *shard) {
+    atomic_store_explicit(&shard->seq, atomic_load_explicit(&shard->seq, memory_order_relaxed) + 1,
+                          memory_order_release);
+    if (shard->retired_count >= KV_RECLAIM_BATCH) kv_reclaim(store, shard);
+    pthread_rwlock_unlock(&shard->rwlock);
+}
+
+static void kv_rehash_step(key_value_store_t *store, kv_shard_t *shard) {
+    /*
+    Redimensionado incremental: cada escritura en la partición migra KV_REHASH_STEP cubetas
+    de table[0] a table[1], así que ninguna operación paga el rehash de toda la tabla.
+    Los nodos se mueven sin copiarlos; un lector sin lock que los esté recorriendo
+    ve cambiar 'seq' y reintenta. Al vaciar table[0], table[1] pasa a ser la única tabla.
+    */
+    kv_table_t *old = shard->table[0], *new = shard->table[1];
+    if (!new) return;
+    for (int n = 0; n < KV_REHASH_STEP && shard->rehash_idx <= old->mask; ++n, ++shard->rehash_idx) {
+        kv_node_t *node = old->buckets[shard->rehash_idx];
+        while (node) {
+            kv_node_t *next = node->next;
+            kv_node_t **bucket = &new->buckets[node->hash & new->mask];
+            node->next = *bucket;
+            __atomic_store_n(bucket, node, __ATOMIC_RELEASE);
+            node = next;
+        }
+        __atomic_store_n(&old->buckets[shard->rehash_idx], NULL, __ATOMIC_RELEASE);
+    }
+    if (shard->rehash_idx > old->mask) {
+        __atomic_store_n(&shard->table[0], new, __ATOMIC_RELEASE);
+        __atomic_store_n(&shard->table[1], NULL, __ATOMIC_RELEASE);
+        kv_retire(store, shard, &old->retired, old, 0, NULL);
+    }
+}
+
+static kv_node_t **kv_find_link(kv_shard_t *shard, uint64_t hash, const char *key, size_t key_len) {
+    /* Busca la clave en las dos tablas de la partición (con el lock tomado). Retorna el enlace que apunta al nodo. */
+    for (int t = 0; t < 2 && shard->table[t]; ++t) {
+        kv_node_t **link = &shard->table[t]->buckets[hash & shard->table[t]->mask];
+        for (; *link; link = &(*link)->next) {
+            kv_node_t *node = *link;
+            if (node->hash == hash && node->key_len == key_len && memcmp(node->data, key, key_len) == 0) return link;
+        }
+    }
+    return NULL;
+}
+
+static kv_node_t *kv_node_create(uint64_t hash, const char *key, size_t key_len, const char *value, size_t value_len) {
+    // El nodo ocupa su clase entera del asignador: el sobrante permite actualizar en el sitio
+    size_t size = slab_usable_size(sizeof(kv_node_t) + key_len + value_len);
+    size_t value_cap = size - sizeof(kv_node_t) - key_len;
+    if (value_cap > UINT32_MAX) value_cap = value_len;
+    kv_node_t *node = slab_alloc(sizeof(kv_node_t) + key_len + value_cap);
+    if (!node) return NULL;
+    node->next = NULL;
+    node->hash = hash;
+    node->key_len = key_len;
+    node->value_len = value_len;
+    node->value_cap = value_cap;
+    node->deleted = 0;
+    atomic_init(&node->pins, 0);
+    node->timer.next = NULL;
+    node->timer.pprev = NULL;
+    node->timer.expires = 0;
+    memcpy(node->data, key, key_len);
+    memcpy(node->data + key_len, value, value_len);
+    return node;
+}
+
+static kv_reader_t *kv_reader_enter(key_value_store_t *store) {
+    /*
+    Anuncia una lectura sin lock en la época global actual, en el slot propio del hilo
+    (una línea de caché que no escribe nadie más). Retorna NULL si no quedan slots:
+    ese hilo lee con el read lock.
+    */
+    static _Thread_local key_value_store_t *owner = NULL;
+    static _Thread_local kv_reader_t *slot = NULL;
+    if (owner != store) {
+        int i = atomic_fetch_add(&store->num_readers, 1);
+        slot = i < KV_MAX_READERS ? &store->readers[i] : NULL;
+        owner = store;
+    }
+    if (!slot) return NULL;
+    unsigned long epoch = atomic_load(&store->epoch);
+    for (;;) {
+        atomic_store(&slot->epoch, epoch);
+        unsigned long now = atomic_load(&store->epoch);
+        if (now == epoch) return slot;
+        epoch = now;
+    }
+}
+
+static const kv_snapshot_record_t *kv_snapshot_find(const kv_snapshot_t *snap, uint64_t hash, const char *key, size_t key_len) {
+    /* Busca en la tabla de la instantánea con sondeo lineal. Los datos son inmutables: no hace falta lock. */
+    if (!snap) return NULL;
+    uint64_t mask = snap->header->buckets - 1;
+    for (uint64_t i = hash & mask;; i = (i + 1) & mask) {
+        uint64_t offset = snap->table[i];
+        if (offset == 0) return NULL;
+        const kv_snapshot_record_t *record = (const kv_snapshot_record_t *)(snap->map + offset);
+        if (record->hash == hash && record->key_len == key_len && memcmp(record->data, key, key_len) == 0) return record;
+    }
+}
+
+static size_t kv_copy_value(char *value, size_t value_size, const char *src, size_t len) {
+    if (value_size > 0) {
+        size_t n = len < value_size ? len : value_size - 1;
+        memcpy(value, src, n);
+        value[n] = '\0';
+    }
+    return len;
+}
+
+static kv_node_t *kv_find_lockfree(kv_shard_t *shard, uint64_t hash, const char *key, size_t key_len) {
+    /*
+    Como kv_find_link pero sin lock, para el modo KV_READ_SEQLOCK: un escritor puede estar
+    cambiando la partición, así que el resultado solo vale si 'seq' no cambió mientras tanto.
+    */
+    for (int t = 0; t < 2; ++t) {
+        kv_table_t *table = __atomic_load_n(&shard->table[t], __ATOMIC_ACQUIRE);
+        if (!table) continue;
+        kv_node_t *node = __atomic_load_n(&table->buckets[hash & table->mask], __ATOMIC_ACQUIRE);
+        for (; node; node = __atomic_load_n(&node->next, __ATOMIC_ACQUIRE)) {
+            if (node->hash == hash && node->key_len == key_len && memcmp(node->data, key, key_len) == 0) return node;
+        }
+    }
+    return NULL;
+}
+
+static uint32_t kv_value_len(const kv_node_t *node) {
+    uint32_t len = node->value_len;
+    return len > node->value_cap ? node->value_cap : len; // lectura rota sin lock: 'seq' la descarta
+}
+
+int kv_store_get(key_value_store_t *store, const char *key, char *value, size_t value_size) {
+    /*
+    Obtiene el valor asociado a una clave del almacén de forma concurrente para lectores.
+
+    - Solo se recorre la partición de la clave: O(1) con independencia del tamaño del almacén.
+    - Modo KV_READ_RWLOCK: adquiere el read lock de la partición, busca la clave y copia el valor.
+    - Modo KV_READ_SEQLOCK: lee 'seq' de la partición, copia el valor y comprueba que 'seq'
+      no cambió; si un escritor intervino, reintenta. La época anunciada garantiza
+      que los nodos recorridos (y la instantánea) no se liberan durante la lectura.
+    - Si la clave no está en memoria (ni borrada en memoria), se busca en la instantánea.
+      Una clave con la caducidad vencida no existe, aunque aún no la haya quitado el hilo de caducidad.
+    - El valor se copia en el buffer del llamante (truncado y terminado en '\0'),
+      nunca se retorna un puntero al almacén.
+    - Retorna la longitud del valor (si es >= value_size, el buffer se quedó corto), o -1 si no está.
+    */
+    size_t key_len = strlen(key);
+    uint64_t hash = kv_hash(key, key_len);
+    kv_shard_t *shard = kv_shard(store, hash);
+    kv_reader_t *reader = store->read_mode == KV_READ_SEQLOCK ? kv_reader_enter(store) : NULL;
+    long found;
+    int in_memory;
+
+    if (!reader) {
+        pthread_rwlock_rdlock(&shard->rwlock);
+        kv_node_t **link = kv_find_link(shard, hash, key, key_len);
+        if (link) {
+            found = (*link)->deleted || kv_expired(*link) ? -1 : (long)kv_copy_value(value, value_size, (*link)->data + key_len, (*link)->value_len);
+        } else {
+            const kv_snapshot_t *snap = __atomic_load_n(&store->snapshot, __ATOMIC_ACQUIRE);
+            const kv_snapshot_record_t *record = kv_snapshot_find(snap, hash, key, key_len);
+            found = record ? (long)kv_copy_value(value, value_size, record->data + key_len, record->value_len) : -1;
+        }
+        pthread_rwlock_unlock(&shard->rwlock);
+        return (int)found;
+    }
+
+    for (;;) {
+        unsigned s1 = atomic_load_explicit(&shard->seq, memory_order_acquire);
+        if (s1 & 1) {
+            cpu_relax();
+            continue;
+        }
+        kv_node_t *node = kv_find_lockfree(shard, hash, key, key_len);
+        in_memory = node != NULL;
+        found = node && !node->deleted && !kv_expired(node) ? (long)kv_copy_value(value, value_size, node->data + key_len, kv_value_len(node)) : -1;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&shard->seq, memory_order_relaxed) == s1) break;
+    }
+    if (!in_memory) {
+        const kv_snapshot_t *snap = __atomic_load_n(&store->snapshot, __ATOMIC_ACQUIRE);
+        const kv_snapshot_record_t *record = kv_snapshot_find(snap, hash, key, key_len);
+        if (record) found = kv_copy_value(value, value_size, record->data + key_len, record->value_len);
+    }
+    atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+    return (int)found;
+}
+
+static uint32_t kv_checksum(const char *data, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)data[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static unsigned long long kv_wal_append(kv_wal_t *wal, int op, const char *key, size_t key_len,
+                                        const char *value, size_t value_len) {
+    /*
+    Añade un registro al buffer del log y retorna su LSN (el final del registro en el flujo del log).
+    Formato: checksum (4) | op (1) | key_len (4) | value_len (4) | clave | valor.
+    Se llama con el lock de la partición tomado, así que el orden del log coincide
+    con el orden en que se aplicaron las escrituras de cada clave.
+    Retorna 0 si no hay memoria; el log queda marcado como fallido.
+    */
+    size_t len = KV_WAL_HEADER + key_len + value_len;
+    pthread_mutex_lock(&wal->mutex);
+    if (wal->len + len > wal->cap) {
+        size_t cap = wal->cap ? wal->cap : BUFFER_SIZE * 64;
+        while (cap < wal->len + len) cap *= 2;
+        char *buf = realloc(wal->buf, cap);
+        if (!buf) {
+            wal->failed = 1;
+            pthread_mutex_unlock(&wal->mutex);
+            return 0;
+        }
+        wal->buf = buf;
+        wal->cap = cap;
+    }
+    char *record = wal->buf + wal->len;
+    uint32_t klen = key_len, vlen = value_len;
+    record[4] = (char)op;
+    memcpy(record + 5, &klen, 4);
+    memcpy(record + 9, &vlen, 4);
+    memcpy(record + KV_WAL_HEADER, key, key_len);
+    if (value_len) memcpy(record + KV_WAL_HEADER + key_len, value, value_len);
+    uint32_t sum = kv_checksum(record + 4, len - 4);
+    memcpy(record, &sum, 4);
+    wal->len += len;
+    wal->appended += len;
+    unsigned long long lsn = wal->appended;
+    pthread_mutex_unlock(&wal->mutex);
+    return lsn;
+}
+
+static int kv_write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) return -1;
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int kv_store_sync(key_value_store_t *store, unsigned long long lsn) {
+    /*
+    Espera a que el log esté en disco hasta 'lsn' (commit en grupo).
+
+    - Si ya lo está, retorna sin tomar el mutex.
+    - Si nadie está escribiendo, este hilo se convierte en líder: se lleva todo el buffer
+      (sus registros y los de todos los hilos que añadieron mientras tanto), lo escribe
+      y hace un único fdatasync fuera del mutex.
+    - Si hay un líder, espera; al terminar ese lote, o ya está cubierto o lidera el siguiente.
+      Con N escritores concurrentes hay del orden de un fdatasync por lote, no uno por escritura.
+    - Retorna 0, o -1 si el log falló (no se puede garantizar la durabilidad).
+    */
+    kv_wal_t *wal = &store->wal;
+    if (lsn == 0 || atomic_load_explicit(&wal->durable, memory_order_acquire) >= lsn) return 0;
+
+    pthread_mutex_lock(&wal->mutex);
+    while (atomic_load_explicit(&wal->durable, memory_order_relaxed) < lsn && !wal->failed) {
+        if (wal->flushing) {
+            pthread_cond_wait(&wal->synced, &wal->mutex);
+            continue;
+        }
+        char *batch = wal->buf;
+        size_t batch_len = wal->len, batch_cap = wal->cap;
+        unsigned long long end = wal->appended;
+        wal->buf = wal->spare;
+        wal->cap = wal->spare_cap;
+        wal->len = 0;
+        wal->spare = NULL;
+        wal->spare_cap = 0;
+        wal->flushing = 1;
+        pthread_mutex_unlock(&wal->mutex);
+
+        int ok = kv_write_all(wal->fd, batch, batch_len) == 0 && fdatasync(wal->fd) == 0;
+
+        pthread_mutex_lock(&wal->mutex);
+        wal->flushing = 0;
+        if (ok) {
+            wal->file_size += batch_len;
+            atomic_store_explicit(&wal->durable, end, memory_order_release);
+        } else {
+            perror("kv wal write failed");
+            wal->failed = 1;
+        }
+        if (!wal->spare) {
+            wal->spare = batch;
+            wal->spare_cap = batch_cap;
+        } else {
+            free(batch);
+        }
+        pthread_cond_broadcast(&wal->synced);
+    }
+    int ret = wal->failed ? -1 : 0;
+    pthread_mutex_unlock(&wal->mutex);
+    return ret;
+}
+
+static void kv_path(char *path, size_t size, const key_value_store_t *store, const char *name) {
+    snprintf(path, size, "%s/%s", store->dir, name);
+}
+
+static void kv_sync_dir(const key_value_store_t *store) {
+    // Hace duraderos los rename y los ficheros nuevos del directorio
+    int fd = open(store->dir, O_RDONLY | O_DIRECTORY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+}
+
+static int kv_wal_rotate(key_value_store_t *store) {
+    /*
+    Cierra el log actual como KV_WAL_OLD y abre uno vacío. Todo lo anterior queda en disco
+    antes de rotar; las escrituras que lleguen después van al log nuevo.
+    */
+    kv_wal_t *wal = &store->wal;
+    char path[PATH_MAX], old_path[PATH_MAX];
+    kv_path(path, sizeof(path), store, KV_WAL_FILE);
+    kv_path(old_path, sizeof(old_path), store, KV_WAL_OLD);
+
+    if (access(old_path, F_OK) == 0) return 0; // una compactación anterior no terminó: su log sigue pendiente
+    pthread_mutex_lock(&wal->mutex);
+    while (wal->len > 0 || wal->flushing) { // vaciar el buffer pendiente como lo haría un líder
+        unsigned long long lsn = wal->appended;
+        pthread_mutex_unlock(&wal->mutex);
+        if (kv_store_sync(store, lsn) < 0) return -1;
+        pthread_mutex_lock(&wal->mutex);
+    }
+    int ret = -1;
+    if (!wal->failed && rename(path, old_path) == 0) {
+        int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            close(wal->fd);
+            wal->fd = fd;
+            wal->file_size = 0;
+            ret = 0;
+        } else {
+            rename(old_path, path);
+        }
+    }
+    pthread_mutex_unlock(&wal->mutex);
+    if (ret == 0) kv_sync_dir(store);
+    return ret;
+}
+
+static kv_snapshot_t *kv_snapshot_open(const char *path) {
+    /*
+    Proyecta la instantánea con mmap y valida su cabecera. No lee los registros:
+    el sistema operativo trae cada página la primera vez que una búsqueda la toca,
+    así que abrir una instantánea de varios GB cuesta lo mismo que una pequeña.
+    */
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return NULL;
+    struct stat st;
+    kv_snapshot_t *snap = NULL;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(kv_snapshot_header_t)) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (map != MAP_FAILED) {
+            const kv_snapshot_header_t *h = map;
+            int valid = memcmp(h->magic, KV_SNAPSHOT_MAGIC, 8) == 0 && h->file_size == (uint64_t)st.st_size &&
+                        h->buckets > 0 && (h->buckets & (h->buckets - 1)) == 0 &&
+                        h->table_offset + h->buckets * sizeof(uint64_t) == h->ttl_offset &&
+                        h->ttl_offset + h->ttl_count * sizeof(uint64_t) == h->file_size;
+            snap = valid ? malloc(sizeof(kv_snapshot_t)) : NULL;
+            if (snap) {
+                snap->map = map;
+                snap->size = st.st_size;
+                snap->header = h;
+                snap->table = (const uint64_t *)((const char *)map + h->table_offset);
+                atomic_init(&snap->pins, 0);
+            } else {
+                if (!valid) fprintf(stderr, "Instantánea %s inválida, se ignora\n", path);
+                munmap(map, st.st_size);
+            }
+        }
+    }
+    close(fd);
+    return snap;
+}
+
+static void kv_snapshot_close(kv_snapshot_t *snap) {
+    if (!snap) return;
+    munmap((void *)snap->map, snap->size);
+    free(snap);
+}
+
+static int kv_insert_node(kv_shard_t *shard, kv_node_t *node) {
+    /* Enlaza un nodo nuevo en su cubeta y, si la partición se llena, empieza a duplicar su tabla. */
+    kv_table_t *table = shard->table[1] ? shard->table[1] : shard->table[0];
+    kv_node_t **bucket = &table->buckets[node->hash & table->mask];
+    node->next = *bucket;
+    __atomic_store_n(bucket, node, __ATOMIC_RELEASE);
+    if (++shard->count > table->mask + 1 && !shard->table[1]) {
+        kv_table_t *bigger = kv_table_create((table->mask + 1) * 2);
+        if (bigger) { // sin memoria, la tabla sigue sirviendo con cadenas más largas
+            shard->rehash_idx = 0;
+            __atomic_store_n(&shard->table[1], bigger, __ATOMIC_RELEASE);
+        }
+    }
+    return 0;
+}
+
+static int kv_pinned(kv_node_t *node) {
+    /*
+    ¿Hay un envío sin copia de este nodo? Entonces no se puede escribir en el sitio.
+    La barrera empareja con la de kv_store_pin: o el lector ve 'seq' cambiado
+    y suelta el nodo, o el escritor ve su pin.
+    */
+    atomic_thread_fence(memory_order_seq_cst);
+    return atomic_load_explicit(&node->pins, memory_order_relaxed) != 0;
+}
+
+static int kv_apply(key_value_store_t *store, kv_shard_t *shard, int op, uint64_t hash, const char *key, size_t key_len,
+                    const char *value, size_t value_len, unsigned long long *lsn) {
+    /*
+    Aplica un PUT, un DELETE o un EXPIRE en la partición de la clave, con su write lock ya tomado,
+    y, si lsn no es NULL y el almacén es persistente, lo añade al log con el lock aún tomado.
+    Al reproducir el log se llama con lsn == NULL.
+
+    - PUT: actualiza en el sitio si el valor cabe en el nodo; si no, lo sustituye por
+      un nodo nuevo y retira el viejo; si la clave no está, inserta un nodo.
+    - DELETE: desenlaza el nodo, salvo que la clave exista en la instantánea (o se esté
+      construyendo una): entonces el nodo queda marcado como borrado para ocultar
+      la versión de disco. Si la clave solo está en la instantánea, se inserta la marca.
+    - PUT y DELETE quitan la caducidad de la clave.
+    - EXPIRE: 'value' es la caducidad absoluta (8 bytes, ms de CLOCK_REALTIME, así sirve
+      tras reiniciar); la clave pasa a la rueda de su partición. Una clave que solo está
+      en la instantánea se carga en memoria, que es donde viven las caducidades.
+    - Retorna 0 en éxito; -1 si no hay memoria (PUT) o la clave no existe (DELETE, EXPIRE).
+    */
+    if (key_len > UINT32_MAX || value_len >= INT_MAX) return -1;
+    int ret = 0;
+
+    kv_node_t **link = kv_find_link(shard, hash, key, key_len);
+    if (op == KV_OP_PUT) {
+        if (link && value_len <= (*link)->value_cap && !kv_pinned(*link)) {
+            kv_node_t *node = *link;
+            memcpy(node->data + key_len, value, value_len);
+            node->value_len = value_len;
+            node->deleted = 0;
+            kv_wheel_cancel(&shard->wheel, &node->timer);
+            __atomic_store_n(&node->timer.expires, 0, __ATOMIC_RELAXED);
+        } else {
+            kv_node_t *node = kv_node_create(hash, key, key_len, value, value_len);
+            if (!node) {
+                ret = -1;
+            } else if (link) {
+                kv_node_t *old = *link;
+                node->next = old->next;
+                __atomic_store_n(link, node, __ATOMIC_RELEASE);
+                kv_wheel_cancel(&shard->wheel, &old->timer);
+                kv_retire(store, shard, &old->retired, old, kv_node_size(old), &old->pins);
+            } else {
+                kv_insert_node(shard, node);
+            }
+        }
+    } else if (op == KV_OP_EXPIRE) {
+        kv_node_t *node = link ? *link : NULL;
+        uint64_t wall;
+        if (value_len != sizeof(wall) || (node && (node->deleted || kv_expired(node)))) {
+            ret = -1;
+        } else if (!node) {
+            const kv_snapshot_t *snap = __atomic_load_n(&store->snapshot, __ATOMIC_ACQUIRE);
+            const kv_snapshot_record_t *record = kv_snapshot_find(snap, hash, key, key_len);
+            node = record ? kv_node_create(hash, key, key_len, record->data + key_len, record->value_len) : NULL;
+            if (node) kv_insert_node(shard, node);
+            else ret = record ? -2 : -1;
+        }
+        if (node && ret == 0) {
+            memcpy(&wall, value, sizeof(wall));
+            kv_wheel_cancel(&shard->wheel, &node->timer);
+            __atomic_store_n(&node->timer.expires, kv_mono_from_wall(le64toh(wall)), __ATOMIC_RELAXED);
+            kv_wheel_add(store, &shard->wheel, &node->timer);
+        }
+    } else {
+        const kv_snapshot_t *snap = __atomic_load_n(&store->snapshot, __ATOMIC_ACQUIRE);
+        int on_disk = atomic_load(&store->compacting) || kv_snapshot_find(snap, hash, key, key_len);
+        if (link && !(*link)->deleted) {
+            kv_node_t *node = *link;
+            kv_wheel_cancel(&shard->wheel, &node->timer);
+            if (on_disk) {
+                node->deleted = 1;
+            } else {
+                __atomic_store_n(link, node->next, __ATOMIC_RELEASE);
+                shard->count--;
+                kv_retire(store, shard, &node->retired, node, kv_node_size(node), &node->pins);
+            }
+        } else if (!link && on_disk && kv_snapshot_find(snap, hash, key, key_len)) {
+            kv_node_t *node = kv_node_create(hash, key, key_len, "", 0);
+            if (node) {
+                node->deleted = 1;
+                kv_insert_node(shard, node);
+            } else {
+                ret = -2; // sin memoria no se puede ocultar la versión de disco
+            }
+        } else {
+            ret = -1;
+        }
+    }
+    if (ret == 0 && lsn && store->dir) { // solo los almacenes de kv_store_open tienen log
+        *lsn = kv_wal_append(&store->wal, op, key, key_len, value, value_len);
+        if (*lsn == 0) *lsn = ULLONG_MAX; // el log falló: kv_store_sync lo notificará
+    }
+    return ret < 0 ? -1 : 0;
+}
+
+static int kv_update(key_value_store_t *store, int op, const char *key, size_t key_len,
+                     const char *value, size_t value_len, unsigned long long *lsn) {
+    /* Aplica una sola escritura: toma el write lock de su partición y avanza el redimensionado pendiente. */
+    uint64_t hash = kv_hash(key, key_len);
+    kv_shard_t *shard = kv_shard(store, hash);
+    kv_write_begin(shard);
+    kv_rehash_step(store, shard);
+    int ret = kv_apply(store, shard, op, hash, key, key_len, value, value_len, lsn);
+    kv_write_end(store, shard);
+    return ret;
+}
+
+int kv_store_put_lsn(key_value_store_t *store, const char *key, const char *value, unsigned long long *lsn) {
+    /*
+    Inserta o actualiza un par clave-valor sin esperar al disco. En *lsn deja la posición
+    del registro en el log: el llamante debe pasarla a kv_store_sync antes de confirmar
+    la escritura (así un lote de comandos espera un solo commit).
+    Retorna 0 en éxito, -1 si no hay memoria.
+    */
+    return kv_update(store, KV_OP_PUT, key, strlen(key), value, strlen(value), lsn);
+}
+
+int kv_store_delete_lsn(key_value_store_t *store, const char *key, unsigned long long *lsn) {
+    /* Como kv_store_put_lsn, para un borrado. Retorna 0 en éxito, -1 si no se encuentra. */
+    return kv_update(store, KV_OP_DELETE, key, strlen(key), NULL, 0, lsn);
+}
+
+int kv_store_put(key_value_store_t *store, const char *key, const char *value) {
+    /*
+    Inserta o actualiza un par clave-valor y, si el almacén es persistente, espera a que
+    el registro esté en disco. Es, junto con kv_store_delete, el único escritor del almacén.
+    Retorna 0 en éxito, -1 si no hay memoria o falló el log.
+    */
+    unsigned long long lsn = 0;
+    if (kv_store_put_lsn(store, key, value, &lsn) < 0) return -1;
+    return kv_store_sync(store, lsn);
+}
+
+int kv_store_delete(key_value_store_t *store, const char *key) {
+    /* Elimina un par clave-valor y espera al log. Retorna 0 en éxito, -1 si no se encuentra o falló el log. */
+    unsigned long long lsn = 0;
+    if (kv_store_delete_lsn(store, key, &lsn) < 0) return -1;
+    return kv_store_sync(store, lsn);
+}
+
+int kv_store_update_lsn(key_value_store_t *store, int op, const char *key, size_t key_len,
+                        const char *value, size_t value_len, unsigned long long *lsn) {
+    /*
+    PUT (op = KV_OP_PUT) o DELETE (KV_OP_DELETE) con longitudes explícitas, para claves
+    y valores binarios que pueden contener '\0'. Por lo demás, como kv_store_put_lsn.
+    */
+    return kv_update(store, op, key, key_len, value, value_len, lsn);
+}
+
+int kv_store_expire_lsn(key_value_store_t *store, const char *key, size_t key_len, uint64_t ttl_ms, unsigned long long *lsn) {
+    /*
+    Programa la caducidad de una clave dentro de ttl_ms (EXPIRE); un PUT posterior la quita.
+    El log guarda la hora absoluta, así que tras reiniciar la clave caduca cuando tocaba.
+    Como kv_store_put_lsn, no espera al disco. Retorna 0, o -1 si la clave no existe.
+    */
+    int64_t wall = (int64_t)kv_now_ms() + kv_wall_offset_ms() + (int64_t)ttl_ms;
+    uint64_t value = htole64((uint64_t)wall);
+    return kv_update(store, KV_OP_EXPIRE, key, key_len, (const char *)&value, sizeof(value), lsn);
+}
+
+long long kv_store_ttl(key_value_store_t *store, const char *key, size_t key_len) {
+    /* ms que le quedan a la clave (TTL): -1 si no caduca, -2 si no existe. */
+    uint64_t hash = kv_hash(key, key_len);
+    kv_shard_t *shard = kv_shard(store, hash);
+    long long ttl = -2;
+    pthread_rwlock_rdlock(&shard->rwlock);
+    kv_node_t **link = kv_find_link(shard, hash, key, key_len);
+    if (link && !(*link)->deleted && !kv_expired(*link)) {
+        uint64_t expires = (*link)->timer.expires, now = kv_now_ms();
+        ttl = expires == 0 ? -1 : (long long)(expires - now);
+    } else if (!link) {
+        const kv_snapshot_t *snap = __atomic_load_n(&store->snapshot, __ATOMIC_ACQUIRE);
+        if (kv_snapshot_find(snap, hash, key, key_len)) ttl = -1;
+    }
+    pthread_rwlock_unlock(&shard->rwlock);
+    return ttl;
+}
+
+void kv_store_set_expire_callback(key_value_store_t *store, kv_expire_fn fn, void *arg) {
+    /* Registra la función a la que el hilo de caducidad avisa de cada clave caducada (NULL: ninguna). */
+    pthread_mutex_lock(&store->expiry_mutex);
+    store->on_expire = fn;
+    store->on_expire_arg = arg;
+    pthread_mutex_unlock(&store->expiry_mutex);
+}
+
+static void kv_unpin_node(void *object);
+
+static void kv_expire_shard(key_value_store_t *store, kv_shard_t *shard, uint64_t now, kv_expire_fn fn, void *arg) {
+    /*
+    Avanza la rueda de la partición y borra las claves vencidas con un solo write lock.
+    El borrado va al log (sin esperarlo) para que una clave caducada no reaparezca al
+    reiniciar. Con aviso, cada nodo se fija antes de borrarlo y el aviso se da tras
+    soltar el lock: el callback puede usar el almacén.
+    */
+    unsigned long long lsn;
+    kv_timer_t *fired = NULL;
+    kv_write_begin(shard);
+    kv_timer_t *timer = kv_wheel_advance(&shard->wheel, now);
+    while (timer) {
+        kv_timer_t *next = timer->next;
+        kv_node_t *node = (kv_node_t *)((char *)timer - offsetof(kv_node_t, timer));
+        if (fn) {
+            atomic_fetch_add(&node->pins, 1);
+            timer->next = fired;
+            fired = timer;
+        }
+        kv_apply(store, shard, KV_OP_DELETE, node->hash, node->data, node->key_len, NULL, 0, &lsn);
+        timer = next;
+    }
+    kv_write_end(store, shard);
+    while (fired) {
+        kv_timer_t *next = fired->next;
+        kv_node_t *node = (kv_node_t *)((char *)fired - offsetof(kv_node_t, timer));
+        fn(arg, node->data, node->key_len, node->data + node->key_len, node->value_len);
+        kv_unpin_node(node);
+        fired = next;
+    }
+}
+
+static void *kv_expirer(void *arg) {
+    /*
+    Hilo de caducidad: procesa las particiones cuya rueda tiene algo vencido y duerme
+    hasta el próximo vencimiento (como mucho KV_EXPIRE_MAX_SLEEP_MS). No hay tic periódico:
+    sin claves con TTL no hace nada, y una caducidad más cercana lo despierta.
+    Tras publicar en expiry_wake hasta cuándo dormirá, vuelve a mirar next_due de cada
+    partición: o ve un temporizador recién añadido, o quien lo añadió ve expiry_wake y lo avisa.
+    */
+    key_value_store_t *store = arg;
+    pthread_mutex_lock(&store->expiry_mutex);
+    while (!store->expirer_stop) {
+        kv_expire_fn fn = store->on_expire;
+        void *fn_arg = store->on_expire_arg;
+        pthread_mutex_unlock(&store->expiry_mutex);
+        uint64_t now = kv_now_ms(), wake = now + KV_EXPIRE_MAX_SLEEP_MS;
+        for (int i = 0; i < KV_SHARDS; ++i) {
+            kv_shard_t *shard = &store->shards[i];
+            if (atomic_load(&shard->wheel.next_due) <= now) kv_expire_shard(store, shard, now, fn, fn_arg);
+        }
+        pthread_mutex_lock(&store->expiry_mutex);
+        atomic_store(&store->expiry_wake, wake);
+        for (int i = 0; i < KV_SHARDS; ++i) {
+            uint64_t due = atomic_load(&store->shards[i].wheel.next_due);
+            if (due < wake) wake = due;
+        }
+        atomic_store(&store->expiry_wake, wake);
+        if (store->expirer_stop || wake <= now) continue;
+        struct timespec deadline = {(time_t)(wake / 1000), (long)(wake % 1000) * 1000000L};
+        pthread_cond_timedwait(&store->expiry_cond, &store->expiry_mutex, &deadline);
+    }
+    pthread_mutex_unlock(&store->expiry_mutex);
+    return NULL;
+}
+
+static void kv_unpin_node(void *object) {
+    kv_node_t *node = object;
+    if (atomic_fetch_sub(&node->pins, 1) == (KV_PIN_DEAD | 1)) kv_release(node, kv_node_size(node));
+}
+
+static void kv_unpin_snapshot(void *object) {
+    kv_snapshot_t *snap = object;
+    if (atomic_fetch_sub(&snap->pins, 1) == (KV_PIN_DEAD | 1)) kv_snapshot_close(snap);
+}
+
+static int kv_pin_snapshot(key_value_store_t *store, uint64_t hash, const char *key, size_t key_len,
+                           kv_pin_t *pin, const char **value, size_t *value_len) {
+    // Con el read lock o la época anunciada: la instantánea no puede cerrarse antes del pin
+    kv_snapshot_t *snap = __atomic_load_n(&store->snapshot, __ATOMIC_ACQUIRE);
+    const kv_snapshot_record_t *record = kv_snapshot_find(snap, hash, key, key_len);
+    if (!record) return -1;
+    atomic_fetch_add(&snap->pins, 1);
+    pin->release = kv_unpin_snapshot;
+    pin->object = snap;
+    *value = record->data + key_len;
+    *value_len = record->value_len;
+    return 0;
+}
+
+int kv_store_pin(key_value_store_t *store, const char *key, size_t key_len, kv_pin_t *pin, const char **value, size_t *value_len) {
+    /*
+    Busca una clave y fija su valor en lugar de copiarlo: *value apunta al nodo del almacén
+    o al mmap de la instantánea y sigue siendo válido e inmutable hasta kv_store_unpin,
+    aunque entretanto la clave se actualice, se borre o se compacte el almacén.
+
+    - Un nodo fijado no se actualiza en el sitio (el PUT crea un nodo nuevo) y, si se retira,
+      lo libera el último unpin en lugar de kv_reclaim. Lo mismo para una instantánea sustituida.
+    - En modo KV_READ_SEQLOCK el pin se valida con 'seq' como cualquier lectura: si un escritor
+      intervino, se suelta y se reintenta.
+    - Retorna 0 si la clave existe, -1 si no.
+    */
+    uint64_t hash = kv_hash(key, key_len);
+    kv_shard_t *shard = kv_shard(store, hash);
+    kv_reader_t *reader = store->read_mode == KV_READ_SEQLOCK ? kv_reader_enter(store) : NULL;
+    kv_node_t *node;
+    int in_memory, ret = -1;
+
+    if (!reader) {
+        pthread_rwlock_rdlock(&shard->rwlock);
+        kv_node_t **link = kv_find_link(shard, hash, key, key_len);
+        in_memory = link != NULL;
+        node = link && !(*link)->deleted && !kv_expired(*link) ? *link : NULL;
+        if (node) atomic_fetch_add(&node->pins, 1);
+        else if (!in_memory) ret = kv_pin_snapshot(store, hash, key, key_len, pin, value, value_len);
+        pthread_rwlock_unlock(&shard->rwlock);
+    } else {
+        for (;;) {
+            unsigned s1 = atomic_load_explicit(&shard->seq, memory_order_acquire);
+            if (s1 & 1) {
+                cpu_relax();
+                continue;
+            }
+            node = kv_find_lockfree(shard, hash, key, key_len);
+            in_memory = node != NULL;
+            if (node && (node->deleted || kv_expired(node))) node = NULL;
+            if (node) atomic_fetch_add_explicit(&node->pins, 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst); // empareja con kv_pinned
+            if (atomic_load_explicit(&shard->seq, memory_order_relaxed) == s1) break;
+            if (node) atomic_fetch_sub(&node->pins, 1); // la época lo protege: no puede estar retirado
+        }
+        if (!in_memory) ret = kv_pin_snapshot(store, hash, key, key_len, pin, value, value_len);
+        atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+    }
+    if (node) {
+        pin->release = kv_unpin_node;
+        pin->object = node;
+        *value = node->data + key_len;
+        *value_len = node->value_len;
+        ret = 0;
+    }
+    return ret;
+}
+
+void kv_store_unpin(kv_pin_t pin) {
+    pin.release(pin.object);
+}
+
+static size_t *kv_batch_order(key_value_store_t *store, kv_batch_item_t *items, size_t n) {
+    /*
+    Calcula el hash de cada clave y retorna sus índices agrupados por partición
+    (ordenación por conteo). Es estable: dos escrituras de la misma clave en un lote
+    se aplican en el orden en que llegaron. Retorna NULL si no hay memoria.
+    */
+    size_t *order = malloc((n ? n : 1) * sizeof(size_t));
+    if (!order) return NULL;
+    size_t next[KV_SHARDS + 1] = {0};
+    for (size_t i = 0; i < n; ++i) {
+        items[i].hash = kv_hash(items[i].key, items[i].key_len);
+        next[kv_shard(store, items[i].hash) - store->shards + 1]++;
+    }
+    for (int s = 0; s < KV_SHARDS; ++s) next[s + 1] += next[s];
+    for (size_t i = 0; i < n; ++i) order[next[kv_shard(store, items[i].hash) - store->shards]++] = i;
+    return order;
+}
+
+static size_t kv_batch_group(key_value_store_t *store, kv_batch_item_t *items, const size_t *order, size_t from, size_t n) {
+    // Fin del grupo de claves de la misma partición que empieza en order[from]
+    kv_shard_t *shard = kv_shard(store, items[order[from]].hash);
+    size_t end = from + 1;
+    while (end < n && kv_shard(store, items[order[end]].hash) == shard) end++;
+    return end;
+}
+
+static int kv_batch_copy(kv_batch_item_t *item, const char *src, size_t len, char **values, size_t *values_cap, size_t *used) {
+    // Copia un valor encontrado al final del buffer de valores del lote, ampliándolo si hace falta
+    if (*used + len > *values_cap) {
+        size_t cap = *values_cap ? *values_cap : BUFFER_SIZE;
+        while (cap < *used + len) cap *= 2;
+        char *bigger = realloc(*values, cap);
+        if (!bigger) return -1;
+        *values = bigger;
+        *values_cap = cap;
+    }
+    memcpy(*values + *used, src, len);
+    item->found = 1;
+    item->value_off = *used;
+    item->value_len = len;
+    *used += len;
+    return 0;
+}
+
+static int kv_batch_read_snapshot(key_value_store_t *store, kv_batch_item_t *items, const size_t *order, size_t from, size_t to,
+                                  char **values, size_t *values_cap, size_t *used) {
+    // Busca en la instantánea las claves del grupo que no están en memoria (found == -1)
+    const kv_snapshot_t *snap = __atomic_load_n(&store->snapshot, __ATOMIC_ACQUIRE);
+    for (size_t i = from; i < to; ++i) {
+        kv_batch_item_t *item = &items[order[i]];
+        if (item->found != -1) continue;
+        item->found = 0;
+        const kv_snapshot_record_t *record = kv_snapshot_find(snap, item->hash, item->key, item->key_len);
+        if (record && kv_batch_copy(item, record->data + record->key_len, record->value_len, values, values_cap, used) < 0) return -1;
+    }
+    return 0;
+}
+
+int kv_store_mget(key_value_store_t *store, kv_batch_item_t *items, size_t n, char **values, size_t *values_cap) {
+    /*
+    Lee varias claves de una vez (MGET). Las claves se agrupan por partición y cada partición
+    se lee una sola vez: un read lock por grupo en modo KV_READ_RWLOCK, o una validación
+    de 'seq' por grupo en modo KV_READ_SEQLOCK (si un escritor intervino, se repite el grupo).
+    La época se anuncia una vez para todo el lote.
+
+    - Los valores se copian seguidos en *values (que crece con realloc); cada item
+      queda con found = 1, value_off y value_len, o found = 0 si la clave no existe.
+    - Retorna 0, o -1 si no hay memoria.
+    */
+    size_t *order = kv_batch_order(store, items, n);
+    if (!order) return -1;
+    kv_reader_t *reader = store->read_mode == KV_READ_SEQLOCK ? kv_reader_enter(store) : NULL;
+    size_t used = 0;
+    int ret = 0;
+
+    for (size_t from = 0, to; from < n && ret == 0; from = to) {
+        to = kv_batch_group(store, items, order, from, n);
+        kv_shard_t *shard = kv_shard(store, items[order[from]].hash);
+        if (!reader) {
+            pthread_rwlock_rdlock(&shard->rwlock);
+            for (size_t i = from; i < to && ret == 0; ++i) {
+                kv_batch_item_t *item = &items[order[i]];
+                kv_node_t **link = kv_find_link(shard, item->hash, item->key, item->key_len);
+                item->found = link ? 0 : -1;
+                if (link && !(*link)->deleted && !kv_expired(*link)) {
+                    ret = kv_batch_copy(item, (*link)->data + item->key_len, (*link)->value_len, values, values_cap, &used);
+                }
+            }
+            if (ret == 0) ret = kv_batch_read_snapshot(store, items, order, from, to, values, values_cap, &used);
+            pthread_rwlock_unlock(&shard->rwlock);
+            continue;
+        }
+        size_t base = used;
+        for (;;) {
+            unsigned s1 = atomic_load_explicit(&shard->seq, memory_order_acquire);
+            if (s1 & 1) {
+                cpu_relax();
+                continue;
+            }
+            used = base; // lo copiado en un intento fallido se sobrescribe
+            for (size_t i = from; i < to && ret == 0; ++i) {
+                kv_batch_item_t *item = &items[order[i]];
+                kv_node_t *node = kv_find_lockfree(shard, item->hash, item->key, item->key_len);
+                item->found = node ? 0 : -1;
+                if (node && !node->deleted && !kv_expired(node)) {
+                    ret = kv_batch_copy(item, node->data + item->key_len, kv_value_len(node), values, values_cap, &used);
+                }
+            }
+            atomic_thread_fence(memory_order_acquire);
+            if (ret < 0 || atomic_load_explicit(&shard->seq, memory_order_relaxed) == s1) break;
+        }
+        if (ret == 0) ret = kv_batch_read_snapshot(store, items, order, from, to, values, values_cap, &used);
+    }
+    if (reader) atomic_store_explicit(&reader->epoch, 0, memory_order_release);
+    free(order);
+    return ret;
+}
+
+static int kv_update_batch(key_value_store_t *store, int op, kv_batch_item_t *items, size_t n, unsigned long long *lsn) {
+    /* Aplica un lote de escrituras tomando el write lock de cada partición una sola vez. */
+    size_t *order = kv_batch_order(store, items, n);
+    if (!order) return -1;
+    for (size_t from = 0, to; from < n; from = to) {
+        to = kv_batch_group(store, items, order, from, n);
+        kv_shard_t *shard = kv_shard(store, items[order[from]].hash);
+        kv_write_begin(shard);
+        kv_rehash_step(store, shard);
+        for (size_t i = from; i < to; ++i) {
+            kv_batch_item_t *item = &items[order[i]];
+            item->found = kv_apply(store, shard, op, item->hash, item->key, item->key_len,
+                                   item->value, item->value_len, lsn) == 0;
+        }
+        kv_write_end(store, shard);
+    }
+    free(order);
+    return 0;
+}
+
+int kv_store_mput_lsn(key_value_store_t *store, kv_batch_item_t *items, size_t n, unsigned long long *lsn) {
+    /*
+    Inserta o actualiza varios pares (MPUT) con un write lock por partición. Cada item
+    queda con found = 1 si se escribió. Como kv_store_put_lsn, no espera al disco:
+    *lsn cubre todo el lote. Retorna -1 si no hay memoria para agrupar el lote.
+    */
+    return kv_update_batch(store, KV_OP_PUT, items, n, lsn);
+}
+
+int kv_store_mdelete_lsn(key_value_store_t *store, kv_batch_item_t *items, size_t n, unsigned long long *lsn) {
+    /* Como kv_store_mput_lsn, para borrados (MDEL): found = 1 si la clave existía. */
+    return kv_update_batch(store, KV_OP_DELETE, items, n, lsn);
+}
+
+static int kv_wal_replay(key_value_store_t *store, const char *path, int truncate_tail) {
+    /*
+    Reaplica un log sobre el almacén. Se detiene en el primer registro incompleto
+    o con checksum incorrecto (una escritura cortada por una caída) y, si se pide,
+    trunca el fichero ahí para que los registros nuevos no queden detrás de basura.
+    Retorna el número de registros aplicados, o -1 si el fichero existe pero no se puede leer.
+    */
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT ? 0 : -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = st.st_size, pos = 0;
+    int applied = 0;
+    const char *map = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    if (map == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+    while (pos + KV_WAL_HEADER <= size) {
+        uint32_t sum, key_len, value_len;
+        memcpy(&sum, map + pos, 4);
+        memcpy(&key_len, map + pos + 5, 4);
+        memcpy(&value_len, map + pos + 9, 4);
+        int op = map[pos + 4];
+        size_t len = KV_WAL_HEADER + (size_t)key_len + value_len;
+        if ((op != KV_OP_PUT && op != KV_OP_DELETE && op != KV_OP_EXPIRE) || len > size - pos ||
+            kv_checksum(map + pos + 4, len - 4) != sum) break;
+        const char *key = map + pos + KV_WAL_HEADER;
+        kv_update(store, op, key, key_len, key + key_len, value_len, NULL);
+        pos += len;
+        applied++;
+    }
+    if (map) munmap((void *)map, size);
+    if (pos < size && truncate_tail) {
+        fprintf(stderr, "Log %s: %zu bytes finales incompletos descartados\n", path, size - pos);
+        if (ftruncate(fd, pos) == 0) fsync(fd);
+    }
+    close(fd);
+    return applied;
+}
+
+static void kv_synchronize(key_value_store_t *store) {
+    /* Espera a que ningún lector sin lock pueda seguir usando lo que se desenlazó antes de llamar. */
+    if (store->read_mode == KV_READ_RWLOCK) return;
+    unsigned long target = atomic_load(&store->epoch) + 2;
+    while (kv_try_advance(store) < target) sched_yield();
+}
+
+typedef struct {
+    char *buf;                // registros pendientes de escribir en la instantánea
+    size_t len, cap;
+    uint64_t *hashes;         // hash y desplazamiento de cada registro, para la tabla final
+    uint64_t *offsets;
+    size_t count, count_cap;
+    uint64_t *ttl;            // desplazamientos de los registros con caducidad
+    size_t ttl_count, ttl_cap;
+    uint64_t offset;          // desplazamiento en el fichero del primer byte de 'buf'
+} kv_snapshot_writer_t;
+
+static int kv_snapshot_add(kv_snapshot_writer_t *w, uint64_t hash, const char *key, size_t key_len,
+                           const char *value, size_t value_len, uint64_t expires) {
+    size_t len = (sizeof(kv_snapshot_record_t) + key_len + value_len + 7) & ~(size_t)7;
+    if (w->len + len > w->cap) {
+        size_t cap = w->cap ? w->cap : 64 * 1024;
+        while (cap < w->len + len) cap *= 2;
+        char *buf = realloc(w->buf, cap);
+        if (!buf) return -1;
+        w->buf = buf;
+        w->cap = cap;
+    }
+    if (w->count == w->count_cap) {
+        size_t cap = w->count_cap ? w->count_cap * 2 : 1024;
+        uint64_t *hashes = realloc(w->hashes, cap * sizeof(uint64_t));
+        if (hashes) w->hashes = hashes;
+        uint64_t *offsets = realloc(w->offsets, cap * sizeof(uint64_t));
+        if (offsets) w->offsets = offsets;
+        if (!hashes || !offsets) return -1;
+        w->count_cap = cap;
+    }
+    if (expires && w->ttl_count == w->ttl_cap) {
+        size_t cap = w->ttl_cap ? w->ttl_cap * 2 : 256;
+        uint64_t *ttl = realloc(w->ttl, cap * sizeof(uint64_t));
+        if (!ttl) return -1;
+        w->ttl = ttl;
+        w->ttl_cap = cap;
+    }
+    kv_snapshot_record_t *record = (kv_snapshot_record_t *)(w->buf + w->len);
+    memset(record, 0, len);
+    record->hash = hash;
+    record->key_len = key_len;
+    record->value_len = value_len;
+    record->expires = expires;
+    memcpy(record->data, key, key_len);
+    memcpy(record->data + key_len, value, value_len);
+    w->hashes[w->count] = hash;
+    w->offsets[w->count] = w->offset + w->len;
+    if (expires) w->ttl[w->ttl_count++] = w->offset + w->len;
+    w->count++;
+    w->len += len;
+    return 0;
+}
+
+static int kv_snapshot_drain(kv_snapshot_writer_t *w, int fd) {
+    // Escribe los registros acumulados fuera de cualquier lock del almacén
+    if (kv_write_all(fd, w->buf, w->len) < 0) return -1;
+    w->offset += w->len;
+    w->len = 0;
+    return 0;
+}
+
+static int kv_snapshot_write(key_value_store_t *store, const char *path) {
+    /*
+    Escribe una instantánea con todas las claves vivas: las de memoria (copiadas partición
+    a partición con el read lock, sin bloquear a las demás) y las de la instantánea anterior
+    que no están en memoria. Después añade la tabla hash, la lista de registros con
+    caducidad (en hora de reloj de pared) y, al final, la cabecera: un fichero a medio
+    escribir nunca tiene la cabecera válida.
+    */
+    int64_t wall_offset = kv_wall_offset_ms();
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+    kv_snapshot_writer_t w = {0};
+    kv_snapshot_header_t header = {0};
+    w.offset = sizeof(header);
+    int ret = kv_write_all(fd, (const char *)&header, sizeof(header));
+
+    for (int i = 0; i < KV_SHARDS && ret == 0; ++i) {
+        kv_shard_t *shard = &store->shards[i];
+        pthread_rwlock_rdlock(&shard->rwlock);
+        for (int t = 0; t < 2 && shard->table[t] && ret == 0; ++t) {
+            kv_table_t *table = shard->table[t];
+            for (size_t b = 0; b <= table->mask && ret == 0; ++b) {
+                for (kv_node_t *node = table->buckets[b]; node && ret == 0; node = node->next) {
+                    if (node->deleted) continue;
+                    uint64_t expires = node->timer.expires ? (uint64_t)((int64_t)node->timer.expires + wall_offset) : 0;
+                    ret = kv_snapshot_add(&w, node->hash, node->data, node->key_len,
+                                          node->data + node->key_len, node->value_len, expires);
+                }
+            }
+        }
+        pthread_rwlock_unlock(&shard->rwlock);
+        if (ret == 0) ret = kv_snapshot_drain(&w, fd);
+    }
+
+    const kv_snapshot_t *old = store->snapshot; // solo el compactador la cambia
+    if (old) {
+        uint64_t pos = sizeof(kv_snapshot_header_t), end = old->header->table_offset;
+        while (pos < end && ret == 0) {
+            const kv_snapshot_record_t *record = (const kv_snapshot_record_t *)(old->map + pos);
+            pos += (sizeof(kv_snapshot_record_t) + record->key_len + record->value_len + 7) & ~(uint64_t)7;
+            kv_shard_t *shard = kv_shard(store, record->hash);
+            pthread_rwlock_rdlock(&shard->rwlock);
+            int in_memory = kv_find_link(shard, record->hash, record->data, record->key_len) != NULL;
+            pthread_rwlock_unlock(&shard->rwlock);
+            if (!in_memory) {
+                ret = kv_snapshot_add(&w, record->hash, record->data, record->key_len,
+                                      record->data + record->key_len, record->value_len, record->expires);
+            }
+            if (ret == 0 && w.len >= 1024 * 1024) ret = kv_snapshot_drain(&w, fd);
+        }
+        if (ret == 0) ret = kv_snapshot_drain(&w, fd);
+    }
+
+    uint64_t buckets = 8;
+    while (buckets < w.count * 2) buckets *= 2;
+    uint64_t *table = ret == 0 ? calloc(buckets, sizeof(uint64_t)) : NULL;
+    if (table) {
+        for (size_t i = 0; i < w.count; ++i) {
+            uint64_t b = w.hashes[i] & (buckets - 1);
+            while (table[b]) b = (b + 1) & (buckets - 1);
+            table[b] = w.offsets[i];
+        }
+        memcpy(header.magic, KV_SNAPSHOT_MAGIC, 8);
+        header.count = w.count;
+        header.buckets = buckets;
+        header.table_offset = w.offset;
+        header.ttl_count = w.ttl_count;
+        header.ttl_offset = w.offset + buckets * sizeof(uint64_t);
+        header.file_size = header.ttl_offset + w.ttl_count * sizeof(uint64_t);
+        ret = kv_write_all(fd, (const char *)table, buckets * sizeof(uint64_t));
+        if (ret == 0) ret = kv_write_all(fd, (const char *)w.ttl, w.ttl_count * sizeof(uint64_t));
+        if (ret == 0 && pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header)) ret = -1;
+        if (ret == 0) ret = fsync(fd);
+    } else {
+        ret = -1;
+    }
+    free(table);
+    free(w.buf);
+    free(w.hashes);
+    free(w.offsets);
+    free(w.ttl);
+    close(fd);
+    if (ret < 0) unlink(path);
+    return ret;
+}
+
+static void kv_purge(key_value_store_t *store) {
+    /*
+    Tras instalar una instantánea, quita de memoria lo que ya no hace falta:
+    las marcas de borrado de claves que no están en ella y los nodos cuyo valor
+    es idéntico al de disco (las lecturas caen a la instantánea). Así la memoria
+    solo guarda lo escrito desde la última compactación. Los nodos con caducidad
+    se quedan: su temporizador está en la rueda.
+    */
+    const kv_snapshot_t *snap = store->snapshot;
+    for (int i = 0; i < KV_SHARDS; ++i) {
+        kv_shard_t *shard = &store->shards[i];
+        kv_write_begin(shard);
+        for (int t = 0; t < 2 && shard->table[t]; ++t) {
+            kv_table_t *table = shard->table[t];
+            for (size_t b = 0; b <= table->mask; ++b) {
+                kv_node_t **link = &table->buckets[b];
+                while (*link) {
+                    kv_node_t *node = *link;
+                    const kv_snapshot_record_t *record = kv_snapshot_find(snap, node->hash, node->data, node->key_len);
+                    int redundant = node->deleted ? !record :
+                                    record && !record->expires && !node->timer.expires &&
+                                    record->value_len == node->value_len &&
+                                    memcmp(record->data + node->key_len, node->data + node->key_len, node->value_len) == 0;
+                    if (redundant) {
+                        __atomic_store_n(link, node->next, __ATOMIC_RELEASE);
+                        shard->count--;
+                        kv_retire(store, shard, &node->retired, node, kv_node_size(node), &node->pins);
+                    } else {
+                        link = &node->next;
+                    }
+                }
+            }
+        }
+        kv_write_end(store, shard);
+    }
+}
+
+static int kv_install_snapshot(key_value_store_t *store) {
+    /*
+    Escribe una instantánea nueva y la pone en servicio. Todo lo que está en KV_WAL_OLD
+    ya está en memoria, así que queda dentro de ella y ese log se puede borrar.
+
+    - Se escribe en KV_SNAPSHOT_TMP y se renombra: una caída deja la instantánea anterior intacta.
+    - El puntero se cambia de forma atómica. Antes de desproyectar la anterior se toma
+      el write lock de cada partición (lectores con lock) y se espera a que avance
+      la época (lectores sin lock).
+    */
+    char path[PATH_MAX], tmp_path[PATH_MAX], old_wal[PATH_MAX];
+    kv_path(path, sizeof(path), store, KV_SNAPSHOT_FILE);
+    kv_path(tmp_path, sizeof(tmp_path), store, KV_SNAPSHOT_TMP);
+    kv_path(old_wal, sizeof(old_wal), store, KV_WAL_OLD);
+
+    atomic_store(&store->compacting, 1);
+    int ret = kv_snapshot_write(store, tmp_path);
+    kv_snapshot_t *snap = NULL;
+    if (ret == 0 && rename(tmp_path, path) == 0) {
+        kv_sync_dir(store);
+        snap = kv_snapshot_open(path);
+    }
+    if (!snap) {
+        atomic_store(&store->compacting, 0);
+        return -1;
+    }
+    kv_snapshot_t *old = store->snapshot;
+    __atomic_store_n(&store->snapshot, snap, __ATOMIC_RELEASE);
+    for (int i = 0; i < KV_SHARDS; ++i) {
+        pthread_rwlock_wrlock(&store->shards[i].rwlock);
+        pthread_rwlock_unlock(&store->shards[i].rwlock);
+    }
+    kv_synchronize(store);
+    if (old && atomic_fetch_or(&old->pins, KV_PIN_DEAD) == 0) kv_snapshot_close(old); // si no, la cierra el último unpin
+    unlink(old_wal);
+    kv_sync_dir(store);
+    atomic_store(&store->compacting, 0);
+    kv_purge(store);
+    return 0;
+}
+
+static void *kv_compactor(void *arg) {
+    /*
+    Hilo de compactación: cuando el log pasa de KV_COMPACT_BYTES, lo rota y vuelca el almacén
+    en una instantánea nueva. Los clientes siguen leyendo y escribiendo mientras tanto;
+    solo cada partición se bloquea para escritura lo que tarda en copiarse.
+    */
+    key_value_store_t *store = arg;
+    pthread_mutex_lock(&store->compact_mutex);
+    while (!store->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += KV_COMPACT_CHECK_MS / 1000;
+        deadline.tv_nsec += (KV_COMPACT_CHECK_MS % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&store->compact_cond, &store->compact_mutex, &deadline);
+        if (store->stop) break;
+
+        pthread_mutex_lock(&store->wal.mutex);
+        size_t size = store->wal.file_size;
+        pthread_mutex_unlock(&store->wal.mutex);
+        if (size < KV_COMPACT_BYTES) continue;
+
+        pthread_mutex_unlock(&store->compact_mutex);
+        atomic_store(&store->compacting, 1);
+        if (kv_wal_rotate(store) < 0 || kv_install_snapshot(store) < 0) {
+            atomic_store(&store->compacting, 0);
+            fprintf(stderr, "Compactación fallida; se reintentará\n");
+        }
+        pthread_mutex_lock(&store->compact_mutex);
+    }
+    pthread_mutex_unlock(&store->compact_mutex);
+    return NULL;
+}
+
+key_value_store_t *kv_store_open(const char *dir, int capacity, kv_read_mode_t read_mode) {
+    /*
+    Crea un almacén persistente en 'dir'.
+
+    - Proyecta la instantánea KV_SNAPSHOT_FILE (si existe) sin cargarla; solo las claves
+      con caducidad pasan a memoria, con su temporizador.
+    - Reaplica KV_WAL_OLD (queda de una compactación interrumpida) y KV_WAL_FILE,
+      descartando la cola cortada por una caída.
+    - Si había un KV_WAL_OLD, escribe ya una instantánea para poder borrarlo
+      antes de que la próxima rotación lo necesite.
+    - Abre el log para añadir y arranca el hilo de compactación.
+    */
+    key_value_store_t *store = kv_store_create(capacity, read_mode);
+    if (!store) return NULL;
+    store->dir = strdup(dir);
+    char path[PATH_MAX], old_wal[PATH_MAX];
+    kv_path(path, sizeof(path), store, KV_SNAPSHOT_FILE);
+    store->snapshot = kv_snapshot_open(path);
+    if (store->snapshot) {
+        const kv_snapshot_header_t *header = store->snapshot->header;
+        const uint64_t *ttl = (const uint64_t *)(store->snapshot->map + header->ttl_offset);
+        for (uint64_t i = 0; i < header->ttl_count; ++i) {
+            const kv_snapshot_record_t *record = (const kv_snapshot_record_t *)(store->snapshot->map + ttl[i]);
+            uint64_t expires = htole64(record->expires);
+            kv_update(store, KV_OP_EXPIRE, record->data, record->key_len, (const char *)&expires, sizeof(expires), NULL);
+        }
+    }
+    kv_path(old_wal, sizeof(old_wal), store, KV_WAL_OLD);
+    kv_path(path, sizeof(path), store, KV_WAL_FILE);
+
+    int old_records = kv_wal_replay(store, old_wal, 0);
+    int records = kv_wal_replay(store, path, 1);
+    if (old_records < 0 || records < 0) {
+        perror("kv wal replay failed");
+        kv_store_destroy(store);
+        return NULL;
+    }
+    if (access(old_wal, F_OK) == 0 && kv_install_snapshot(store) < 0) {
+        perror("kv snapshot failed");
+        kv_store_destroy(store);
+        return NULL;
+    }
+
+    store->wal.fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat st;
+    if (store->wal.fd < 0 || fstat(store->wal.fd, &st) < 0) {
+        perror("kv wal open failed");
+        kv_store_destroy(store);
+        return NULL;
+    }
+    store->wal.file_size = st.st_size;
+    kv_sync_dir(store);
+    printf("Almacén en %s: instantánea con %llu claves, %d registros del log reaplicados\n", dir,
+           store->snapshot ? (unsigned long long)store->snapshot->header->count : 0ULL, old_records + records);
+
+    if (pthread_create(&store->compactor, NULL, kv_compactor, store) == 0) store->compactor_running = 1;
+    return store;
+}
+
+void kv_store_destroy(key_value_store_t *store) {
+    /* Para el compactador y el hilo de caducidad, vacía el log pendiente y libera el almacén. */
+    if (store->expirer_running) {
+        pthread_mutex_lock(&store->expiry_mutex);
+        store->expirer_stop = 1;
+        pthread_cond_signal(&store->expiry_cond);
+        pthread_mutex_unlock(&store->expiry_mutex);
+        pthread_join(store->expirer, NULL);
+    }
+    if (store->compactor_running) {
+        pthread_mutex_lock(&store->compact_mutex);
+        store->stop = 1;
+        pthread_cond_signal(&store->compact_cond);
+        pthread_mutex_unlock(&store->compact_mutex);
+        pthread_join(store->compactor, NULL);
+    }
+    if (store->wal.fd >= 0) {
+        kv_store_sync(store, store->wal.appended);
+        close(store->wal.fd);
+    }
+    free(store->wal.buf);
+    free(store->wal.spare);
+    kv_snapshot_close(store->snapshot);
+    pthread_mutex_destroy(&store->wal.mutex);
+    pthread_cond_destroy(&store->wal.synced);
+    pthread_mutex_destroy(&store->compact_mutex);
+    pthread_cond_destroy(&store->compact_cond);
+    pthread_mutex_destroy(&store->expiry_mutex);
+    pthread_cond_destroy(&store->expiry_cond);
+    free(store->dir);
+    for (int i = 0; i < KV_SHARDS; ++i) {
+        kv_shard_t *shard = &store->shards[i];
+        for (int t = 0; t < 2; ++t) {
+            kv_table_t *table = shard->table[t];
+            if (!table) continue;
+            for (size_t b = 0; b <= table->mask; ++b) {
+                kv_node_t *node = table->buckets[b];
+                while (node) {
+                    kv_node_t *next = node->next;
+                    slab_free(node, kv_node_size(node));
+                    node = next;
+                }
+            }
+            free(table);
+        }
+        while (shard->retired) {
+            kv_retired_t *retired = shard->retired;
+            shard->retired = retired->next;
+            kv_release(retired->mem, retired->size);
+        }
+        pthread_rwlock_destroy(&shard->rwlock);
+    }
+    free(store);
+}
+
+static char *output_reserve(output_queue_t *q, size_t len) {
+    /* Retorna hueco para len bytes al final de la cola, añadiendo un fragmento si no cabe. */
+    output_chunk_t *tail = q->tail;
+    if (!tail || tail->ref || tail->cap - tail->len < len) {
+        // Los fragmentos llenan su clase del asignador: BUFFER_SIZE bytes con la cabecera
+        size_t size = sizeof(output_chunk_t) + len > BUFFER_SIZE ? sizeof(output_chunk_t) + len : BUFFER_SIZE;
+        size = slab_usable_size(size);
+        size_t cap = size - sizeof(output_chunk_t);
+        output_chunk_t *c = slab_alloc(size);
+        if (!c) return NULL;
+        c->next = NULL;
+        c->off = 0;
+        c->len = 0;
+        c->cap = cap;
+        c->ref = NULL;
+        c->release = NULL;
+        if (tail) tail->next = c;
+        else q->head = c;
+        q->tail = tail = c;
+    }
+    return tail->data + tail->len;
+}
+
+static int output_append(output_queue_t *q, const char *data, size_t len) {
+    /* Copia len bytes al final de la cola. Retorna -1 si falla la reserva. */
+    char *dst = output_reserve(q, len);
+    if (!dst) return -1;
+    memcpy(dst, data, len);
+    q->tail->len += len;
+    q->len += len;
+    return 0;
+}
+
+static int output_append_ref(output_queue_t *q, const char *data, size_t len, void (*release)(void *), void *arg) {
+    /*
+    Encola len bytes de memoria ajena sin copiarlos. release(arg) se llama cuando se han
+    enviado o al descartar la cola; hasta entonces data debe seguir siendo válida.
+    Retorna -1 (sin llamar a release) si falla la reserva.
+    */
+    output_chunk_t *c = slab_alloc(sizeof(output_chunk_t));
+    if (!c) return -1;
+    c->next = NULL;
+    c->off = 0;
+    c->len = len;
+    c->cap = 0;
+    c->ref = data;
+    c->release = release;
+    c->release_arg = arg;
+    if (q->tail) q->tail->next = c;
+    else q->head = c;
+    q->tail = c;
+    q->len += len;
+    return 0;
+}
+
+static void output_free_chunk(output_chunk_t *c) {
+    if (c->release) c->release(c->release_arg);
+    slab_free(c, sizeof(output_chunk_t) + c->cap);
+}
+
+static int output_iov(const output_queue_t *q, struct iovec *iov, int max) {
+    /* Describe hasta max fragmentos pendientes de la cola para sendmsg. Retorna cuántos. */
+    int n = 0;
+    for (output_chunk_t *c = q->head; c && n < max; c = c->next) {
+        iov[n].iov_base = (char *)(c->ref ? c->ref : c->data) + c->off;
+        iov[n].iov_len = c->len - c->off;
+        ++n;
+    }
+    return n;
+}
+
+static void output_consume(output_queue_t *q, size_t n) {
+    /* Descarta n bytes enviados del principio de la cola y libera los fragmentos agotados. */
+    q->len -= n;
+    while (n > 0) {
+        output_chunk_t *c = q->head;
+        size_t k = c->len - c->off;
+        if (k > n) {
+            c->off += n;
+            return;
+        }
+        n -= k;
+        q->head = c->next;
+        if (!q->head) q->tail = NULL;
+        output_free_chunk(c);
+    }
+}
+
+static void output_reset(output_queue_t *q) {
+    while (q->head) {
+        output_chunk_t *c = q->head;
+        q->head = c->next;
+        output_free_chunk(c);
+    }
+    q->tail = NULL;
+    q->len = 0;
+}
+
+static void close_connection(client_context_t *ctx) {
+    // close() también lo quita del epoll: el fd no está duplicado
+    printf("Cliente fd %d desconectado\n", ctx->client_fd);
+    close(ctx->client_fd);
+    output_reset(&ctx->out);
+    free(ctx->in);
+    slab_free(ctx, sizeof(client_context_t));
+}
+
+static int rearm_connection(client_context_t *ctx) {
+    /*
+    Vuelve a armar la conexión en el epoll (EPOLLONESHOT): esperando datos si no hay salida pendiente,
+    o esperando hueco en el socket si la hay. Con EPOLL_CTL_MOD el kernel revisa el estado actual,
+    así que no se pierde un evento que llegó mientras el trabajador procesaba.
+    En modo reuseport la conexión está registrada para siempre con EPOLLIN | EPOLLOUT
+    y no hace falta rearmarla.
+    */
+    if (!ctx->reactor->pool) return 0;
+    struct epoll_event ev;
+    ev.events = (ctx->out.len > 0 ? EPOLLOUT : EPOLLIN) | EPOLLRDHUP | EPOLLET | EPOLLONESHOT;
+    ev.data.ptr = ctx;
+    return epoll_ctl(ctx->reactor->epoll_fd, EPOLL_CTL_MOD, ctx->client_fd, &ev);
+}
+
+static int flush_output(client_context_t *ctx) {
+    /*
+    Envía la salida pendiente hasta vaciarla o hasta EAGAIN. Retorna -1 si la conexión falló.
+    sendmsg es el writev de los sockets (admite MSG_NOSIGNAL): varios fragmentos
+    salen en una sola llamada, y un envío parcial deja la cola lista para retomarlo.
+    */
+    struct iovec iov[OUTPUT_IOVECS];
+    while (ctx->out.len > 0) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = output_iov(&ctx->out, iov, OUTPUT_IOVECS);
+        ssize_t n = sendmsg(ctx->client_fd, &msg, MSG_NOSIGNAL);
+        if (n > 0) {
+            output_consume(&ctx->out, n);
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int next_frame(const char *buf, size_t len, size_t *start, size_t *frame_len, size_t *consumed) {
+    /*
+    Busca un mensaje completo al principio de buf. Hay dos formatos:
+    - Línea terminada en '\n' (el '\r' previo, si lo hay, no forma parte del mensaje).
+    - Mensaje con prefijo de longitud: "$<n>\n" seguido de n bytes cualesquiera y un '\n' final.
+    Retorna 1 y la posición del mensaje si está completo, 0 si faltan bytes
+    y -1 si el prefijo no es válido o el mensaje supera MAX_FRAME_SIZE.
+    */
+    if (len > 0 && buf[0] == '$') {
+        const char *nl = memchr(buf, '\n', len < FRAME_HEADER_MAX ? len : FRAME_HEADER_MAX);
+        if (!nl) return len < FRAME_HEADER_MAX ? 0 : -1;
+        size_t n = 0;
+        const char *p = buf + 1;
+        if (p == nl) return -1;
+        for (; p < nl; ++p) {
+            if (*p < '0' || *p > '9') return -1;
+            n = n * 10 + (*p - '0');
+            if (n > MAX_FRAME_SIZE) return -1;
+        }
+        size_t header = nl - buf + 1;
+        if (len < header + n + 1) return 0;
+        if (buf[header + n] != '\n') return -1;
+        *start = header;
+        *frame_len = n;
+        *consumed = header + n + 1;
+        return 1;
+    }
+    const char *nl = memchr(buf, '\n', len);
+    if (!nl) return len > MAX_FRAME_SIZE ? -1 : 0;
+    *start = 0;
+    *frame_len = nl - buf;
+    if (*frame_len > 0 && nl[-1] == '\r') --*frame_len;
+    *consumed = nl - buf + 1;
+    return 1;
+}
+
+static int append_reply(client_context_t *ctx, const char *prefix, const char *body, size_t len, int framed) {
+    /*
+    Encola la respuesta prefix + body con el formato del comando: una línea, o "$<n>\n<respuesta>\n"
+    si el comando llegó con prefijo de longitud. Retorna -1 si falla la reserva.
+    */
+    size_t prefix_len = strlen(prefix);
+    if (framed) {
+        char header[FRAME_HEADER_MAX];
+        int n = snprintf(header, sizeof(header), "$%zu\n", prefix_len + len);
+        if (output_append(&ctx->out, header, n) < 0) return -1;
+    }
+    if (output_append(&ctx->out, prefix, prefix_len) < 0) return -1;
+    if (output_append(&ctx->out, body, len) < 0) return -1;
+    return output_append(&ctx->out, "\n", 1);
+}
+
+static int process_batch(client_context_t *ctx, const char *cmd, char *first, char *save, int framed) {
+    /*
+    MGET k1 k2 ... / MPUT k1 v1 k2 v2 ... / MDEL k1 k2 ...: cada clave recibe la misma respuesta,
+    y en el mismo orden, que con el GET, PUT o DELETE equivalente, pero el almacén toma
+    el lock de cada partición una sola vez por comando en lugar de una vez por clave.
+    Los valores de MPUT se separan por espacios, así que no pueden contenerlos.
+    Retorna -1 si no se pudo encolar una respuesta.
+    */
+    int mput = strcmp(cmd, "MPUT") == 0, mget = strcmp(cmd, "MGET") == 0;
+    size_t max = 2; // 'first' y una clave más por cada espacio del resto
+    for (const char *p = save; p && *p; ++p) max += *p == ' ';
+    kv_batch_item_t *items = malloc(max * sizeof(kv_batch_item_t));
+    if (!items) return append_reply(ctx, "", "ERROR", 5, framed);
+
+    size_t n = 0;
+    for (char *token = first; token; token = save ? strtok_r(NULL, " ", &save) : NULL) {
+        kv_batch_item_t *item = &items[n++];
+        item->key = token;
+        item->key_len = strlen(token);
+        item->value = NULL;
+        item->value_len = 0;
+        if (mput) {
+            char *value = save ? strtok_r(NULL, " ", &save) : NULL;
+            if (!value) { // clave sin valor: comando mal formado, un solo ERROR como un PUT sin valor
+                free(items);
+                return append_reply(ctx, "", "ERROR", 5, framed);
+            }
+            item->value = value;
+            item->value_len = strlen(value);
+        }
+    }
+
+    char *values = NULL;
+    size_t values_cap = 0;
+    int ret = mget ? kv_store_mget(ctx->store, items, n, &values, &values_cap)
+            : mput ? kv_store_mput_lsn(ctx->store, items, n, &ctx->wal_lsn)
+                   : kv_store_mdelete_lsn(ctx->store, items, n, &ctx->wal_lsn);
+    int sent = 0;
+    for (size_t i = 0; i < n && sent == 0; ++i) {
+        const char *reply = ret < 0 ? "ERROR" : items[i].found ? "OK" : mput ? "ERROR" : "NOT_FOUND";
+        if (mget && ret == 0 && items[i].found) {
+            sent = append_reply(ctx, "VALUE ", values + items[i].value_off, items[i].value_len, framed);
+        } else {
+            sent = append_reply(ctx, "", reply, strlen(reply), framed);
+        }
+    }
+    free(values);
+    free(items);
+    return sent;
+}
+
+// Claves caducadas desde el arranque, para STATS
+static atomic_ullong expired_keys;
+
+static void count_expired(void *arg, const char *key, size_t key_len, const char *value, size_t value_len) {
+    (void)key;
+    (void)key_len;
+    (void)value;
+    (void)value_len;
+    atomic_fetch_add_explicit((atomic_ullong *)arg, 1, memory_order_relaxed);
+}
+
+static int process_command(client_context_t *ctx, char *line, int framed) {
+    /*
+    Ejecuta un comando (terminado en '\0') y encola la respuesta.
+    GET <key> -> VALUE <value> | NOT_FOUND; PUT <key> <value> -> OK | ERROR;
+    DELETE <key> -> OK | NOT_FOUND; MGET, MPUT y MDEL -> una respuesta por clave (ver process_batch);
+    EXPIRE <key> <segundos> -> OK | NOT_FOUND | ERROR (admite decimales; un PUT quita la caducidad);
+    TTL <key> -> TTL <ms restantes> | TTL -1 (no caduca) | NOT_FOUND;
+    STATS -> STATS expired=<n> <clase> ...; cualquier otra cosa -> ERROR.
+    El valor de PUT es el resto del comando, así que puede contener espacios
+    y, si el comando llegó con prefijo de longitud, saltos de línea.
+    La respuesta se acumula en la salida; quien procesa la tanda de comandos la envía.
+    Retorna -1 si no se pudo encolar la respuesta.
+    */
+    char buffer[BUFFER_SIZE];
+    char *save = NULL;
+    char *cmd = strtok_r(line, " ", &save);
+    char *key = cmd ? strtok_r(NULL, " ", &save) : NULL;
+    const char *reply = "ERROR";
+
+    if (cmd && !key && strcmp(cmd, "STATS") == 0) {
+        // Por cada clase en uso del asignador: slabs, objetos vivos, bytes pedidos y fragmentación
+        // (parte de los slabs que no ocupan los bytes pedidos: cabeceras, redondeo y huecos libres)
+        slab_stats_t stats[SLAB_CLASSES];
+        size_t len = snprintf(buffer, sizeof(buffer), " expired=%llu", (unsigned long long)atomic_load(&expired_keys));
+        slab_stats(stats);
+        for (int i = 0; i < SLAB_CLASSES; ++i) {
+            if (stats[i].slabs == 0) continue;
+            double total = (double)stats[i].slabs * SLAB_SIZE;
+            len += snprintf(buffer + len, sizeof(buffer) - len, " %zuB:slabs=%zu,objects=%zu,bytes=%zu,frag=%.1f%%",
+                            stats[i].object_size, stats[i].slabs, stats[i].objects, stats[i].bytes,
+                            100.0 * (1.0 - stats[i].bytes / total));
+            if (len >= sizeof(buffer)) len = sizeof(buffer) - 1;
+        }
+        return append_reply(ctx, "STATS", buffer, len, framed);
+    } else if (cmd && key && strcmp(cmd, "GET") == 0) {
+        // Los valores son de longitud variable: si no cabe en la pila, se reintenta con uno a su medida
+        char *value = buffer;
+        size_t size = sizeof(buffer);
+        int len;
+        while ((len = kv_store_get(ctx->store, key, value, size)) >= 0 && (size_t)len >= size) {
+            size = (size_t)len + 1;
+            char *bigger = realloc(value == buffer ? NULL : value, size);
+            if (!bigger) {
+                len = -2;
+                break;
+            }
+            value = bigger;
+        }
+        int ret = len >= 0 ? append_reply(ctx, "VALUE ", value, len, framed)
+                           : append_reply(ctx, "", len == -1 ? "NOT_FOUND" : "ERROR", len == -1 ? 9 : 5, framed);
+        if (value != buffer) free(value);
+        return ret;
+    } else if (cmd && key && strcmp(cmd, "PUT") == 0) {
+        char *val = save;
+        while (val && *val == ' ') val++;
+        if (val && *val) reply = kv_store_put_lsn(ctx->store, key, val, &ctx->wal_lsn) == 0 ? "OK" : "ERROR";
+    } else if (cmd && key && strcmp(cmd, "DELETE") == 0) {
+        reply = kv_store_delete_lsn(ctx->store, key, &ctx->wal_lsn) == 0 ? "OK" : "NOT_FOUND";
+    } else if (cmd && key && strcmp(cmd, "EXPIRE") == 0) {
+        char *arg = strtok_r(NULL, " ", &save), *end = NULL;
+        double seconds = arg ? strtod(arg, &end) : 0;
+        if (arg && *end == '\0' && seconds > 0 && seconds < 1e9) {
+            uint64_t ttl_ms = (uint64_t)(seconds * 1000 + 0.5);
+            reply = kv_store_expire_lsn(ctx->store, key, strlen(key), ttl_ms ? ttl_ms : 1, &ctx->wal_lsn) == 0 ? "OK" : "NOT_FOUND";
+        }
+    } else if (cmd && key && strcmp(cmd, "TTL") == 0) {
+        long long ttl = kv_store_ttl(ctx->store, key, strlen(key));
+        if (ttl == -2) return append_reply(ctx, "", "NOT_FOUND", 9, framed);
+        int len = snprintf(buffer, sizeof(buffer), "%lld", ttl);
+        return append_reply(ctx, "TTL ", buffer, len, framed);
+    } else if (cmd && key && (strcmp(cmd, "MGET") == 0 || strcmp(cmd, "MPUT") == 0 || strcmp(cmd, "MDEL") == 0)) {
+        return process_batch(ctx, cmd, key, save, framed);
+    }
+    return append_reply(ctx, "", reply, strlen(reply), framed);
+}
+
+static long process_frames(client_context_t *ctx, char *buf, size_t len) {
+    /*
+    Ejecuta cada comando completo de buf. El '\n' que cierra el comando se sustituye por '\0'
+    (por eso los comandos con prefijo también llevan un '\n' final).
+    Retorna los bytes consumidos; el resto es un comando incompleto. Un comando inválido
+    se responde con ERROR y retorna -1, igual que si no se pudo encolar una respuesta:
+    sin longitud fiable no se puede saber dónde empieza el siguiente.
+    */
+    size_t used = 0;
+    while (used < len) {
+        size_t start, frame_len, consumed;
+        int r = next_frame(buf + used, len - used, &start, &frame_len, &consumed);
+        if (r == 0) break;
+        if (r < 0) {
+            append_reply(ctx, "", "ERROR", 5, 0);
+            return -1;
+        }
+        char *frame = buf + used + start;
+        frame[frame_len] = '\0';
+        if (process_command(ctx, frame, start > 0) < 0) return -1;
+        used += consumed;
+    }
+    return (long)used;
+}
+
+static int bin_reply(client_context_t *ctx, const bin_header_t *req, int status, const char *value, size_t len) {
+    /*
+    Encola la cabecera de respuesta (con el request_id de la petición, sin tocarlo) y el valor.
+    Con value == NULL solo se encola la cabecera: el valor lo añade el llamante sin copiarlo.
+    */
+    bin_header_t h = {BIN_MAGIC_RESPONSE, req->opcode, htole16(status), 0, htole32(len), req->request_id};
+    if (output_append(&ctx->out, (const char *)&h, sizeof(h)) < 0) return -1;
+    return value ? output_append(&ctx->out, value, len) : 0;
+}
+
+static int process_binary_request(client_context_t *ctx, const bin_header_t *h, const char *key, size_t key_len,
+                                  const char *value, size_t value_len) {
+    // Ejecuta una petición binaria completa. Las claves y los valores pueden contener cualquier byte
+    if (key_len == 0) return bin_reply(ctx, h, BIN_STATUS_ERROR, "", 0);
+    switch (h->opcode) {
+    case BIN_OP_GET: {
+        kv_pin_t pin;
+        const char *found;
+        size_t len;
+        if (kv_store_pin(ctx->store, key, key_len, &pin, &found, &len) < 0) {
+            return bin_reply(ctx, h, BIN_STATUS_NOT_FOUND, "", 0);
+        }
+        if (len < BIN_ZERO_COPY_MIN) { // copiar un valor pequeño cuesta menos que un fragmento más
+            int ret = bin_reply(ctx, h, BIN_STATUS_OK, found, len);
+            kv_store_unpin(pin);
+            return ret;
+        }
+        // El valor sale hacia el socket desde la memoria del almacén; el pin se suelta al enviarlo
+        if (bin_reply(ctx, h, BIN_STATUS_OK, NULL, len) < 0 ||
+            output_append_ref(&ctx->out, found, len, pin.release, pin.object) < 0) {
+            kv_store_unpin(pin);
+            return -1;
+        }
+        return 0;
+    }
+    case BIN_OP_PUT:
+        if (kv_store_update_lsn(ctx->store, KV_OP_PUT, key, key_len, value, value_len, &ctx->wal_lsn) < 0) {
+            return bin_reply(ctx, h, BIN_STATUS_ERROR, "", 0);
+        }
+        return bin_reply(ctx, h, BIN_STATUS_OK, "", 0);
+    case BIN_OP_DELETE:
+        if (kv_store_update_lsn(ctx->store, KV_OP_DELETE, key, key_len, NULL, 0, &ctx->wal_lsn) < 0) {
+            return bin_reply(ctx, h, BIN_STATUS_NOT_FOUND, "", 0);
+        }
+        return bin_reply(ctx, h, BIN_STATUS_OK, "", 0);
+    case BIN_OP_EXPIRE: {
+        uint64_t ttl_ms;
+        if (value_len != sizeof(ttl_ms)) return bin_reply(ctx, h, BIN_STATUS_ERROR, "", 0);
+        memcpy(&ttl_ms, value, sizeof(ttl_ms));
+        ttl_ms = le64toh(ttl_ms);
+        if (ttl_ms == 0 || ttl_ms > INT64_MAX / 2) return bin_reply(ctx, h, BIN_STATUS_ERROR, "", 0);
+        if (kv_store_expire_lsn(ctx->store, key, key_len, ttl_ms, &ctx->wal_lsn) < 0) {
+            return bin_reply(ctx, h, BIN_STATUS_NOT_FOUND, "", 0);
+        }
+        return bin_reply(ctx, h, BIN_STATUS_OK, "", 0);
+    }
+    case BIN_OP_TTL: {
+        long long ttl = kv_store_ttl(ctx->store, key, key_len);
+        if (ttl == -2) return bin_reply(ctx, h, BIN_STATUS_NOT_FOUND, "", 0);
+        uint64_t wire = htole64((uint64_t)ttl);
+        return bin_reply(ctx, h, BIN_STATUS_OK, (const char *)&wire, sizeof(wire));
+    }
+    default:
+        return bin_reply(ctx, h, BIN_STATUS_ERROR, "", 0);
+    }
+}
+
+static long process_binary(client_context_t *ctx, char *buf, size_t len) {
+    /*
+    Equivalente binario de process_frames: cada petición es una cabecera bin_header_t fija
+    seguida de la clave y el valor, sin nada que parsear ni formatear como texto.
+    Retorna los bytes consumidos; el resto es una petición incompleta. Una cabecera inválida
+    (magic, estado distinto de 0 o longitud mayor que MAX_FRAME_SIZE) se responde con
+    BIN_STATUS_ERROR y retorna -1: sin longitud fiable no se puede seguir.
+    */
+    size_t used = 0;
+    while (len - used >= sizeof(bin_header_t)) {
+        bin_header_t h;
+        memcpy(&h, buf + used, sizeof(h));
+        size_t key_len = le32toh(h.key_len), value_len = le32toh(h.value_len);
+        if (h.magic != BIN_MAGIC_REQUEST || h.status != 0 || key_len + value_len > MAX_FRAME_SIZE) {
+            bin_reply(ctx, &h, BIN_STATUS_ERROR, "", 0);
+            return -1;
+        }
+        if (len - used - sizeof(h) < key_len + value_len) break;
+        const char *key = buf + used + sizeof(h);
+        if (process_binary_request(ctx, &h, key, key_len, key + key_len, value_len) < 0) return -1;
+        used += sizeof(h) + key_len + value_len;
+    }
+    return (long)used;
+}
+
+static int consume_input(client_context_t *ctx, char *data, size_t len) {
+    /*
+    Procesa los bytes recibidos. Si no hay un mensaje a medias, se procesan directamente
+    desde el buffer de recepción y solo el resto incompleto se copia a ctx->in;
+    si lo hay, los bytes se añaden a ctx->in, que crece según haga falta.
+    ctx->in se libera en cuanto queda vacío. El primer byte de la conexión decide el protocolo:
+    BIN_MAGIC_REQUEST para el binario; cualquier otro, texto. Retorna -1 si la conexión debe cerrarse.
+    */
+    if (ctx->protocol == PROTOCOL_UNKNOWN) {
+        ctx->protocol = (unsigned char)data[0] == BIN_MAGIC_REQUEST ? PROTOCOL_BINARY : PROTOCOL_TEXT;
+    }
+    char *buf = data;
+    size_t buf_len = len;
+    if (ctx->in_len > 0) {
+        if (ctx->in_len + len > ctx->in_cap) {
+            size_t cap = ctx->in_cap;
+            while (cap < ctx->in_len + len) cap *= 2;
+            char *in = realloc(ctx->in, cap);
+            if (!in) return -1;
+            ctx->in = in;
+            ctx->in_cap = cap;
+        }
+        memcpy(ctx->in + ctx->in_len, data, len);
+        ctx->in_len += len;
+        buf = ctx->in;
+        buf_len = ctx->in_len;
+    }
+
+    long used = ctx->protocol == PROTOCOL_BINARY ? process_binary(ctx, buf, buf_len) : process_frames(ctx, buf, buf_len);
+    if (used < 0) return -1;
+    size_t rest = buf_len - used;
+    if (rest == 0) {
+        free(ctx->in);
+        ctx->in = NULL;
+        ctx->in_len = ctx->in_cap = 0;
+    } else if (buf == ctx->in) {
+        memmove(ctx->in, ctx->in + used, rest);
+        ctx->in_len = rest;
+    } else {
+        size_t cap = rest > BUFFER_SIZE ? rest : BUFFER_SIZE;
+        ctx->in = malloc(cap);
+        if (!ctx->in) return -1;
+        memcpy(ctx->in, buf + used, rest);
+        ctx->in_len = rest;
+        ctx->in_cap = cap;
+    }
+    return 0;
+}
+
+void handle_client(void *arg) {
+    /*
+    Maneja las peticiones de un cliente en un hilo del thread pool (o en su reactor, en modo reuseport).
+
+    - Recibe el client_context_t con el descriptor del socket del cliente y el almacén clave-valor.
+    - Envía primero la respuesta pendiente; si el socket sigue lleno, no lee más comandos.
+    - Lee comandos del cliente (GET, PUT, DELETE) hasta EAGAIN, una línea o un mensaje
+      con prefijo de longitud por comando (ver Bloque 10).
+      Un comando incompleto se guarda en el contexto hasta que llegue el resto.
+    - Parsea el comando y la clave (y el valor para PUT).
+    - Realiza la operación correspondiente en el almacén clave-valor.
+    - Envía una respuesta al cliente.
+    - La conexión sigue abierta hasta que el cliente la cierre.
+    */
+    client_context_t *ctx = (client_context_t *)arg;
+    char buffer[BUFFER_SIZE];
+
+    if (ctx->out.len > 0 && flush_output(ctx) < 0) {
+        close_connection(ctx);
+        return;
+    }
+    while (ctx->out.len == 0) {
+        ssize_t n = recv(ctx->client_fd, buffer, sizeof(buffer), 0);
+        if (n == 0) {
+            close_connection(ctx);
+            return;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
+        } else if (n < 0) {
+            perror("recv failed");
+            close_connection(ctx);
+            return;
+        }
+
+        // Procesar los comandos completos y enviar sus respuestas de una vez,
+        // cuando las escrituras del lote ya están en el log (un solo commit por lote)
+        if (consume_input(ctx, buffer, n) < 0) {
+            if (kv_store_sync(ctx->store, ctx->wal_lsn) == 0) flush_output(ctx); // las respuestas anteriores y el ERROR
+            close_connection(ctx);
+            return;
+        }
+        if (kv_store_sync(ctx->store, ctx->wal_lsn) < 0 || flush_output(ctx) < 0) {
+            close_connection(ctx);
+            return;
+        }
+    }
+    if (rearm_connection(ctx) < 0) {
+        perror("epoll_ctl rearm failed");
+        close_connection(ctx);
+    }
+}
+
+static void accept_connections(reactor_t *reactor) {
+    /*
+    Acepta todas las conexiones pendientes: el listener también es de disparo por flanco,
+    así que hay que vaciar la cola de accept hasta EAGAIN o no llegará otro evento.
+    Cada cliente nace no bloqueante (accept4) y se registra con su client_context_t
+    en el epoll de este reactor, al que queda fijado.
+    */
+    while (1) {
+        struct sockaddr_in address;
+        socklen_t addrlen = sizeof(address);
+        int new_socket = accept4(reactor->listen_fd, (struct sockaddr *)&address, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (new_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept failed"); // p. ej. EMFILE
+            return;
+        }
+
+        printf("Nueva conexión aceptada, socket fd es %d, IP es: %s, puerto: %d\n", new_socket, inet_ntoa(address.sin_addr), ntohs(address.sin_port));
+
+        client_context_t *ctx = slab_alloc(sizeof(client_context_t));
+        if (!ctx) {
+            perror("slab_alloc client_context failed");
+            close(new_socket);
+            continue;
+        }
+        memset(ctx, 0, sizeof(client_context_t));
+        ctx->client_fd = new_socket;
+        ctx->store = reactor->store;
+        ctx->reactor = reactor;
+
+        struct epoll_event ev;
+        ev.events = reactor->pool ? EPOLLIN | EPOLLRDHUP | EPOLLET | EPOLLONESHOT
+                                  : EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = ctx;
+        if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, new_socket, &ev) < 0) {
+            perror("epoll_ctl add client failed");
+            close(new_socket);
+            slab_free(ctx, sizeof(client_context_t));
+        }
+    }
+}
+
+static void raise_fd_limit(void) {
+    // Cada conexión es un descriptor: subir el límite blando al duro (100k conexiones ociosas)
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static int create_listener(int reuseport) {
+    /*
+    Crea el socket de escucha no bloqueante en PORT.
+    Con 'reuseport' activa SO_REUSEPORT: varios sockets pueden escuchar en el mismo puerto
+    y el kernel reparte las conexiones entrantes entre ellos.
+    Retorna el descriptor, o -1 en error.
+    */
+    int server_fd;
+    struct sockaddr_in address;
+
+    // Crear socket del servidor
+    if ((server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) < 0) {
+        perror("socket failed");
+        return -1;
+    }
+
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reuseport && setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+        perror("setsockopt SO_REUSEPORT failed");
+        close(server_fd);
+        return -1;
+    }
+
+    // Configurar socket no bloqueante
+    int flags = fcntl(server_fd, F_GETFL, 0);
+    if (fcntl(server_fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        perror("fcntl nonblock failed");
+        close(server_fd);
+        return -1;
+    }
+
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = INADDR_ANY;
+    address.sin_port = htons(PORT);
+
+    // Bind del socket
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        perror("bind failed");
+        close(server_fd);
+        return -1;
+    }
+
+    // Escuchar por conexiones
+    if (listen(server_fd, LISTEN_BACKLOG) < 0) {
+        perror("listen failed");
+        close(server_fd);
+        return -1;
+    }
+    return server_fd;
+}
+
+static int reactor_init(reactor_t *reactor, int reuseport, int cpu, thread_pool_t *pool,
+                        key_value_store_t *store) {
+    /* Crea el listener y el epoll del reactor y registra el listener (data.ptr == NULL lo identifica). */
+    reactor->cpu = cpu;
+    reactor->pool = pool;
+    reactor->store = store;
+    reactor->ring = NULL;
+    if ((reactor->listen_fd = create_listener(reuseport)) < 0) return -1;
+    if ((reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        perror("epoll_create1 failed");
+        close(reactor->listen_fd);
+        return -1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, reactor->listen_fd, &ev) < 0) {
+        perror("epoll_ctl add listener failed");
+        close(reactor->epoll_fd);
+        close(reactor->listen_fd);
+        return -1;
+    }
+    return 0;
+}
+
+void *reactor_loop(void *arg) {
+    /*
+    Bucle de eventos de un reactor.
+
+    - Si tiene CPU asignada, fija el hilo a ella: las conexiones, sus buffers y las estructuras
+      del kernel del socket se quedan en la caché de ese núcleo.
+    - Acepta las conexiones de su listener y espera actividad en ellas con epoll_wait.
+    - Con pool, cada conexión activa se envía como tarea (queda desarmada por EPOLLONESHOT
+      hasta que el trabajador la rearme); sin pool, la atiende el propio reactor:
+      no hay traspaso entre hilos.
+    */
+    reactor_t *reactor = (reactor_t *)arg;
+    struct epoll_event events[MAX_EVENTS];
+
+    if (reactor->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(reactor->cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) fprintf(stderr, "No se pudo fijar el reactor a la CPU %d: %s\n", reactor->cpu, strerror(rc));
+    }
+
+    while (1) {
+        int n = epoll_wait(reactor->epoll_fd, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno != EINTR) perror("epoll_wait error");
+            continue;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.ptr == NULL) {
+                accept_connections(reactor);
+            } else if (reactor->pool) {
+                thread_pool_submit(reactor->pool, handle_client, events[i].data.ptr);
+            } else {
+                handle_client(events[i].data.ptr);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Backend io_uring (copia del Bloque 10): llamadas al sistema directas, sin liburing
+typedef struct uring {
+    int ring_fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned sqe_tail;     // SQEs preparados, publicados al kernel en uring_enter
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    struct io_uring_buf_ring *buf_ring; // buffers de recepción provistos al kernel
+    char *buffers;
+    unsigned short buf_tail;
+    client_context_t *deferred; // conexiones con operaciones sin SQE, reintentadas en cada vuelta
+    int accept_deferred;
+} uring_t;
+
+// msghdr e iovecs de un sendmsg en vuelo: el kernel los lee hasta que se completa.
+// Se reservan junto a las conexiones del backend io_uring; las de epoll no los necesitan.
+typedef struct uring_send {
+    struct msghdr msg;
+    struct iovec iov[OUTPUT_IOVECS];
+} uring_send_t;
+
+// user_data = puntero a la conexión | tipo de operación (client_context_t está alineada a 8)
+enum { URING_OP_ACCEPT = 0, URING_OP_RECV = 1, URING_OP_SEND = 2, URING_OP_CLOSE = 3, URING_OP_CANCEL = 4, URING_OP_PROBE = 5 };
+#define URING_OP_MASK 7ULL
+
+static int uring_enter(uring_t *ring, unsigned min_complete) {
+    /*
+    Publica los SQEs preparados (release) y, si min_complete > 0, espera completaciones.
+    Se piden todos los que el kernel aún no consumió, también los de un intento fallido.
+    */
+    __atomic_store_n(ring->sq_tail, ring->sqe_tail, __ATOMIC_RELEASE);
+    unsigned submit = ring->sqe_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    int ret = (int)syscall(__NR_io_uring_enter, ring->ring_fd, submit, min_complete,
+                           min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    return ret < 0 && errno != EINTR ? -1 : 0;
+}
+
+static int uring_reserve(uring_t *ring, unsigned n) {
+    /*
+    Asegura n SQEs libres; si la cola está llena, envía lo preparado para hacer sitio.
+    Retorna -1 si el kernel no acepta más envíos (p. ej. EBUSY con la cola de completaciones llena).
+    */
+    while (ring->sqe_tail + n - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) > ring->sq_entries) {
+        if (uring_enter(ring, 0) < 0) return -1;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *uring_get_sqe(uring_t *ring) {
+    /* Siguiente SQE libre, o NULL si no lo hay: el llamante aplaza la operación con uring_defer. */
+    if (uring_reserve(ring, 1) < 0) return NULL;
+    unsigned idx = ring->sqe_tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[idx] = idx;
+    ring->sqe_tail++;
+    return sqe;
+}
+
+static void uring_provide_buffer(uring_t *ring, unsigned short bid) {
+    /* Devuelve un buffer de recepción al anillo de buffers provistos; se publica con uring_publish_buffers. */
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[ring->buf_tail & (URING_BUFFERS - 1)];
+    buf->addr = (unsigned long)(ring->buffers + (size_t)bid * BUFFER_SIZE);
+    buf->len = BUFFER_SIZE;
+    buf->bid = bid;
+    ring->buf_tail++;
+}
+
+static void uring_publish_buffers(uring_t *ring) {
+    __atomic_store_n(&ring->buf_ring->tail, ring->buf_tail, __ATOMIC_RELEASE);
+}
+
+static void uring_defer(uring_t *ring, client_context_t *ctx, int op) {
+    /* Anota una operación sin SQE; uring_retry_deferred la repite antes de la siguiente espera. */
+    if (!ctx->deferred) {
+        ctx->next_deferred = ring->deferred;
+        ring->deferred = ctx;
+    }
+    ctx->deferred |= 1u << op;
+}
+
+static int uring_hold_input(client_context_t *ctx, const char *data, size_t len) {
+    /* Guarda sin procesar lo que entrega el recv durante la pausa. Retorna -1 si falla la memoria. */
+    char *held = realloc(ctx->held, ctx->held_len + len);
+    if (!held) return -1;
+    memcpy(held + ctx->held_len, data, len);
+    ctx->held = held;
+    ctx->held_len += len;
+    return 0;
+}
+
+static void uring_destroy(uring_t *ring) {
+    if (ring->buf_ring) munmap(ring->buf_ring, sizeof(struct io_uring_buf) * URING_BUFFERS);
+    free(ring->buffers);
+    if (ring->sqes) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->ring_fd >= 0) close(ring->ring_fd);
+}
+
+static int uring_probe_recv_multishot(uring_t *ring) {
+    /*
+    io_uring_setup y los buffers provistos funcionan desde 5.19, pero el recv multishot es de 6.0:
+    en 5.19 cada recv terminaría con -EINVAL y se cerrarían todas las conexiones.
+    Se prueba con un socketpair: un byte seguido de EOF debe dar una completación con datos
+    e IORING_CQE_F_MORE (y después la final). Retorna 0 si el kernel lo soporta.
+    */
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) return -1;
+    int written = write(sv[1], "x", 1) == 1;
+    close(sv[1]);
+    struct io_uring_sqe *sqe = written ? uring_get_sqe(ring) : NULL;
+    int supported = 0;
+    if (sqe) {
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sv[0];
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = URING_BUFFER_GROUP;
+        sqe->user_data = URING_OP_PROBE;
+        for (int more = 1; more && uring_enter(ring, 1) == 0;) {
+            unsigned head = *ring->cq_head;
+            unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+            for (; head != tail; ++head) {
+                struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+                if (cqe->res == 1 && (cqe->flags & IORING_CQE_F_MORE)) supported = 1;
+                if (cqe->flags & IORING_CQE_F_BUFFER) uring_provide_buffer(ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+                if (!(cqe->flags & IORING_CQE_F_MORE)) more = 0;
+            }
+            __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        }
+        uring_publish_buffers(ring);
+    }
+    close(sv[0]);
+    return supported ? 0 : -1;
+}
+
+static int uring_init(uring_t *ring) {
+    /*
+    Crea el anillo y registra URING_BUFFERS buffers de recepción provistos (kernel >= 5.19),
+    y comprueba que el kernel admite el recv multishot (6.0).
+    Retorna -1 si el kernel no soporta io_uring o alguna de estas funciones
+    (o si está deshabilitado, p. ej. por seccomp): el llamante vuelve a epoll.
+    */
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = URING_ENTRIES * 4; // holgura para ráfagas de completaciones multishot
+    ring->ring_fd = (int)syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (ring->ring_fd < 0) return -1;
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP)) {
+        uring_destroy(ring);
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+    ring->cq_ring = ring->sq_ring;
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+    char *sq = ring->sq_ring;
+    ring->sq_head = (unsigned *)(sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)(sq + params.sq_off.array);
+    ring->cq_head = (unsigned *)(sq + params.cq_off.head);
+    ring->cq_tail = (unsigned *)(sq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)(sq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(sq + params.cq_off.cqes);
+    ring->sq_entries = params.sq_entries;
+    ring->sqe_tail = *ring->sq_tail;
+
+    // Anillo de buffers provistos: el kernel elige un buffer libre al completar cada recv,
+    // así una conexión ociosa no tiene ningún buffer reservado
+    ring->buf_ring = mmap(NULL, sizeof(struct io_uring_buf) * URING_BUFFERS, PROT_READ | PROT_WRITE,
+                          MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+    ring->buffers = malloc((size_t)URING_BUFFERS * BUFFER_SIZE);
+    if (ring->buf_ring == MAP_FAILED || !ring->buffers) {
+        if (ring->buf_ring == MAP_FAILED) ring->buf_ring = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)ring->buf_ring;
+    reg.ring_entries = URING_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        uring_destroy(ring);
+        return -1;
+    }
+    ring->buf_tail = 0;
+    for (unsigned short bid = 0; bid < URING_BUFFERS; ++bid) uring_provide_buffer(ring, bid);
+    uring_publish_buffers(ring);
+    if (uring_probe_recv_multishot(ring) < 0) {
+        uring_destroy(ring);
+        errno = EOPNOTSUPP;
+        return -1;
+    }
+    return 0;
+}
+
+static void uring_arm_accept(uring_t *ring, int listen_fd) {
+    /*
+    Accept multishot: un solo SQE produce una completación por cada conexión aceptada.
+    Los clientes quedan bloqueantes a propósito: con O_NONBLOCK io_uring devolvería EAGAIN
+    en vez de esperar él mismo a que el socket esté listo.
+    */
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        ring->accept_deferred = 1;
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = URING_OP_ACCEPT;
+}
+
+static void uring_arm_recv(uring_t *ring, client_context_t *ctx) {
+    /*
+    Recv multishot con buffer elegido por el kernel del grupo URING_BUFFER_GROUP.
+    Un recv aplazado por falta de SQE ya cuenta como armado: nadie más cierra la conexión.
+    */
+    ctx->recv_armed = 1;
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        uring_defer(ring, ctx, URING_OP_RECV);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = ctx->client_fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = (unsigned long long)(uintptr_t)ctx | URING_OP_RECV;
+}
+
+static void uring_cancel_recv(uring_t *ring, client_context_t *ctx) {
+    /* Cancela el recv multishot de la conexión; su completación final llega con -ECANCELED. */
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        uring_defer(ring, ctx, URING_OP_CANCEL);
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (unsigned long long)(uintptr_t)ctx | URING_OP_RECV;
+    sqe->user_data = URING_OP_CANCEL; // sin conexión: puede completarse después de liberarla
+}
+
+static void uring_close(uring_t *ring, client_context_t *ctx) {
+    /* Cierra el socket con IORING_OP_CLOSE; la conexión se libera al completarse. */
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    if (!sqe) {
+        uring_defer(ring, ctx, URING_OP_CLOSE);
+        return;
+    }
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = ctx->client_fd;
+    sqe->user_data = (unsigned long long)(uintptr_t)ctx | URING_OP_CLOSE;
+}
+
+static void uring_submit_send(uring_t *ring, client_context_t *ctx) {
+    /*
+    Envía lo que queda de 'sending' (hasta OUTPUT_IOVECS fragmentos) con un IORING_OP_SENDMSG.
+    Si la conexión se está cerrando y es el último envío, el send se enlaza con IOSQE_IO_LINK
+    a su IORING_OP_CLOSE: ambos van en el mismo io_uring_enter y el cierre solo se ejecuta
+    si el send se completó entero. Los dos SQEs se reservan juntos: sin sitio, se aplaza el par.
+    */
+    uring_send_t *send = ctx->send;
+    memset(&send->msg, 0, sizeof(send->msg));
+    send->msg.msg_iov = send->iov;
+    send->msg.msg_iovlen = output_iov(&ctx->sending, send->iov, OUTPUT_IOVECS);
+    size_t len = 0;
+    for (size_t i = 0; i < send->msg.msg_iovlen; ++i) len += send->iov[i].iov_len;
+    int link = ctx->closing && !ctx->recv_armed && ctx->out.len == 0 && len == ctx->sending.len;
+    if (uring_reserve(ring, link ? 2 : 1) < 0) {
+        uring_defer(ring, ctx, URING_OP_SEND);
+        return;
+    }
+    struct io_uring_sqe *sqe = uring_get_sqe(ring);
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = ctx->client_fd;
+    sqe->addr = (unsigned long)&send->msg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+    sqe->user_data = (unsigned long long)(uintptr_t)ctx | URING_OP_SEND;
+    ctx->close_linked = link;
+    if (ctx->close_linked) {
+        sqe->flags = IOSQE_IO_LINK;
+        uring_close(ring, ctx);
+    }
+}
+
+static void uring_flush(uring_t *ring, client_context_t *ctx) {
+    /*
+    Envía la salida acumulada de la conexión si no hay ya un send en vuelo (así las respuestas
+    salen en orden y un send nunca apunta a un fragmento al que se sigan añadiendo bytes):
+    la cola entera pasa al send y la salida nueva empieza una vacía.
+    Sin salida y con la conexión cerrándose, la cierra.
+    */
+    if (ctx->sending.len > 0) return;
+    if (ctx->out.len == 0) {
+        if (ctx->closing && !ctx->recv_armed) uring_close(ring, ctx);
+        return;
+    }
+    ctx->sending = ctx->out;
+    memset(&ctx->out, 0, sizeof(ctx->out));
+    uring_submit_send(ring, ctx);
+}
+
+static void uring_resume_recv(uring_t *ring, client_context_t *ctx) {
+    /*
+    Sale de la pausa por contrapresión cuando el recv cancelado ya terminó y la salida pendiente
+    bajó a la mitad de OUTPUT_HIGH_WATER. Lo retenido durante la cancelación se procesa
+    de BUFFER_SIZE en BUFFER_SIZE y se para si la salida vuelve a pasar del límite
+    (sigue el siguiente send completado); el recv solo se rearma sin nada retenido.
+    */
+    if (!ctx->recv_paused || ctx->recv_armed || ctx->closing) return;
+    if (ctx->out.len + ctx->sending.len > OUTPUT_HIGH_WATER / 2) return;
+    while (ctx->held_off < ctx->held_len && ctx->out.len + ctx->sending.len <= OUTPUT_HIGH_WATER) {
+        size_t len = ctx->held_len - ctx->held_off;
+        if (len > BUFFER_SIZE) len = BUFFER_SIZE;
+        if (consume_input(ctx, ctx->held + ctx->held_off, len) < 0) {
+            ctx->closing = 1; // sin recv: cierra uring_flush
+            break;
+        }
+        ctx->held_off += len;
+    }
+    if (ctx->held_off == ctx->held_len) {
+        free(ctx->held);
+        ctx->held = NULL;
+        ctx->held_len = ctx->held_off = 0;
+    }
+    if (kv_store_sync(ctx->store, ctx->wal_lsn) < 0) {
+        output_reset(&ctx->out);
+        ctx->closing = 1;
+    }
+    uring_flush(ring, ctx);
+    if (ctx->closing || ctx->held || ctx->out.len + ctx->sending.len > OUTPUT_HIGH_WATER) return;
+    ctx->recv_paused = 0;
+    uring_arm_recv(ring, ctx);
+}
+
+static void uring_retry_deferred(uring_t *ring, reactor_t *reactor) {
+    /*
+    Repite las operaciones que no encontraron SQE. Una conexión con operaciones aplazadas
+    no se libera: su close es una de ellas o aún no se ha pedido.
+    */
+    if (ring->accept_deferred) {
+        ring->accept_deferred = 0;
+        uring_arm_accept(ring, reactor->listen_fd);
+    }
+    client_context_t *list = ring->deferred;
+    ring->deferred = NULL;
+    while (list) {
+        client_context_t *ctx = list;
+        list = ctx->next_deferred;
+        unsigned ops = ctx->deferred;
+        ctx->deferred = 0;
+        // Si entretanto el recv terminó y se rearmó, el cancel aplazado ya no debe tocarlo
+        if ((ops & (1u << URING_OP_CANCEL)) && ctx->recv_paused && ctx->recv_armed) uring_cancel_recv(ring, ctx);
+        if (ops & (1u << URING_OP_RECV)) uring_arm_recv(ring, ctx);
+        if (ops & (1u << URING_OP_SEND)) uring_submit_send(ring, ctx);
+        if (ops & (1u << URING_OP_CLOSE)) uring_close(ring, ctx);
+    }
+}
+
+static void uring_handle_cqe(uring_t *ring, reactor_t *reactor, struct io_uring_cqe *cqe) {
+    /* Procesa una completación. Puede preparar nuevos SQEs, que salen en el siguiente io_uring_enter. */
+    int op = (int)(cqe->user_data & URING_OP_MASK);
+    client_context_t *ctx = (client_context_t *)(uintptr_t)(cqe->user_data & ~URING_OP_MASK);
+
+    switch (op) {
+    case URING_OP_ACCEPT:
+        if (cqe->res >= 0) {
+            client_context_t *c = slab_alloc(sizeof(client_context_t) + sizeof(uring_send_t));
+            if (!c) {
+                perror("slab_alloc client_context failed");
+                close(cqe->res);
+            } else {
+                memset(c, 0, sizeof(client_context_t) + sizeof(uring_send_t));
+                printf("Nueva conexión aceptada, socket fd es %d\n", cqe->res);
+                c->client_fd = cqe->res;
+                c->store = reactor->store;
+                c->reactor = reactor;
+                c->send = (uring_send_t *)(c + 1);
+                uring_arm_recv(ring, c);
+            }
+        } else if (cqe->res != -EAGAIN && cqe->res != -EINTR) {
+            fprintf(stderr, "accept failed: %s\n", strerror(-cqe->res));
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) uring_arm_accept(ring, reactor->listen_fd);
+        break;
+
+    case URING_OP_RECV:
+        if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+            unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            char *data = ring->buffers + (size_t)bid * BUFFER_SIZE;
+            // En pausa, lo que aún entregue el recv que se está cancelando espera sin procesar
+            if (!ctx->closing && (ctx->recv_paused ? uring_hold_input(ctx, data, cqe->res)
+                                                   : consume_input(ctx, data, cqe->res)) < 0) {
+                ctx->closing = 1;
+                shutdown(ctx->client_fd, SHUT_RD); // termina el recv multishot; lo ya encolado se envía
+            }
+            if (kv_store_sync(ctx->store, ctx->wal_lsn) < 0) { // no se confirma lo que no está en el log
+                output_reset(&ctx->out);
+                if (!ctx->closing) shutdown(ctx->client_fd, SHUT_RD);
+                ctx->closing = 1;
+            }
+            uring_provide_buffer(ring, bid);
+        }
+        if (!ctx->closing && !ctx->recv_paused && ctx->out.len + ctx->sending.len > OUTPUT_HIGH_WATER) {
+            // Contrapresión, como handle_client con epoll: no se leen más comandos hasta que salga la salida
+            ctx->recv_paused = 1;
+            if (cqe->flags & IORING_CQE_F_MORE) uring_cancel_recv(ring, ctx);
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            ctx->recv_armed = 0;
+            if (!ctx->closing && (cqe->res > 0 || cqe->res == -ENOBUFS ||
+                                  (cqe->res == -ECANCELED && ctx->recv_paused))) {
+                // Sin buffers libres o multishot cortado por el kernel: se rearma, salvo en pausa
+                if (!ctx->recv_paused) uring_arm_recv(ring, ctx);
+            } else {
+                if (cqe->res < 0 && cqe->res != -ECONNRESET) fprintf(stderr, "recv failed: %s\n", strerror(-cqe->res));
+                ctx->closing = 1; // res == 0: el cliente cerró
+            }
+        }
+        uring_flush(ring, ctx);
+        uring_resume_recv(ring, ctx);
+        break;
+
+    case URING_OP_SEND:
+        if (cqe->res < 0) {
+            if (cqe->res != -EPIPE && cqe->res != -ECONNRESET) fprintf(stderr, "send failed: %s\n", strerror(-cqe->res));
+            // Si el send falló, el close enlazado se canceló: hay que volver a cerrar
+            output_reset(&ctx->sending);
+            output_reset(&ctx->out);
+            if (ctx->recv_armed) {
+                if (!ctx->closing) shutdown(ctx->client_fd, SHUT_RDWR); // termina el recv multishot, que cerrará
+            } else {
+                uring_close(ring, ctx); // cerrándose o en pausa: no hay recv que cierre
+            }
+            ctx->closing = 1;
+            break;
+        }
+        output_consume(&ctx->sending, cqe->res);
+        if (ctx->sending.len > 0) { // envío parcial (el close enlazado se canceló) o más fragmentos
+            uring_submit_send(ring, ctx);
+            break;
+        }
+        if (!ctx->close_linked) {
+            uring_flush(ring, ctx);
+            uring_resume_recv(ring, ctx); // la salida bajó: si estaba en pausa, vuelve a leer
+        }
+        break;
+
+    case URING_OP_CLOSE:
+        if (cqe->res == -ECANCELED) break; // el send enlazado falló; lo cierra su completación
+        printf("Cliente fd %d desconectado\n", ctx->client_fd);
+        output_reset(&ctx->sending);
+        output_reset(&ctx->out);
+        free(ctx->in);
+        free(ctx->held);
+        slab_free(ctx, sizeof(client_context_t) + sizeof(uring_send_t));
+        break;
+
+    case URING_OP_CANCEL: // el recv cancelado informa en su propia completación
+        break;
+    }
+}
+
+void *uring_loop(void *arg) {
+    /*
+    Bucle de eventos io_uring de un reactor (mismo listener SO_REUSEPORT y afinidad que reactor_loop).
+
+    - Un único accept multishot para todas las conexiones y un recv multishot por conexión:
+      no hay que volver a pedir la operación tras cada evento.
+    - Los recv usan buffers provistos: el kernel toma uno del anillo al llegar datos
+      y el bucle lo devuelve en cuanto copia los bytes.
+    - Cada vuelta procesa todas las completaciones disponibles y entrega todos los SQEs
+      resultantes (sends, rearmados, cierres) y la espera de la siguiente tanda
+      en una sola llamada a io_uring_enter.
+    - Una conexión con más de OUTPUT_HIGH_WATER bytes de salida pendientes deja de leer:
+      se cancela su recv multishot y se rearma cuando los sends vacían la cola.
+    - Las operaciones que no encontraron SQE se repiten antes de cada espera.
+    */
+    reactor_t *reactor = (reactor_t *)arg;
+    uring_t *ring = reactor->ring;
+
+    if (reactor->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(reactor->cpu, &set);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (rc != 0) fprintf(stderr, "No se pudo fijar el reactor a la CPU %d: %s\n", reactor->cpu, strerror(rc));
+    }
+
+    uring_arm_accept(ring, reactor->listen_fd);
+    while (1) {
+        uring_retry_deferred(ring, reactor);
+        // Con operaciones aún aplazadas no se espera: puede no haber nada en vuelo que despierte el bucle.
+        // EBUSY: la cola de completaciones está llena y el kernel no admite envíos hasta vaciarla
+        int wait = !ring->deferred && !ring->accept_deferred;
+        if (uring_enter(ring, wait) < 0 && errno != EBUSY && errno != EAGAIN) perror("io_uring_enter failed");
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            uring_handle_cqe(ring, reactor, &ring->cqes[head & *ring->cq_mask]);
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+        uring_publish_buffers(ring);
+    }
+    return NULL;
+}
+
+static int parse_cpu_list(const char *arg, int *cpus, int max) {
+    /* Convierte "0,2,4" en {0, 2, 4}. Retorna el número de CPUs, o -1 si la lista no es válida. */
+    int n = 0;
+    const char *p = arg;
+    while (*p && n < max) {
+        char *end;
+        long cpu = strtol(p, &end, 10);
+        if (end == p || cpu < 0 || cpu >= CPU_SETSIZE) return -1;
+        cpus[n++] = (int)cpu;
+        if (*end == ',') end++;
+        else if (*end != '\0') return -1;
+        p = end;
+    }
+    return n;
+}
+
+int main(int argc, char *argv[]) {
+    thread_pool_t pool;
+    key_value_store_t *store;
+
+    raise_fd_limit();
+
+    // Crear el almacén clave-valor
+    // Persistente en KV_DATA_DIR: instantánea + log; tamaño inicial estimado (el índice crece solo), lecturas sin lock
+    store = kv_store_open(KV_DATA_DIR, 1024, KV_READ_SEQLOCK);
+    if (!store) {
+        perror("kv_store_open failed");
+        exit(EXIT_FAILURE);
+    }
+    kv_store_set_expire_callback(store, count_expired, &expired_keys); // contador de STATS
+
+    if (argc > 1 && (strcmp(argv[1], "reuseport") == 0 || strcmp(argv[1], "uring") == 0)) {
+        // Un reactor por núcleo (igual que en el Bloque 10); todos comparten el almacén
+        static reactor_t reactors[MAX_REACTORS];
+        static uring_t rings[MAX_REACTORS];
+        int use_uring = strcmp(argv[1], "uring") == 0;
+        int cpus[MAX_REACTORS];
+        int ncpu = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        int n;
+        int pin = argc > 2;
+        if (ncpu < 1) ncpu = 1;
+        if (argc > 2 && strcmp(argv[2], "auto") == 0) {
+            n = ncpu < MAX_REACTORS ? ncpu : MAX_REACTORS;
+            for (int i = 0; i < n; ++i) cpus[i] = i;
+        } else if (argc > 2) {
+            if ((n = parse_cpu_list(argv[2], cpus, MAX_REACTORS)) <= 0) {
+                fprintf(stderr, "Lista de CPUs no válida: %s\n", argv[2]);
+                exit(EXIT_FAILURE);
+            }
+        } else {
+            n = ncpu < MAX_REACTORS ? ncpu : MAX_REACTORS;
+        }
+
+        for (int i = 0; i < n; ++i) {
+            if (reactor_init(&reactors[i], 1, pin ? cpus[i] : -1, NULL, store) < 0) exit(EXIT_FAILURE);
+            if (use_uring && uring_init(&rings[i]) < 0) {
+                fprintf(stderr, "io_uring no disponible (%s), usando epoll\n", strerror(errno));
+                for (int k = 0; k < i; ++k) uring_destroy(&rings[k]);
+                use_uring = 0;
+            }
+        }
+        for (int i = 0; i < n && use_uring; ++i) reactors[i].ring = &rings[i];
+        void *(*loop)(void *) = use_uring ? uring_loop : reactor_loop;
+        printf("Servidor escuchando en el puerto %d con %d reactores SO_REUSEPORT (%s)%s...\n",
+               PORT, n, use_uring ? "io_uring" : "epoll", pin ? " fijados a CPU" : "");
+        for (int i = 1; i < n; ++i) {
+            if (pthread_create(&reactors[i].thread, NULL, loop, &reactors[i]) != 0) {
+                perror("pthread_create reactor failed");
+                exit(EXIT_FAILURE);
+            }
+        }
+        loop(&reactors[0]);
+        return 0;
+    }
+
+    // Modo por defecto: un reactor que reparte las conexiones activas al thread pool
+    reactor_t reactor;
+    thread_pool_init(&pool, THREAD_POOL_SIZE, MAX_TASKS);
+    if (reactor_init(&reactor, 0, -1, &pool, store) < 0) exit(EXIT_FAILURE);
+    printf("Servidor escuchando en el puerto %d...\n", PORT);
+    reactor_loop(&reactor);
+
+    close(reactor.epoll_fd);
+    close(reactor.listen_fd);
+    thread_pool_destroy(&pool);
+    kv_store_destroy(store);
+    return 0;
+}
+
+/*
+Compila: gcc pthreads11.c -o concurrent_kv_store -lpthread
+Ejecuta: ./concurrent_kv_store [reuseport | uring [auto | lista de CPUs, p. ej. 0,2,4]]
+Explicación:
+    -Almacén Clave-Valor Concurrente:
+        Se implementa una estructura key_value_store_t
+        que utiliza un array para almacenar las entradas clave-valor
+        y un pthread_rwlock_t para controlar el acceso concurrente.
+        Esto permite que múltiples lectores accedan al almacén simultáneamente,
+        pero requiere un lock exclusivo para las operaciones de escritura (PUT y DELETE).
+
+    -Operaciones del Almacén:
+        Se proporcionan funciones para crear, obtener, insertar/actualizar
+        y eliminar pares clave-valor de forma thread-safe.
+
+    -Integración con el Servidor No Bloqueante y el Thread Pool:
+        Al igual que en el Bloque 10,
+        se utiliza un reactor epoll con disparo por flanco para aceptar conexiones
+        y esperar actividad en ellas. Cada conexión con datos se pasa como una tarea
+        al thread pool (la cola MPMC del Bloque 10).
+
+    -Modo reuseport:
+        Con ./concurrent_kv_store reuseport hay un reactor por núcleo, cada uno con su listener
+        SO_REUSEPORT, y cada conexión la atiende el reactor que la aceptó, sin pasar por el pool.
+        La afinidad a CPU se configura igual que en el Bloque 10 ('auto' o una lista).
+        El almacén es el único estado compartido entre reactores.
+
+    -Backend io_uring:
+        Con ./concurrent_kv_store uring cada reactor usa el backend io_uring del Bloque 10
+        (accept y recv multishot, buffers provistos, send enlazado al close), y vuelve a epoll
+        si el kernel no lo soporta. Los comandos de todas las completaciones de una vuelta
+        se procesan antes de entrar en el kernel, así que una ráfaga de GET pequeños
+        cuesta una sola llamada a io_uring_enter en lugar de un recv y un send por petición.
+
+    -handle_client con Almacén:
+        La función handle_client ahora recibe un client_context_t
+        que contiene tanto el descriptor del socket del cliente como un puntero
+        al almacén clave-valor compartido, además del comando a medio recibir
+        y la cola de respuestas pendientes. La conexión es persistente: el cliente puede
+        enviar varios comandos seguidos sin esperar las respuestas.
+        Los comandos se delimitan como los mensajes del Bloque 10: una línea, o "$<n>\n"
+        seguido de n bytes y un '\n'. Un comando partido entre lecturas espera en un buffer
+        de la conexión que crece según haga falta (hasta MAX_FRAME_SIZE), y las respuestas
+        de cada tanda salen juntas con un solo sendmsg.
+
+    -Protocolo Simple:
+        El cliente puede enviar comandos simples como GET <key>,
+        PUT <key> <value>, y DELETE <key>.
+        El servidor responde con OK, VALUE <value>, NOT_FOUND, o ERROR.
+        La respuesta lleva el mismo formato que el comando: un valor con saltos de línea
+        solo se puede leer sin ambigüedad con un GET con prefijo de longitud.
+        Un comando con un prefijo inválido se responde con ERROR y cierra la conexión.
+
+    -Comandos por lotes (MGET, MPUT, MDEL):
+        MGET k1 k2 ..., MPUT k1 v1 k2 v2 ... y MDEL k1 k2 ... responden una línea (o un frame)
+        por clave, en orden, exactamente lo mismo que la serie de GET, PUT o DELETE
+        equivalente; un cliente que ya envía comandos encadenados no cambia su lectura.
+        La diferencia está en el almacén: las claves se agrupan por partición y cada
+        partición se bloquea (o se valida con 'seq') una sola vez por comando, en lugar de
+        una vez por clave, y todas las escrituras del lote esperan a un solo commit del log.
+        Una consulta de 50 a 500 claves cuesta un viaje de red y un lock por partición tocada.
+        Los valores de MPUT no pueden contener espacios; para eso está PUT.
+
+    -Protocolo binario:
+        Si el primer byte de una conexión es BIN_MAGIC_REQUEST (0x80), la conexión habla
+        el protocolo binario: una cabecera fija de 16 bytes (bin_header_t, little-endian)
+        con la operación, la longitud de la clave y del valor y un request_id opaco,
+        seguida de la clave y el valor. La respuesta lleva la misma cabecera con un estado
+        (OK, NOT_FOUND, ERROR) y el valor. No hay texto que parsear ni respuestas que
+        formatear, y claves y valores pueden contener cualquier byte.
+        Las respuestas salen en orden, pero cada una devuelve el request_id de su petición:
+        el cliente no necesita contar respuestas para emparejarlas.
+        Un GET de un valor de BIN_ZERO_COPY_MIN bytes o más no copia el valor: lo fija
+        (kv_store_pin) y la cola de salida apunta a la memoria del almacén, sea el nodo
+        o el mmap de la instantánea. Mientras está fijado, un PUT de esa clave crea un nodo
+        nuevo en lugar de escribir en el sitio, y si el nodo o la instantánea se retiran,
+        los libera el último envío que los usaba en lugar de la liberación por épocas.
+
+    -Lecturas sin lock (KV_READ_SEQLOCK):
+        pthread_rwlock_rdlock escribe en la palabra del lock incluso sin contención,
+        lo que hace que las lecturas escalen mal con muchos núcleos.
+        En este modo kv_store_get no adquiere ningún lock: valida su copia con el contador
+        de secuencia de la partición, que solo kv_store_put y kv_store_delete modifican.
+        Como los nodos se liberan, cada lector anuncia la época global en su propio slot
+        y la memoria desenlazada se libera dos épocas después (liberación por épocas),
+        cuando ya ningún lector puede estar recorriéndola.
+        El benchmark comparativo de ambos modos está en el Bloque 1 (./rwlock_cache bench).
+
+    -Asignador por clases de tamaño y STATS:
+        Los contextos de cliente, los fragmentos de salida y los nodos del almacén
+        (clave y valor) salen del asignador por slabs del Bloque 10, con una caché por hilo
+        y liberaciones remotas por lotes. Un nodo ocupa su clase entera: el sobrante
+        deja crecer el valor en el sitio sin pedir otro nodo.
+        El comando STATS responde, por clase en uso, los slabs, los objetos vivos,
+        los bytes pedidos y la fragmentación (la parte de los slabs no ocupada por esos bytes).
+
+    -Índice hash con particiones:
+        El almacén es una tabla hash dividida en KV_SHARDS particiones: los bits altos del hash
+        eligen la partición y los bajos la cubeta, así que GET, PUT y DELETE solo tocan
+        una cadena corta de una partición y son O(1) aunque haya millones de entradas.
+        Cada partición tiene su propio lock, de modo que escritores de claves distintas
+        casi nunca compiten. Claves y valores son de longitud variable y van en un solo bloque.
+        Cuando una partición supera una entrada por cubeta, reserva una tabla del doble
+        y cada escritura posterior migra unas pocas cubetas (redimensionado incremental):
+        ninguna petición se detiene a rehacer toda la tabla. Mientras dura, las búsquedas
+        miran las dos tablas. Borrar solo desenlaza el nodo de su cadena: sin tombstones
+        ni entradas desplazadas (salvo para ocultar una clave de la instantánea, ver abajo).
+
+    -Persistencia: log con commit en grupo, instantánea y compactación:
+        Cada PUT, DELETE y EXPIRE se añade a un log (KV_WAL_FILE en KV_DATA_DIR) con un checksum
+        por registro, y el servidor no responde OK hasta que está en disco.
+        No hay un fdatasync por escritura: las respuestas de toda una tanda de comandos
+        esperan a la vez, y cuando varias conexiones esperan, el primer hilo (el líder)
+        escribe los registros de todas con un único fdatasync mientras las demás esperan
+        a que termine (commit en grupo). En modo reuseport/uring esa espera bloquea el reactor,
+        pero se paga una vez por tanda y no por comando.
+        Cuando el log pasa de KV_COMPACT_BYTES, un hilo en segundo plano lo rota y escribe
+        una instantánea (KV_SNAPSHOT_FILE): una tabla hash de direccionamiento abierto
+        que se usa directamente con mmap. Al arrancar solo se proyecta la instantánea
+        y se reaplica el log corto que hay detrás, así que el arranque no depende del
+        tamaño de los datos; las páginas se cargan la primera vez que se leen.
+        Tras la compactación, la memoria solo guarda lo escrito después: un GET que no
+        encuentra la clave en memoria la busca en la instantánea, y un DELETE de una clave
+        que está en ella deja en memoria una marca de borrado hasta la siguiente compactación.
+        La instantánea se escribe a un fichero temporal y se renombra, y un registro cortado
+        por una caída al final del log se descarta al arrancar: en ningún punto de una caída
+        se pierde una escritura confirmada.
+
+    -Caducidad de claves (EXPIRE y TTL):
+        EXPIRE <key> <segundos> programa la caducidad de una clave y TTL <key> responde
+        los ms que le quedan (-1 si no caduca); un PUT de la clave quita la caducidad.
+        Cada partición tiene una rueda de temporizadores jerárquica de KV_WHEEL_LEVELS niveles
+        de 64 ranuras con tic de 1 ms: programar y cancelar es O(1) (enlazar o desenlazar el
+        temporizador del nodo), y solo al dar la vuelta un nivel se reparte una ranura del
+        superior. Con un mapa de bits de ranuras ocupadas por nivel, el hilo de caducidad
+        calcula el próximo vencimiento con ctz y duerme hasta entonces: no hay un tic
+        periódico ni se recorren claves, así que millones de TTL no cuestan nada mientras
+        no vencen, y una clave desaparece con un retraso de pocos ms.
+        Las claves vencidas se borran por partición con un solo write lock y se avisa fuera
+        del lock a un callback (kv_store_set_expire_callback; el servidor las cuenta en
+        STATS expired=<n>). Hasta entonces, GET ya no ve una clave vencida.
+        La caducidad va al log y a la instantánea como hora absoluta de reloj de pared:
+        tras reiniciar, la clave caduca cuando tocaba (o enseguida, si ya pasó).
+
+Para probar este servidor:
+
+        Ejecuta el programa concurrent_kv_store (los datos quedan en kv.snap y kv.wal del directorio actual).
+            Puedes usar la herramienta netcat (nc) desde otra terminal
+            para interactuar con el servidor.
+    Por ejemplo:
+        Para insertar un valor: echo "PUT mykey myvalue" | nc localhost 8080
+        Para obtener un valor: echo "GET mykey" | nc localhost 8080
+        Para eliminar una clave: echo "DELETE mykey" | nc localhost 8080
+        Varias claves de una vez: echo "MGET k1 k2 k3" | nc localhost 8080
+        Para que una clave caduque en 10 s: echo "EXPIRE mykey 10" | nc localhost 8080
+        Con prefijo de longitud: printf '$15\nPUT mykey a\nb c\n' | nc localhost 8080
+ */
\ No newline at end of file
@@ -1,9 +1,18 @@
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #define QUEUE_CAPACITY 5
+#define CACHE_LINE_SIZE 64
+#define SPSC_SPIN_LIMIT 1024   // iteraciones de espera activa antes de dormir
+
+#define BENCH_ITEMS 2000000
+#define BENCH_PINGS 100000
+#define BENCH_CAPACITY 1024
 
 typedef struct {
     int *queue;
@@ -21,6 +30,33 @@ void bqueue_enqueue(blocking_queue_t *bq, int item);
 int bqueue_dequeue(blocking_queue_t *bq);
 void bqueue_destroy(blocking_queue_t *bq);
 
+// Anillo SPSC sin locks: un único productor y un único consumidor
+typedef struct {
+    // Lado del consumidor
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t head;
+    size_t cached_tail;          // última 'tail' vista por el consumidor
+    // Lado del productor
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;
+    size_t cached_head;          // última 'head' vista por el productor
+    // Datos de solo lectura tras la creación
+    _Alignas(CACHE_LINE_SIZE) int *buffer;
+    size_t mask;                 // capacidad - 1, la capacidad es potencia de dos
+    int spin_limit;              // 0 en máquinas de un solo núcleo: esperar activamente no sirve
+    // Estacionamiento: solo se usa cuando la espera activa no basta
+    _Alignas(CACHE_LINE_SIZE) atomic_int consumer_parked;
+    atomic_int producer_parked;
+    pthread_mutex_t park_mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+} spsc_ring_t;
+
+spsc_ring_t* spsc_ring_create(size_t capacity);
+int spsc_ring_try_push(spsc_ring_t *ring, int item);
+int spsc_ring_try_pop(spsc_ring_t *ring, int *item);
+void spsc_ring_push(spsc_ring_t *ring, int item);
+int spsc_ring_pop(spsc_ring_t *ring);
+void spsc_ring_destroy(spsc_ring_t *ring);
+
 blocking_queue_t* bqueue_create(int capacity) {
     /*
     Crea e inicializa una cola bloqueante con la capacidad especificada.
@@ -33,6 +69,19 @@ blocking_queue_t* bqueue_create(int capacity) {
     - Establece el tamaño, la cabeza y la cola de la cola a sus valores iniciales.
     - Retorna un puntero a la cola bloqueante creada.
     */
+    blocking_queue_t *bq = malloc(sizeof(blocking_queue_t));
+    if (!bq) return NULL;
+    bq->queue = malloc(sizeof(int) * capacity);
+    if (!bq->queue) {
+        free(bq);
+        return NULL;
+    }
+    pthread_mutex_init(&bq->mutex, NULL);
+    pthread_cond_init(&bq->not_empty, NULL);
+    pthread_cond_init(&bq->not_full, NULL);
+    bq->head = bq->tail = bq->size = 0;
+    bq->capacity = capacity;
+    return bq;
 }
 
 void bqueue_enqueue(blocking_queue_t *bq, int item) {
@@ -62,12 +111,186 @@ int bqueue_dequeue(blocking_queue_t *bq) {
     - Desbloquea el mutex.
     - Retorna el elemento desencolado.
     */
+    pthread_mutex_lock(&bq->mutex);
+    while (bq->size == 0) {
+        pthread_cond_wait(&bq->not_empty, &bq->mutex);
+    }
+    int item = bq->queue[bq->head];
+    bq->size--;
+    bq->head = (bq->head + 1) % bq->capacity;
+    pthread_cond_signal(&bq->not_full);
+    pthread_mutex_unlock(&bq->mutex);
+    return item;
 }
 
 void bqueue_destroy(blocking_queue_t *bq) {
     /*
     Libera la memoria y destruye el mutex y las variables de condición de la cola bloqueante.
     */
+    pthread_mutex_destroy(&bq->mutex);
+    pthread_cond_destroy(&bq->not_empty);
+    pthread_cond_destroy(&bq->not_full);
+    free(bq->queue);
+    free(bq);
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+spsc_ring_t* spsc_ring_create(size_t capacity) {
+    /*
+    Crea un anillo SPSC con capacidad redondeada a la siguiente potencia de dos,
+    para indexar con una máscara en lugar de con el operador módulo.
+
+    - head y tail son contadores que solo crecen; el índice real es contador & mask.
+    - Cada lado tiene su propia línea de caché: el productor solo escribe 'tail'
+      y el consumidor solo escribe 'head', así no hay falso compartir.
+    - El mutex y las condiciones solo se usan para dormir cuando la espera activa no basta.
+    */
+    size_t cap = 2;
+    while (cap < capacity) cap *= 2;
+
+    spsc_ring_t *ring = aligned_alloc(CACHE_LINE_SIZE, sizeof(spsc_ring_t));
+    if (!ring) return NULL;
+    memset(ring, 0, sizeof(spsc_ring_t));
+    ring->buffer = malloc(sizeof(int) * cap);
+    if (!ring->buffer) {
+        free(ring);
+        return NULL;
+    }
+    ring->mask = cap - 1;
+    ring->spin_limit = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SPSC_SPIN_LIMIT : 0;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    atomic_init(&ring->consumer_parked, 0);
+    atomic_init(&ring->producer_parked, 0);
+    pthread_mutex_init(&ring->park_mutex, NULL);
+    pthread_cond_init(&ring->not_empty, NULL);
+    pthread_cond_init(&ring->not_full, NULL);
+    return ring;
+}
+
+int spsc_ring_try_push(spsc_ring_t *ring, int item) {
+    /*
+    Encola sin bloquear. Solo puede llamarla el hilo productor.
+
+    - Compara con la copia local de 'head'; solo relee la del consumidor si el anillo parece lleno.
+    - Escribe el elemento y publica la nueva 'tail' con semántica release,
+      de modo que el consumidor ve el elemento antes que el índice.
+    - Si el consumidor está dormido, lo despierta (única vía con llamada al sistema).
+    - Retorna 0 en éxito, -1 si el anillo está lleno.
+    */
+    size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    if (tail - ring->cached_head > ring->mask) {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (tail - ring->cached_head > ring->mask) return -1;
+    }
+    ring->buffer[tail & ring->mask] = item;
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->consumer_parked, memory_order_relaxed)) {
+        pthread_mutex_lock(&ring->park_mutex);
+        pthread_cond_signal(&ring->not_empty);
+        pthread_mutex_unlock(&ring->park_mutex);
+    }
+    return 0;
+}
+
+int spsc_ring_try_pop(spsc_ring_t *ring, int *item) {
+    /*
+    Desencola sin bloquear. Solo puede llamarla el hilo consumidor.
+    Simétrica a spsc_ring_try_push: lee el elemento y publica 'head' con release.
+    Retorna 0 en éxito, -1 si el anillo está vacío.
+    */
+    size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    if (head == ring->cached_tail) {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+        if (head == ring->cached_tail) return -1;
+    }
+    *item = ring->buffer[head & ring->mask];
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&ring->producer_parked, memory_order_relaxed)) {
+        pthread_mutex_lock(&ring->park_mutex);
+        pthread_cond_signal(&ring->not_full);
+        pthread_mutex_unlock(&ring->park_mutex);
+    }
+    return 0;
+}
+
+static int spsc_ring_full(spsc_ring_t *ring) {
+    return atomic_load_explicit(&ring->tail, memory_order_relaxed) -
+           atomic_load_explicit(&ring->head, memory_order_acquire) > ring->mask;
+}
+
+static int spsc_ring_empty(spsc_ring_t *ring) {
+    return atomic_load_explicit(&ring->head, memory_order_relaxed) ==
+           atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+void spsc_ring_push(spsc_ring_t *ring, int item) {
+    /*
+    Encola esperando si el anillo está lleno: primero espera activa durante 'spin_limit'
+    iteraciones y después duerme en 'not_full'.
+
+    El productor marca 'producer_parked' y vuelve a comprobar el anillo con el mutex tomado;
+    el consumidor publica 'head' y después mira la marca. Con las barreras seq_cst de ambos lados,
+    o el productor ve el hueco o el consumidor ve la marca, así que no se pierde ningún despertar.
+    */
+    for (int spins = 0; spsc_ring_try_push(ring, item) != 0; ++spins) {
+        if (spins < ring->spin_limit) {
+            cpu_relax();
+            continue;
+        }
+        pthread_mutex_lock(&ring->park_mutex);
+        atomic_store_explicit(&ring->producer_parked, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (spsc_ring_full(ring)) {
+            pthread_cond_wait(&ring->not_full, &ring->park_mutex);
+        }
+        atomic_store_explicit(&ring->producer_parked, 0, memory_order_relaxed);
+        pthread_mutex_unlock(&ring->park_mutex);
+        spins = 0;
+    }
+}
+
+int spsc_ring_pop(spsc_ring_t *ring) {
+    /*
+    Desencola esperando si el anillo está vacío, con la misma política
+    de espera activa y después dormir que spsc_ring_push.
+    */
+    int item;
+    for (int spins = 0; spsc_ring_try_pop(ring, &item) != 0; ++spins) {
+        if (spins < ring->spin_limit) {
+            cpu_relax();
+            continue;
+        }
+        pthread_mutex_lock(&ring->park_mutex);
+        atomic_store_explicit(&ring->consumer_parked, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (spsc_ring_empty(ring)) {
+            pthread_cond_wait(&ring->not_empty, &ring->park_mutex);
+        }
+        atomic_store_explicit(&ring->consumer_parked, 0, memory_order_relaxed);
+        pthread_mutex_unlock(&ring->park_mutex);
+        spins = 0;
+    }
+    return item;
+}
+
+void spsc_ring_destroy(spsc_ring_t *ring) {
+    pthread_mutex_destroy(&ring->park_mutex);
+    pthread_cond_destroy(&ring->not_empty);
+    pthread_cond_destroy(&ring->not_full);
+    free(ring->buffer);
+    free(ring);
 }
 
 void *producer_thread(void *arg) {
@@ -90,7 +313,106 @@ void *consumer_thread(void *arg) {
     pthread_exit(NULL);
 }
 
-int main() {
+// Benchmark: la misma carga sobre la cola bloqueante y sobre el anillo SPSC
+typedef struct {
+    const char *name;
+    void *q;
+    void (*push)(void *q, int item);
+    int (*pop)(void *q);
+} bench_queue_t;
+
+static void bq_push(void *q, int item) { bqueue_enqueue((blocking_queue_t *)q, item); }
+static int bq_pop(void *q) { return bqueue_dequeue((blocking_queue_t *)q); }
+static void ring_push(void *q, int item) { spsc_ring_push((spsc_ring_t *)q, item); }
+static int ring_pop(void *q) { return spsc_ring_pop((spsc_ring_t *)q); }
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void *bench_producer(void *arg) {
+    bench_queue_t *bq = (bench_queue_t *)arg;
+    for (int i = 0; i < BENCH_ITEMS; ++i) bq->push(bq->q, i);
+    return NULL;
+}
+
+void *bench_echo(void *arg) {
+    // Devuelve cada elemento de la primera cola por la segunda, hasta recibir -1
+    bench_queue_t *pair = (bench_queue_t *)arg;
+    int item;
+    while ((item = pair[0].pop(pair[0].q)) != -1) pair[1].push(pair[1].q, item);
+    return NULL;
+}
+
+static int cmp_ll(const void *a, const void *b) {
+    long long x = *(const long long *)a, y = *(const long long *)b;
+    return (x > y) - (x < y);
+}
+
+static void bench_throughput(bench_queue_t *bq) {
+    pthread_t producer;
+    long long start = now_ns();
+    pthread_create(&producer, NULL, bench_producer, bq);
+    for (int i = 0; i < BENCH_ITEMS; ++i) {
+        if (bq->pop(bq->q) != i) {
+            fprintf(stderr, "%s: elemento fuera de orden\n", bq->name);
+            exit(1);
+        }
+    }
+    pthread_join(producer, NULL);
+    double secs = (now_ns() - start) / 1e9;
+    printf("%-10s throughput: %12.0f elementos/s\n", bq->name, BENCH_ITEMS / secs);
+}
+
+static void bench_latency(bench_queue_t pair[2]) {
+    // Ida y vuelta de un elemento entre dos hilos: mide el coste de cada traspaso
+    pthread_t echo;
+    long long *rtt = malloc(sizeof(long long) * BENCH_PINGS);
+    if (!rtt) return;
+    pthread_create(&echo, NULL, bench_echo, pair);
+    for (int i = 0; i < BENCH_PINGS; ++i) {
+        long long t0 = now_ns();
+        pair[0].push(pair[0].q, i);
+        pair[1].pop(pair[1].q);
+        rtt[i] = now_ns() - t0;
+    }
+    pair[0].push(pair[0].q, -1);
+    pthread_join(echo, NULL);
+    qsort(rtt, BENCH_PINGS, sizeof(long long), cmp_ll);
+    printf("%-10s ida y vuelta: p50 %lld ns, p99 %lld ns, max %lld ns\n", pair[0].name,
+           rtt[BENCH_PINGS / 2], rtt[BENCH_PINGS * 99 / 100], rtt[BENCH_PINGS - 1]);
+    free(rtt);
+}
+
+static void bench(void) {
+    blocking_queue_t *bq[2] = {bqueue_create(BENCH_CAPACITY), bqueue_create(BENCH_CAPACITY)};
+    spsc_ring_t *ring[2] = {spsc_ring_create(BENCH_CAPACITY), spsc_ring_create(BENCH_CAPACITY)};
+    if (!bq[0] || !bq[1] || !ring[0] || !ring[1]) {
+        perror("Error al crear las colas del benchmark");
+        exit(1);
+    }
+    bench_queue_t bq_pair[2] = {{"mutex+cond", bq[0], bq_push, bq_pop}, {"mutex+cond", bq[1], bq_push, bq_pop}};
+    bench_queue_t ring_pair[2] = {{"spsc", ring[0], ring_push, ring_pop}, {"spsc", ring[1], ring_push, ring_pop}};
+
+    bench_throughput(&bq_pair[0]);
+    bench_throughput(&ring_pair[0]);
+    bench_latency(bq_pair);
+    bench_latency(ring_pair);
+
+    for (int i = 0; i < 2; ++i) {
+        bqueue_destroy(bq[i]);
+        spsc_ring_destroy(ring[i]);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        bench();
+        return 0;
+    }
+
     blocking_queue_t *bq = bqueue_create(QUEUE_CAPACITY);
     if (!bq) {
         perror("Error al crear la cola bloqueante");
@@ -122,8 +444,9 @@ int main() {
 }
 
 /*
-Compila: gcc pthreads3.c -o thread_safe_queue -lpthread
+Compila: gcc -O2 pthreads3.c -o thread_safe_queue -lpthread
 Ejecuta: ./thread_safe_queue
+         ./thread_safe_queue bench   (cola bloqueante frente a anillo SPSC)
 Explicación:
 Este bloque implementa una cola thread-safe utilizando un mutex
 para proteger el acceso a la estructura de la cola
@@ -132,4 +455,17 @@ para coordinar la actividad de los hilos productores y consumidores.
 El productor encola números y el consumidor los desencola,
 demostrando cómo los hilos pueden comunicarse de forma segura a través de la cola,
 incluso cuando la cola está llena o vacía.
+
+Anillo SPSC (spsc_ring_t):
+Para el caso de un único productor y un único consumidor no hace falta exclusión mutua.
+El anillo usa una capacidad potencia de dos y dos contadores, 'tail' (solo lo escribe el productor)
+y 'head' (solo lo escribe el consumidor), cada uno en su propia línea de caché.
+El productor escribe el elemento y publica 'tail' con semántica release;
+el consumidor lee 'tail' con acquire antes de leer el elemento.
+Cada lado guarda una copia local del contador del otro y solo la relee cuando
+el anillo parece lleno o vacío, así en régimen normal no hay tráfico de coherencia cruzado.
+
+Cuando el anillo está vacío (o lleno) el hilo espera activamente SPSC_SPIN_LIMIT iteraciones
+(ninguna si la máquina tiene un solo núcleo) y solo después duerme en una variable de condición. El otro lado solo toma el mutex
+si ve la marca de "dormido", de modo que el camino sin contención no hace ninguna llamada al sistema.
  */
\ No newline at end of file
@@ -1,68 +1,533 @@
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <unistd.h>
 
 #define INITIAL_THREADS 2
 #define MAX_THREADS 5
 #define MAX_TASKS 20
+#define WORKER_BATCH 8       // máximo de tareas que un trabajador retira de una vez
+#define DEQUE_CAPACITY 256   // tareas por deque local, potencia de dos
+#define CACHE_LINE_SIZE 64
+#define IDLE_TIMEOUT_MS 2000  // un trabajador ocioso más allá de este tiempo se retira (respetando el mínimo)
+#define GROW_LATENCY_MS 500   // si la tarea más antigua del inyector espera más que esto, se añade un hilo
+#define FUTURE_CHUNK 64       // futuros por bloque; la lista libre crece de bloque en bloque
+#define FUTURE_MAX_CHUNKS 4096 // tope de bloques por pool (262144 futuros vivos)
+
+typedef enum {
+    THREAD_POOL_RUNNING,
+    THREAD_POOL_DRAIN,  // no se aceptan tareas nuevas; se ejecutan las pendientes
+    THREAD_POOL_CANCEL  // no se aceptan tareas nuevas; las pendientes se descartan
+} thread_pool_state_t;
+
+typedef enum {
+    WORKER_FREE,    // slot sin hilo
+    WORKER_RUNNING,
+    WORKER_EXITED   // el hilo se retiró; add_worker o thread_pool_destroy harán el join
+} worker_state_t;
 
 typedef struct {
     void (*function)(void *);
     void *argument;
+    long long enqueued_ns; // instante en que entró en el inyector (lo rellena mpmc_enqueue_bulk)
 } task_t;
 
+// Cola MPMC acotada (Vyukov): cada celda lleva un número de secuencia que indica
+// si está libre para el productor de la posición 'pos' (seq == pos)
+// o lista para su consumidor (seq == pos + 1).
+typedef struct {
+    atomic_size_t seq;
+    task_t task;
+} mpmc_cell_t;
+
 typedef struct {
-    task_t *tasks;
-    int head;
-    int tail;
-    int count;
-    int capacity;
-    pthread_mutex_t queue_mutex;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t enqueue_pos;
+    _Alignas(CACHE_LINE_SIZE) atomic_size_t dequeue_pos;
+    _Alignas(CACHE_LINE_SIZE) mpmc_cell_t *cells;
+    size_t mask; // capacidad - 1, la capacidad es potencia de dos
+} mpmc_queue_t;
+
+int mpmc_queue_init(mpmc_queue_t *q, size_t capacity);
+size_t mpmc_enqueue_bulk(mpmc_queue_t *q, const task_t *tasks, size_t n);
+size_t mpmc_dequeue_bulk(mpmc_queue_t *q, task_t *tasks, size_t n);
+size_t mpmc_size(mpmc_queue_t *q);
+void mpmc_queue_destroy(mpmc_queue_t *q);
+
+// Deque Chase-Lev de capacidad fija: el dueño empuja y saca por 'bottom' (LIFO, caché caliente),
+// los ladrones roban por 'top' (FIFO) con un CAS.
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) atomic_long top;
+    _Alignas(CACHE_LINE_SIZE) atomic_long bottom;
+    _Alignas(CACHE_LINE_SIZE) task_t buffer[DEQUE_CAPACITY];
+} ws_deque_t;
+
+struct thread_pool;
+
+typedef struct {
+    ws_deque_t deque;
+    pthread_t thread;
+    struct thread_pool *pool;
+    int index;
+    unsigned rng; // estado xorshift para elegir víctimas
+    atomic_int state; // worker_state_t
+} worker_t;
+
+typedef enum {
+    FUTURE_PENDING,
+    FUTURE_DONE,
+    FUTURE_CANCELLED // descartado en un cierre THREAD_POOL_CANCEL, o su predecesor lo fue
+} future_state_t;
+
+// Grupo para esperar a varios futuros a la vez. 'pending' empieza en 1: esa unidad
+// es del propio grupo y la suelta future_group_wait, así nunca llega a 0 antes de esperar.
+typedef struct {
+    atomic_int pending;
+    int finished;           // protegido por 'mutex'
+    pthread_mutex_t mutex;
+    pthread_cond_t done;
+} future_group_t;
+
+// Resultado de una tarea enviada con thread_pool_submit_future. Los futuros viven en bloques
+// del pool y se reciclan por una lista libre; cada uno tiene dos referencias
+// al crearse (la del llamante y la de la ejecución) y vuelve a la lista al soltar ambas.
+typedef struct future {
+    atomic_int state;        // future_state_t
+    atomic_int refs;
+    atomic_int waiters;      // hilos dormidos en future_wait; sin ellos no se toma el mutex al completar
+    void *(*fn)(void *input, void *arg);
+    void *input;             // resultado del predecesor, para continuaciones
+    void *arg;
+    void *result;
+    _Atomic(struct future *) continuations; // pila de continuaciones, FUTURE_CLOSED al completar
+    struct future *next_cont;
+    future_group_t *group;
+    struct thread_pool *pool;
+    unsigned index;          // índice + 1 de este futuro en los bloques del pool
+    atomic_int next_free;    // índice + 1 del siguiente en la lista libre
+    pthread_mutex_t mutex;
+    pthread_cond_t completed;
+} future_t;
+
+#define FUTURE_CLOSED ((future_t *)1)
+
+typedef struct thread_pool {
+    mpmc_queue_t tasks;            // inyector: tareas enviadas desde fuera del pool
+    worker_t *workers;             // un deque local por trabajador
+    atomic_int idle_workers;       // trabajadores dormidos esperando tareas
+    atomic_int waiting_submitters; // productores dormidos esperando hueco
+    pthread_mutex_t queue_mutex;   // solo protege el dormir/despertar, no la cola
     pthread_cond_t queue_not_empty;
     pthread_cond_t queue_not_full;
 
-    pthread_t *threads;
-    int num_threads;
+    atomic_int num_threads;        // hilos vivos; lo leen los trabajadores sin tomar pool_mutex
+    int min_threads;               // suelo por debajo del cual los ociosos no se retiran
     int max_threads;
     pthread_mutex_t pool_mutex; // Mutex para controlar el número de hilos
+    atomic_int state;              // thread_pool_state_t
+    atomic_llong last_grow_ns;     // último crecimiento por latencia, para no crecer a ráfagas
+
+    _Atomic(future_t *) *future_chunks; // FUTURE_MAX_CHUNKS punteros; los bloques no se liberan hasta destroy
+    atomic_int future_nchunks;
+    pthread_mutex_t future_grow_mutex; // solo para añadir un bloque, nunca en el camino rápido
+    atomic_ullong future_free;     // cabeza de la lista libre: (etiqueta << 32) | (índice + 1)
+
+    // Se llama en un cierre THREAD_POOL_CANCEL por cada tarea descartada (no para los futuros)
+    void (*discard)(void (*function)(void *), void *argument);
 } thread_pool_t;
 
 void thread_pool_init(thread_pool_t *pool, int initial_threads, int max_threads, int max_tasks);
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument);
-void thread_pool_destroy(thread_pool_t *pool);
-void *worker(void *pool);
+int thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument);
+int thread_pool_submit_bulk(thread_pool_t *pool, const task_t *tasks, int n);
+int thread_pool_destroy(thread_pool_t *pool, thread_pool_state_t mode);
+void thread_pool_set_discard(thread_pool_t *pool, void (*discard)(void (*function)(void *), void *argument));
+void *worker(void *arg);
 int add_worker(thread_pool_t *pool);
 
+future_t *thread_pool_submit_future(thread_pool_t *pool, future_group_t *group,
+                                    void *(*fn)(void *input, void *arg), void *arg);
+future_t *future_then(future_t *prev, future_group_t *group,
+                      void *(*fn)(void *input, void *arg), void *arg);
+int future_wait(future_t *f, void **result);
+int future_timed_wait(future_t *f, int timeout_ms, void **result);
+void future_release(future_t *f);
+void future_group_init(future_group_t *group);
+void future_group_wait(future_group_t *group);
+void future_group_destroy(future_group_t *group);
+
+static _Thread_local worker_t *current_worker; // trabajador que ejecuta este hilo, NULL fuera del pool
+
+static thread_pool_t *demo_pool;
+
+void followup_task(void *arg) {
+    int task_id = *(int *)arg;
+    printf("Hilo %lu ejecutando continuación de la tarea %d\n", pthread_self(), task_id);
+    free(arg);
+}
+
 void execute_task(void *arg) {
     int task_id = *(int *)arg;
     printf("Hilo %lu ejecutando tarea %d\n", pthread_self(), task_id);
     sleep(rand() % 5); // Simular trabajo más largo
+    if (task_id % 2 == 0) {
+        // Continuación enviada desde el trabajador: va a su deque local
+        if (thread_pool_submit(demo_pool, followup_task, arg) == 0) return;
+    }
     free(arg);
 }
 
+void discard_task(void (*function)(void *), void *arg) {
+    // Tarea descartada en un cierre THREAD_POOL_CANCEL: execute_task y followup_task reciben un int de malloc
+    (void)function;
+    free(arg);
+}
+
+// Tubería de una llamada: parseo SDP -> negociación de códec -> reserva de puerto RTP.
+// Cada etapa es una continuación de la anterior y ningún trabajador se bloquea esperando.
+typedef struct {
+    int id;
+    int codec;    // payload type elegido
+    int rtp_port;
+} call_setup_t;
+
+static atomic_int next_rtp_port = 10000;
+
+void *parse_sdp(void *input, void *arg) {
+    (void)input;
+    call_setup_t *call = (call_setup_t *)arg;
+    printf("Hilo %lu parseando SDP de la llamada %d\n", pthread_self(), call->id);
+    usleep(100000);
+    return call;
+}
+
+void *negotiate_codec(void *input, void *arg) {
+    (void)arg;
+    call_setup_t *call = (call_setup_t *)input;
+    call->codec = call->id % 2 ? 0 : 8; // PCMU o PCMA
+    printf("Hilo %lu negociando códec de la llamada %d: PT %d\n", pthread_self(), call->id, call->codec);
+    return call;
+}
+
+void *allocate_rtp_port(void *input, void *arg) {
+    (void)arg;
+    call_setup_t *call = (call_setup_t *)input;
+    call->rtp_port = atomic_fetch_add(&next_rtp_port, 2); // RTP par, RTCP impar
+    return call;
+}
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static void mpmc_wait_seq(mpmc_cell_t *cell, size_t expected) {
+    /*
+    Espera a que otro hilo termine de copiar una celda que ya reclamó.
+    Es una espera corta (una copia de task_t); si el otro hilo fue desalojado,
+    se cede la CPU para no quemar el quantum.
+    */
+    for (int spins = 0; atomic_load_explicit(&cell->seq, memory_order_acquire) != expected; ++spins) {
+        if (spins < 64) cpu_relax();
+        else sched_yield();
+    }
+}
+
+int mpmc_queue_init(mpmc_queue_t *q, size_t capacity) {
+    /*
+    Inicializa la cola con capacidad redondeada a la siguiente potencia de dos.
+    La celda i empieza con seq = i: libre para el productor de la posición i.
+    Retorna 0 en éxito, -1 si falla la reserva de memoria.
+    */
+    size_t cap = 2;
+    while (cap < capacity) cap *= 2;
+    q->cells = malloc(sizeof(mpmc_cell_t) * cap);
+    if (!q->cells) return -1;
+    for (size_t i = 0; i < cap; ++i) atomic_init(&q->cells[i].seq, i);
+    q->mask = cap - 1;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    return 0;
+}
+
+size_t mpmc_enqueue_bulk(mpmc_queue_t *q, const task_t *tasks, size_t n) {
+    /*
+    Encola hasta n tareas con una sola operación atómica.
+
+    - Calcula el hueco libre a partir de dequeue_pos y reclama k = min(n, hueco) posiciones
+      con un único CAS sobre enqueue_pos.
+    - Todas las posiciones reclamadas ya fueron retiradas por algún consumidor
+      (dequeue_pos las superó), así que como mucho hay que esperar a que termine su copia.
+    - Escribe cada tarea, sellada con el instante de entrada, y la publica con seq = pos + 1 (release).
+    - Retorna el número de tareas encoladas; 0 si la cola está llena.
+    */
+    size_t cap = q->mask + 1;
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    size_t k;
+    for (;;) {
+        size_t head = atomic_load_explicit(&q->dequeue_pos, memory_order_acquire);
+        size_t used = pos - head;
+        if (used > cap) { // 'pos' estaba obsoleta: otro productor avanzó
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+            continue;
+        }
+        if (used == cap) return 0;
+        k = n < cap - used ? n : cap - used;
+        if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + k,
+                                                  memory_order_relaxed, memory_order_relaxed)) break;
+    }
+    long long stamp = now_ns();
+    for (size_t i = 0; i < k; ++i) {
+        mpmc_cell_t *cell = &q->cells[(pos + i) & q->mask];
+        mpmc_wait_seq(cell, pos + i);
+        cell->task.function = tasks[i].function;
+        cell->task.argument = tasks[i].argument;
+        __atomic_store_n(&cell->task.enqueued_ns, stamp, __ATOMIC_RELAXED);
+        atomic_store_explicit(&cell->seq, pos + i + 1, memory_order_release);
+    }
+    return k;
+}
+
+size_t mpmc_dequeue_bulk(mpmc_queue_t *q, task_t *tasks, size_t n) {
+    /*
+    Desencola hasta n tareas con una sola operación atómica.
+    Simétrica a mpmc_enqueue_bulk: reclama k posiciones con un CAS sobre dequeue_pos,
+    espera a que cada celda esté publicada (seq == pos + 1), la copia
+    y la libera para la siguiente vuelta (seq == pos + capacidad).
+    Retorna el número de tareas desencoladas; 0 si la cola está vacía.
+    */
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    size_t k;
+    for (;;) {
+        size_t tail = atomic_load_explicit(&q->enqueue_pos, memory_order_acquire);
+        size_t avail = tail - pos;
+        if (avail == 0) return 0;
+        if (avail > q->mask + 1) {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+            continue;
+        }
+        k = n < avail ? n : avail;
+        if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + k,
+                                                  memory_order_relaxed, memory_order_relaxed)) break;
+    }
+    for (size_t i = 0; i < k; ++i) {
+        mpmc_cell_t *cell = &q->cells[(pos + i) & q->mask];
+        mpmc_wait_seq(cell, pos + i + 1);
+        tasks[i] = cell->task;
+        atomic_store_explicit(&cell->seq, pos + i + q->mask + 1, memory_order_release);
+    }
+    return k;
+}
+
+size_t mpmc_size(mpmc_queue_t *q) {
+    /* Número aproximado de tareas reclamadas por productores y aún no por consumidores. */
+    size_t tail = atomic_load_explicit(&q->enqueue_pos, memory_order_acquire);
+    size_t head = atomic_load_explicit(&q->dequeue_pos, memory_order_acquire);
+    return tail > head ? tail - head : 0;
+}
+
+static long long mpmc_oldest_wait_ns(mpmc_queue_t *q) {
+    /*
+    Cuánto lleva esperando la tarea en la cabeza de la cola, o 0 si está vacía.
+    La lectura es optimista: si la celda cambia mientras se lee, el valor solo se subestima.
+    */
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_acquire);
+    mpmc_cell_t *cell = &q->cells[pos & q->mask];
+    if (atomic_load_explicit(&cell->seq, memory_order_acquire) != pos + 1) return 0;
+    long long stamp = __atomic_load_n(&cell->task.enqueued_ns, __ATOMIC_RELAXED);
+    long long wait = now_ns() - stamp;
+    return wait > 0 ? wait : 0;
+}
+
+void mpmc_queue_destroy(mpmc_queue_t *q) {
+    free(q->cells);
+}
+
+static int deque_push(ws_deque_t *d, task_t task) {
+    /*
+    Empuja una tarea en el extremo 'bottom'. Solo la llama el hilo dueño.
+    Retorna 0 en éxito, -1 si el deque está lleno.
+    */
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    if (b - t >= DEQUE_CAPACITY) return -1;
+    task_t *slot = &d->buffer[b & (DEQUE_CAPACITY - 1)];
+    __atomic_store_n(&slot->function, task.function, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->argument, task.argument, __ATOMIC_RELAXED);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_release); // publica el slot a los ladrones
+    return 0;
+}
+
+static int deque_pop(ws_deque_t *d, task_t *task) {
+    /*
+    Saca la tarea más reciente del extremo 'bottom'. Solo la llama el hilo dueño.
+    Si solo queda una tarea, compite con los ladrones mediante un CAS sobre 'top'.
+    Retorna 0 si obtuvo una tarea, -1 si el deque está vacío.
+    */
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+    if (t > b) {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return -1;
+    }
+    task_t *slot = &d->buffer[b & (DEQUE_CAPACITY - 1)];
+    task->function = __atomic_load_n(&slot->function, __ATOMIC_RELAXED);
+    task->argument = __atomic_load_n(&slot->argument, __ATOMIC_RELAXED);
+    if (t == b) {
+        int won = atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                          memory_order_seq_cst, memory_order_relaxed);
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return won ? 0 : -1;
+    }
+    return 0;
+}
+
+static int deque_steal(ws_deque_t *d, task_t *task) {
+    /*
+    Roba la tarea más antigua del extremo 'top'. La puede llamar cualquier hilo.
+    La tarea se lee antes del CAS; si el CAS falla, otro hilo se la llevó y la copia se descarta.
+    Retorna 0 si robó una tarea, -1 si el deque estaba vacío o perdió la carrera.
+    */
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    if (t >= b) return -1;
+    task_t *slot = &d->buffer[t & (DEQUE_CAPACITY - 1)];
+    task->function = __atomic_load_n(&slot->function, __ATOMIC_RELAXED);
+    task->argument = __atomic_load_n(&slot->argument, __ATOMIC_RELAXED);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) return -1;
+    return 0;
+}
+
+static long deque_size(ws_deque_t *d) {
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    return b > t ? b - t : 0;
+}
+
+static int pool_has_work(thread_pool_t *pool) {
+    /* Hay trabajo si el inyector o algún deque local no están vacíos. */
+    if (mpmc_size(&pool->tasks) > 0) return 1;
+    for (int i = 0; i < pool->max_threads; ++i) {
+        if (deque_size(&pool->workers[i].deque) > 0) return 1;
+    }
+    return 0;
+}
+
+static future_t *future_at(thread_pool_t *pool, unsigned idx) {
+    /* Futuro de índice + 1 'idx'. El bloque se publicó antes de que su índice entrara en la lista libre. */
+    future_t *chunk = atomic_load_explicit(&pool->future_chunks[(idx - 1) / FUTURE_CHUNK], memory_order_acquire);
+    return &chunk[(idx - 1) % FUTURE_CHUNK];
+}
+
+static int future_grow(thread_pool_t *pool) {
+    /*
+    Añade un bloque de FUTURE_CHUNK futuros a la lista libre.
+
+    - Lo serializa 'future_grow_mutex'; si al tomarlo la lista ya no está vacía,
+      otro hilo creció entretanto y no se hace nada.
+    - El bloque se inicializa encadenado, se publica en 'future_chunks' y se empuja
+      entero a la pila con un solo CAS. Los bloques no se mueven ni se liberan hasta
+      thread_pool_destroy, así que un puntero a futuro es válido mientras viva el pool.
+    - Retorna 0 si hay futuros libres, -1 si se alcanzó FUTURE_MAX_CHUNKS o falla la memoria.
+    */
+    int ret = 0;
+    pthread_mutex_lock(&pool->future_grow_mutex);
+    unsigned long long head = atomic_load_explicit(&pool->future_free, memory_order_acquire);
+    int n = atomic_load_explicit(&pool->future_nchunks, memory_order_relaxed);
+    future_t *chunk = NULL;
+    if ((unsigned)head == 0) {
+        chunk = n < FUTURE_MAX_CHUNKS ? malloc(sizeof(future_t) * FUTURE_CHUNK) : NULL;
+        if (!chunk) ret = -1;
+    }
+    if (chunk) {
+        unsigned first = (unsigned)n * FUTURE_CHUNK + 1;
+        for (int i = 0; i < FUTURE_CHUNK; ++i) {
+            future_t *f = &chunk[i];
+            f->pool = pool;
+            f->index = first + i;
+            atomic_init(&f->state, FUTURE_DONE);
+            atomic_init(&f->refs, 0);
+            atomic_init(&f->waiters, 0);
+            atomic_init(&f->continuations, FUTURE_CLOSED);
+            atomic_init(&f->next_free, i + 1 < FUTURE_CHUNK ? (int)(first + i + 1) : 0);
+            pthread_mutex_init(&f->mutex, NULL);
+            pthread_cond_init(&f->completed, NULL);
+        }
+        atomic_store_explicit(&pool->future_chunks[n], chunk, memory_order_release);
+        atomic_store_explicit(&pool->future_nchunks, n + 1, memory_order_relaxed);
+        unsigned long long next;
+        do {
+            atomic_store_explicit(&chunk[FUTURE_CHUNK - 1].next_free, (int)(unsigned)head, memory_order_relaxed);
+            next = ((head >> 32) + 1) << 32 | first;
+        } while (!atomic_compare_exchange_weak_explicit(&pool->future_free, &head, next,
+                                                        memory_order_release, memory_order_relaxed));
+    }
+    pthread_mutex_unlock(&pool->future_grow_mutex);
+    return ret;
+}
+
 void thread_pool_init(thread_pool_t *pool, int initial_threads, int max_threads, int max_tasks) {
     /*
     Inicializa la estructura del thread pool con soporte para redimensionamiento dinámico.
 
-    - Asigna memoria para la cola de tareas y los hilos.
-    - Inicializa los mutexes para la cola y el pool de hilos.
+    - Inicializa la cola MPMC de tareas (capacidad redondeada a potencia de dos), que hace de inyector
+      para las tareas enviadas desde fuera del pool.
+    - Reserva un worker_t con su deque local para cada hilo posible (hasta max_threads),
+      de modo que los ladrones nunca ven un deque sin inicializar.
+    - Inicializa los mutexes para dormir/despertar y para el pool de hilos.
     - Inicializa las variables de condición para la cola.
-    - Establece la capacidad máxima de la cola y el número máximo de hilos.
+    - Establece el número máximo de hilos. El número inicial es también el mínimo:
+      los trabajadores ociosos se retiran tras IDLE_TIMEOUT_MS, pero nunca por debajo de él.
     - Crea el número inicial de hilos trabajadores y los inicia.
     */
-    pool->capacity = max_tasks;
-    pool->tasks = malloc(sizeof(task_t) * pool->capacity);
-    if (!pool->tasks) perror("malloc tasks failed");
-    pool->head = pool->tail = pool->count = 0;
+    if (mpmc_queue_init(&pool->tasks, max_tasks) != 0) perror("malloc tasks failed");
+    atomic_init(&pool->idle_workers, 0);
+    atomic_init(&pool->waiting_submitters, 0);
     pthread_mutex_init(&pool->queue_mutex, NULL);
     pthread_cond_init(&pool->queue_not_empty, NULL);
     pthread_cond_init(&pool->queue_not_full, NULL);
 
+    pool->min_threads = initial_threads;
     pool->max_threads = max_threads;
-    pool->num_threads = 0;
-    pool->threads = malloc(sizeof(pthread_t) * pool->max_threads);
-    if (!pool->threads) perror("malloc threads failed");
+    atomic_init(&pool->num_threads, 0);
+    atomic_init(&pool->state, THREAD_POOL_RUNNING);
+    atomic_init(&pool->last_grow_ns, 0);
+    pool->discard = NULL;
+    pool->future_chunks = calloc(FUTURE_MAX_CHUNKS, sizeof(*pool->future_chunks));
+    atomic_init(&pool->future_nchunks, 0);
+    atomic_init(&pool->future_free, 0);
+    pthread_mutex_init(&pool->future_grow_mutex, NULL);
+    if (!pool->future_chunks || future_grow(pool) != 0) {
+        perror("Error al asignar memoria para los futuros");
+        exit(EXIT_FAILURE);
+    }
+    pool->workers = aligned_alloc(CACHE_LINE_SIZE, sizeof(worker_t) * pool->max_threads);
+    if (!pool->workers) perror("malloc threads failed");
+    for (int i = 0; i < pool->max_threads; ++i) {
+        worker_t *w = &pool->workers[i];
+        atomic_init(&w->deque.top, 0);
+        atomic_init(&w->deque.bottom, 0);
+        w->pool = pool;
+        w->index = i;
+        w->rng = 2463534242u * (i + 1);
+        atomic_init(&w->state, WORKER_FREE);
+    }
     pthread_mutex_init(&pool->pool_mutex, NULL);
 
     for (int i = 0; i < initial_threads; ++i) {
@@ -73,38 +538,120 @@ void thread_pool_init(thread_pool_t *pool, int initial_threads, int max_threads,
     }
 }
 
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument) {
+static void wake_workers(thread_pool_t *pool, size_t n) {
     /*
-    Añade una tarea a la cola del thread pool y gestiona el redimensionamiento dinámico.
+    Despierta hasta n trabajadores dormidos tras encolar n tareas.
+    Si ninguno duerme (caso habitual bajo carga) no se toca el mutex ni se hace ninguna llamada al sistema.
+    La barrera seq_cst empareja con la de worker antes de dormir: o el trabajador ve la tarea
+    o el productor ve 'idle_workers' > 0.
+    */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pool->idle_workers, memory_order_relaxed) == 0) return;
+    pthread_mutex_lock(&pool->queue_mutex);
+    if (n > 1) pthread_cond_broadcast(&pool->queue_not_empty);
+    else pthread_cond_signal(&pool->queue_not_empty);
+    pthread_mutex_unlock(&pool->queue_mutex);
+}
 
-    - Bloquea el mutex de la cola.
-    - Espera si la cola está llena.
-    - Añade la tarea a la cola.
-    - Incrementa el contador de tareas.
-    - Señala que la cola ya no está vacía.
-    - Comprueba si la cola está llena y si el número actual de hilos es menor que el máximo.
-      Si ambas condiciones son verdaderas, intenta añadir un nuevo hilo trabajador.
-    - Desbloquea el mutex de la cola.
+static void maybe_grow(thread_pool_t *pool) {
+    /*
+    Decide el crecimiento por latencia de cola y no por "cola exactamente llena":
+    si la tarea más antigua del inyector lleva esperando más de GROW_LATENCY_MS
+    y hay margen hasta max_threads, se añade un hilo. Como mucho se crece una vez
+    por cada GROW_LATENCY_MS, para dar tiempo al nuevo hilo a notar su efecto.
+    Durante el cierre no se crece: en DRAIN los trabajadores siguen pasando por aquí.
     */
+    if (atomic_load_explicit(&pool->state, memory_order_acquire) != THREAD_POOL_RUNNING) return;
+    if (atomic_load_explicit(&pool->num_threads, memory_order_relaxed) >= pool->max_threads) return;
+    long long wait = mpmc_oldest_wait_ns(&pool->tasks);
+    long long threshold = (long long)GROW_LATENCY_MS * 1000000LL;
+    if (wait < threshold) return;
+    long long now = now_ns();
+    long long last = atomic_load_explicit(&pool->last_grow_ns, memory_order_relaxed);
+    if (now - last < threshold) return;
+    if (!atomic_compare_exchange_strong(&pool->last_grow_ns, &last, now)) return;
+    printf("Redimensionando pool: la tarea más antigua espera %lld ms, añadiendo un hilo (actualmente %d)\n",
+           wait / 1000000, atomic_load(&pool->num_threads));
+    add_worker(pool);
+}
+
+static void wake_submitters(thread_pool_t *pool) {
+    /* Igual que wake_workers, para los productores que esperan hueco en la cola. */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&pool->waiting_submitters, memory_order_relaxed) == 0) return;
     pthread_mutex_lock(&pool->queue_mutex);
-    while (pool->count == pool->capacity) {
-        pthread_cond_wait(&pool->queue_not_full, &pool->queue_mutex);
-    }
-    pool->tasks[pool->tail].function = function;
-    pool->tasks[pool->tail].argument = argument;
-    pool->tail = (pool->tail + 1) % pool->capacity;
-    pool->count++;
-    pthread_cond_signal(&pool->queue_not_empty);
-
-    if (pool->count == pool->capacity && pool->num_threads < pool->max_threads) {
-        pthread_mutex_lock(&pool->pool_mutex);
-        if (pool->num_threads < pool->max_threads) {
-            printf("Redimensionando pool: añadiendo un nuevo hilo (actualmente %d)\n", pool->num_threads);
+    pthread_cond_broadcast(&pool->queue_not_full);
+    pthread_mutex_unlock(&pool->queue_mutex);
+}
+
+int thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument) {
+    /*
+    Añade una tarea al pool. Retorna 0 en éxito, -1 si el pool se está cerrando.
+
+    - Si la llama un trabajador de este mismo pool (por ejemplo, la continuación
+      de una transacción SIP), la tarea va a su deque local: la ejecutará él mismo
+      con los datos aún en su caché, salvo que otro trabajador ocioso se la robe.
+    - Si el deque local está lleno, la tarea va al inyector sin esperar; y si este también lo está,
+      el trabajador la ejecuta en línea, porque bloquearse esperando hueco podría dejar
+      a todos los trabajadores esperándose entre sí.
+    - Desde fuera del pool equivale a thread_pool_submit_bulk con una sola tarea.
+    */
+    task_t task = {function, argument, 0};
+    worker_t *self = current_worker;
+    if (atomic_load_explicit(&pool->state, memory_order_acquire) == THREAD_POOL_CANCEL) return -1;
+    if (self && self->pool == pool) {
+        // En modo DRAIN las continuaciones de tareas pendientes se siguen aceptando
+        if (deque_push(&self->deque, task) == 0 || mpmc_enqueue_bulk(&pool->tasks, &task, 1) == 1) {
+            wake_workers(pool, 1);
+        } else {
+            task.function(task.argument);
+        }
+        return 0;
+    }
+    return thread_pool_submit_bulk(pool, &task, 1) < 0 ? -1 : 0;
+}
+
+int thread_pool_submit_bulk(thread_pool_t *pool, const task_t *tasks, int n) {
+    /*
+    Añade n tareas a la cola del thread pool y gestiona el redimensionamiento dinámico.
+
+    - Rechaza las tareas si el pool se está cerrando.
+    - Encola tantas tareas como quepan con una sola operación atómica (mpmc_enqueue_bulk)
+      y despierta a los trabajadores dormidos, si los hay.
+    - Comprueba la latencia de la cola (maybe_grow) por si hace falta otro hilo.
+    - Si la cola está llena y el número actual de hilos es menor que el máximo,
+      intenta añadir un nuevo hilo trabajador.
+    - Mientras siga llena, espera en 'queue_not_full' y reintenta con las tareas restantes.
+    - Retorna el número de tareas encoladas si fueron todas, o -1 si el cierre interrumpió el envío.
+    */
+    int done = 0;
+    while (done < n) {
+        if (atomic_load_explicit(&pool->state, memory_order_acquire) != THREAD_POOL_RUNNING) return -1;
+        size_t k = mpmc_enqueue_bulk(&pool->tasks, tasks + done, n - done);
+        if (k > 0) {
+            done += k;
+            wake_workers(pool, k);
+            maybe_grow(pool);
+            continue;
+        }
+
+        if (atomic_load(&pool->num_threads) < pool->max_threads) {
+            printf("Redimensionando pool: cola llena, añadiendo un nuevo hilo (actualmente %d)\n",
+                   atomic_load(&pool->num_threads));
             add_worker(pool);
         }
-        pthread_mutex_unlock(&pool->pool_mutex);
+
+        pthread_mutex_lock(&pool->queue_mutex);
+        atomic_fetch_add_explicit(&pool->waiting_submitters, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (mpmc_size(&pool->tasks) > pool->tasks.mask &&
+               atomic_load(&pool->state) == THREAD_POOL_RUNNING) {
+            pthread_cond_wait(&pool->queue_not_full, &pool->queue_mutex);
+        }
+        atomic_fetch_sub_explicit(&pool->waiting_submitters, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&pool->queue_mutex);
     }
-    pthread_mutex_unlock(&pool->queue_mutex);
+    return done;
 }
 
 int add_worker(thread_pool_t *pool) {
@@ -112,87 +659,462 @@ int add_worker(thread_pool_t *pool) {
     Añade un nuevo hilo trabajador al pool.
 
     - Bloquea el mutex del pool para modificar el número de hilos.
+    - Busca un slot libre; si el hilo anterior de ese slot se retiró, hace su join primero.
+      El deque de un hilo retirado siempre está vacío, así que se reutiliza tal cual.
     - Crea un nuevo hilo que ejecuta la función 'worker'.
     - Incrementa el contador de hilos.
     - Desbloquea el mutex del pool.
     - Retorna 0 en éxito, -1 en error.
     */
     pthread_mutex_lock(&pool->pool_mutex);
-    if (pool->num_threads < pool->max_threads) {
-        if (pthread_create(&pool->threads[pool->num_threads], NULL, worker, pool) == 0) {
-            pool->num_threads++;
-            pthread_mutex_unlock(&pool->pool_mutex);
-            return 0;
-        } else {
+    if (atomic_load(&pool->num_threads) < pool->max_threads &&
+        atomic_load(&pool->state) == THREAD_POOL_RUNNING) {
+        for (int i = 0; i < pool->max_threads; ++i) {
+            worker_t *w = &pool->workers[i];
+            int state = atomic_load(&w->state);
+            if (state == WORKER_RUNNING) continue;
+            if (state == WORKER_EXITED) pthread_join(w->thread, NULL);
+            atomic_store(&w->state, WORKER_RUNNING);
+            atomic_fetch_add(&pool->num_threads, 1);
+            if (pthread_create(&w->thread, NULL, worker, w) == 0) {
+                pthread_mutex_unlock(&pool->pool_mutex);
+                return 0;
+            }
             perror("Error al crear un nuevo hilo trabajador");
-            pthread_mutex_unlock(&pool->pool_mutex);
-            return -1;
+            atomic_store(&w->state, WORKER_FREE);
+            atomic_fetch_sub(&pool->num_threads, 1);
+            break;
         }
     }
     pthread_mutex_unlock(&pool->pool_mutex);
     return -1; // No se pueden añadir más hilos
 }
 
-void *worker(void *pool) {
+static int try_retire(thread_pool_t *pool) {
+    /* Descuenta este hilo si el pool sigue por encima del mínimo. Retorna 1 si puede retirarse. */
+    int n = atomic_load(&pool->num_threads);
+    while (n > pool->min_threads) {
+        if (atomic_compare_exchange_weak(&pool->num_threads, &n, n - 1)) return 1;
+    }
+    return 0;
+}
+
+static int steal_task(worker_t *self, task_t *task) {
+    /*
+    Intenta robar una tarea a otro trabajador, empezando por una víctima aleatoria
+    para repartir la presión entre deques y no atacar siempre al mismo.
+    */
+    thread_pool_t *p = self->pool;
+    int n = p->max_threads;
+    if (n < 2) return -1;
+    self->rng ^= self->rng << 13;
+    self->rng ^= self->rng >> 17;
+    self->rng ^= self->rng << 5;
+    int start = self->rng % n;
+    for (int i = 0; i < n; ++i) {
+        int victim = (start + i) % n;
+        if (victim == self->index) continue;
+        if (deque_steal(&p->workers[victim].deque, task) == 0) return 0;
+    }
+    return -1;
+}
+
+void *worker(void *arg) {
     /*
     Función que ejecuta cada hilo trabajador del pool.
 
     - Entra en un bucle infinito para procesar tareas.
-    - Bloquea el mutex de la cola.
-    - Espera hasta que haya una tarea disponible o se indique el cierre.
-    - Obtiene una tarea de la cola.
-    - Desbloquea el mutex de la cola.
-    - Ejecuta la tarea.
+    - Primero saca de su deque local (lo más reciente, con la caché aún caliente).
+    - Si está vacío, retira del inyector un lote con una sola operación atómica:
+      ejecuta la primera tarea y deja el resto en su deque, donde otros pueden robarlas.
+      El lote es una parte proporcional del inyector (hasta WORKER_BATCH).
+    - Si el inyector también está vacío, intenta robar a otros trabajadores.
+    - Si no hay trabajo en ningún sitio, se anota en 'idle_workers' y duerme hasta que lo haya,
+      con un tiempo máximo de IDLE_TIMEOUT_MS. Si vence y el pool está por encima del mínimo,
+      el hilo se retira.
+    - Despierta a los productores que esperan hueco en el inyector, si los hay.
+    - En cierre THREAD_POOL_CANCEL sale tras la tarea en curso; en THREAD_POOL_DRAIN
+      sale cuando ya no queda trabajo en ningún sitio.
     */
-    thread_pool_t *p = (thread_pool_t *)pool;
+    worker_t *self = (worker_t *)arg;
+    thread_pool_t *p = self->pool;
+    task_t batch[WORKER_BATCH];
+    task_t task;
+    current_worker = self;
     while (1) {
+        int state = atomic_load_explicit(&p->state, memory_order_acquire);
+        if (state == THREAD_POOL_CANCEL) break;
+
+        if (deque_pop(&self->deque, &task) == 0) {
+            task.function(task.argument);
+            continue;
+        }
+
+        int n = atomic_load_explicit(&p->num_threads, memory_order_relaxed);
+        size_t want = mpmc_size(&p->tasks) / (n > 0 ? n : 1);
+        if (want < 1) want = 1;
+        if (want > WORKER_BATCH) want = WORKER_BATCH;
+
+        maybe_grow(p);
+        size_t k = mpmc_dequeue_bulk(&p->tasks, batch, want);
+        if (k > 0) {
+            wake_submitters(p);
+            for (size_t i = 1; i < k; ++i) {
+                if (deque_push(&self->deque, batch[i]) != 0) batch[i].function(batch[i].argument);
+            }
+            if (k > 1) wake_workers(p, k - 1);
+            batch[0].function(batch[0].argument);
+            continue;
+        }
+
+        if (steal_task(self, &task) == 0) {
+            task.function(task.argument);
+            continue;
+        }
+
+        if (state == THREAD_POOL_DRAIN && !pool_has_work(p)) break;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += IDLE_TIMEOUT_MS / 1000;
+        deadline.tv_nsec += (long)(IDLE_TIMEOUT_MS % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        int retire = 0;
         pthread_mutex_lock(&p->queue_mutex);
-        while (p->count == 0) {
-            pthread_cond_wait(&p->queue_not_empty, &p->queue_mutex);
+        atomic_fetch_add_explicit(&p->idle_workers, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (!pool_has_work(p) && atomic_load(&p->state) == THREAD_POOL_RUNNING) {
+            if (pthread_cond_timedwait(&p->queue_not_empty, &p->queue_mutex, &deadline) == ETIMEDOUT) {
+                retire = !pool_has_work(p) && try_retire(p);
+                break;
+            }
         }
-        task_t task = p->tasks[p->head];
-        p->head = (p->head + 1) % p->capacity;
-        p->count--;
-        pthread_cond_signal(&p->queue_not_full);
+        atomic_fetch_sub_explicit(&p->idle_workers, 1, memory_order_relaxed);
         pthread_mutex_unlock(&p->queue_mutex);
-        task.function(task.argument);
+
+        if (retire) {
+            printf("Hilo %lu se retira por inactividad (quedan %d)\n", pthread_self(), atomic_load(&p->num_threads));
+            atomic_store(&self->state, WORKER_EXITED);
+            return NULL;
+        }
     }
+    // Cierre: thread_pool_destroy hará el join de este hilo
     return NULL;
 }
 
-void thread_pool_destroy(thread_pool_t *pool) {
+static future_t *future_alloc(thread_pool_t *pool) {
+    /*
+    Saca un futuro de la lista libre (pila de Treiber).
+    La etiqueta de los 32 bits altos cambia en cada operación y evita el problema ABA.
+    Si la lista está vacía, añade un bloque de FUTURE_CHUNK futuros (future_grow) y reintenta.
+    Retorna NULL solo si se alcanzó FUTURE_MAX_CHUNKS o falla la memoria.
+    */
+    unsigned long long head = atomic_load_explicit(&pool->future_free, memory_order_acquire);
+    for (;;) {
+        unsigned idx = (unsigned)head;
+        if (idx == 0) {
+            if (future_grow(pool) != 0) return NULL;
+            head = atomic_load_explicit(&pool->future_free, memory_order_acquire);
+            continue;
+        }
+        future_t *f = future_at(pool, idx);
+        unsigned long long next = ((head >> 32) + 1) << 32 |
+                                  (unsigned)atomic_load_explicit(&f->next_free, memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&pool->future_free, &head, next,
+                                                  memory_order_acquire, memory_order_acquire)) {
+            return f;
+        }
+    }
+}
+
+void future_release(future_t *f) {
+    /* Suelta una referencia; la última devuelve el futuro a la lista libre. */
+    if (atomic_fetch_sub_explicit(&f->refs, 1, memory_order_acq_rel) != 1) return;
+    thread_pool_t *pool = f->pool;
+    unsigned long long head = atomic_load_explicit(&pool->future_free, memory_order_relaxed);
+    unsigned long long next;
+    do {
+        atomic_store_explicit(&f->next_free, (int)(unsigned)head, memory_order_relaxed);
+        next = ((head >> 32) + 1) << 32 | f->index;
+    } while (!atomic_compare_exchange_weak_explicit(&pool->future_free, &head, next,
+                                                    memory_order_release, memory_order_relaxed));
+}
+
+static future_t *future_prepare(thread_pool_t *pool, future_group_t *group,
+                                void *(*fn)(void *input, void *arg), void *arg) {
+    future_t *f = future_alloc(pool);
+    if (!f) return NULL;
+    f->fn = fn;
+    f->input = NULL;
+    f->arg = arg;
+    f->result = NULL;
+    f->next_cont = NULL;
+    f->group = group;
+    atomic_store_explicit(&f->refs, 2, memory_order_relaxed); // llamante + ejecución
+    atomic_store_explicit(&f->continuations, NULL, memory_order_relaxed);
+    atomic_store_explicit(&f->state, FUTURE_PENDING, memory_order_release);
+    if (group) atomic_fetch_add_explicit(&group->pending, 1, memory_order_relaxed);
+    return f;
+}
+
+static void future_run(void *arg);
+
+static void future_complete(future_t *f, future_state_t state) {
+    /*
+    Publica el resultado de un futuro.
+
+    - Cambia el estado (release: quien vea DONE ve también 'result').
+    - Cierra la pila de continuaciones y las envía al pool con el resultado como entrada;
+      si este futuro se canceló, o el pool ya no acepta tareas, las cancela en cascada.
+    - Descuenta el futuro de su grupo y despierta a los hilos que esperan en él, si los hay.
+    - Suelta la referencia de la ejecución.
+    */
+    atomic_store_explicit(&f->state, state, memory_order_release);
+    future_t *cont = atomic_exchange_explicit(&f->continuations, FUTURE_CLOSED, memory_order_acq_rel);
+    while (cont) {
+        future_t *next = cont->next_cont;
+        if (state == FUTURE_DONE) {
+            cont->input = f->result;
+            if (thread_pool_submit(f->pool, future_run, cont) != 0) future_complete(cont, FUTURE_CANCELLED);
+        } else {
+            future_complete(cont, FUTURE_CANCELLED);
+        }
+        cont = next;
+    }
+
+    future_group_t *group = f->group;
+    if (group && atomic_fetch_sub_explicit(&group->pending, 1, memory_order_acq_rel) == 1) {
+        pthread_mutex_lock(&group->mutex);
+        group->finished = 1;
+        pthread_cond_broadcast(&group->done);
+        pthread_mutex_unlock(&group->mutex);
+    }
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&f->waiters, memory_order_relaxed) > 0) {
+        pthread_mutex_lock(&f->mutex);
+        pthread_cond_broadcast(&f->completed);
+        pthread_mutex_unlock(&f->mutex);
+    }
+    future_release(f);
+}
+
+static void future_run(void *arg) {
+    future_t *f = (future_t *)arg;
+    f->result = f->fn(f->input, f->arg);
+    future_complete(f, FUTURE_DONE);
+}
+
+future_t *thread_pool_submit_future(thread_pool_t *pool, future_group_t *group,
+                                    void *(*fn)(void *input, void *arg), void *arg) {
+    /*
+    Envía fn(NULL, arg) al pool y retorna un futuro con su resultado.
+
+    - El futuro sale de la lista libre del pool: solo hay malloc cuando hace falta otro bloque.
+    - Si se pasa un grupo, future_group_wait esperará también a este futuro.
+    - Retorna NULL si no hay memoria para más futuros o si el pool se está cerrando.
+    - El llamante debe soltar el futuro con future_release cuando ya no lo use.
+    */
+    future_t *f = future_prepare(pool, group, fn, arg);
+    if (!f) return NULL;
+    if (thread_pool_submit(pool, future_run, f) != 0) {
+        if (group) atomic_fetch_sub_explicit(&group->pending, 1, memory_order_relaxed);
+        atomic_store_explicit(&f->refs, 1, memory_order_relaxed);
+        future_release(f);
+        return NULL;
+    }
+    return f;
+}
+
+future_t *future_then(future_t *prev, future_group_t *group,
+                      void *(*fn)(void *input, void *arg), void *arg) {
+    /*
+    Encadena fn(resultado de prev, arg) para cuando prev termine, sin bloquear a nadie.
+
+    - La continuación se apila en prev con un CAS; quien complete prev la envía al pool
+      (desde un trabajador va a su deque local, con el resultado aún en caché).
+    - Si prev ya terminó, se envía directamente.
+    - Si prev se cancela, la continuación también.
+    - Retorna NULL si no quedan futuros libres.
+    */
+    future_t *f = future_prepare(prev->pool, group, fn, arg);
+    if (!f) return NULL;
+    future_t *head = atomic_load_explicit(&prev->continuations, memory_order_acquire);
+    while (head != FUTURE_CLOSED) {
+        f->next_cont = head;
+        if (atomic_compare_exchange_weak_explicit(&prev->continuations, &head, f,
+                                                  memory_order_release, memory_order_acquire)) {
+            return f;
+        }
+    }
+    // prev ya está completo: su estado y resultado son visibles tras ver FUTURE_CLOSED
+    if (atomic_load_explicit(&prev->state, memory_order_acquire) == FUTURE_DONE) {
+        f->input = prev->result;
+        if (thread_pool_submit(prev->pool, future_run, f) != 0) future_complete(f, FUTURE_CANCELLED);
+    } else {
+        future_complete(f, FUTURE_CANCELLED);
+    }
+    return f;
+}
+
+int future_timed_wait(future_t *f, int timeout_ms, void **result) {
+    /*
+    Espera a que el futuro termine, como mucho timeout_ms (negativo: sin límite).
+
+    - Camino rápido: si ya terminó, no se toma ningún lock.
+    - Si no, se anota en 'waiters' y duerme en la condición del futuro.
+    - Retorna 0 y deja el resultado en *result (si no es NULL), ECANCELED si se canceló
+      o ETIMEDOUT si venció el plazo.
+    - No conviene llamarla desde un trabajador: bloquea el hilo; use future_then.
+    */
+    int state = atomic_load_explicit(&f->state, memory_order_acquire);
+    if (state == FUTURE_PENDING) {
+        struct timespec deadline;
+        if (timeout_ms >= 0) {
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec += timeout_ms / 1000;
+            deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000;
+            if (deadline.tv_nsec >= 1000000000) {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000;
+            }
+        }
+        pthread_mutex_lock(&f->mutex);
+        atomic_fetch_add_explicit(&f->waiters, 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        while ((state = atomic_load_explicit(&f->state, memory_order_acquire)) == FUTURE_PENDING) {
+            if (timeout_ms < 0) {
+                pthread_cond_wait(&f->completed, &f->mutex);
+            } else if (pthread_cond_timedwait(&f->completed, &f->mutex, &deadline) == ETIMEDOUT) {
+                state = atomic_load_explicit(&f->state, memory_order_acquire);
+                break;
+            }
+        }
+        atomic_fetch_sub_explicit(&f->waiters, 1, memory_order_relaxed);
+        pthread_mutex_unlock(&f->mutex);
+        if (state == FUTURE_PENDING) return ETIMEDOUT;
+    }
+    if (state == FUTURE_CANCELLED) return ECANCELED;
+    if (result) *result = f->result;
+    return 0;
+}
+
+int future_wait(future_t *f, void **result) {
+    /* Espera sin límite. Retorna 0 o ECANCELED. */
+    return future_timed_wait(f, -1, result);
+}
+
+void future_group_init(future_group_t *group) {
+    atomic_init(&group->pending, 1);
+    group->finished = 0;
+    pthread_mutex_init(&group->mutex, NULL);
+    pthread_cond_init(&group->done, NULL);
+}
+
+void future_group_wait(future_group_t *group) {
+    /*
+    Espera a que terminen (o se cancelen) todos los futuros del grupo.
+    Suelta la unidad propia del grupo; quien deje 'pending' a 0 marca 'finished'
+    bajo el mutex, así que al volver ningún hilo sigue tocando el grupo
+    y puede destruirse. Un grupo se espera una sola vez.
+    */
+    if (atomic_fetch_sub_explicit(&group->pending, 1, memory_order_acq_rel) == 1) return;
+    pthread_mutex_lock(&group->mutex);
+    while (!group->finished) pthread_cond_wait(&group->done, &group->mutex);
+    pthread_mutex_unlock(&group->mutex);
+}
+
+void future_group_destroy(future_group_t *group) {
+    pthread_mutex_destroy(&group->mutex);
+    pthread_cond_destroy(&group->done);
+}
+
+void thread_pool_set_discard(thread_pool_t *pool, void (*discard)(void (*function)(void *), void *argument)) {
+    /* Registra el callback que recibe las tareas descartadas en un cierre THREAD_POOL_CANCEL. */
+    pool->discard = discard;
+}
+
+static void discard_task_of(thread_pool_t *pool, task_t *task) {
+    if (task->function == future_run) future_complete(task->argument, FUTURE_CANCELLED);
+    else if (pool->discard) pool->discard(task->function, task->argument);
+}
+
+int thread_pool_destroy(thread_pool_t *pool, thread_pool_state_t mode) {
     /*
     Destruye el thread pool.
 
-    - Bloquea el mutex de la cola.
-    - Señala a todos los hilos que deben terminar (esto requeriría un mecanismo más sofisticado
-      para una terminación limpia, como una bandera 'shutdown' y una condición).
-    - Desbloquea el mutex de la cola.
-    - Espera a que todos los hilos terminen.
-    - Libera la memoria asignada.
+    - Cambia el estado a 'mode' (THREAD_POOL_DRAIN o THREAD_POOL_CANCEL): desde ese momento
+      thread_pool_submit rechaza las tareas externas.
+    - El estado cambia con 'pool_mutex' tomado, así ningún add_worker en curso crea hilos después;
+      el mutex se suelta antes de los joins, porque un trabajador puede estar esperándolo.
+    - Despierta a todos los hilos trabajadores y a los productores que esperan hueco.
+    - Espera a que todos los hilos terminen: en DRAIN después de ejecutar todo lo pendiente,
+      en CANCEL después de la tarea que estén ejecutando.
+    - En CANCEL descarta las tareas que quedaron sin ejecutar y pasa cada una al callback de
+      thread_pool_set_discard, si hay, para que libere su argumento; sin callback, los argumentos
+      siguen siendo del llamante. Los futuros descartados (y sus continuaciones) se marcan
+      FUTURE_CANCELLED, así que nadie queda esperándolos; su 'arg' lo recupera quien reciba ECANCELED.
+    - Libera la memoria asignada. Los futuros deben haberse soltado antes.
     - Destruye los mutexes y las condiciones.
+    - Retorna el número de tareas descartadas.
     */
+    pthread_mutex_lock(&pool->pool_mutex); // ningún add_worker concurrente
     pthread_mutex_lock(&pool->queue_mutex);
-    // En una implementación real, se necesitaría una forma de indicar a los hilos que terminen
-    // de forma más elegante (ej. estableciendo pool->shutdown = 1 y señalando la condición).
-    pthread_cond_broadcast(&pool->queue_not_empty); // Despertar a los hilos para que comprueben la condición de cierre
+    atomic_store(&pool->state, mode == THREAD_POOL_CANCEL ? THREAD_POOL_CANCEL : THREAD_POOL_DRAIN);
+    pthread_cond_broadcast(&pool->queue_not_empty);
+    pthread_cond_broadcast(&pool->queue_not_full);
     pthread_mutex_unlock(&pool->queue_mutex);
+    pthread_mutex_unlock(&pool->pool_mutex);
+
+    // Fuera de RUNNING add_worker ya no toca 'workers': se puede recorrer sin el mutex
+    for (int i = 0; i < pool->max_threads; ++i) {
+        if (atomic_load(&pool->workers[i].state) != WORKER_FREE) {
+            pthread_join(pool->workers[i].thread, NULL);
+        }
+    }
 
-    for (int i = 0; i < pool->num_threads; ++i) {
-        pthread_join(pool->threads[i], NULL);
+    int discarded = 0;
+    task_t task;
+    while (mpmc_dequeue_bulk(&pool->tasks, &task, 1) == 1) {
+        discard_task_of(pool, &task);
+        discarded++;
+    }
+    for (int i = 0; i < pool->max_threads; ++i) {
+        while (deque_steal(&pool->workers[i].deque, &task) == 0) {
+            discard_task_of(pool, &task);
+            discarded++;
+        }
+    }
+    int nchunks = atomic_load(&pool->future_nchunks);
+    for (int c = 0; c < nchunks; ++c) {
+        future_t *chunk = atomic_load(&pool->future_chunks[c]);
+        for (int i = 0; i < FUTURE_CHUNK; ++i) {
+            pthread_mutex_destroy(&chunk[i].mutex);
+            pthread_cond_destroy(&chunk[i].completed);
+        }
+        free(chunk);
     }
+    free(pool->future_chunks);
+    pthread_mutex_destroy(&pool->future_grow_mutex);
 
-    free(pool->tasks);
-    free(pool->threads);
+    mpmc_queue_destroy(&pool->tasks);
+    free(pool->workers);
     pthread_mutex_destroy(&pool->queue_mutex);
     pthread_cond_destroy(&pool->queue_not_empty);
     pthread_cond_destroy(&pool->queue_not_full);
     pthread_mutex_destroy(&pool->pool_mutex);
+    return discarded;
 }
 
 int main() {
     thread_pool_t pool;
     thread_pool_init(&pool, INITIAL_THREADS, MAX_THREADS, MAX_TASKS);
+    thread_pool_set_discard(&pool, discard_task);
+    demo_pool = &pool;
     srand(time(NULL));
 
     printf("Enviando tareas...\n");
@@ -203,9 +1125,36 @@ int main() {
         usleep(200000); // Simular llegadas de tareas con un pequeño retraso
     }
 
-    sleep(10); // Dar tiempo para que las tareas se ejecuten y el pool se redimensione
+    // Tubería con futuros: el hilo principal solo espera al final, a todo el grupo
+    call_setup_t calls[5];
+    future_t *ports[5];
+    future_group_t setup;
+    future_group_init(&setup);
+    for (int i = 0; i < 5; ++i) {
+        calls[i] = (call_setup_t){.id = i + 1};
+        future_t *parsed = thread_pool_submit_future(&pool, NULL, parse_sdp, &calls[i]);
+        future_t *codec = parsed ? future_then(parsed, NULL, negotiate_codec, NULL) : NULL;
+        ports[i] = codec ? future_then(codec, &setup, allocate_rtp_port, NULL) : NULL;
+        if (parsed) future_release(parsed);
+        if (codec) future_release(codec);
+    }
+    future_group_wait(&setup);
+    future_group_destroy(&setup);
+    for (int i = 0; i < 5; ++i) {
+        void *result;
+        if (ports[i] && future_timed_wait(ports[i], 0, &result) == 0) {
+            call_setup_t *call = (call_setup_t *)result;
+            printf("Llamada %d lista: PT %d, puerto RTP %d\n", call->id, call->codec, call->rtp_port);
+        } else {
+            printf("Llamada %d sin preparar\n", calls[i].id);
+        }
+        if (ports[i]) future_release(ports[i]);
+    }
+
+    sleep(10); // Dar tiempo a que la carga baje y los hilos ociosos se retiren
+    printf("Hilos vivos tras el periodo de inactividad: %d\n", atomic_load(&pool.num_threads));
 
-    thread_pool_destroy(&pool);
+    thread_pool_destroy(&pool, THREAD_POOL_DRAIN);
     printf("Programa principal terminado.\n");
     return 0;
 }
@@ -218,19 +1167,49 @@ Este bloque implementa un thread pool que puede redimensionarse dinámicamente.
 
     -Inicialización: El pool comienza con un número inicial de hilos (INITIAL_THREADS).
 
-    -Envío de Tareas: Cuando se envía una tarea y la cola está llena,
-    el pool intenta crear un nuevo hilo trabajador
-    (siempre que no se haya alcanzado el número máximo de hilos, MAX_THREADS).
+    -Envío de Tareas: cada tarea del inyector lleva el instante en que se encoló.
+    Si la más antigua lleva esperando más de GROW_LATENCY_MS, el pool crea un nuevo hilo
+    trabajador (como mucho uno por cada GROW_LATENCY_MS y sin pasar de MAX_THREADS).
+    Si la cola llega a llenarse, también se crea un hilo antes de esperar hueco.
 
     -Hilos Trabajadores: Los hilos trabajadores toman tareas de la cola y las ejecutan.
 
+    -Cola MPMC sin locks: la cola de tareas es una cola acotada de Vyukov.
+    Cada celda lleva un número de secuencia, y productores y consumidores reclaman posiciones
+    con un CAS sobre enqueue_pos/dequeue_pos en lugar de tomar un mutex.
+    thread_pool_submit_bulk y los trabajadores mueven lotes de tareas con un único CAS,
+    y el mutex y las condiciones solo se usan para dormir cuando no hay trabajo (o no hay hueco):
+    bajo una ráfaga de INVITEs no hay ni un lock ni un pthread_cond_signal por tarea.
+
+    -Robo de trabajo: cada trabajador tiene un deque Chase-Lev propio.
+    Las tareas enviadas desde dentro del pool (continuaciones) van al deque local del trabajador
+    y se ejecutan en orden LIFO, con los datos aún en su caché; las enviadas desde fuera
+    van a la cola MPMC, que hace de inyector. Un trabajador sin tareas propias
+    toma un lote del inyector y, si también está vacío, roba a una víctima aleatoria,
+    de modo que ningún lock global queda en el camino rápido.
+
+    -Futuros: thread_pool_submit_future retorna un future_t con el resultado de la tarea.
+    Admite espera (future_wait), espera con plazo (future_timed_wait), encadenado
+    (future_then: la siguiente etapa se envía al pool cuando termina la anterior, sin bloquear
+    a ningún trabajador) y espera conjunta (future_group_wait). Los futuros se reciclan con una
+    lista libre sin locks que crece por bloques de FUTURE_CHUNK cuando se vacía: no hay malloc
+    por tarea, y el número de futuros en vuelo no tiene un tope fijo pequeño.
+    La demo prepara 5 llamadas con la tubería parseo SDP -> códec -> puerto RTP.
+
     -Redimensionamiento: El redimensionamiento se activa en la función thread_pool_submit
-    cuando la cola está llena y todavía hay capacidad para crear más hilos.
+    y en los propios trabajadores cuando la latencia de la cola supera el umbral
+    y todavía hay capacidad para crear más hilos.
+
+    -Reducción: un trabajador sin tareas duerme con un tiempo máximo (IDLE_TIMEOUT_MS).
+    Si vence y el pool tiene más hilos que el mínimo (INITIAL_THREADS), el hilo se retira;
+    su slot queda libre para un crecimiento posterior.
+
+    -Cierre: thread_pool_destroy(pool, THREAD_POOL_DRAIN) deja de aceptar tareas externas
+    y espera a que se ejecuten las pendientes; THREAD_POOL_CANCEL las descarta
+    y solo espera a las que ya estaban en ejecución.
 
 Observarás en la salida que el número de hilos trabajadores puede aumentar
-a medida que se envían más tareas y la cola se llena,
-hasta alcanzar el 1  límite máximo de hilos definido.
-Este es un ejemplo básico de cómo un thread pool puede adaptarse a la carga de trabajo.
-En una implementación más completa, también se podría incluir la reducción del número de hilos
-cuando la carga disminuye.
+a medida que se envían más tareas y la cola acumula retraso,
+hasta alcanzar el límite máximo de hilos definido,
+y que vuelve a bajar hasta INITIAL_THREADS cuando la carga desaparece.
  */
\ No newline at end of file
@@ -1,33 +1,97 @@
+#include <limits.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include <unistd.h>
 
-#define MAX_PRIORITY 3
+#define MAX_PRIORITY 3        // como mucho 32: un bit por nivel en 'ready'
 #define MAX_TASKS 30
 #define NUM_THREADS 4
+#define RESERVED_THREADS 1    // hilos que solo toman tareas de prioridad 0 si el resto está ocupado
+#define AGING_MS 2000         // una tarea que espera esto en la cabeza de su nivel sube un nivel
+#define MAX_TASK_CLASSES 4    // clases de tarea con contadores de plazos incumplidos propios
+#define PRIORITY_BUDGET_MS 100 // en modo EDF, una tarea de prioridad p debe empezar en (p + 1) * esto
+
+typedef enum {
+    SCHED_PRIORITY, // niveles de prioridad estáticos con envejecimiento
+    SCHED_EDF       // el plazo más próximo primero (earliest deadline first)
+} sched_mode_t;
 
 typedef struct {
     void (*function)(void *);
     void *argument;
     int priority; // 0: Mayor prioridad, MAX_PRIORITY - 1: Menor prioridad
+    long long enqueued_ms; // instante de entrada en su nivel actual, para el envejecimiento
+    long long deadline_ms; // modo EDF: instante absoluto (CLOCK_MONOTONIC) en que debe haber empezado
+    int task_class;        // modo EDF: clase para las estadísticas de plazos
 } task_t;
 
+// Cola circular acotada de un nivel de prioridad
+typedef struct {
+    task_t *tasks;
+    int head;
+    int tail;
+    int count;
+    pthread_cond_t not_full;
+} priority_queue_t;
+
+// Montículo mínimo por plazo. 'top_deadline' copia el plazo de la cima (LLONG_MAX si está vacío)
+// para que los trabajadores comparen montículos sin tomar sus mutex.
+typedef struct {
+    pthread_mutex_t mutex;
+    task_t *tasks;
+    int count;
+    atomic_llong top_deadline;
+} deadline_heap_t;
+
+typedef struct {
+    atomic_long executed;
+    atomic_long missed;      // tareas que empezaron después de su plazo
+    atomic_llong worst_late_ms;
+} class_stats_t;
+
+struct thread_pool;
+
+// Cada trabajador duerme en su propia condición: un envío despierta exactamente a un hilo
 typedef struct {
-    task_t **tasks[1];
-    int head[1];
-    int tail[1];
-    int count[1];
+    deadline_heap_t heap;   // solo en modo EDF
+    struct thread_pool *pool;
+    pthread_t thread;
+    pthread_cond_t wake;
+    int signaled;
+    int next_idle; // siguiente en la pila de ociosos, -1 al final
+} worker_t;
+
+typedef struct thread_pool {
+    sched_mode_t mode;
+    priority_queue_t levels[MAX_PRIORITY];
+    unsigned ready;             // bit p a 1 si el nivel p tiene tareas
     int capacity;
     pthread_mutex_t queue_mutex;
-    pthread_cond_t queue_not_empty[1];
-    pthread_cond_t queue_not_full[1];
-    pthread_t threads[THREAD_POOL_SIZE];
+    worker_t workers[NUM_THREADS];
+    int num_threads;
+    int idle_top;               // pila de trabajadores dormidos, -1 si vacía
+    int running_low;            // trabajadores ejecutando tareas de prioridad > 0
+    long long next_aging_ms;
+    long promoted;              // tareas que subieron de nivel por envejecimiento
     int shutdown;
+
+    // Modo EDF
+    atomic_int edf_pending;         // tareas en los montículos
+    atomic_uint edf_next;           // reparto round-robin de los envíos entre montículos
+    atomic_int edf_waiting;         // productores esperando hueco
+    atomic_int edf_submitters;      // envíos EDF en curso; destroy espera a que salgan
+    pthread_cond_t edf_not_full;
+    class_stats_t stats[MAX_TASK_CLASSES];
 } thread_pool_t;
 
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks);
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument, int priority);
+void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks, sched_mode_t mode);
+int thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument, int priority);
+int thread_pool_submit_deadline(thread_pool_t *pool, void (*function)(void *), void *argument,
+                                long long deadline_ms, int task_class);
 void thread_pool_destroy(thread_pool_t *pool);
 void *worker(void *pool);
 
@@ -38,45 +102,418 @@ void execute_task(void *arg) {
     free(arg);
 }
 
-void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks) {
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void thread_pool_init(thread_pool_t *pool, int num_threads, int max_tasks, sched_mode_t mode) {
     /*
     Inicializa la estructura del thread pool con soporte para priorización de tareas.
 
+    - 'mode' elige el planificador: SCHED_PRIORITY (niveles) o SCHED_EDF (plazos).
+      En modo EDF cada trabajador tiene un montículo de 'max_tasks' tareas.
+
     - Inicializa las cabezas, colas y contadores para cada nivel de prioridad.
     - Inicializa el mutex para proteger el acceso a las colas de tareas.
-    - Inicializa las variables de condición 'queue_not_empty' y 'queue_not_full' para cada nivel de prioridad.
+    - Inicializa la condición 'not_full' de cada nivel y la condición propia de cada trabajador.
     - Establece la capacidad máxima de cada cola de prioridad.
-    - Crea y lanza los hilos trabajadores.
     - Inicializa la bandera de 'shutdown' a 0.
+    - Crea y lanza los hilos trabajadores.
+    */
+    if (num_threads > NUM_THREADS) num_threads = NUM_THREADS;
+    pool->mode = mode;
+    pool->capacity = max_tasks;
+    pool->ready = 0;
+    for (int p = 0; p < MAX_PRIORITY; ++p) {
+        priority_queue_t *q = &pool->levels[p];
+        q->tasks = malloc(sizeof(task_t) * max_tasks);
+        if (!q->tasks) {
+            perror("Error al asignar memoria para las colas de tareas");
+            exit(EXIT_FAILURE);
+        }
+        q->head = q->tail = q->count = 0;
+        pthread_cond_init(&q->not_full, NULL);
+    }
+    pthread_mutex_init(&pool->queue_mutex, NULL);
+    pool->num_threads = num_threads;
+    pool->idle_top = -1;
+    pool->running_low = 0;
+    pool->next_aging_ms = now_ms() + AGING_MS;
+    pool->promoted = 0;
+    pool->shutdown = 0;
+    atomic_init(&pool->edf_pending, 0);
+    atomic_init(&pool->edf_next, 0);
+    atomic_init(&pool->edf_waiting, 0);
+    atomic_init(&pool->edf_submitters, 0);
+    pthread_cond_init(&pool->edf_not_full, NULL);
+    memset(pool->stats, 0, sizeof(pool->stats));
+
+    for (int i = 0; i < num_threads; ++i) {
+        worker_t *w = &pool->workers[i];
+        deadline_heap_t *h = &w->heap;
+        pthread_mutex_init(&h->mutex, NULL);
+        h->tasks = mode == SCHED_EDF ? malloc(sizeof(task_t) * max_tasks) : NULL;
+        if (mode == SCHED_EDF && !h->tasks) {
+            perror("Error al asignar memoria para los montículos de plazos");
+            exit(EXIT_FAILURE);
+        }
+        h->count = 0;
+        atomic_init(&h->top_deadline, LLONG_MAX);
+        pthread_cond_init(&w->wake, NULL);
+        w->signaled = 0;
+        w->next_idle = -1;
+        w->pool = pool;
+        if (pthread_create(&w->thread, NULL, worker, w) != 0) {
+            perror("Error al crear los hilos trabajadores");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void queue_push(thread_pool_t *pool, int priority, task_t task) {
+    /* Encola en el nivel 'priority' (que tiene hueco) y marca su bit. Con queue_mutex tomado. */
+    priority_queue_t *q = &pool->levels[priority];
+    q->tasks[q->tail] = task;
+    q->tail = (q->tail + 1) % pool->capacity;
+    q->count++;
+    pool->ready |= 1u << priority;
+}
+
+static task_t queue_pop(thread_pool_t *pool, int priority) {
+    /* Desencola del nivel 'priority' (no vacío), limpia su bit si queda vacío y avisa a un productor. */
+    priority_queue_t *q = &pool->levels[priority];
+    task_t task = q->tasks[q->head];
+    q->head = (q->head + 1) % pool->capacity;
+    if (--q->count == 0) pool->ready &= ~(1u << priority);
+    pthread_cond_signal(&q->not_full);
+    return task;
+}
+
+static int runnable_level(thread_pool_t *pool) {
+    /*
+    Nivel del que puede tomar tarea un trabajador, o -1 si ninguno. Con queue_mutex tomado.
+    El nivel más prioritario es el bit más bajo de 'ready' (una instrucción: O(1)).
+    Las tareas de prioridad > 0 no pueden ocupar los RESERVED_THREADS últimos hilos,
+    así que una tarea de emergencia siempre encuentra un hilo libre o a punto de liberarse.
+    En el cierre ya no pueden llegar emergencias y la reserva se levanta: todos los hilos
+    vacían las colas, y ninguno se queda dando vueltas con el mutex ante tareas que no puede tomar.
+    */
+    if (pool->ready == 0) return -1;
+    int level = __builtin_ctz(pool->ready);
+    if (level > 0 && !pool->shutdown && pool->running_low >= pool->num_threads - RESERVED_THREADS) return -1;
+    return level;
+}
+
+static int has_runnable(thread_pool_t *pool) {
+    if (pool->mode == SCHED_EDF) return atomic_load(&pool->edf_pending) > 0;
+    return runnable_level(pool) >= 0;
+}
+
+static void wake_one(thread_pool_t *pool) {
+    /* Despierta al último trabajador que se durmió (el de caché más caliente), si hay tarea para él. */
+    if (pool->idle_top < 0 || !has_runnable(pool)) return;
+    worker_t *w = &pool->workers[pool->idle_top];
+    pool->idle_top = w->next_idle;
+    w->signaled = 1;
+    pthread_cond_signal(&w->wake);
+}
+
+static void age_tasks(thread_pool_t *pool) {
+    /*
+    Envejecimiento contra la inanición: como mucho cada AGING_MS / 4, las tareas que llevan
+    AGING_MS en la cabeza de un nivel p > 1 pasan al final del nivel p - 1 (si cabe).
+    Nada sube al nivel 0: es el de las emergencias, el único que puede ocupar el hilo reservado.
+    Recorrer las cabezas cuesta O(MAX_PRIORITY) por pasada y no toca el camino de elección.
+    Con queue_mutex tomado.
     */
+    long long now = now_ms();
+    if (now < pool->next_aging_ms) return;
+    pool->next_aging_ms = now + AGING_MS / 4;
+    for (int p = 2; p < MAX_PRIORITY; ++p) {
+        priority_queue_t *q = &pool->levels[p];
+        while (q->count > 0 && pool->levels[p - 1].count < pool->capacity &&
+               now - q->tasks[q->head].enqueued_ms >= AGING_MS) {
+            task_t task = queue_pop(pool, p);
+            task.enqueued_ms = now;
+            queue_push(pool, p - 1, task);
+            pool->promoted++;
+        }
+    }
 }
 
-void thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument, int priority) {
+static int edf_submit_leave(thread_pool_t *pool, int ret) {
+    /*
+    Sale de un envío EDF. Con queue_mutex tomado: thread_pool_destroy mira el contador
+    con el mismo mutex, así que tras soltarlo el envío ya no toca el pool.
+    El último en salir durante el cierre avisa a destroy, que espera en 'edf_not_full'.
+    */
+    if (atomic_fetch_sub(&pool->edf_submitters, 1) == 1 && pool->shutdown) {
+        pthread_cond_broadcast(&pool->edf_not_full);
+    }
+    return ret;
+}
+
+static void heap_push(deadline_heap_t *h, task_t task) {
+    /* Inserta ordenando por plazo (sift-up). Con h->mutex tomado y hueco disponible. */
+    int i = h->count++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (h->tasks[parent].deadline_ms <= task.deadline_ms) break;
+        h->tasks[i] = h->tasks[parent];
+        i = parent;
+    }
+    h->tasks[i] = task;
+    atomic_store(&h->top_deadline, h->tasks[0].deadline_ms);
+}
+
+static task_t heap_pop(deadline_heap_t *h) {
+    /* Extrae la tarea de plazo más próximo (sift-down). Con h->mutex tomado y el montículo no vacío. */
+    task_t top = h->tasks[0];
+    task_t last = h->tasks[--h->count];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= h->count) break;
+        if (child + 1 < h->count && h->tasks[child + 1].deadline_ms < h->tasks[child].deadline_ms) child++;
+        if (last.deadline_ms <= h->tasks[child].deadline_ms) break;
+        h->tasks[i] = h->tasks[child];
+        i = child;
+    }
+    if (h->count > 0) h->tasks[i] = last;
+    atomic_store(&h->top_deadline, h->count > 0 ? h->tasks[0].deadline_ms : LLONG_MAX);
+    return top;
+}
+
+int thread_pool_submit_deadline(thread_pool_t *pool, void (*function)(void *), void *argument,
+                                long long deadline_ms, int task_class) {
+    /*
+    Añade una tarea con plazo absoluto (milisegundos de CLOCK_MONOTONIC, ver now_ms):
+    el instante en que la tarea debería haber empezado. Solo en modo SCHED_EDF.
+
+    - Reparte los envíos entre los montículos de los trabajadores (round-robin),
+      así los productores no compiten por un único lock.
+    - Si el montículo elegido está lleno prueba los demás; si todos lo están,
+      espera en 'edf_not_full'.
+    - Despierta a un único trabajador dormido.
+    - Se anota en 'edf_submitters' antes de mirar 'shutdown' (ambos seq_cst): o ve el cierre,
+      o thread_pool_destroy lo ve a él y espera a que salga antes de destruir los montículos.
+    - Retorna 0 en éxito, -1 si el modo o la clase no son válidos o el pool se está cerrando.
+    */
+    if (pool->mode != SCHED_EDF || task_class < 0 || task_class >= MAX_TASK_CLASSES) return -1;
+    task_t task = {function, argument, 0, now_ms(), deadline_ms, task_class};
+    int n = pool->num_threads;
+    if (__atomic_load_n(&pool->shutdown, __ATOMIC_SEQ_CST)) return -1;
+    atomic_fetch_add(&pool->edf_submitters, 1);
+    while (1) {
+        if (__atomic_load_n(&pool->shutdown, __ATOMIC_SEQ_CST)) {
+            pthread_mutex_lock(&pool->queue_mutex);
+            int ret = edf_submit_leave(pool, -1);
+            pthread_mutex_unlock(&pool->queue_mutex);
+            return ret;
+        }
+        unsigned start = atomic_fetch_add_explicit(&pool->edf_next, 1, memory_order_relaxed);
+        for (int k = 0; k < n; ++k) {
+            deadline_heap_t *h = &pool->workers[(start + k) % n].heap;
+            pthread_mutex_lock(&h->mutex);
+            if (h->count < pool->capacity) {
+                heap_push(h, task);
+                atomic_fetch_add(&pool->edf_pending, 1);
+                pthread_mutex_unlock(&h->mutex);
+                pthread_mutex_lock(&pool->queue_mutex);
+                wake_one(pool);
+                edf_submit_leave(pool, 0);
+                pthread_mutex_unlock(&pool->queue_mutex);
+                return 0; // si el pool se cerraba, destroy ejecuta la tarea
+            }
+            pthread_mutex_unlock(&h->mutex);
+        }
+
+        pthread_mutex_lock(&pool->queue_mutex);
+        atomic_fetch_add(&pool->edf_waiting, 1);
+        while (atomic_load(&pool->edf_pending) >= pool->capacity * n && !pool->shutdown) {
+            pthread_cond_wait(&pool->edf_not_full, &pool->queue_mutex);
+        }
+        atomic_fetch_sub(&pool->edf_waiting, 1);
+        pthread_mutex_unlock(&pool->queue_mutex);
+    }
+}
+
+int thread_pool_submit(thread_pool_t *pool, void (*function)(void *), void *argument, int priority) {
     /*
     Añade una tarea a la cola del thread pool con la prioridad especificada.
+    En modo EDF la prioridad se traduce en un plazo de (priority + 1) * PRIORITY_BUDGET_MS
+    y la tarea cuenta en la clase 'priority'.
 
     - Bloquea el mutex de la cola.
     - Espera si la cola de la prioridad especificada está llena.
-    - Añade la tarea a la cola correspondiente a su prioridad.
-    - Incrementa el contador de tareas para esa prioridad.
-    - Señala a un hilo trabajador que hay una nueva tarea disponible en esa prioridad.
+    - Añade la tarea a la cola correspondiente a su prioridad y marca su bit en 'ready'.
+    - Despierta a un único trabajador dormido, si hay uno que pueda ejecutarla.
     - Desbloquea el mutex de la cola.
+    - Retorna 0 en éxito, -1 si la prioridad no es válida o el pool se está cerrando.
+    */
+    if (priority < 0 || priority >= MAX_PRIORITY) return -1;
+    if (pool->mode == SCHED_EDF) {
+        return thread_pool_submit_deadline(pool, function, argument,
+                                           now_ms() + (priority + 1) * PRIORITY_BUDGET_MS,
+                                           priority % MAX_TASK_CLASSES);
+    }
+    task_t task = {function, argument, priority, now_ms(), 0, 0};
+    pthread_mutex_lock(&pool->queue_mutex);
+    while (pool->levels[priority].count == pool->capacity && !pool->shutdown) {
+        pthread_cond_wait(&pool->levels[priority].not_full, &pool->queue_mutex);
+    }
+    if (pool->shutdown) {
+        pthread_mutex_unlock(&pool->queue_mutex);
+        return -1;
+    }
+    queue_push(pool, priority, task);
+    wake_one(pool);
+    pthread_mutex_unlock(&pool->queue_mutex);
+    return 0;
+}
+
+static void idle_wait(thread_pool_t *p, worker_t *self) {
+    /*
+    Apila al trabajador como ocioso y lo duerme en su propia condición hasta que un envío
+    lo despierte (un envío lo saca de la pila) o el pool se cierre. Con queue_mutex tomado.
     */
+    int index = (int)(self - p->workers);
+    self->signaled = 0;
+    self->next_idle = p->idle_top;
+    p->idle_top = index;
+    while (!self->signaled && !p->shutdown) {
+        pthread_cond_wait(&self->wake, &p->queue_mutex);
+    }
+    if (!self->signaled) { // cierre: sacarse de la pila de ociosos
+        for (int *it = &p->idle_top; *it >= 0; it = &p->workers[*it].next_idle) {
+            if (*it == index) {
+                *it = self->next_idle;
+                break;
+            }
+        }
+    }
 }
 
-void *worker(void *pool) {
+static int edf_take(thread_pool_t *p, worker_t *self, task_t *task) {
+    /*
+    EDF global sobre montículos por trabajador: compara los plazos de las cimas
+    (top_deadline, sin locks), empezando por el montículo propio para desempatar,
+    y extrae la más próxima. Si otro hilo se adelantó, reintenta.
+    Retorna 0 si obtuvo una tarea, -1 si todos los montículos están vacíos.
+    */
+    int n = p->num_threads;
+    int own = (int)(self - p->workers);
+    while (atomic_load(&p->edf_pending) > 0) {
+        int best = -1;
+        long long best_deadline = LLONG_MAX;
+        for (int k = 0; k < n; ++k) {
+            int i = (own + k) % n;
+            long long d = atomic_load_explicit(&p->workers[i].heap.top_deadline, memory_order_relaxed);
+            if (d < best_deadline) {
+                best_deadline = d;
+                best = i;
+            }
+        }
+        if (best < 0) continue; // un productor aún no publicó su cima
+        deadline_heap_t *h = &p->workers[best].heap;
+        pthread_mutex_lock(&h->mutex);
+        if (h->count > 0) {
+            *task = heap_pop(h);
+            pthread_mutex_unlock(&h->mutex);
+            atomic_fetch_sub(&p->edf_pending, 1);
+            return 0;
+        }
+        pthread_mutex_unlock(&h->mutex);
+    }
+    return -1;
+}
+
+static void edf_account(thread_pool_t *p, const task_t *task) {
+    /* Anota la ejecución de la tarea en su clase y, si empieza tarde, el plazo incumplido. */
+    class_stats_t *st = &p->stats[task->task_class];
+    atomic_fetch_add_explicit(&st->executed, 1, memory_order_relaxed);
+    long long late = now_ms() - task->deadline_ms;
+    if (late <= 0) return;
+    atomic_fetch_add_explicit(&st->missed, 1, memory_order_relaxed);
+    long long worst = atomic_load_explicit(&st->worst_late_ms, memory_order_relaxed);
+    while (late > worst && !atomic_compare_exchange_weak(&st->worst_late_ms, &worst, late)) {
+    }
+}
+
+static void edf_worker(thread_pool_t *p, worker_t *self) {
+    /*
+    Bucle del trabajador en modo EDF: los montículos tienen sus propios locks,
+    y queue_mutex solo se toma para dormir o para despertar a un productor que espera hueco.
+    */
+    task_t task;
+    while (1) {
+        if (edf_take(p, self, &task) == 0) {
+            if (atomic_load(&p->edf_waiting) > 0) {
+                pthread_mutex_lock(&p->queue_mutex);
+                pthread_cond_signal(&p->edf_not_full);
+                pthread_mutex_unlock(&p->queue_mutex);
+            }
+            edf_account(p, &task);
+            task.function(task.argument);
+            continue;
+        }
+        pthread_mutex_lock(&p->queue_mutex);
+        if (atomic_load(&p->edf_pending) == 0) {
+            if (p->shutdown) {
+                pthread_mutex_unlock(&p->queue_mutex);
+                return;
+            }
+            idle_wait(p, self);
+        }
+        pthread_mutex_unlock(&p->queue_mutex);
+    }
+}
+
+void *worker(void *arg) {
     /*
     Función que ejecuta cada hilo trabajador del pool. Los hilos buscan tareas comenzando por la prioridad más alta.
+    En modo EDF delega en edf_worker.
 
-    - Entra en un bucle infinito para procesar tareas.
-    - Bloquea el mutex de la cola.
-    - Itera a través de los niveles de prioridad (de mayor a menor).
-    - Para cada prioridad, espera si no hay tareas disponibles.
-    - Si se encuentra una tarea, la obtiene de la cola correspondiente.
-    - Señala que la cola de esa prioridad ya no está llena.
+    - Entra en un bucle para procesar tareas.
+    - Bloquea el mutex de la cola y aplica el envejecimiento pendiente.
+    - Elige el nivel más prioritario con tareas con el bitmap 'ready'.
+    - Si no hay tarea que pueda tomar, se apila como ocioso y duerme en su propia condición
+      hasta que un envío lo despierte (o el pool se cierre).
+    - Obtiene la tarea de la cola correspondiente y avisa a un productor de ese nivel.
     - Desbloquea el mutex de la cola.
     - Ejecuta la tarea.
+    - Al cerrarse el pool, sale cuando ya no quedan tareas.
     */
+    worker_t *self = (worker_t *)arg;
+    thread_pool_t *p = self->pool;
+    if (p->mode == SCHED_EDF) {
+        edf_worker(p, self);
+        return NULL;
+    }
+    pthread_mutex_lock(&p->queue_mutex);
+    while (1) {
+        age_tasks(p);
+        int level = runnable_level(p);
+        if (level < 0) {
+            if (p->shutdown && p->ready == 0) break;
+            idle_wait(p, self);
+            continue;
+        }
+
+        task_t task = queue_pop(p, level);
+        if (level > 0) p->running_low++;
+        wake_one(p); // si queda trabajo, que no espere a que este hilo termine
+        pthread_mutex_unlock(&p->queue_mutex);
+
+        task.function(task.argument);
+
+        pthread_mutex_lock(&p->queue_mutex);
+        if (level > 0) p->running_low--;
+    }
+    pthread_mutex_unlock(&p->queue_mutex);
+    return NULL;
 }
 
 void thread_pool_destroy(thread_pool_t *pool) {
@@ -85,17 +522,90 @@ void thread_pool_destroy(thread_pool_t *pool) {
 
     - Bloquea el mutex de la cola.
     - Establece la bandera de 'shutdown' a 1.
-    - Envía una señal a todos los hilos trabajadores para que despierten.
+    - Envía una señal a todos los hilos trabajadores y productores para que despierten.
     - Desbloquea el mutex de la cola.
-    - Espera a que todos los hilos terminen.
+    - Espera a que todos los hilos terminen (antes ejecutan las tareas ya encoladas).
+    - En modo EDF espera a que salgan los envíos que vieron el pool abierto y ejecuta aquí
+      las tareas que dejaran en los montículos; solo entonces destruye sus mutex.
     - Libera la memoria asignada.
     - Destruye los mutexes y las condiciones.
     */
+    pthread_mutex_lock(&pool->queue_mutex);
+    __atomic_store_n(&pool->shutdown, 1, __ATOMIC_SEQ_CST);
+    for (int i = 0; i < pool->num_threads; ++i) pthread_cond_signal(&pool->workers[i].wake);
+    for (int p = 0; p < MAX_PRIORITY; ++p) pthread_cond_broadcast(&pool->levels[p].not_full);
+    pthread_cond_broadcast(&pool->edf_not_full);
+    pthread_mutex_unlock(&pool->queue_mutex);
+
+    for (int i = 0; i < pool->num_threads; ++i) {
+        pthread_join(pool->workers[i].thread, NULL);
+    }
+    pthread_mutex_lock(&pool->queue_mutex);
+    while (atomic_load(&pool->edf_submitters) > 0) {
+        pthread_cond_wait(&pool->edf_not_full, &pool->queue_mutex);
+    }
+    pthread_mutex_unlock(&pool->queue_mutex);
+    for (int i = 0; i < pool->num_threads; ++i) {
+        // Un envío EDF que vio el pool abierto pudo encolar tras la salida de los trabajadores
+        deadline_heap_t *h = &pool->workers[i].heap;
+        while (h->count > 0) {
+            task_t task = heap_pop(h);
+            edf_account(pool, &task);
+            task.function(task.argument);
+        }
+        pthread_cond_destroy(&pool->workers[i].wake);
+        pthread_mutex_destroy(&h->mutex);
+        free(h->tasks);
+    }
+    pthread_cond_destroy(&pool->edf_not_full);
+    for (int p = 0; p < MAX_PRIORITY; ++p) {
+        free(pool->levels[p].tasks);
+        pthread_cond_destroy(&pool->levels[p].not_full);
+    }
+    pthread_mutex_destroy(&pool->queue_mutex);
+}
+
+// Clases de tarea de la demo EDF, con su plazo relativo de inicio
+enum { CLASS_FLOOR_CONTROL, CLASS_CALL_SETUP, CLASS_REGISTRATION };
+static const char *class_names[] = {"control de turno", "establecimiento", "registro"};
+static const int class_budget_ms[] = {20, 200, 2000};
+
+void execute_timed_task(void *arg) {
+    int *data = (int *)arg;
+    usleep(data[1] == CLASS_REGISTRATION ? 30000 : 5000); // un registro cuesta más que una respuesta de turno
+    free(arg);
 }
 
-int main() {
+static void run_edf_demo(void) {
     thread_pool_t pool;
-    thread_pool_init(&pool, NUM_THREADS, MAX_TASKS);
+    thread_pool_init(&pool, NUM_THREADS, MAX_TASKS, SCHED_EDF);
+
+    printf("Modo EDF: enviando ráfagas de registros con peticiones de turno intercaladas...\n");
+    for (int i = 1; i <= 200; ++i) {
+        int task_class = i % 10 == 0 ? CLASS_FLOOR_CONTROL : i % 4 == 0 ? CLASS_CALL_SETUP : CLASS_REGISTRATION;
+        int *arg = malloc(sizeof(int) * 2);
+        arg[0] = i;
+        arg[1] = task_class;
+        thread_pool_submit_deadline(&pool, execute_timed_task, arg, now_ms() + class_budget_ms[task_class], task_class);
+        usleep(2000);
+    }
+
+    thread_pool_destroy(&pool);
+    for (int c = 0; c < 3; ++c) {
+        printf("Clase %-16s (plazo %4d ms): %ld ejecutadas, %ld fuera de plazo, peor retraso %lld ms\n",
+               class_names[c], class_budget_ms[c], atomic_load(&pool.stats[c].executed),
+               atomic_load(&pool.stats[c].missed), atomic_load(&pool.stats[c].worst_late_ms));
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc > 1 && strcmp(argv[1], "edf") == 0) {
+        run_edf_demo();
+        return 0;
+    }
+
+    thread_pool_t pool;
+    thread_pool_init(&pool, NUM_THREADS, MAX_TASKS, SCHED_PRIORITY);
     srand(time(NULL));
 
     printf("Enviando tareas con diferentes prioridades...\n");
@@ -116,16 +626,15 @@ int main() {
         thread_pool_submit(&pool, execute_task, arg_medium, 1);
     }
 
-    sleep(15);
-
-    thread_pool_destroy(&pool);
+    thread_pool_destroy(&pool); // espera a que se ejecuten todas las tareas encoladas
+    printf("Tareas promovidas por envejecimiento: %ld\n", pool.promoted);
     printf("Programa principal terminado.\n");
     return 0;
 }
 
 /*
 Compila: gcc pthreads9.c -o thread_pool_priority -lpthread
-Ejecuta: ./thread_pool_priority
+Ejecuta: ./thread_pool_priority [edf]
 Explicación:
     -Priorización de Tareas:
         Este thread pool avanzado introduce la priorización de tareas.
@@ -146,13 +655,40 @@ Explicación:
         y luego pasando a prioridades más bajas.
         Esto asegura que las tareas de mayor prioridad se ejecuten antes que las de menor prioridad.
 
-    -Variables de Condición por Prioridad:
-        Se utiliza un array de variables de condición (queue_not_empty y queue_not_full)
-        para cada nivel de prioridad, permitiendo que los hilos esperen específicamente por tareas
-        en su nivel de prioridad.
+    -Elección en O(1):
+        El pool mantiene un bitmap 'ready' con un bit por nivel que tiene tareas.
+        El nivel a atender es el bit más bajo (__builtin_ctz), sin recorrer las colas.
+
+    -Colas acotadas por nivel:
+        Cada nivel tiene su propia cola circular de MAX_TASKS tareas y su propia condición
+        'not_full', de modo que un nivel lleno solo bloquea a los productores de ese nivel.
+
+    -Envejecimiento:
+        Una tarea que lleva AGING_MS en la cabeza de su nivel sube al nivel superior, hasta el 1,
+        así el tráfico de baja prioridad (registros) no puede quedar sin servicio indefinidamente
+        ni colarse en el nivel 0, que es el que usa el hilo reservado.
+
+    -Despertar selectivo:
+        No hay una condición global que despierte a todos los hilos: cada trabajador ocioso
+        duerme en su propia condición dentro de una pila, y cada envío despierta a uno solo.
+
+    -Hilos reservados:
+        Las tareas de prioridad mayor que 0 nunca ocupan los RESERVED_THREADS últimos hilos.
+        Una llamada de emergencia (MCPTT) no desaloja una tarea en curso, pero siempre encuentra
+        un hilo disponible en vez de esperar detrás del tráfico rutinario.
+
+    -Modo EDF (./thread_pool_priority edf):
+        Con SCHED_EDF, thread_pool_submit_deadline recibe un plazo absoluto de inicio
+        ("esta respuesta de control de turno, TS 24.380, debe empezar en 20 ms").
+        Cada trabajador tiene un montículo mínimo por plazo con su propio mutex; los envíos
+        se reparten entre montículos y cada trabajador toma la tarea de plazo más próximo
+        de entre todas las cimas, que compara sin locks. Las tareas que empiezan tarde
+        se cuentan por clase (ejecutadas, fuera de plazo y peor retraso).
+        thread_pool_submit sigue funcionando: la prioridad se traduce en un plazo.
 
 Al ejecutar este código, deberías observar que las tareas con prioridad 0 (alta)
-tienden a ejecutarse antes que las tareas con prioridad 1 (media) y 2 (baja).
+tienden a ejecutarse antes que las tareas con prioridad 1 (media) y 2 (baja),
+y que las de baja prioridad que esperan demasiado se promueven.
 Este es un ejemplo de cómo se puede implementar la priorización en un thread pool
 para gestionar diferentes tipos de cargas de trabajo.
  */
\ No newline at end of file